@@ -0,0 +1,73 @@
+// Microbenchmarks of fiber switches, creation and fiber locals.
+// usage: fiberbench [--benchmark_filter=regex] [--benchmark_min_time=seconds] ...
+//   BM_FiberSwitch: a Resume and the Yield back, two switches
+//   BM_UcontextSwitch: the same with swapcontext, for comparison
+//   BM_FiberCreate: create, run to the end and destroy a fiber, the stack from the pool
+#include <benchmark/benchmark.h>
+#include <ucontext.h>
+#include "../src/fiber.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+void BM_FiberSwitch(benchmark::State& state) {
+    bool done = false;
+    Fiber fiber([&done]() {
+        while (!done) {
+            Fiber::YieldToReady();
+        }
+    });
+    for (auto _ : state) {
+        fiber.Resume();
+    }
+    done = true;
+    fiber.Resume();
+}
+BENCHMARK(BM_FiberSwitch);
+
+ucontext_t g_main_context;
+ucontext_t g_fiber_context;
+
+void UcontextLoop() {
+    while (true) {
+        swapcontext(&g_fiber_context, &g_main_context);
+    }
+}
+
+void BM_UcontextSwitch(benchmark::State& state) {
+    std::vector<char> stack(128 << 10);
+    getcontext(&g_fiber_context);
+    g_fiber_context.uc_stack.ss_sp = stack.data();
+    g_fiber_context.uc_stack.ss_size = stack.size();
+    g_fiber_context.uc_link = nullptr;
+    makecontext(&g_fiber_context, &UcontextLoop, 0);
+    for (auto _ : state) {
+        swapcontext(&g_main_context, &g_fiber_context);
+    }
+}
+BENCHMARK(BM_UcontextSwitch);
+
+void BM_FiberCreate(benchmark::State& state) {
+    for (auto _ : state) {
+        Fiber fiber([]() {});
+        fiber.Resume();
+    }
+}
+BENCHMARK(BM_FiberCreate);
+
+FiberLocal<uint64_t> g_local;
+
+void BM_FiberLocal(benchmark::State& state) {
+    Fiber fiber([&state]() {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(++*g_local);
+        }
+    });
+    fiber.Resume();
+}
+BENCHMARK(BM_FiberLocal);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,133 @@
+// Microbenchmarks of waiting on sockets through the IOManager.
+// usage: iomanagerbench [--benchmark_filter=regex] [--benchmark_min_time=seconds] ...
+//   BM_IOManager_PingPong: two fibers bounce a byte over a socketpair
+//   BM_Thread_PingPong: the same with two threads in blocking reads
+//   BM_IOManager_Fanout: a byte written to each of range(0) sockets, one fiber
+//     waiting on each; time per socket
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/iomanager.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+void MakePair(int fds[2], bool non_blocking) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        abort();
+    }
+    if (non_blocking) {
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    }
+}
+
+// one byte, waiting for it through `iom`; false once the peer is closed
+bool ReadByte(IOManager& iom, int fd) {
+    char byte;
+    while (true) {
+        auto ret = read(fd, &byte, 1);
+        if (ret == 1) {
+            return true;
+        }
+        if (ret == 0 || errno != EAGAIN) {
+            return false;
+        }
+        iom.AddEvent(fd, IOManager::Event::READ);
+        Fiber::YieldToHold();
+    }
+}
+
+void BM_IOManager_PingPong(benchmark::State& state) {
+    IOManager iom(2, "bench");
+    iom.Start();
+    int fds[2];
+    MakePair(fds, true);
+    // echoes until closed
+    iom.Schedule([&iom, &fds]() {
+        while (ReadByte(iom, fds[1]) && write(fds[1], "x", 1) == 1) {
+        }
+    });
+    Semaphore done;
+    iom.Schedule([&]() {
+        for (auto _ : state) {
+            if (write(fds[0], "x", 1) != 1 || !ReadByte(iom, fds[0])) {
+                state.SkipWithError("ping failed");
+                break;
+            }
+        }
+        done.Notify();
+    });
+    done.Wait();
+    shutdown(fds[0], SHUT_WR);
+    iom.Stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+BENCHMARK(BM_IOManager_PingPong)->UseRealTime();
+
+void BM_Thread_PingPong(benchmark::State& state) {
+    int fds[2];
+    MakePair(fds, false);
+    Thread echo([&fds]() {
+        char byte;
+        while (read(fds[1], &byte, 1) == 1 && write(fds[1], &byte, 1) == 1) {
+        }
+    }, "echo");
+    char byte = 'x';
+    for (auto _ : state) {
+        if (write(fds[0], &byte, 1) != 1 || read(fds[0], &byte, 1) != 1) {
+            state.SkipWithError("ping failed");
+            break;
+        }
+    }
+    shutdown(fds[0], SHUT_WR);
+    echo.Join();
+    close(fds[0]);
+    close(fds[1]);
+}
+BENCHMARK(BM_Thread_PingPong)->UseRealTime();
+
+void BM_IOManager_Fanout(benchmark::State& state) {
+    const int count = state.range(0);
+    IOManager iom(2, "bench");
+    iom.Start();
+    std::vector<int> outside(count);
+    std::atomic<int> left{0};
+    Semaphore done;
+    for (int i = 0; i < count; ++i) {
+        int fds[2];
+        MakePair(fds, true);
+        outside[i] = fds[0];
+        int fd = fds[1];
+        iom.Schedule([&iom, &left, &done, fd]() {
+            while (ReadByte(iom, fd)) {
+                if (--left == 0) {
+                    done.Notify();
+                }
+            }
+            close(fd);
+        });
+    }
+    for (auto _ : state) {
+        left = count;
+        for (auto fd : outside) {
+            if (write(fd, "x", 1) != 1) {
+                abort();
+            }
+        }
+        done.Wait();
+    }
+    for (auto fd : outside) {
+        close(fd);
+    }
+    iom.Stop();
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_IOManager_Fanout)->Arg(100)->Arg(1000)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,128 @@
+// Microbenchmarks of the locks in mutex.hpp, to pick one per shared structure.
+// usage: lockbench [--benchmark_filter=regex] [--benchmark_min_time=seconds] ...
+//   BM_LockUnlock: an uncontended lock and unlock
+//   BM_Contended: threads incrementing one counter under the lock, wall time per increment
+//   BM_ReadMostly: threads reading a 16 byte value, one write every kWriteEvery reads of thread 0
+#include <benchmark/benchmark.h>
+#include <mutex>
+#include "../src/mutex.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+const int kMaxThreads = 8;
+const int kWriteEvery = 64;
+
+struct Value {
+    uint64_t a = 0;
+    uint64_t b = ~0ULL; // always ~a, a reader seeing otherwise got a torn value
+};
+
+// the shared side for read-write locks, the exclusive one for the others
+template<class M>
+struct Reader {
+    static void Lock(M& mutex) { mutex.lock(); }
+    static void Unlock(M& mutex) { mutex.unlock(); }
+};
+
+template<>
+struct Reader<RWMutex> {
+    static void Lock(RWMutex& mutex) { mutex.lock_shared(); }
+    static void Unlock(RWMutex& mutex) { mutex.unlock_shared(); }
+};
+
+template<class M>
+void BM_LockUnlock(benchmark::State& state) {
+    M mutex;
+    for (auto _ : state) {
+        mutex.lock();
+        benchmark::ClobberMemory();
+        mutex.unlock();
+    }
+}
+BENCHMARK_TEMPLATE(BM_LockUnlock, std::mutex);
+BENCHMARK_TEMPLATE(BM_LockUnlock, Mutex);
+BENCHMARK_TEMPLATE(BM_LockUnlock, RWMutex);
+BENCHMARK_TEMPLATE(BM_LockUnlock, SpinLock);
+BENCHMARK_TEMPLATE(BM_LockUnlock, NullMutex);
+
+void BM_LockUnlock_Shared(benchmark::State& state) {
+    RWMutex mutex;
+    for (auto _ : state) {
+        RWMutex::ReadLock lock(mutex);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_LockUnlock_Shared);
+
+template<class M>
+void BM_Contended(benchmark::State& state) {
+    static M s_mutex;
+    static uint64_t s_counter = 0;
+    for (auto _ : state) {
+        typename M::Lock lock(s_mutex);
+        ++s_counter;
+    }
+    benchmark::DoNotOptimize(s_counter);
+}
+BENCHMARK_TEMPLATE(BM_Contended, Mutex)->ThreadRange(1, kMaxThreads)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Contended, SpinLock)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+template<class M>
+void BM_ReadMostly(benchmark::State& state) {
+    static M s_mutex;
+    static Value s_value;
+    uint64_t torn = 0;
+    uint64_t i = 0;
+    for (auto _ : state) {
+        if (state.thread_index() == 0 && ++i % kWriteEvery == 0) {
+            typename M::WriteLock lock(s_mutex);
+            s_value.a = i;
+            s_value.b = ~i;
+            continue;
+        }
+        Reader<M>::Lock(s_mutex);
+        Value value = s_value;
+        Reader<M>::Unlock(s_mutex);
+        torn += value.b != ~value.a;
+    }
+    if (torn) {
+        state.SkipWithError("torn read");
+    }
+}
+
+// the plain locks used exclusively by readers too
+template<class M>
+struct Exclusive : public M {
+    typedef typename M::Lock WriteLock;
+};
+
+void BM_ReadMostly_SeqLock(benchmark::State& state) {
+    static SeqLock<Value> s_value;
+    uint64_t torn = 0;
+    uint64_t i = 0;
+    for (auto _ : state) {
+        if (state.thread_index() == 0 && ++i % kWriteEvery == 0) {
+            Value value;
+            value.a = i;
+            value.b = ~i;
+            s_value.Store(value);
+            continue;
+        }
+        auto value = s_value.Load();
+        torn += value.b != ~value.a;
+    }
+    if (torn) {
+        state.SkipWithError("torn read");
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ReadMostly, Exclusive<Mutex>)->ThreadRange(1, kMaxThreads)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ReadMostly, Exclusive<SpinLock>)->ThreadRange(1, kMaxThreads)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ReadMostly, RWMutex)->ThreadRange(1, kMaxThreads)->UseRealTime();
+BENCHMARK(BM_ReadMostly_SeqLock)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
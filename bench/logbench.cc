@@ -0,0 +1,231 @@
+// Microbenchmarks of the logging call sites, appenders and formatters.
+// usage: logbench [--benchmark_filter=regex] [--benchmark_min_time=seconds] ...
+// Every benchmark reports the time per event, the multithreaded ones the
+// wall time of all producers with UseRealTime.
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../src/logger.hpp"
+#include "../src/async_logger.hpp"
+#include "../src/binary_logger.hpp"
+#include "../src/gzip_file_appender.hpp"
+#include "../tests/test_appenders.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+const int kMaxThreads = 8;
+const char kFilePath[] = "./logbench.log";
+const char kBinaryPath[] = "./logbench.bin";
+
+enum AppenderKind {
+    NULL_APPENDER = 0,
+    STDOUT_APPENDER, // to /dev/null
+    FILE_APPENDER,
+    GZIP_FILE_APPENDER,
+    ASYNC_NULL_APPENDER, // the null appender behind the AsyncLogDispatcher
+    APPENDER_KIND_COUNT,
+};
+const char* const kAppenderNames[] = { "null", "stdout", "file", "gzip", "async" };
+
+const char* const kPatterns[] = {
+    "%m%n",
+    "[%p]%d{%Y-%m-%d %H:%M:%S}.%u%T(tid)%t%T(tname)%N%T(fid)%F%T[%c]%T%f:%l%T%m%K%n", // the default
+    "%d{%Y-%m-%d %H:%M:%S}.%i %p [%c] %f:%l %m%n",
+    "json",
+};
+const int kPatternCount = sizeof(kPatterns) / sizeof(kPatterns[0]);
+
+int s_dev_null = -1;
+
+Logger::SharedPtr AddLogger(const std::string& name, LogLevel::Level level) {
+    Logger::SharedPtr logger(new Logger(name, level));
+    LoggerManager::GetInstance().AddLogger(logger);
+    return logger;
+}
+
+// the loggers used by the call sites below, created once
+void SetUpLoggers() {
+    AddLogger("bench.enabled", LogLevel::Level::DEBUG)->AddAppender(std::make_shared<NullLogAppender>());
+    AddLogger("bench.disabled", LogLevel::Level::ERROR)->AddAppender(std::make_shared<NullLogAppender>());
+    AddLogger("bench.sink", LogLevel::Level::DEBUG);
+    AddLogger("bench.binary", LogLevel::Level::DEBUG);
+    s_dev_null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+}
+
+// put the appender of state.range(0) on bench.sink
+void SetUpAppender(const benchmark::State& state) {
+    auto logger = LoggerManager::GetInstance().GetLogger("bench.sink");
+    LogAppenderConfig config;
+    config.path = kFilePath;
+    switch (state.range(0)) {
+    case STDOUT_APPENDER:
+        logger->AddAppender(std::make_shared<StdoutLogAppender>(s_dev_null));
+        break;
+    case FILE_APPENDER:
+        logger->AddAppender(std::make_shared<FileLogAppender>(config));
+        break;
+    case GZIP_FILE_APPENDER:
+        config.type = LogAppenderConfig::Type::GZIP_FILE_APPENDER;
+        logger->AddAppender(std::make_shared<GzipFileLogAppender>(config));
+        break;
+    case ASYNC_NULL_APPENDER:
+        logger->AddAppender(std::make_shared<NullLogAppender>());
+        AsyncLogDispatcher::GetInstance().Start();
+        break;
+    default:
+        logger->AddAppender(std::make_shared<NullLogAppender>());
+        break;
+    }
+}
+
+void TearDownAppender(const benchmark::State& state) {
+    AsyncLogDispatcher::GetInstance().Stop();
+    auto logger = LoggerManager::GetInstance().GetLogger("bench.sink");
+    logger->Flush();
+    logger->ClearAppenders();
+    // the appenders are destroyed once no thread logs through them
+    Rcu::Synchronize();
+    remove(kFilePath);
+}
+
+void SetUpBinaryLogger(const benchmark::State& state) {
+    BinaryLogConfig config;
+    config.path = kBinaryPath;
+    BinaryLogger::GetInstance().Start(config);
+}
+
+void TearDownBinaryLogger(const benchmark::State& state) {
+    BinaryLogger::GetInstance().Stop();
+    remove(kBinaryPath);
+}
+
+}
+
+// call sites of each API, the level enabled
+static void BM_LLOG(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        LINFO("bench.enabled") << "request " << i++ << " from " << "client" << " took " << 0.25 << " ms";
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LLOG)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_FLLOG(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        FLINFO("bench.enabled", "request %ld from %s took %.2f ms", i++, "client", 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FLLOG)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_TLLOG(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        TLINFO("bench.enabled", "request {} from {} took {:.2} ms", i++, "client", 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TLLOG)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// the same call sites, the level disabled
+static void BM_LLOG_Disabled(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        LINFO("bench.disabled") << "request " << i++ << " from " << "client" << " took " << 0.25 << " ms";
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LLOG_Disabled)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_FLLOG_Disabled(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        FLINFO("bench.disabled", "request %ld from %s took %.2f ms", i++, "client", 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FLLOG_Disabled)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_TLLOG_Disabled(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        TLINFO("bench.disabled", "request {} from {} took {:.2} ms", i++, "client", 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TLLOG_Disabled)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// each appender with the default pattern, the argument is an AppenderKind
+static void BM_Appender(benchmark::State& state) {
+    state.SetLabel(kAppenderNames[state.range(0)]);
+    int64_t i = 0;
+    for (auto _ : state) {
+        LINFO("bench.sink") << "request " << i++ << " from " << "client" << " took " << 0.25 << " ms";
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Appender)->DenseRange(0, APPENDER_KIND_COUNT - 1)->ArgName("appender")
+    ->ThreadRange(1, kMaxThreads)->UseRealTime()->Setup(SetUpAppender)->Teardown(TearDownAppender);
+
+// records written by the binary logger to its file
+static void BM_BLLOG(benchmark::State& state) {
+    int64_t i = 0;
+    for (auto _ : state) {
+        BLINFO("bench.binary", "request %ld from %s took %f ms", i++, "client", 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BLLOG)->ThreadRange(1, kMaxThreads)->UseRealTime()
+    ->Setup(SetUpBinaryLogger)->Teardown(TearDownBinaryLogger);
+
+// one event formatted by each pattern, the argument indexes kPatterns
+static void BM_Formatter(benchmark::State& state) {
+    auto formatter = Formatter::Create(kPatterns[state.range(0)]);
+    state.SetLabel(kPatterns[state.range(0)]);
+    auto logger = LoggerManager::GetInstance().GetLogger("bench.enabled");
+    LogEvent event(__FILE__, 1700000000000000000ULL, 0, __LINE__, 1, "main", 0, logger,
+                   LogLevel::Level::INFO);
+    event.GetStringStream().With("user", "bob").With("bytes", 1024)
+        << "request 42 from client took 0.25 ms";
+    LogBuffer buffer;
+    for (auto _ : state) {
+        buffer.Clear();
+        formatter->Format(buffer, logger, LogLevel::Level::INFO, event);
+        benchmark::DoNotOptimize(buffer.Data());
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.Size());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Formatter)->DenseRange(0, kPatternCount - 1)->ArgName("pattern");
+
+// what every event reads about its thread, against asking the kernel each time
+static void BM_ThreadIdentity(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(GetThreadId());
+        benchmark::DoNotOptimize(GetThreadName().data());
+    }
+}
+BENCHMARK(BM_ThreadIdentity);
+
+static void BM_GettidSyscall(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(syscall(SYS_gettid));
+    }
+}
+BENCHMARK(BM_GettidSyscall);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    SetUpLoggers();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    close(s_dev_null);
+    return 0;
+}
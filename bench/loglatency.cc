@@ -0,0 +1,228 @@
+// Sustained-load harness: producer threads log at a steady rate for a while,
+// the latency of every call site is kept in a histogram and reported as
+// percentiles along with the throughput.
+// usage: loglatency [-t threads] [-n events per thread] [-r events per second per thread]
+//                   [-a null|stdout|file|gzip|async|binary] [-p pattern]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/async_logger.hpp"
+#include "../src/binary_logger.hpp"
+#include "../src/gzip_file_appender.hpp"
+#include "../tests/test_appenders.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+const char kFilePath[] = "./loglatency.log";
+const char kBinaryPath[] = "./loglatency.bin";
+
+/**
+ * @brief Log-linear histogram of nanoseconds: every power of two is split
+ * into kSubBuckets, so a value is kept within 1/kSubBuckets of its size.
+ **/
+class LatencyHistogram {
+public:
+    static const int kSubBits = 4;
+    static const int kSubBuckets = 1 << kSubBits;
+
+    LatencyHistogram() : buckets_((64 - kSubBits + 1) * kSubBuckets, 0) {}
+    void Add(uint64_t ns) {
+        ++buckets_[Index(ns)];
+        ++count_;
+        max_ = std::max(max_, ns);
+    }
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+    // upper bound of the bucket holding the value at `quantile`
+    uint64_t Percentile(double quantile) const {
+        uint64_t rank = std::ceil(quantile * count_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i];
+            if (seen >= rank && seen > 0) {
+                return std::min(UpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+    uint64_t GetCount() const { return count_; }
+    uint64_t GetMax() const { return max_; }
+private:
+    static size_t Index(uint64_t ns) {
+        if (ns < kSubBuckets) {
+            return ns;
+        }
+        int shift = 63 - __builtin_clzll(ns) - kSubBits; // bits below the sub-bucket
+        return (shift + 1) * kSubBuckets + ((ns >> shift) - kSubBuckets);
+    }
+    static uint64_t UpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        int shift = index / kSubBuckets - 1;
+        uint64_t sub = index % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct Options {
+    int threads = 4;
+    int64_t events = 200000; // per thread
+    int64_t rate = 0; // events per second per thread, 0 logs as fast as possible
+    std::string appender = "null";
+    std::string pattern;
+};
+
+void Usage(const char* name) {
+    std::cerr << "usage: " << name << " [-t threads] [-n events per thread] [-r events per second per thread]"
+        << " [-a null|stdout|file|gzip|async|binary] [-p pattern]" << std::endl;
+}
+
+bool SetUpAppender(const Options& options, Logger::SharedPtr logger, int dev_null) {
+    LogAppenderConfig config;
+    config.path = kFilePath;
+    config.format_pattern = options.pattern;
+    LogAppender::SharedPtr appender;
+    if (options.appender == "null" || options.appender == "async") {
+        appender = std::make_shared<NullLogAppender>();
+        if (!options.pattern.empty()) {
+            appender->SetFormatter(Formatter::Create(options.pattern));
+        }
+    } else if (options.appender == "stdout") {
+        appender = std::make_shared<StdoutLogAppender>(dev_null);
+        if (!options.pattern.empty()) {
+            appender->SetFormatter(Formatter::Create(options.pattern));
+        }
+    } else if (options.appender == "file") {
+        appender = std::make_shared<FileLogAppender>(config);
+    } else if (options.appender == "gzip") {
+        appender = std::make_shared<GzipFileLogAppender>(config);
+    } else if (options.appender == "binary") {
+        BinaryLogConfig binary_config;
+        binary_config.path = kBinaryPath;
+        return BinaryLogger::GetInstance().Start(binary_config);
+    } else {
+        return false;
+    }
+    logger->AddAppender(appender);
+    if (options.appender == "async") {
+        AsyncLogDispatcher::GetInstance().Start();
+    }
+    return true;
+}
+
+// log options.events events at the rate, timing every call
+void Produce(const Options& options, bool binary, LatencyHistogram& histogram) {
+    std::chrono::nanoseconds interval(options.rate > 0 ? 1000000000 / options.rate : 0);
+    auto next = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < options.events; ++i) {
+        if (interval.count() > 0) {
+            // the schedule is kept even when a call was slow, like an open-loop client
+            next += interval;
+            while (std::chrono::steady_clock::now() < next) {
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (binary) {
+            BLINFO("latency", "request %ld from %s took %f ms", i, "client", 0.25);
+        } else {
+            LINFO("latency") << "request " << i << " from " << "client" << " took " << 0.25 << " ms";
+        }
+        auto end = std::chrono::steady_clock::now();
+        histogram.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:r:a:p:h")) != -1) {
+        switch (opt) {
+        case 't':
+            options.threads = std::max(1, atoi(optarg));
+            break;
+        case 'n':
+            options.events = std::max(1LL, atoll(optarg));
+            break;
+        case 'r':
+            options.rate = std::max(0LL, atoll(optarg));
+            break;
+        case 'a':
+            options.appender = optarg;
+            break;
+        case 'p':
+            options.pattern = optarg;
+            break;
+        default:
+            Usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    Logger::SharedPtr logger(new Logger("latency", LogLevel::Level::DEBUG));
+    LoggerManager::GetInstance().AddLogger(logger);
+    int dev_null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (!SetUpAppender(options, logger, dev_null)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    bool binary = options.appender == "binary";
+
+    std::vector<LatencyHistogram> histograms(options.threads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.threads; ++i) {
+        threads.emplace_back(Produce, std::cref(options), binary, std::ref(histograms[i]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> produced = std::chrono::steady_clock::now() - start;
+    // the throughput counts the events as written, including what the background threads still hold
+    AsyncLogDispatcher::GetInstance().Stop();
+    BinaryLogger::GetInstance().Stop();
+    logger->Flush();
+    std::chrono::duration<double> written = std::chrono::steady_clock::now() - start;
+
+    LatencyHistogram total;
+    for (auto& histogram : histograms) {
+        total.Merge(histogram);
+    }
+    std::cout << "appender " << options.appender << ", " << options.threads << " threads, "
+        << total.GetCount() << " events";
+    if (options.rate > 0) {
+        std::cout << " at " << options.rate << "/s per thread";
+    }
+    std::cout << std::endl << "latency ns: p50 " << total.Percentile(0.5)
+        << " p99 " << total.Percentile(0.99) << " p999 " << total.Percentile(0.999)
+        << " max " << total.GetMax() << std::endl
+        << std::fixed << std::setprecision(0)
+        << "throughput: " << total.GetCount() / produced.count() << " events/s logged, "
+        << total.GetCount() / written.count() << " events/s written" << std::endl;
+
+    logger->ClearAppenders();
+    Rcu::Synchronize();
+    close(dev_null);
+    remove(kFilePath);
+    remove(kBinaryPath);
+    return 0;
+}
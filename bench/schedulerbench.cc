@@ -0,0 +1,143 @@
+// Microbenchmarks of the work-stealing Scheduler against a pool sharing one
+// locked run queue, with 1 to 8 workers.
+// usage: schedulerbench [--benchmark_filter=regex] [--benchmark_min_time=seconds] ...
+//   BM_*_Spawn: a tree of 4095 short tasks, each scheduling its two children
+//   BM_*_Submit: 4096 short tasks scheduled from a thread that isn't a worker
+// Times are per task.
+#include <benchmark/benchmark.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "../src/scheduler.hpp"
+
+using namespace mysylar;
+
+namespace {
+
+const int kDepth = 11; // 4095 tasks
+const int kTasks = (1 << (kDepth + 1)) - 1;
+
+// the single run queue the scheduler avoids
+class GlobalQueuePool {
+public:
+    explicit GlobalQueuePool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back(new Thread([this]() { Run(); }, "global_" + std::to_string(i)));
+        }
+    }
+    ~GlobalQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        for (auto& thread : threads_) {
+            thread->Join();
+        }
+    }
+    void Schedule(std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(callback));
+        }
+        condition_.notify_one();
+    }
+private:
+    void Run() {
+        while (true) {
+            std::function<void()> callback;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;
+                }
+                callback = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            callback();
+        }
+    }
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()> > queue_;
+    bool stopping_ = false;
+    std::vector<Thread::SharedPtr> threads_;
+};
+
+// counts finished tasks, the last one lets the benchmark go on
+struct Completion {
+    std::atomic<int> left{0};
+    Semaphore done;
+    void Finish() {
+        if (--left == 0) {
+            done.Notify();
+        }
+    }
+};
+
+template<class Pool>
+void Spawn(Pool& pool, int depth, Completion& completion) {
+    if (depth > 0) {
+        pool.Schedule([&pool, depth, &completion]() { Spawn(pool, depth - 1, completion); });
+        pool.Schedule([&pool, depth, &completion]() { Spawn(pool, depth - 1, completion); });
+    }
+    completion.Finish();
+}
+
+template<class Pool>
+void RunSpawn(benchmark::State& state, Pool& pool) {
+    Completion completion;
+    for (auto _ : state) {
+        completion.left = kTasks;
+        pool.Schedule([&pool, &completion]() { Spawn(pool, kDepth, completion); });
+        completion.done.Wait();
+    }
+    state.SetItemsProcessed(state.iterations() * kTasks);
+}
+
+template<class Pool>
+void RunSubmit(benchmark::State& state, Pool& pool) {
+    const int tasks = 1 << 12;
+    Completion completion;
+    for (auto _ : state) {
+        completion.left = tasks;
+        for (int i = 0; i < tasks; ++i) {
+            pool.Schedule([&completion]() { completion.Finish(); });
+        }
+        completion.done.Wait();
+    }
+    state.SetItemsProcessed(state.iterations() * tasks);
+}
+
+void BM_Scheduler_Spawn(benchmark::State& state) {
+    Scheduler scheduler(state.range(0), "bench");
+    scheduler.Start();
+    RunSpawn(state, scheduler);
+    scheduler.Stop();
+}
+BENCHMARK(BM_Scheduler_Spawn)->RangeMultiplier(2)->Range(1, 8)->ArgName("workers")->UseRealTime();
+
+void BM_GlobalQueue_Spawn(benchmark::State& state) {
+    GlobalQueuePool pool(state.range(0));
+    RunSpawn(state, pool);
+}
+BENCHMARK(BM_GlobalQueue_Spawn)->RangeMultiplier(2)->Range(1, 8)->ArgName("workers")->UseRealTime();
+
+void BM_Scheduler_Submit(benchmark::State& state) {
+    Scheduler scheduler(state.range(0), "bench");
+    scheduler.Start();
+    RunSubmit(state, scheduler);
+    scheduler.Stop();
+}
+BENCHMARK(BM_Scheduler_Submit)->RangeMultiplier(2)->Range(1, 8)->ArgName("workers")->UseRealTime();
+
+void BM_GlobalQueue_Submit(benchmark::State& state) {
+    GlobalQueuePool pool(state.range(0));
+    RunSubmit(state, pool);
+}
+BENCHMARK(BM_GlobalQueue_Submit)->RangeMultiplier(2)->Range(1, 8)->ArgName("workers")->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
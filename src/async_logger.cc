@@ -0,0 +1,246 @@
+#include "async_logger.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace mysylar {
+
+static const size_t kDrainBatch = 256; // events taken from one ring before visiting the next
+
+LogRing::LogRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+LogRing::~LogRing() {
+    LogEvent* event;
+    while (Pop(event)) {
+        LogEventPool::Release(event);
+    }
+}
+
+bool LogRing::Push(LogEvent* event) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    auto& slot = slots_[pos & mask_];
+    // the slot is free once its last consumer has advanced the sequence
+    if (slot.sequence.load(std::memory_order_acquire) != pos) {
+        return false;
+    }
+    slot.event = event;
+    slot.sequence.store(pos + 1, std::memory_order_release);
+    tail_.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::Pop(LogEvent*& event) {
+    auto pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+        auto& slot = slots_[pos & mask_];
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                event = slot.event;
+                slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) { // empty
+            return false;
+        } else { // another consumer took it
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLogDispatcher::Start(const AsyncLogConfig& config) {
+    if (IsRunning()) {
+        return;
+    }
+    config_ = config;
+    stopping_ = false;
+    wakeup_ = false;
+    flush_requested_ = flush_done_ = 0;
+    rings_.Reset();
+    flusher_ = std::thread(&AsyncLogDispatcher::FlusherMain, this);
+    flusher_id_ = flusher_.get_id();
+    running_.store(true, std::memory_order_release);
+}
+
+void AsyncLogDispatcher::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_cond_.notify_one();
+    flusher_.join();
+    // producers that saw running_ before it was cleared may still be pushing
+    while (submitting_.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+    // pick up what producers pushed while the flusher was exiting
+    DrainAll();
+    FlushTouchedLoggers();
+    rings_.Clear();
+    space_cond_.notify_all();
+}
+
+void AsyncLogDispatcher::Flush() {
+    if (!IsRunning()) {
+        return;
+    }
+    if (std::this_thread::get_id() == flusher_id_) { // called by an appender
+        DrainAll();
+        FlushTouchedLoggers();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_) {
+        return;
+    }
+    auto target = ++flush_requested_;
+    wake_cond_.notify_one();
+    done_cond_.wait(lock, [this, target] { return flush_done_ >= target; });
+}
+
+bool AsyncLogDispatcher::Submit(LogEvent* event) {
+    // pairs with Stop: either this sees it stopped or Stop waits for the push
+    submitting_.fetch_add(1, std::memory_order_seq_cst);
+    if (!running_.load(std::memory_order_seq_cst)) {
+        submitting_.fetch_sub(1, std::memory_order_release);
+        event->GetLogger()->Log(*event);
+        LogEventPool::Release(event);
+        return true;
+    }
+    auto queued = Enqueue(event);
+    submitting_.fetch_sub(1, std::memory_order_release);
+    return queued;
+}
+
+bool AsyncLogDispatcher::Enqueue(LogEvent* event) {
+    auto ring = rings_.Get([this]() { return std::make_shared<LogRing>(config_.ring_capacity); });
+    auto cost = EventCost(event);
+    while (true) {
+        if (queued_bytes_.fetch_add(cost, std::memory_order_relaxed) + cost <= config_.memory_budget) {
+            if (ring->Push(event)) {
+                // wake the flusher early when the ring is half full
+                if (ring->Size() == ring->Capacity() / 2) {
+                    Wakeup();
+                }
+                return true;
+            }
+        }
+        queued_bytes_.fetch_sub(cost, std::memory_order_relaxed);
+        switch (config_.overflow_policy) {
+        case AsyncLogConfig::OverflowPolicy::DROP_OLDEST: {
+            LogEvent* oldest;
+            if (ring->Pop(oldest)) {
+                queued_bytes_.fetch_sub(EventCost(oldest), std::memory_order_relaxed);
+                LogEventPool::Release(oldest);
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            // budget is held by other threads, nothing of ours to give up
+            LogEventPool::Release(event);
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        case AsyncLogConfig::OverflowPolicy::DROP_NEWEST:
+            LogEventPool::Release(event);
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        default: {
+            if (!IsRunning()) { // stopped while we were waiting, write it here
+                event->GetLogger()->Log(*event);
+                LogEventPool::Release(event);
+                return true;
+            }
+            Wakeup();
+            std::unique_lock<std::mutex> lock(mutex_);
+            space_cond_.wait_for(lock, std::chrono::milliseconds(1));
+            break;
+        }
+        }
+    }
+}
+
+void AsyncLogDispatcher::DrainAll() {
+    auto& rings = rings_.Snapshot();
+    bool drained = true;
+    while (drained) {
+        drained = false;
+        for (auto& ring : rings) {
+            LogEvent* event;
+            for (size_t i = 0; i < kDrainBatch && ring->Pop(event); ++i) {
+                queued_bytes_.fetch_sub(EventCost(event), std::memory_order_relaxed);
+                auto logger = event->GetLogger();
+                logger->Log(*event);
+                LogEventPool::Release(event);
+                if (std::find(touched_loggers_.begin(), touched_loggers_.end(), logger)
+                    == touched_loggers_.end()) {
+                    touched_loggers_.push_back(logger);
+                }
+                drained = true;
+            }
+        }
+        if (drained) {
+            space_cond_.notify_all();
+        }
+    }
+    rings_.Purge();
+}
+
+void AsyncLogDispatcher::FlushTouchedLoggers() {
+    for (auto& logger : touched_loggers_) {
+        logger->Flush();
+    }
+    touched_loggers_.clear();
+}
+
+void AsyncLogDispatcher::Wakeup() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wakeup_ = true;
+    }
+    wake_cond_.notify_one();
+}
+
+void AsyncLogDispatcher::FlusherMain() {
+    while (true) {
+        uint64_t flush_target;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_cond_.wait_for(lock, std::chrono::milliseconds(config_.flush_interval_ms), [this] {
+                return stopping_ || wakeup_ || flush_requested_ != flush_done_;
+            });
+            wakeup_ = false;
+            flush_target = flush_requested_;
+            stop = stopping_;
+        }
+        DrainAll();
+        FlushTouchedLoggers();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flush_done_ = flush_target;
+        }
+        done_cond_.notify_all();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+size_t AsyncLogDispatcher::EventCost(const LogEvent* event) {
+    return sizeof(LogEvent) + event->GetContent().size();
+}
+
+}
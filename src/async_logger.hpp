@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "logger.hpp"
+#include "singleton.hpp"
+#include "thread_ring.hpp"
+
+namespace mysylar {
+
+struct AsyncLogConfig {
+    enum OverflowPolicy {
+        BLOCK = 0, // wait for the flusher to make room
+        DROP_NEWEST = 1, // discard the event being submitted
+        DROP_OLDEST = 2, // discard the oldest queued event of the submitting thread
+    };
+    OverflowPolicy overflow_policy = OverflowPolicy::BLOCK;
+    size_t ring_capacity = 8192; // events per producer thread, rounded up to a power of two
+    size_t memory_budget = 64 << 20; // bytes of queued events over all rings
+    uint32_t flush_interval_ms = 10; // max time an event waits before being written
+};
+
+/**
+ * @brief Bounded lock-free ring of events. Only the owner thread pushes,
+ * the flusher pops, and the owner may also pop to drop its oldest event.
+ **/
+class LogRing {
+public:
+    typedef std::shared_ptr<LogRing> SharedPtr;
+    explicit LogRing(size_t capacity);
+    // events left behind are given back to their pools
+    ~LogRing();
+    /**
+     * @brief push an event, only called by the owner thread
+     * @return false if the ring is full
+     **/
+    bool Push(LogEvent* event);
+    /**
+     * @brief pop the oldest event, safe to call from several threads
+     * @return false if the ring is empty
+     **/
+    bool Pop(LogEvent*& event);
+    size_t Size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+    size_t Capacity() const { return mask_ + 1; }
+    // mark the ring as abandoned by its owner thread
+    void Close() { closed_.store(true, std::memory_order_release); }
+    bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+    bool Empty() const { return Size() == 0; }
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogEvent* event;
+    };
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0}; // next slot to pop
+    alignas(64) std::atomic<size_t> tail_{0}; // next slot to push
+    std::atomic<bool> closed_{false};
+};
+
+/**
+ * @brief Moves event output off the logging threads: producers push finished
+ * events into their own LogRing and a background thread drains them into the
+ * appenders.
+ **/
+class AsyncLogDispatcher : public Singleton<AsyncLogDispatcher> {
+friend class Singleton<AsyncLogDispatcher>;
+public:
+    /**
+     * @brief start the flusher thread, events submitted later are written asynchronously
+     * @param config ring size, memory budget and overflow policy
+     **/
+    void Start(const AsyncLogConfig& config = AsyncLogConfig());
+    /**
+     * @brief write every queued event and stop the flusher thread
+     **/
+    void Stop();
+    /**
+     * @brief block until every event submitted before the call has been written
+     * and the appenders have been flushed
+     **/
+    void Flush();
+    /**
+     * @brief queue a pooled event for the flusher thread, which takes the ownership
+     * @return false if the event was dropped by the overflow policy
+     **/
+    bool Submit(LogEvent* event);
+    bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+    // events discarded because of the overflow policy
+    uint64_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+private:
+    AsyncLogDispatcher() {}
+    ~AsyncLogDispatcher() { Stop(); }
+    // write the events of all rings until they are empty, only run by the flusher
+    void DrainAll();
+    // flush the appenders of loggers written since the last call
+    void FlushTouchedLoggers();
+    // push into the ring of the thread, Submit once it is sure Stop waits for it
+    bool Enqueue(LogEvent* event);
+    void Wakeup();
+    void FlusherMain();
+    static size_t EventCost(const LogEvent* event);
+
+    AsyncLogConfig config_;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> submitting_{0}; // Submit calls that saw running_, Stop drains after them
+    std::atomic<size_t> queued_bytes_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::thread flusher_;
+    std::thread::id flusher_id_;
+
+    ThreadRings<LogRing> rings_; // Reset on every Start
+    // flusher-side state
+    std::vector<Logger::SharedPtr> touched_loggers_;
+
+    std::mutex mutex_; // guards the fields below
+    std::condition_variable wake_cond_; // wakes the flusher
+    std::condition_variable done_cond_; // signals finished flush requests
+    std::condition_variable space_cond_; // signals freed space to blocked producers
+    bool stopping_ = false;
+    bool wakeup_ = false;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+};
+
+}
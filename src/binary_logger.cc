@@ -0,0 +1,579 @@
+#include "binary_logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mysylar {
+
+static const char kFileMagic[8] = {'M', 'Y', 'S', 'Y', 'L', 'A', 'R', 'B'};
+static const uint32_t kFileVersion = 1;
+static const char kSiteTag = 'S';
+static const char kEventTag = 'E';
+
+namespace {
+// call sites registered so far, ids are indexes
+struct SiteRegistry {
+    std::mutex mutex;
+    std::deque<BinaryLogSite> sites;
+};
+
+SiteRegistry& GetSiteRegistry() {
+    static SiteRegistry registry;
+    return registry;
+}
+
+// records formatted right away when the background thread is not running
+thread_local LogBuffer t_scratch_record;
+
+template<class T>
+void AppendRaw(LogBuffer& out, const T& value) {
+    out.Append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(LogBuffer& out, const std::string& str) {
+    AppendRaw(out, static_cast<uint32_t>(str.size()));
+    out.Append(str);
+}
+
+template<class T>
+bool ReadRaw(const char*& p, const char* end, T& value) {
+    if (static_cast<size_t>(end - p) < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+bool ReadString(const char*& p, const char* end, std::string& str) {
+    uint32_t size;
+    if (!ReadRaw(p, end, size) || static_cast<size_t>(end - p) < size) {
+        return false;
+    }
+    str.assign(p, size);
+    p += size;
+    return true;
+}
+
+// snprintf straight into the buffer
+template<class T>
+void AppendPrintf(LogBuffer& out, const char* spec, T value) {
+    auto n = snprintf(out.Reserve(64), 64, spec, value);
+    if (n >= 64) {
+        n = snprintf(out.Reserve(n + 1), n + 1, spec, value);
+    }
+    if (n > 0) {
+        out.Commit(n);
+    }
+}
+}
+
+void BinaryLogSite::Decode(const char* payload, size_t size, LogBuffer& out) const {
+    const char* end = payload + size;
+    size_t arg = 0;
+    const char* f = format.c_str();
+    char spec[32];
+    while (*f) {
+        auto percent = strchr(f, '%');
+        if (!percent) {
+            out.Append(f, strlen(f));
+            break;
+        }
+        out.Append(f, percent - f);
+        if (percent[1] == '%') {
+            out.Append('%');
+            f = percent + 2;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion, the length is
+        // replaced by the one of the stored type
+        auto p = percent + 1;
+        while (*p && strchr("-+ #0'", *p)) {
+            ++p;
+        }
+        while (isdigit(*p)) {
+            ++p;
+        }
+        if (*p == '.') {
+            ++p;
+            while (isdigit(*p)) {
+                ++p;
+            }
+        }
+        size_t prefix_size = p - percent;
+        while (*p && strchr("hlLqjzt", *p)) {
+            ++p;
+        }
+        char conversion = *p;
+        if (!conversion || prefix_size + 4 > sizeof(spec) || !strchr("diouxXceEfFgGaAsp", conversion)) {
+            auto spec_end = conversion ? p + 1 : p;
+            out.Append(percent, spec_end - percent);
+            f = spec_end;
+            continue;
+        }
+        f = p + 1;
+        if (arg >= arg_types.size()) {
+            out.Append("<<missing argument>>");
+            continue;
+        }
+        auto type = arg_types[arg++];
+        int64_t integer = 0;
+        double floating = 0;
+        std::string_view str;
+        const char* q = payload;
+        if (type == BinaryArgType::STRING) {
+            uint32_t n;
+            if (!ReadRaw(q, end, n) || static_cast<size_t>(end - q) < n) {
+                out.Append("<<truncated>>");
+                return;
+            }
+            str = std::string_view(q, n);
+            q += n;
+        } else if (type == BinaryArgType::DOUBLE) {
+            if (!ReadRaw(q, end, floating)) {
+                out.Append("<<truncated>>");
+                return;
+            }
+            integer = floating;
+        } else {
+            if (!ReadRaw(q, end, integer)) {
+                out.Append("<<truncated>>");
+                return;
+            }
+            floating = type == BinaryArgType::UINT64 ? static_cast<double>(static_cast<uint64_t>(integer)) : integer;
+        }
+        payload = q;
+
+        memcpy(spec, percent, prefix_size);
+        auto spec_end = spec + prefix_size;
+        if (type == BinaryArgType::STRING) {
+            if (conversion == 's' && prefix_size == 1) {
+                out.Append(str);
+            } else if (conversion == 's') {
+                memcpy(spec_end, "s", 2);
+                AppendPrintf(out, spec, std::string(str).c_str());
+            } else {
+                out.Append(str);
+            }
+            continue;
+        }
+        switch (conversion) {
+        case 'c':
+            memcpy(spec_end, "c", 2);
+            AppendPrintf(out, spec, static_cast<int>(integer));
+            break;
+        case 'p':
+            memcpy(spec_end, "p", 2);
+            AppendPrintf(out, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(integer)));
+            break;
+        case 's': // number given to %s, print it as it is
+            if (type == BinaryArgType::DOUBLE) {
+                AppendPrintf(out, "%g", floating);
+            } else if (type == BinaryArgType::INT64) {
+                out.AppendInteger(integer);
+            } else {
+                out.AppendInteger(static_cast<uint64_t>(integer));
+            }
+            break;
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            spec_end[0] = 'l';
+            spec_end[1] = 'l';
+            spec_end[2] = conversion;
+            spec_end[3] = '\0';
+            AppendPrintf(out, spec, static_cast<long long>(integer));
+            break;
+        default:
+            spec_end[0] = conversion;
+            spec_end[1] = '\0';
+            AppendPrintf(out, spec, floating);
+            break;
+        }
+    }
+}
+
+BinaryLogRing::BinaryLogRing(size_t capacity, uint32_t thread_id, const std::string& thread_name) :
+    thread_id_(thread_id),
+    thread_name_(thread_name) {
+    size_t size = 64;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    buffer_.reset(new char[size]);
+    mask_ = size - 1;
+}
+
+char* BinaryLogRing::Reserve(size_t size) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto pos = tail & mask_;
+    auto contiguous = mask_ + 1 - pos;
+    // a record never wraps, the end of the ring is skipped instead
+    auto need = contiguous < size ? contiguous + size : size;
+    if (tail + need - cached_head_ > mask_ + 1) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail + need - cached_head_ > mask_ + 1) {
+            return nullptr;
+        }
+    }
+    if (contiguous < size) {
+        uint32_t padding = 0;
+        memcpy(buffer_.get() + pos, &padding, sizeof(padding));
+        pos = 0;
+    }
+    reserved_tail_ = tail + need;
+    return buffer_.get() + pos;
+}
+
+uint32_t BinaryLogger::RegisterSite(const char* format, const char* file_name, uint32_t line,
+                                    LogLevel::Level level, const std::string& logger_name,
+                                    const BinaryArgType* arg_types, uint32_t arg_count) {
+    auto& registry = GetSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    BinaryLogSite site;
+    site.id = registry.sites.size();
+    site.level = level;
+    site.line = line;
+    site.format = format;
+    site.file_name = file_name;
+    site.logger_name = logger_name;
+    site.arg_types.assign(arg_types, arg_types + arg_count);
+    registry.sites.push_back(std::move(site));
+    return registry.sites.back().id;
+}
+
+uint32_t BinaryLogSiteCache::Get(std::string_view logger_name, bool constant, const char* format,
+                                 const char* file_name, uint32_t line, LogLevel::Level level,
+                                 const BinaryArgType* arg_types, uint32_t arg_count) {
+    if (constant) {
+        auto id = constant_id_.load(std::memory_order_acquire);
+        if (id != kNoSite) {
+            return id;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(logger_name);
+    if (it == ids_.end()) {
+        auto id = BinaryLogger::RegisterSite(format, file_name, line, level, std::string(logger_name),
+            arg_types, arg_count);
+        it = ids_.emplace(std::string(logger_name), id).first;
+    }
+    if (constant) {
+        constant_id_.store(it->second, std::memory_order_release);
+    }
+    return it->second;
+}
+
+bool BinaryLogger::GetSite(uint32_t id, BinaryLogSite& site) {
+    auto& registry = GetSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (id >= registry.sites.size()) {
+        return false;
+    }
+    site = registry.sites[id];
+    return true;
+}
+
+bool BinaryLogger::Start(const BinaryLogConfig& config) {
+    if (IsRunning()) {
+        return true;
+    }
+    config_ = config;
+    if (!config_.path.empty()) {
+        fd_ = open(config_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            std::cerr << "open binary log file " << config_.path << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        // every session starts with a header, sites are written again after it
+        out_.Append(kFileMagic, sizeof(kFileMagic));
+        AppendRaw(out_, kFileVersion);
+    }
+    written_sites_.clear();
+    stopping_ = false;
+    wakeup_ = false;
+    flush_requested_ = flush_done_ = 0;
+    rings_.Reset();
+    writer_ = std::thread(&BinaryLogger::WriterMain, this);
+    writer_id_ = writer_.get_id();
+    running_.store(true, std::memory_order_release);
+    return true;
+}
+
+void BinaryLogger::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_cond_.notify_one();
+    writer_.join();
+    // producers that saw running_ before it was cleared may still be writing
+    while (recording_.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+    // pick up what producers wrote while the writer was exiting
+    DrainAll();
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    rings_.Clear();
+}
+
+void BinaryLogger::Flush() {
+    if (!IsRunning()) {
+        return;
+    }
+    if (std::this_thread::get_id() == writer_id_) {
+        DrainAll();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_) {
+        return;
+    }
+    auto target = ++flush_requested_;
+    wake_cond_.notify_one();
+    done_cond_.wait(lock, [this, target] { return flush_done_ >= target; });
+}
+
+char* BinaryLogger::ReserveRecord(size_t size, BinaryLogRing*& ring) {
+    ring = nullptr;
+    if (!IsRunning() || size > config_.ring_capacity / 2) {
+        t_scratch_record.Clear();
+        return t_scratch_record.Reserve(size);
+    }
+    // pairs with Stop: either this sees it stopped or Stop waits for the commit
+    recording_.fetch_add(1, std::memory_order_seq_cst);
+    if (!running_.load(std::memory_order_seq_cst)) {
+        recording_.fetch_sub(1, std::memory_order_release);
+        t_scratch_record.Clear();
+        return t_scratch_record.Reserve(size);
+    }
+    auto thread_ring = rings_.Get([this]() {
+        return std::make_shared<BinaryLogRing>(config_.ring_capacity, GetThreadId(), GetThreadName());
+    });
+    while (true) {
+        auto record = thread_ring->Reserve(size);
+        if (record) {
+            ring = thread_ring;
+            return record;
+        }
+        if (!IsRunning()) { // stopped while we were waiting, format it here
+            recording_.fetch_sub(1, std::memory_order_release);
+            t_scratch_record.Clear();
+            return t_scratch_record.Reserve(size);
+        }
+        Wakeup();
+        std::this_thread::yield();
+    }
+}
+
+void BinaryLogger::LogNow(const BinaryRecordHeader& header, const char* payload) {
+    BinaryLogSite site;
+    if (!GetSite(header.site_id, site)) {
+        return;
+    }
+    auto logger = LoggerManager::GetInstance().GetLogger(site.logger_name);
+    LogBuffer text;
+    site.Decode(payload, header.payload_size, text);
+    auto event = LogEventPool::Acquire(site.file_name.c_str(), header.time_ns, GetElapsedMs(header.time_ns),
+        site.line, header.thread_id, GetThreadName(), GetFiberId(), std::move(logger), site.level);
+    event->GetStringStream().write(text.Data(), text.Size());
+    event->GetLogger()->Log(*event);
+    LogEventPool::Release(event);
+}
+
+const BinaryLogSite* BinaryLogger::FindSite(uint32_t id) {
+    if (id >= known_sites_.size()) {
+        known_sites_.resize(id + 1);
+    }
+    if (!known_sites_[id]) {
+        std::unique_ptr<BinaryLogSite> site(new BinaryLogSite());
+        if (!GetSite(id, *site)) {
+            return nullptr;
+        }
+        known_sites_[id] = std::move(site);
+    }
+    return known_sites_[id].get();
+}
+
+void BinaryLogger::WriteSite(const BinaryLogSite& site) {
+    out_.Append(kSiteTag);
+    AppendRaw(out_, site.id);
+    AppendRaw(out_, static_cast<uint8_t>(site.level));
+    AppendRaw(out_, site.line);
+    AppendRaw(out_, static_cast<uint8_t>(site.arg_types.size()));
+    for (auto type : site.arg_types) {
+        AppendRaw(out_, static_cast<uint8_t>(type));
+    }
+    AppendString(out_, site.format);
+    AppendString(out_, site.file_name);
+    AppendString(out_, site.logger_name);
+}
+
+void BinaryLogger::DrainAll() {
+    for (auto& ring : rings_.Snapshot()) {
+        ring->Consume([this, &ring](const BinaryRecordHeader& header, const char* payload) {
+            auto site = FindSite(header.site_id);
+            if (!site) {
+                return;
+            }
+            if (fd_ >= 0) {
+                if (site->id >= written_sites_.size()) {
+                    written_sites_.resize(site->id + 1, false);
+                }
+                if (!written_sites_[site->id]) {
+                    WriteSite(*site);
+                    written_sites_[site->id] = true;
+                }
+                out_.Append(kEventTag);
+                AppendRaw(out_, header.site_id);
+                AppendRaw(out_, header.time_ns);
+                AppendRaw(out_, header.thread_id);
+                AppendRaw(out_, header.payload_size);
+                out_.Append(payload, header.payload_size);
+                return;
+            }
+            auto logger = LoggerManager::GetInstance().GetLogger(site->logger_name);
+            text_.Clear();
+            site->Decode(payload, header.payload_size, text_);
+            auto event = LogEventPool::Acquire(site->file_name.c_str(), header.time_ns,
+                GetElapsedMs(header.time_ns), site->line, header.thread_id, ring->GetThreadName(), header.fiber_id,
+                Logger::SharedPtr(logger), site->level);
+            event->GetStringStream().write(text_.Data(), text_.Size());
+            logger->Log(*event);
+            LogEventPool::Release(event);
+            if (std::find(touched_loggers_.begin(), touched_loggers_.end(), logger) == touched_loggers_.end()) {
+                touched_loggers_.push_back(logger);
+            }
+        });
+    }
+    if (fd_ >= 0) {
+        auto data = out_.Data();
+        size_t left = out_.Size();
+        while (left > 0) {
+            auto n = write(fd_, data, left);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "write binary log file " << config_.path << " failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            data += n;
+            left -= n;
+        }
+        out_.Clear();
+    }
+    for (auto& logger : touched_loggers_) {
+        logger->Flush();
+    }
+    touched_loggers_.clear();
+    rings_.Purge();
+}
+
+void BinaryLogger::Wakeup() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wakeup_ = true;
+    }
+    wake_cond_.notify_one();
+}
+
+void BinaryLogger::WriterMain() {
+    while (true) {
+        uint64_t flush_target;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_cond_.wait_for(lock, std::chrono::milliseconds(config_.poll_interval_ms), [this] {
+                return stopping_ || wakeup_ || flush_requested_ != flush_done_;
+            });
+            wakeup_ = false;
+            flush_target = flush_requested_;
+            stop = stopping_;
+        }
+        DrainAll();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flush_done_ = flush_target;
+        }
+        done_cond_.notify_all();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+bool BinaryLogReader::Open(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    pos_ = 0;
+    sites_.clear();
+    return data_.size() >= sizeof(kFileMagic) && memcmp(data_.data(), kFileMagic, sizeof(kFileMagic)) == 0;
+}
+
+bool BinaryLogReader::Next(Record& record) {
+    const char* end = data_.data() + data_.size();
+    while (pos_ < data_.size()) {
+        const char* p = data_.data() + pos_;
+        if (static_cast<size_t>(end - p) >= sizeof(kFileMagic) && memcmp(p, kFileMagic, sizeof(kFileMagic)) == 0) {
+            // a new session, site ids start over
+            p += sizeof(kFileMagic);
+            uint32_t version;
+            if (!ReadRaw(p, end, version) || version != kFileVersion) {
+                return false;
+            }
+            sites_.clear();
+            pos_ = p - data_.data();
+            continue;
+        }
+        char tag = *p++;
+        if (tag == kSiteTag) {
+            std::unique_ptr<BinaryLogSite> site(new BinaryLogSite());
+            uint8_t level, arg_count;
+            if (!ReadRaw(p, end, site->id) || !ReadRaw(p, end, level) || !ReadRaw(p, end, site->line)
+                || !ReadRaw(p, end, arg_count) || static_cast<size_t>(end - p) < arg_count) {
+                return false;
+            }
+            site->level = static_cast<LogLevel::Level>(level);
+            for (uint8_t i = 0; i < arg_count; ++i) {
+                site->arg_types.push_back(static_cast<BinaryArgType>(*p++));
+            }
+            if (!ReadString(p, end, site->format) || !ReadString(p, end, site->file_name)
+                || !ReadString(p, end, site->logger_name)) {
+                return false;
+            }
+            auto id = site->id;
+            if (id >= sites_.size()) {
+                sites_.resize(id + 1);
+            }
+            sites_[id] = std::move(site);
+            pos_ = p - data_.data();
+        } else if (tag == kEventTag) {
+            uint32_t site_id;
+            if (!ReadRaw(p, end, site_id) || !ReadRaw(p, end, record.time_ns)
+                || !ReadRaw(p, end, record.thread_id) || !ReadRaw(p, end, record.payload_size)
+                || static_cast<size_t>(end - p) < record.payload_size
+                || site_id >= sites_.size() || !sites_[site_id]) {
+                return false;
+            }
+            record.site = sites_[site_id].get();
+            record.payload = p;
+            pos_ = p + record.payload_size - data_.data();
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+}
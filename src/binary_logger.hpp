@@ -0,0 +1,370 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "logger.hpp"
+#include "singleton.hpp"
+#include "thread_ring.hpp"
+
+/**
+ * Deferred logging: the format string and the static details of a call site
+ * are registered once, every call only copies the raw arguments into a
+ * per-thread ring. A background thread either formats the records into the
+ * loggers or writes them to a binary file read by mysylar-logdecode.
+ * The format is printf-style, arguments may be integers, floating points,
+ * pointers and strings.
+ **/
+#define BLLOG(logger_name, event_level, format, ...) \
+    do { \
+        if ((event_level) < MYSYLAR_MIN_LOG_LEVEL \
+            || !MYSYLAR_LOGGER_HANDLE(logger_name).IsEnabled(event_level)) { \
+            break; \
+        } \
+        typedef decltype(mysylar::MakeBinaryArgTypeList(__VA_ARGS__)) mysylar_arg_types; \
+        static mysylar::BinaryLogSiteCache mysylar_site_cache; \
+        auto mysylar_site_id = mysylar_site_cache.Get(logger_name, __builtin_constant_p(logger_name), \
+            format, __FILE__, __LINE__, event_level, mysylar_arg_types::kTypes, mysylar_arg_types::kCount); \
+        mysylar::BinaryLogger::GetInstance().Record(mysylar_site_id, ##__VA_ARGS__); \
+        if ((event_level) == mysylar::LogLevel::Level::FATAL) { \
+            mysylar::BinaryLogger::GetInstance().Flush(); \
+        } \
+    } while (0)
+#define BLDEBUG(logger_name, format, ...) BLLOG(logger_name, \
+    mysylar::LogLevel::Level::DEBUG, format, ##__VA_ARGS__)
+#define BLINFO(logger_name, format, ...) BLLOG(logger_name, \
+    mysylar::LogLevel::Level::INFO, format, ##__VA_ARGS__)
+#define BLWARNING(logger_name, format, ...) BLLOG(logger_name, \
+    mysylar::LogLevel::Level::WARNING, format, ##__VA_ARGS__)
+#define BLERROR(logger_name, format, ...) BLLOG(logger_name, \
+    mysylar::LogLevel::Level::ERROR, format, ##__VA_ARGS__)
+#define BLFATAL(logger_name, format, ...) BLLOG(logger_name, \
+    mysylar::LogLevel::Level::FATAL, format, ##__VA_ARGS__)
+
+namespace mysylar {
+
+enum class BinaryArgType : uint8_t {
+    NONE = 0,
+    INT64 = 1,
+    UINT64 = 2,
+    DOUBLE = 3,
+    STRING = 4, // uint32 length followed by the chars
+    POINTER = 5,
+};
+
+/**
+ * @brief How an argument type is stored in a record
+ **/
+template<class T, class Enable = void>
+struct BinaryArg;
+
+template<class T>
+struct BinaryArg<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type Stored;
+    static constexpr BinaryArgType kType = std::is_signed<T>::value ? BinaryArgType::INT64 : BinaryArgType::UINT64;
+    static size_t Size(const T&) { return sizeof(Stored); }
+    static char* Write(char* p, const T& value) {
+        Stored stored = value;
+        memcpy(p, &stored, sizeof(stored));
+        return p + sizeof(stored);
+    }
+};
+
+template<class T>
+struct BinaryArg<T, typename std::enable_if<std::is_enum<T>::value>::type>
+    : BinaryArg<typename std::underlying_type<T>::type> {
+    static char* Write(char* p, const T& value) {
+        return BinaryArg<typename std::underlying_type<T>::type>::Write(
+            p, static_cast<typename std::underlying_type<T>::type>(value));
+    }
+};
+
+template<class T>
+struct BinaryArg<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static constexpr BinaryArgType kType = BinaryArgType::DOUBLE;
+    static size_t Size(const T&) { return sizeof(double); }
+    static char* Write(char* p, const T& value) {
+        double stored = value;
+        memcpy(p, &stored, sizeof(stored));
+        return p + sizeof(stored);
+    }
+};
+
+struct BinaryStringArg {
+    static constexpr BinaryArgType kType = BinaryArgType::STRING;
+    static size_t Size(std::string_view value) { return sizeof(uint32_t) + value.size(); }
+    static char* Write(char* p, std::string_view value) {
+        uint32_t size = value.size();
+        memcpy(p, &size, sizeof(size));
+        memcpy(p + sizeof(size), value.data(), size);
+        return p + sizeof(size) + size;
+    }
+};
+
+template<>
+struct BinaryArg<const char*> : BinaryStringArg {
+    static size_t Size(const char* value) { return BinaryStringArg::Size(value ? value : "(null)"); }
+    static char* Write(char* p, const char* value) { return BinaryStringArg::Write(p, value ? value : "(null)"); }
+};
+template<> struct BinaryArg<char*> : BinaryArg<const char*> {};
+template<> struct BinaryArg<std::string> : BinaryStringArg {};
+template<> struct BinaryArg<std::string_view> : BinaryStringArg {};
+
+template<class T>
+struct BinaryArg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static constexpr BinaryArgType kType = BinaryArgType::POINTER;
+    static size_t Size(T*) { return sizeof(uint64_t); }
+    static char* Write(char* p, T* value) {
+        uint64_t stored = reinterpret_cast<uintptr_t>(value);
+        memcpy(p, &stored, sizeof(stored));
+        return p + sizeof(stored);
+    }
+};
+
+template<class... Args>
+struct BinaryArgTypeList {
+    static constexpr BinaryArgType kTypes[] = { BinaryArg<Args>::kType..., BinaryArgType::NONE };
+    static constexpr uint32_t kCount = sizeof...(Args);
+};
+
+// only used in decltype by BLLOG to name the argument types
+template<class... Args>
+BinaryArgTypeList<typename std::decay<Args>::type...> MakeBinaryArgTypeList(const Args&...);
+
+/**
+ * @brief Static details of a BLLOG call site
+ **/
+struct BinaryLogSite {
+    uint32_t id;
+    LogLevel::Level level;
+    uint32_t line;
+    std::string format;
+    std::string file_name;
+    std::string logger_name;
+    std::vector<BinaryArgType> arg_types;
+    /**
+     * @brief render the arguments of a record with the format of the site
+     * @param payload the arguments as written by BinaryLogger::Record
+     * @param size payload size
+     * @param out the text is appended here
+     **/
+    void Decode(const char* payload, size_t size, LogBuffer& out) const;
+};
+
+/**
+ * @brief Site ids of one BLLOG call site, a site per logger name. A string
+ * literal name is registered on first use only, other names are looked up
+ * on every call.
+ **/
+class BinaryLogSiteCache {
+public:
+    // `constant`: the name is a constant expression, the same on every call
+    uint32_t Get(std::string_view logger_name, bool constant, const char* format, const char* file_name,
+                 uint32_t line, LogLevel::Level level, const BinaryArgType* arg_types, uint32_t arg_count);
+private:
+    static const uint32_t kNoSite = UINT32_MAX;
+    std::atomic<uint32_t> constant_id_{kNoSite};
+    std::mutex mutex_;
+    std::map<std::string, uint32_t, std::less<> > ids_; // by logger name, guarded by mutex_
+};
+
+/**
+ * @brief Single producer byte ring holding the records of one thread. It
+ * keeps the name the thread had when the ring was made, a later rename
+ * shows in the records of the next ring only.
+ **/
+class BinaryLogRing {
+public:
+    typedef std::shared_ptr<BinaryLogRing> SharedPtr;
+    BinaryLogRing(size_t capacity, uint32_t thread_id, const std::string& thread_name);
+    // get room for a record of `size` bytes, a multiple of 8, null if full
+    char* Reserve(size_t size);
+    // publish the record written into the reserved room
+    void Commit() { tail_.store(reserved_tail_, std::memory_order_release); }
+    /**
+     * @brief hand every published record to `consume`
+     * @return the number of records
+     **/
+    template<class F>
+    size_t Consume(F consume);
+    uint32_t GetThreadId() const { return thread_id_; }
+    const std::string& GetThreadName() const { return thread_name_; }
+    void Close() { closed_.store(true, std::memory_order_release); }
+    bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+    bool Empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+private:
+    std::unique_ptr<char[]> buffer_;
+    size_t mask_;
+    uint32_t thread_id_;
+    std::string thread_name_;
+    alignas(64) std::atomic<size_t> head_{0}; // consumer position
+    size_t cached_tail_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0}; // producer position
+    size_t cached_head_ = 0;
+    size_t reserved_tail_ = 0;
+    std::atomic<bool> closed_{false};
+};
+
+/**
+ * @brief Layout of a record in the ring, followed by the arguments
+ **/
+struct BinaryRecordHeader {
+    uint32_t size; // whole record including padding, 0 marks the wrap to the ring start
+    uint32_t site_id;
+    uint64_t time_ns;
+    uint32_t thread_id;
+    uint32_t payload_size;
+    uint32_t fiber_id; // not written to the binary file
+};
+
+template<class F>
+size_t BinaryLogRing::Consume(F consume) {
+    auto head = head_.load(std::memory_order_relaxed);
+    auto tail = tail_.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (head != tail) {
+        auto record = buffer_.get() + (head & mask_);
+        BinaryRecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        if (header.size == 0) { // padding up to the end of the ring
+            head += mask_ + 1 - (head & mask_);
+            continue;
+        }
+        consume(header, record + sizeof(header));
+        head += header.size;
+        ++count;
+    }
+    head_.store(head, std::memory_order_release);
+    return count;
+}
+
+struct BinaryLogConfig {
+    std::string path; // binary file to write, empty to format the records into the loggers
+    size_t ring_capacity = 1 << 20; // bytes per producer thread
+    uint32_t poll_interval_ms = 5; // how often the background thread looks for records
+};
+
+/**
+ * @brief Owns the call-site registry, the per-thread rings and the background writer
+ **/
+class BinaryLogger : public Singleton<BinaryLogger> {
+friend class Singleton<BinaryLogger>;
+public:
+    /**
+     * @brief register a call site, done once per site and logger name by BLLOG
+     * @return the site id
+     **/
+    static uint32_t RegisterSite(const char* format, const char* file_name, uint32_t line,
+                                 LogLevel::Level level, const std::string& logger_name,
+                                 const BinaryArgType* arg_types, uint32_t arg_count);
+    // copy of a registered site, false if the id is unknown
+    static bool GetSite(uint32_t id, BinaryLogSite& site);
+    /**
+     * @brief start the background thread, records are written to a file when
+     * config.path is set and formatted into the loggers otherwise
+     **/
+    bool Start(const BinaryLogConfig& config = BinaryLogConfig());
+    // write everything recorded so far and stop the background thread
+    void Stop();
+    // block until every record made before the call is written
+    void Flush();
+    bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+    /**
+     * @brief record a call of a site, formats synchronously when not started
+     **/
+    template<class... Args>
+    void Record(uint32_t site_id, const Args&... args);
+private:
+    BinaryLogger() {}
+    ~BinaryLogger() { Stop(); }
+    // the ring of current thread, waits while it is full; a record got from
+    // the ring counts in recording_ until CommitRecord
+    char* ReserveRecord(size_t size, BinaryLogRing*& ring);
+    void CommitRecord(BinaryLogRing* ring) {
+        ring->Commit();
+        recording_.fetch_sub(1, std::memory_order_release);
+    }
+    // format a record right away, used when the background thread is not running
+    void LogNow(const BinaryRecordHeader& header, const char* payload);
+    // format or write every record of every ring
+    void DrainAll();
+    void WriteSite(const BinaryLogSite& site);
+    const BinaryLogSite* FindSite(uint32_t id);
+    void Wakeup();
+    void WriterMain();
+
+    BinaryLogConfig config_;
+    int fd_ = -1;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> recording_{0}; // records reserved in a ring and not committed yet, Stop drains after them
+    std::thread writer_;
+    std::thread::id writer_id_;
+
+    ThreadRings<BinaryLogRing> rings_; // Reset on every Start
+    // writer-side state
+    std::vector<std::unique_ptr<BinaryLogSite> > known_sites_; // indexed by id
+    std::vector<bool> written_sites_; // sites already in the file
+    LogBuffer out_; // pending file output
+    LogBuffer text_; // a formatted record
+    std::vector<Logger::SharedPtr> touched_loggers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_cond_;
+    std::condition_variable done_cond_;
+    bool stopping_ = false;
+    bool wakeup_ = false;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+};
+
+template<class... Args>
+void BinaryLogger::Record(uint32_t site_id, const Args&... args) {
+    size_t payload_size = (sizeof(BinaryRecordHeader) + ... + BinaryArg<typename std::decay<Args>::type>::Size(args))
+        - sizeof(BinaryRecordHeader);
+    size_t size = (sizeof(BinaryRecordHeader) + payload_size + 7) & ~static_cast<size_t>(7);
+    BinaryLogRing* ring = nullptr;
+    auto record = ReserveRecord(size, ring);
+    BinaryRecordHeader header{static_cast<uint32_t>(size), site_id, GetCurrentNs(),
+        ring ? ring->GetThreadId() : static_cast<uint32_t>(GetThreadId()), static_cast<uint32_t>(payload_size),
+        GetFiberId()};
+    memcpy(record, &header, sizeof(header));
+    auto p = record + sizeof(header);
+    ((p = BinaryArg<typename std::decay<Args>::type>::Write(p, args)), ...);
+    (void)p;
+    if (ring) {
+        CommitRecord(ring);
+    } else {
+        LogNow(header, record + sizeof(header));
+    }
+}
+
+/**
+ * @brief Reads the files written by BinaryLogger
+ **/
+class BinaryLogReader {
+public:
+    struct Record {
+        const BinaryLogSite* site;
+        uint64_t time_ns;
+        uint32_t thread_id;
+        const char* payload;
+        uint32_t payload_size;
+    };
+    bool Open(const std::string& path);
+    // the next event of the file, false at the end or on a corrupted file
+    bool Next(Record& record);
+private:
+    std::vector<char> data_;
+    size_t pos_ = 0;
+    std::vector<std::unique_ptr<BinaryLogSite> > sites_; // indexed by id
+};
+
+}
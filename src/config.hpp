@@ -11,6 +11,7 @@
 #include <boost/lexical_cast.hpp>
 #include <yaml-cpp/yaml.h>
 #include "logger.hpp"
+#include "mutex.hpp"
 #include "singleton.hpp"
 #include "utils.hpp"
 
@@ -260,14 +261,17 @@ public:
      * @brief Get the Value 
      * @return const T 
      **/
-    const T GetValue() const { return value_; }
+    const T GetValue() const {
+        RWMutex::ReadLock lock(mutex_);
+        return value_;
+    }
     /**
      * @brief Get the Value as String 
      * @return const std::string 
      **/
     const std::string GetValueAsString() const override { 
         try {
-            return ToString()(value_); 
+            return ToString()(GetValue()); 
         } catch (std::exception& e) {
             LRERROR << "" << e.what();
             return "";
@@ -278,14 +282,23 @@ public:
     }
     void AddOnChangeCallback(uint64_t cb_id, 
         std::function<void(const T&, const T&)> callback_function) {
+        RWMutex::WriteLock lock(mutex_);
         on_change_callbacks_[cb_id] = callback_function;
     }
     void DeleteOnChangeCallback(uint64_t cb_id) {
+        RWMutex::WriteLock lock(mutex_);
         on_change_callbacks_.erase(cb_id);
     }
     void ClearOnChangeCallbcaks() {
+        RWMutex::WriteLock lock(mutex_);
         on_change_callbacks_.clear();
     }
+    // the manager keeps a copy, taken under the lock of `other`
+    ConfigVariable(const ConfigVariable& other) : ConfigVariableBase(other) {
+        RWMutex::ReadLock lock(other.mutex_);
+        value_ = other.value_;
+        on_change_callbacks_ = other.on_change_callbacks_;
+    }
 private:
     ConfigVariable() {}
     /**
@@ -300,6 +313,7 @@ private:
         const T& value); 
     T value_; // the value of the config varible
     std::map<uint64_t, std::function<void(const T&, const T&)> > on_change_callbacks_; // on change callback functions
+    mutable RWMutex mutex_; // guards value_ and on_change_callbacks_
 };
 
 class ConfigManager : public Singleton<ConfigManager> {
@@ -334,6 +348,23 @@ public:
         }
         return std::dynamic_pointer_cast<ConfigVariable<T> >(SearchConfigBase(name));
     }
+    /**
+     * @brief Get the config object, created quietly with the default value if it doesn't exist
+     * @tparam T 
+     * @param name config varible name
+     * @param description config varible description
+     * @param default_value value of a new config varible
+     * @return nullptr if the name exists with another type
+     **/
+    template<class T>
+    typename ConfigVariable<T>::SharedPtr Lookup(const std::string& name,
+                   const std::string& description,
+                   const T& default_value) {
+        if (!SearchConfigBase(name)) {
+            ConfigVariable<T>(name, description, default_value);
+        }
+        return std::dynamic_pointer_cast<ConfigVariable<T> >(SearchConfigBase(name));
+    }
     /**
      * @brief search the config object by name
      * @tparam T 
@@ -341,6 +372,7 @@ public:
      * @return ConfigVariable<T>::SharedPtr 
      **/
     ConfigVariableBase::SharedPtr SearchConfigBase(const std::string& name) {
+        RWMutex::ReadLock lock(mutex_);
         auto config = configs_.find(name);
         return (config == configs_.end()) ? nullptr : config->second;
     }
@@ -357,6 +389,7 @@ public:
     static void ConfigFromYaml(const YAML::Node& root_node);
 private:
     std::unordered_map<std::string, ConfigVariableBase::SharedPtr> configs_;
+    RWMutex mutex_; // guards configs_, read far more often than written
     ConfigManager() {}
     template<class T>
     void AddConfig(const ConfigVariable<T>& config) {
@@ -366,6 +399,7 @@ private:
     }
     void AddConfig(ConfigVariableBase::SharedPtr config_base) {
         auto name = config_base->GetName();
+        RWMutex::WriteLock lock(mutex_);
         auto config_exist = configs_.find(name);
         if (config_exist == configs_.end()) { // config doesn't exist
             configs_.insert(std::make_pair(name, config_base));
@@ -389,10 +423,21 @@ ConfigVariable<T, ToValue, ToString>::ConfigVariable(
 template<class T, class ToValue, class ToString>
 void ConfigVariable<T, ToValue, ToString>::SetValue(const T& value) { 
     auto old_value_string = GetValueAsString();
-    for (auto& it : on_change_callbacks_) {
-        it.second(value_, value);
+    // callbacks run unlocked, they may read this variable
+    T old_value;
+    std::map<uint64_t, std::function<void(const T&, const T&)> > callbacks;
+    {
+        RWMutex::ReadLock lock(mutex_);
+        old_value = value_;
+        callbacks = on_change_callbacks_;
+    }
+    for (auto& it : callbacks) {
+        it.second(old_value, value);
+    }
+    {
+        RWMutex::WriteLock lock(mutex_);
+        value_ = value;
     }
-    value_ = value; 
     LRINFO << "\'" << name_ << "\' exist, change the value from " << 
         old_value_string << " to " << GetValueAsString();
     ConfigManager::GetInstance().AddConfig(*this);
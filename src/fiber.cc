@@ -0,0 +1,456 @@
+#include "fiber.hpp"
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "config.hpp"
+#include "mutex.hpp"
+
+#ifndef MYSYLAR_FIBER_USE_UCONTEXT
+// mysylar_fiber_switch(&from_sp, to_sp) pushes the callee-saved registers,
+// stores the stack pointer in from_sp, loads to_sp and pops the registers saved
+// there. mysylar_fiber_start is where a new fiber returns to the first time,
+// it calls the function in the second saved register with the first as argument.
+extern "C" void mysylar_fiber_switch(void** from_sp, void* to_sp);
+extern "C" void mysylar_fiber_start();
+
+#if defined(__x86_64__)
+// saved from the lowest address: mxcsr and the x87 control word, r12, r13,
+// r14, r15, rbx, rbp, return address
+asm(R"(
+    .text
+    .globl mysylar_fiber_switch
+    .hidden mysylar_fiber_switch
+    .type mysylar_fiber_switch, @function
+    .p2align 4
+mysylar_fiber_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size mysylar_fiber_switch, .-mysylar_fiber_switch
+
+    .globl mysylar_fiber_start
+    .hidden mysylar_fiber_start
+    .type mysylar_fiber_start, @function
+    .p2align 4
+mysylar_fiber_start:
+    .cfi_startproc
+    .cfi_undefined rip
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+    .cfi_endproc
+    .size mysylar_fiber_start, .-mysylar_fiber_start
+)");
+#elif defined(__aarch64__)
+// saved from the lowest address: x19-x28, x29 (frame), x30 (return address), d8-d15
+asm(R"(
+    .text
+    .globl mysylar_fiber_switch
+    .hidden mysylar_fiber_switch
+    .type mysylar_fiber_switch, %function
+    .p2align 4
+mysylar_fiber_switch:
+    sub sp, sp, #160
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size mysylar_fiber_switch, .-mysylar_fiber_switch
+
+    .globl mysylar_fiber_start
+    .hidden mysylar_fiber_start
+    .type mysylar_fiber_start, %function
+    .p2align 4
+mysylar_fiber_start:
+    .cfi_startproc
+    .cfi_undefined x30
+    mov x0, x19
+    blr x20
+    brk #0
+    .cfi_endproc
+    .size mysylar_fiber_start, .-mysylar_fiber_start
+)");
+#endif
+#endif
+
+namespace mysylar {
+
+__thread uint32_t t_fiber_id = 0;
+
+namespace {
+
+const uint64_t kStackSizeCallbackId = 0x66696265; // "fibe"
+const size_t kDefaultStackSize = 128 << 10;
+const size_t kMinStackSize = 16 << 10;
+const size_t kThreadCacheSize = 16; // stacks kept by each thread
+const size_t kGlobalCacheSize = 1024; // and by the process
+
+const size_t s_page_size = sysconf(_SC_PAGESIZE);
+std::atomic<size_t> s_stack_size{kDefaultStackSize};
+std::atomic<uint64_t> s_next_fiber_id{0};
+std::atomic<uint64_t> s_fiber_count{0};
+std::atomic<size_t> s_cached_stacks{0};
+std::atomic<size_t> s_next_local_key{0};
+
+// the fiber running on this thread, read only through functions that aren't
+// inlined: a fiber resumed by another thread must not see a thread pointer
+// cached from before it yielded
+__thread Fiber* t_fiber = nullptr;
+
+// the main fiber of the thread, deleted when it exits
+struct MainFiberStorage {
+    std::unique_ptr<Fiber> fiber;
+    ~MainFiberStorage() {
+        fiber.reset();
+        t_fiber = nullptr;
+        t_fiber_id = 0;
+    }
+};
+
+thread_local MainFiberStorage t_main_fiber;
+
+__attribute__((noinline)) void SetCurrentFiber(Fiber* fiber) {
+    t_fiber = fiber;
+    t_fiber_id = static_cast<uint32_t>(fiber->GetId());
+}
+
+// the stack size follows fiber.stack_size
+struct StackSizeVariableInit {
+    StackSizeVariableInit() {
+        auto stack_size = ConfigManager::GetInstance().Lookup("fiber.stack_size", "fiber stack size in bytes",
+            static_cast<uint32_t>(kDefaultStackSize));
+        s_stack_size = stack_size->GetValue();
+        stack_size->AddOnChangeCallback(kStackSizeCallbackId,
+            [](const uint32_t& old_value, const uint32_t& new_value) {
+                s_stack_size = new_value;
+            });
+    }
+};
+
+StackSizeVariableInit s_stack_size_variable_init;
+
+FiberStack MapStack(size_t size) {
+    auto mapping = mmap(nullptr, size + s_page_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    if (mprotect(mapping, s_page_size, PROT_NONE) != 0) {
+        munmap(mapping, size + s_page_size);
+        throw std::bad_alloc();
+    }
+    FiberStack stack;
+    stack.base = static_cast<char*>(mapping) + s_page_size;
+    stack.size = size;
+    return stack;
+}
+
+void UnmapStack(const FiberStack& stack) {
+    munmap(static_cast<char*>(stack.base) - s_page_size, stack.size + s_page_size);
+}
+
+struct GlobalStackCache {
+    SpinLock lock;
+    std::vector<FiberStack> stacks;
+};
+
+// never deleted, threads give their stacks back while exiting
+GlobalStackCache& GetGlobalStackCache() {
+    static auto s_cache = new GlobalStackCache();
+    return *s_cache;
+}
+
+void ReleaseToGlobal(FiberStack& stack) {
+    auto& cache = GetGlobalStackCache();
+    SpinLock::Lock lock(cache.lock);
+    if (cache.stacks.size() >= kGlobalCacheSize) {
+        lock.Unlock();
+        UnmapStack(stack);
+        return;
+    }
+    cache.stacks.push_back(stack);
+    ++s_cached_stacks;
+}
+
+__thread bool t_stack_cache_gone = false;
+
+struct ThreadStackCache {
+    std::vector<FiberStack> stacks;
+    ~ThreadStackCache() {
+        t_stack_cache_gone = true;
+        for (auto& stack : stacks) {
+            --s_cached_stacks;
+            ReleaseToGlobal(stack);
+        }
+    }
+};
+
+thread_local ThreadStackCache t_stack_cache;
+
+// a cached stack of `size` bytes, stacks of an older fiber.stack_size are unmapped
+bool TakeCached(std::vector<FiberStack>& stacks, size_t size, FiberStack& stack) {
+    while (!stacks.empty()) {
+        stack = stacks.back();
+        stacks.pop_back();
+        --s_cached_stacks;
+        if (stack.size == size) {
+            return true;
+        }
+        UnmapStack(stack);
+    }
+    return false;
+}
+
+}
+
+FiberStack FiberStackPool::Allocate(size_t size) {
+    size = std::max(size, kMinStackSize);
+    size = (size + s_page_size - 1) / s_page_size * s_page_size;
+    FiberStack stack;
+    if (!t_stack_cache_gone && TakeCached(t_stack_cache.stacks, size, stack)) {
+        return stack;
+    }
+    {
+        auto& cache = GetGlobalStackCache();
+        SpinLock::Lock lock(cache.lock);
+        if (TakeCached(cache.stacks, size, stack)) {
+            return stack;
+        }
+    }
+    return MapStack(size);
+}
+
+void FiberStackPool::Release(FiberStack& stack) {
+    if (!stack.base) {
+        return;
+    }
+    if (!t_stack_cache_gone && t_stack_cache.stacks.size() < kThreadCacheSize) {
+        t_stack_cache.stacks.push_back(stack);
+        ++s_cached_stacks;
+    } else {
+        ReleaseToGlobal(stack);
+    }
+    stack.base = nullptr;
+    stack.size = 0;
+}
+
+size_t FiberStackPool::GetCachedCount() {
+    return s_cached_stacks;
+}
+
+Fiber::Fiber() :
+    state_(State::RUNNING) {
+}
+
+Fiber::Fiber(std::function<void()> callback, size_t stack_size) :
+    id_(++s_next_fiber_id),
+    stack_(FiberStackPool::Allocate(stack_size ? stack_size : s_stack_size.load(std::memory_order_relaxed))),
+    callback_(std::move(callback)) {
+    ++s_fiber_count;
+    MakeContext();
+}
+
+Fiber::~Fiber() {
+    ClearLocals();
+    if (stack_.base) {
+        FiberStackPool::Release(stack_);
+        --s_fiber_count;
+    }
+}
+
+void Fiber::Reset(std::function<void()> callback) {
+    if (!stack_.base || (state_ != State::INIT && !IsDone())) {
+        throw std::logic_error("reset a fiber that is running or suspended");
+    }
+    ClearLocals();
+    callback_ = std::move(callback);
+    state_ = State::INIT;
+    MakeContext();
+}
+
+Fiber::State Fiber::Resume() {
+    auto caller = GetThis();
+    // yielded (or about to) on another thread, which may still be saving its registers
+    Backoff backoff;
+    while (switching_.load(std::memory_order_acquire)) {
+        backoff.Pause();
+    }
+    if (state_ == State::RUNNING || IsDone() || !stack_.base) {
+        throw std::logic_error("resume a fiber that is running or done");
+    }
+    caller_ = caller;
+    state_ = State::RUNNING;
+    SetCurrentFiber(this);
+    Switch(caller->context_, context_);
+    // back on the caller, the fiber's registers are saved
+    auto state = state_;
+    switching_.store(false, std::memory_order_release);
+    return state;
+}
+
+Fiber* Fiber::GetThis() {
+    if (!t_fiber) {
+        t_main_fiber.fiber.reset(new Fiber());
+        t_fiber = t_main_fiber.fiber.get();
+    }
+    return t_fiber;
+}
+
+void Fiber::YieldToReady() {
+    auto fiber = GetThis();
+    if (fiber->caller_) {
+        fiber->Yield(State::READY);
+    }
+}
+
+void Fiber::YieldToHold() {
+    auto fiber = GetThis();
+    if (fiber->caller_) {
+        fiber->Yield(State::HOLD);
+    }
+}
+
+uint64_t Fiber::GetCount() {
+    return s_fiber_count;
+}
+
+size_t Fiber::NewLocalKey() {
+    return s_next_local_key++;
+}
+
+void Fiber::SetLocal(size_t key, void* value, void (*deleter)(void*)) {
+    if (key >= locals_.size()) {
+        locals_.resize(key + 1);
+    }
+    auto& local = locals_[key];
+    if (local.value && local.value != value && local.deleter) {
+        local.deleter(local.value);
+    }
+    local.value = value;
+    local.deleter = deleter;
+}
+
+void Fiber::ClearLocals() {
+    // deleters may use fiber locals themselves
+    while (!locals_.empty()) {
+        std::vector<Local> locals;
+        locals.swap(locals_);
+        for (auto& local : locals) {
+            if (local.value && local.deleter) {
+                local.deleter(local.value);
+            }
+        }
+    }
+}
+
+void Fiber::MakeContext() {
+#ifdef MYSYLAR_FIBER_USE_UCONTEXT
+    getcontext(&context_.context);
+    context_.context.uc_link = nullptr;
+    context_.context.uc_stack.ss_sp = stack_.base;
+    context_.context.uc_stack.ss_size = stack_.size;
+    // makecontext passes ints, the pointer goes in two halves
+    auto address = reinterpret_cast<uintptr_t>(this);
+    void (*start)(uint32_t, uint32_t) = [](uint32_t high, uint32_t low) {
+        Main(reinterpret_cast<Fiber*>((static_cast<uint64_t>(high) << 32) | low));
+    };
+    makecontext(&context_.context, reinterpret_cast<void (*)()>(start), 2,
+        static_cast<uint32_t>(static_cast<uint64_t>(address) >> 32), static_cast<uint32_t>(address));
+#else
+    // the frame mysylar_fiber_switch pops, returning to mysylar_fiber_start
+    // with the stack 16 byte aligned
+    auto top = reinterpret_cast<uintptr_t>(stack_.Top()) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    auto frame = reinterpret_cast<uint64_t*>(top) - 8;
+    frame[0] = 0x1f80 | (static_cast<uint64_t>(0x037f) << 32); // default mxcsr and x87 control word
+    frame[1] = reinterpret_cast<uint64_t>(this); // r12
+    frame[2] = reinterpret_cast<uint64_t>(&Fiber::Main); // r13
+    frame[3] = frame[4] = frame[5] = frame[6] = 0; // r14, r15, rbx, rbp
+    frame[7] = reinterpret_cast<uint64_t>(&mysylar_fiber_start);
+#elif defined(__aarch64__)
+    auto frame = reinterpret_cast<uint64_t*>(top) - 20;
+    for (int i = 0; i < 20; ++i) {
+        frame[i] = 0;
+    }
+    frame[0] = reinterpret_cast<uint64_t>(this); // x19
+    frame[1] = reinterpret_cast<uint64_t>(&Fiber::Main); // x20
+    frame[11] = reinterpret_cast<uint64_t>(&mysylar_fiber_start); // x30
+#endif
+    context_.sp = frame;
+#endif
+}
+
+void Fiber::Yield(State state) {
+    auto caller = caller_;
+    caller_ = nullptr;
+    state_ = state;
+    switching_.store(true, std::memory_order_relaxed);
+    SetCurrentFiber(caller);
+    Switch(context_, caller->context_);
+}
+
+void Fiber::Switch(Context& from, Context& to) {
+#ifdef MYSYLAR_FIBER_USE_UCONTEXT
+    swapcontext(&from.context, &to.context);
+#else
+    mysylar_fiber_switch(&from.sp, to.sp);
+#endif
+}
+
+void Fiber::Main(Fiber* fiber) {
+    auto state = State::TERM;
+    try {
+        fiber->callback_();
+    } catch (std::exception& e) {
+        state = State::EXCEPT;
+        LRERROR << "fiber " << fiber->id_ << " threw: " << e.what();
+    } catch (...) {
+        state = State::EXCEPT;
+        LRERROR << "fiber " << fiber->id_ << " threw";
+    }
+    // the captures go while still on this stack
+    fiber->callback_ = nullptr;
+    fiber->Yield(state);
+}
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#if defined(MYSYLAR_FIBER_UCONTEXT) || !(defined(__x86_64__) || defined(__aarch64__))
+#define MYSYLAR_FIBER_USE_UCONTEXT 1
+#include <ucontext.h>
+#endif
+
+namespace mysylar {
+
+/**
+ * @brief Stack of a fiber, mapped with an inaccessible guard page below it so
+ * an overflow faults instead of overwriting the next stack
+ **/
+struct FiberStack {
+    void* base = nullptr; // lowest usable byte, the guard page is right below
+    size_t size = 0;
+    char* Top() const { return static_cast<char*>(base) + size; }
+};
+
+/**
+ * @brief Hands out fiber stacks and keeps released ones for reuse, first in a
+ * small per-thread cache, then in a process wide one. Every stack is two
+ * mappings (the guard page and the stack), more than about 30000 live fibers
+ * need vm.max_map_count raised.
+ **/
+class FiberStackPool {
+public:
+    // a stack of at least `size` bytes, throws std::bad_alloc when it can't be mapped
+    static FiberStack Allocate(size_t size);
+    static void Release(FiberStack& stack);
+    // stacks cached for reuse, in all threads
+    static size_t GetCachedCount();
+};
+
+/**
+ * @brief Stackful coroutine. Resume runs it on the calling thread until it
+ * yields or returns, Yield goes back to the fiber that resumed it; each thread
+ * starts in a main fiber (id 0) made on first use. Fibers switch by saving
+ * the callee-saved registers on their own stack, with hand-written code on
+ * x86-64 and aarch64 and ucontext elsewhere or with MYSYLAR_FIBER_UCONTEXT.
+ * The stack size comes from the `fiber.stack_size` config variable. A fiber
+ * may be resumed by another thread than the one it yielded on.
+ **/
+class Fiber : public std::enable_shared_from_this<Fiber> {
+public:
+    typedef std::shared_ptr<Fiber> SharedPtr;
+    enum class State {
+        INIT, // not run yet
+        READY, // yielded and wants to run again
+        HOLD, // yielded and waits for something
+        RUNNING,
+        TERM, // returned
+        EXCEPT, // threw, the exception was logged
+    };
+    // stack_size 0 takes fiber.stack_size
+    explicit Fiber(std::function<void()> callback, size_t stack_size = 0);
+    // a fiber destroyed before it ends doesn't unwind its stack
+    ~Fiber();
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+
+    // run a new callback on the stack of a fiber that hasn't started or has ended
+    void Reset(std::function<void()> callback);
+    /**
+     * @brief switch to the fiber until it yields or ends, it must not be running
+     * @return the state it yielded or ended with; once it is HOLD another thread
+     * may already be running it again and GetState isn't safe to call
+     **/
+    State Resume();
+    uint64_t GetId() const { return id_; }
+    State GetState() const { return state_; }
+    void SetState(State state) { state_ = state; }
+    bool IsDone() const { return state_ == State::TERM || state_ == State::EXCEPT; }
+    /**
+     * @brief for the running fiber, about to hand itself to another thread and
+     * yield: a Resume there waits for the yield instead of throwing. Nothing
+     * but the yield may switch fibers in between.
+     **/
+    void PrepareYield() { switching_.store(true, std::memory_order_relaxed); }
+
+    // the fiber running the caller, the thread's main fiber outside of any other
+    static Fiber* GetThis();
+    // back to the fiber that resumed the current one, as READY
+    static void YieldToReady();
+    // back to the fiber that resumed the current one, as HOLD
+    static void YieldToHold();
+    // fibers alive in the process, main fibers not included
+    static uint64_t GetCount();
+
+    size_t GetStackSize() const { return stack_.size; }
+
+    // fiber-local storage, see FiberLocal
+    static size_t NewLocalKey();
+    void* GetLocal(size_t key) const { return key < locals_.size() ? locals_[key].value : nullptr; }
+    void SetLocal(size_t key, void* value, void (*deleter)(void*));
+private:
+    struct Context {
+#ifdef MYSYLAR_FIBER_USE_UCONTEXT
+        ucontext_t context;
+#else
+        void* sp = nullptr; // the registers are saved on the stack it points to
+#endif
+    };
+    struct Local {
+        void* value = nullptr;
+        void (*deleter)(void*) = nullptr;
+    };
+    Fiber(); // the main fiber of a thread
+    void MakeContext();
+    void Yield(State state);
+    void ClearLocals();
+    static void Switch(Context& from, Context& to);
+    static void Main(Fiber* fiber);
+
+    uint64_t id_ = 0;
+    State state_ = State::INIT;
+    FiberStack stack_;
+    Context context_;
+    Fiber* caller_ = nullptr; // resumed this fiber, gets control back on yield
+    std::atomic<bool> switching_{false}; // yielded, but the registers may not be saved yet
+    std::function<void()> callback_;
+    std::vector<Local> locals_;
+};
+
+/**
+ * @brief Variable with one instance per fiber, made on first use in each and
+ * destroyed with the fiber or when it is reset. Outside of fibers every thread
+ * has its own through its main fiber. Keys aren't reused, meant for statics.
+ **/
+template<class T>
+class FiberLocal {
+public:
+    FiberLocal() : key_(Fiber::NewLocalKey()) {}
+    FiberLocal(const FiberLocal&) = delete;
+    FiberLocal& operator=(const FiberLocal&) = delete;
+    T& Get() {
+        auto fiber = Fiber::GetThis();
+        auto value = static_cast<T*>(fiber->GetLocal(key_));
+        if (!value) {
+            value = new T();
+            fiber->SetLocal(key_, value, [](void* p) { delete static_cast<T*>(p); });
+        }
+        return *value;
+    }
+    T* operator->() { return &Get(); }
+    T& operator*() { return Get(); }
+private:
+    size_t key_;
+};
+
+}
@@ -0,0 +1,312 @@
+#include "flight_recorder.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mysylar {
+
+namespace {
+const char kMagic[8] = { 'M', 'Y', 'S', 'Y', 'L', 'A', 'R', 'F' };
+const int kFatalSignals[] = { SIGSEGV, SIGABRT, SIGBUS };
+const int kMaxFrames = 64;
+
+void WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        auto written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+// append a decimal number without library calls
+char* AppendNumber(char* out, uint64_t value) {
+    char digits[24];
+    int count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+char* AppendText(char* out, const char* text) {
+    while (*text) {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+const char* SignalName(int sig) {
+    switch (sig) {
+    case SIGSEGV:
+        return "SIGSEGV";
+    case SIGABRT:
+        return "SIGABRT";
+    case SIGBUS:
+        return "SIGBUS";
+    default:
+        return "signal";
+    }
+}
+}
+
+FlightRecorder::Mapping::~Mapping() {
+    if (header) {
+        munmap(header, size);
+    }
+}
+
+void FlightRecorder::Mapping::Append(const char* text, size_t size) const {
+    if (size > capacity) { // only the tail fits
+        text += size - capacity;
+        size = capacity;
+    }
+    auto pos = header->write_pos.fetch_add(size, std::memory_order_relaxed);
+    auto offset = pos & (capacity - 1);
+    auto first = std::min<uint64_t>(size, capacity - offset);
+    memcpy(data + offset, text, first);
+    memcpy(data, text + first, size - first);
+}
+
+void FlightRecorder::Mapping::Dump(int fd) const {
+    auto pos = header->write_pos.load(std::memory_order_acquire);
+    if (pos <= capacity) {
+        WriteAll(fd, data, pos);
+        return;
+    }
+    // the oldest record is cut, start at the next line
+    auto begin = pos & (capacity - 1);
+    uint64_t skipped = 0;
+    while (skipped < capacity && data[(begin + skipped) & (capacity - 1)] != '\n') {
+        ++skipped;
+    }
+    begin = (begin + skipped + 1) & (capacity - 1);
+    auto end = pos & (capacity - 1);
+    if (begin <= end) {
+        WriteAll(fd, data + begin, end - begin);
+    } else {
+        WriteAll(fd, data + begin, capacity - begin);
+        WriteAll(fd, data, end);
+    }
+}
+
+bool FlightRecorder::Start(const FlightRecorderConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_.load(std::memory_order_relaxed) || config.path.size() + 7 >= sizeof(crash_path_)) {
+        return false;
+    }
+    uint64_t capacity = 4096;
+    while (capacity < config.capacity) {
+        capacity <<= 1;
+    }
+    // keep the ring of the previous run, it may tell why that one ended
+    struct stat st;
+    if (stat(config.path.c_str(), &st) == 0) {
+        rename(config.path.c_str(), (config.path + ".1").c_str());
+    }
+    int fd = open(config.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "open flight recorder file " << config.path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    auto size = kHeaderSize + capacity;
+    void* address = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (address == MAP_FAILED) {
+        std::cerr << "map flight recorder file " << config.path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    auto mapping = new Mapping();
+    mapping->header = new (address) Header();
+    memcpy(mapping->header->magic, kMagic, sizeof(kMagic));
+    mapping->header->capacity = capacity;
+    mapping->header->write_pos.store(0, std::memory_order_relaxed);
+    mapping->data = static_cast<char*>(address) + kHeaderSize;
+    mapping->capacity = capacity;
+    mapping->size = size;
+    mapping_.Update(mapping);
+    strcpy(crash_path_, (config.path + ".crash").c_str());
+    if (config.install_signal_handlers) {
+        InstallSignalHandlers();
+    }
+    running_.store(true, std::memory_order_release);
+    LoggerHandle::SetRecordLevel(config.level);
+    return true;
+}
+
+void FlightRecorder::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    LoggerHandle::SetRecordLevel(INT_MAX);
+    if (handlers_installed_) {
+        RestoreSignalHandlers();
+    }
+    Flush();
+    running_.store(false, std::memory_order_release);
+    // unmapped once the threads still recording are done
+    mapping_.Update(nullptr);
+    Rcu::Synchronize();
+}
+
+void FlightRecorder::Record(LogEvent& event) {
+    static thread_local LogBuffer t_buffer;
+    // a recording thread gets its own stack for the handler, see InstallSignalHandlers
+    InstallSignalStack();
+    t_buffer.Clear();
+    formatter_.Format(t_buffer, event.GetLogger(), event.GetLevel(), event);
+    Write(t_buffer.Data(), t_buffer.Size());
+}
+
+void FlightRecorder::Write(const char* data, size_t size) {
+    Rcu::ReadGuard guard;
+    auto mapping = mapping_.Read();
+    if (mapping) {
+        mapping->Append(data, size);
+    }
+}
+
+void FlightRecorder::Flush() {
+    Rcu::ReadGuard guard;
+    auto mapping = mapping_.Read();
+    if (mapping) {
+        msync(mapping->header, mapping->size, MS_SYNC);
+    }
+}
+
+bool FlightRecorder::ReadFile(const std::string& path, std::string& records) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > kHeaderSize) {
+        address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (address == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    Mapping mapping;
+    mapping.header = static_cast<Header*>(address);
+    mapping.data = static_cast<char*>(address) + kHeaderSize;
+    mapping.capacity = mapping.header->capacity;
+    mapping.size = st.st_size;
+    if (memcmp(mapping.header->magic, kMagic, sizeof(kMagic)) != 0
+        || mapping.capacity + kHeaderSize != mapping.size) {
+        close(fd);
+        return false;
+    }
+    // oldest first, without the record cut by the wrap
+    auto pos = mapping.header->write_pos.load(std::memory_order_acquire);
+    records.clear();
+    if (pos <= mapping.capacity) {
+        records.assign(mapping.data, pos);
+    } else {
+        auto begin = pos & (mapping.capacity - 1);
+        records.assign(mapping.data + begin, mapping.capacity - begin);
+        records.append(mapping.data, begin);
+        records.erase(0, records.find('\n') + 1);
+    }
+    // space reserved by a writer that never finished
+    records.erase(std::remove(records.begin(), records.end(), '\0'), records.end());
+    close(fd);
+    return true;
+}
+
+void FlightRecorder::OnFatalSignal(int sig, siginfo_t* info, void* context) {
+    auto& recorder = GetInstance();
+    auto mapping = recorder.mapping_.Read();
+    char banner[128];
+    auto end = AppendText(banner, "*** fatal ");
+    end = AppendText(end, SignalName(sig));
+    end = AppendText(end, " (");
+    end = AppendNumber(end, sig);
+    end = AppendText(end, ") in thread ");
+    end = AppendNumber(end, syscall(SYS_gettid));
+    end = AppendText(end, " ***\n");
+    size_t size = end - banner;
+    WriteAll(STDERR_FILENO, banner, size);
+    void* frames[kMaxFrames];
+    int count = backtrace(frames, kMaxFrames);
+    backtrace_symbols_fd(frames, count, STDERR_FILENO);
+    if (mapping) {
+        mapping->Append(banner, size);
+        int fd = open(recorder.crash_path_, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd != -1) {
+            WriteAll(fd, banner, size);
+            backtrace_symbols_fd(frames, count, fd);
+            const char kRecords[] = "*** last records ***\n";
+            WriteAll(fd, kRecords, sizeof(kRecords) - 1);
+            mapping->Dump(fd);
+            close(fd);
+        }
+        msync(mapping->header, mapping->size, MS_SYNC);
+    }
+    // hand over to the handler installed before, or die of the signal once it is unblocked
+    for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); ++i) {
+        if (kFatalSignals[i] != sig) {
+            continue;
+        }
+        auto& old_action = recorder.old_actions_[i];
+        if (old_action.sa_flags & SA_SIGINFO) {
+            old_action.sa_sigaction(sig, info, context);
+            return;
+        }
+        if (old_action.sa_handler != SIG_DFL && old_action.sa_handler != SIG_IGN) {
+            old_action.sa_handler(sig);
+            return;
+        }
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void FlightRecorder::InstallSignalHandlers() {
+    // backtrace loads libgcc on first use, which is not signal-safe
+    void* frames[1];
+    backtrace(frames, 1);
+    // the handler may run on an overflowed stack, the other threads get theirs from Thread
+    // or on their first record
+    InstallSignalStack();
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &FlightRecorder::OnFatalSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); ++i) {
+        sigaction(kFatalSignals[i], &action, &old_actions_[i]);
+    }
+    handlers_installed_ = true;
+}
+
+void FlightRecorder::RestoreSignalHandlers() {
+    for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); ++i) {
+        sigaction(kFatalSignals[i], &old_actions_[i], nullptr);
+    }
+    handlers_installed_ = false;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include "logger.hpp"
+#include "rcu.hpp"
+#include "singleton.hpp"
+
+namespace mysylar {
+
+struct FlightRecorderConfig {
+    std::string path; // the ring file, a fatal signal also writes path + ".crash"
+    size_t capacity = 4 << 20; // bytes of records kept, rounded up to a power of two
+    LogLevel::Level level = LogLevel::Level::DEBUG; // lowest level kept, even below the logger levels
+    bool install_signal_handlers = true; // dump on SIGSEGV, SIGABRT and SIGBUS
+};
+
+/**
+ * @brief Always-on record of the last events in a memory mapped file. Every
+ * captured event is formatted as one line and copied into a ring shared by
+ * all threads, the page cache keeps it when the process dies. A fatal event
+ * syncs the file, a fatal signal writes a report with the backtrace and the
+ * records in order to path + ".crash" and stderr before the process dies.
+ * Threads lapping each other in a ring too small may garble a record.
+ **/
+class FlightRecorder : public Singleton<FlightRecorder> {
+friend class Singleton<FlightRecorder>;
+public:
+    bool Start(const FlightRecorderConfig& config);
+    // stop recording and unmap the ring, the file stays
+    void Stop();
+    bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+    // append the event as one line
+    void Record(LogEvent& event);
+    // append raw text
+    void Write(const char* data, size_t size);
+    // write the ring out to the file
+    void Flush();
+    // the records kept in a ring file, oldest first, false if it is not a ring file
+    static bool ReadFile(const std::string& path, std::string& records);
+private:
+    // header at the start of the file, the ring starts at the next page
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        std::atomic<uint64_t> write_pos; // bytes ever written
+    };
+    struct Mapping {
+        ~Mapping();
+        // copy into the ring, async-signal-safe
+        void Append(const char* text, size_t size) const;
+        // write the records to fd oldest first, async-signal-safe
+        void Dump(int fd) const;
+        Header* header = nullptr;
+        char* data = nullptr;
+        uint64_t capacity = 0;
+        size_t size = 0; // of the whole mapping
+    };
+    static constexpr size_t kHeaderSize = 4096;
+    FlightRecorder() {}
+    ~FlightRecorder() { Stop(); }
+    static void OnFatalSignal(int sig, siginfo_t* info, void* context);
+    void InstallSignalHandlers();
+    void RestoreSignalHandlers();
+
+    std::mutex mutex_; // serializes Start and Stop
+    std::atomic<bool> running_{false};
+    RcuPtr<Mapping> mapping_;
+    Formatter formatter_{"%d{%Y-%m-%d %H:%M:%S}.%u %p %t [%c] %f:%l %m%K%n"};
+    char crash_path_[4096] = {0};
+    bool handlers_installed_ = false;
+    struct sigaction old_actions_[3]; // of SIGSEGV, SIGABRT and SIGBUS while installed
+};
+
+}
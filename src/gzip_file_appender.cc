@@ -0,0 +1,127 @@
+#include "gzip_file_appender.hpp"
+#include <iostream>
+#include <zlib.h>
+
+namespace mysylar {
+
+GzipFileLogAppender::GzipFileLogAppender(const LogAppenderConfig& config) :
+    FileLogAppender(config),
+    stream_(new z_stream()) {
+    // window bits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(stream_, config.compress_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "invalid gzip level " << config.compress_level << " for " << file_name_ << std::endl;
+        deflateInit2(stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    }
+    thread_ = std::thread(&GzipFileLogAppender::Run, this);
+}
+
+GzipFileLogAppender::~GzipFileLogAppender() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        WriteOut();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stop_ = true;
+    }
+    queue_cond_.notify_one();
+    // the thread compresses everything queued before it exits
+    thread_.join();
+    deflateEnd(stream_);
+    delete stream_;
+}
+
+void GzipFileLogAppender::Flush() {
+    FileLogAppender::Flush();
+    WaitIdle();
+}
+
+void GzipFileLogAppender::WriteOut() {
+    if (buffer_.Size() == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    idle_cond_.wait(lock, [this]() { return queue_.size() < kMaxQueuedFrames; });
+    std::unique_ptr<LogBuffer> frame;
+    if (free_buffers_.empty()) {
+        frame = std::make_unique<LogBuffer>(buffer_size_ + 1024);
+    } else {
+        frame = std::move(free_buffers_.back());
+        free_buffers_.pop_back();
+    }
+    frame->Swap(buffer_);
+    queued_bytes_.fetch_add(frame->Size(), std::memory_order_relaxed);
+    queue_.push_back(std::move(frame));
+    CountQueued(queue_.size());
+    queue_cond_.notify_one();
+}
+
+void GzipFileLogAppender::CloseFile() {
+    WaitIdle();
+    // the reopened file is measured again
+    written_since_open_.store(0, std::memory_order_relaxed);
+    FileLogAppender::CloseFile();
+}
+
+uint64_t GzipFileLogAppender::GetPendingFileSize() const {
+    auto written = written_since_open_.load(std::memory_order_relaxed);
+    auto pending = queued_bytes_.load(std::memory_order_relaxed) + buffer_.Size();
+    auto raw = raw_bytes_.load(std::memory_order_relaxed);
+    auto compressed = compressed_bytes_.load(std::memory_order_relaxed);
+    // records not compressed yet are assumed to shrink like the ones before
+    if (raw != 0) {
+        pending = pending * compressed / raw;
+    }
+    return file_size_ + written + pending;
+}
+
+void GzipFileLogAppender::WaitIdle() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    idle_cond_.wait(lock, [this]() { return queue_.empty() && !busy_; });
+}
+
+void GzipFileLogAppender::Run() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        queue_cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        auto frame = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        Compress(*frame);
+        lock.lock();
+        queued_bytes_.fetch_sub(frame->Size(), std::memory_order_relaxed);
+        frame->Clear();
+        free_buffers_.push_back(std::move(frame));
+        busy_ = false;
+        idle_cond_.notify_all();
+    }
+}
+
+void GzipFileLogAppender::Compress(const LogBuffer& frame) {
+    auto bound = deflateBound(stream_, frame.Size());
+    if (output_.size() < bound) {
+        output_.resize(bound);
+    }
+    stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(frame.Data()));
+    stream_->avail_in = frame.Size();
+    stream_->next_out = reinterpret_cast<Bytef*>(output_.data());
+    stream_->avail_out = output_.size();
+    auto ret = deflate(stream_, Z_FINISH);
+    auto size = output_.size() - stream_->avail_out;
+    // the next frame starts a new gzip member
+    deflateReset(stream_);
+    if (ret != Z_STREAM_END) {
+        std::cerr << "gzip compression failed for " << file_name_ << ": " << ret << std::endl;
+        return;
+    }
+    auto written = WriteFile(output_.data(), size);
+    written_since_open_.fetch_add(written, std::memory_order_relaxed);
+    raw_bytes_.fetch_add(frame.Size(), std::memory_order_relaxed);
+    compressed_bytes_.fetch_add(written, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "logger.hpp"
+
+struct z_stream_s;
+
+namespace mysylar {
+
+/**
+ * @brief File appender writing gzip. Every written buffer becomes a gzip
+ * member of its own, so the file is a plain concatenation of independently
+ * decompressible frames: zcat reads it as a whole, a reader may start at any
+ * member, and a crash loses at most the frame being written. Compression
+ * runs on a background thread, logging only blocks once a few frames are
+ * queued. Rotation counts compressed bytes.
+ **/
+class GzipFileLogAppender : public FileLogAppender {
+public:
+    GzipFileLogAppender(const LogAppenderConfig& config);
+    ~GzipFileLogAppender();
+    // write out the buffered records and wait until they are in the file
+    void Flush() override;
+    std::string GetName() const override { return "gzip:" + file_name_; }
+    // uncompressed and compressed bytes written so far
+    uint64_t GetRawBytes() const { return raw_bytes_.load(std::memory_order_relaxed); }
+    uint64_t GetCompressedBytes() const { return compressed_bytes_.load(std::memory_order_relaxed); }
+private:
+    // queue the buffered records as one frame
+    void WriteOut() override;
+    // wait for the queued frames before the file goes away
+    void CloseFile() override;
+    uint64_t GetPendingFileSize() const override;
+    // wait until every queued frame is in the file
+    void WaitIdle();
+    void Run();
+    void Compress(const LogBuffer& frame);
+
+    static constexpr size_t kMaxQueuedFrames = 4;
+    z_stream_s* stream_; // only used by the compressing thread
+    std::vector<char> output_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cond_; // signals queued frames and stop
+    std::condition_variable idle_cond_; // signals finished frames
+    std::deque<std::unique_ptr<LogBuffer> > queue_;
+    std::vector<std::unique_ptr<LogBuffer> > free_buffers_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::atomic<uint64_t> queued_bytes_{0}; // uncompressed, including the frame in work
+    std::atomic<uint64_t> written_since_open_{0}; // compressed, not in file_size_ yet
+    std::atomic<uint64_t> raw_bytes_{0};
+    std::atomic<uint64_t> compressed_bytes_{0};
+    std::thread thread_;
+};
+
+}
@@ -0,0 +1,285 @@
+#include "iomanager.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+#include "logger.hpp"
+
+namespace mysylar {
+
+namespace {
+
+const size_t kMaxEvents = 256; // taken by one epoll_wait
+const size_t kInitialContexts = 64;
+
+static_assert(static_cast<uint32_t>(IOManager::Event::READ) == EPOLLIN, "READ is EPOLLIN");
+static_assert(static_cast<uint32_t>(IOManager::Event::WRITE) == EPOLLOUT, "WRITE is EPOLLOUT");
+
+const char* GetEventName(IOManager::Event event) {
+    return event == IOManager::Event::READ ? "read" : "write";
+}
+
+}
+
+IOManager::IOManager(size_t threads, const std::string& name, bool pin_threads) :
+    Scheduler(threads, name, pin_threads) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_create1 " + name);
+    }
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        auto error = errno;
+        close(epoll_fd_);
+        throw std::system_error(error, std::generic_category(), "eventfd " + name);
+    }
+    // level-triggered, stays ready until the poller reads it
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) != 0) {
+        auto error = errno;
+        close(event_fd_);
+        close(epoll_fd_);
+        throw std::system_error(error, std::generic_category(), "epoll_ctl eventfd " + name);
+    }
+    contexts_.resize(kInitialContexts);
+    for (size_t i = 0; i < kInitialContexts; ++i) {
+        contexts_[i].reset(new FdContext());
+        contexts_[i]->fd = static_cast<int>(i);
+    }
+}
+
+IOManager::~IOManager() {
+    // the workers call the overrides, they have to be gone before this is
+    StopForDestructor();
+    close(event_fd_);
+    close(epoll_fd_);
+}
+
+void IOManager::AddEvent(int fd, Event event, std::function<void()> callback) {
+    if (fd < 0) {
+        throw std::invalid_argument("wait on fd " + std::to_string(fd) + " with " + GetName());
+    }
+    Fiber::SharedPtr fiber;
+    if (!callback) {
+        // the thread's main fiber isn't shared and can't be scheduled
+        fiber = Fiber::GetThis()->weak_from_this().lock();
+        if (!fiber) {
+            throw std::logic_error("wait on fd " + std::to_string(fd) + " outside of a fiber");
+        }
+    }
+    auto context = GetContext(fd);
+    auto bit = static_cast<uint32_t>(event);
+    Mutex::Lock lock(context->mutex);
+    if (context->events & bit) {
+        throw std::logic_error("fd " + std::to_string(fd) + " already waits for " + GetEventName(event));
+    }
+    // MOD rearms: a ready fd is reported again, and interest left over from
+    // earlier waits goes; the fd is gone from the set when it was closed
+    epoll_event ready = {};
+    ready.events = EPOLLET | context->events | bit;
+    ready.data.ptr = context;
+    int ret = -1;
+    if (context->registered) {
+        ret = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ready);
+    }
+    if (ret != 0 && (!context->registered || errno == ENOENT)) {
+        ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ready);
+    }
+    if (ret != 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl fd " + std::to_string(fd));
+    }
+    context->registered = true;
+    context->events |= bit;
+    pending_events_.fetch_add(1, std::memory_order_seq_cst);
+    auto& waiter = context->Get(event);
+    if (callback) {
+        waiter.callback = std::move(callback);
+    } else {
+        waiter.fiber = std::move(fiber);
+        waiter.thread = GetTaskThread();
+        // the poller may schedule it before it is done yielding
+        waiter.fiber->PrepareYield();
+    }
+}
+
+bool IOManager::DelEvent(int fd, Event event) {
+    auto context = FindContext(fd);
+    if (!context) {
+        return false;
+    }
+    auto bit = static_cast<uint32_t>(event);
+    Mutex::Lock lock(context->mutex);
+    if (!(context->events & bit)) {
+        return false;
+    }
+    context->events &= ~bit;
+    context->Get(event) = FdContext::Waiter();
+    OnEventsDone(1);
+    return true;
+}
+
+bool IOManager::CancelEvent(int fd, Event event) {
+    auto context = FindContext(fd);
+    if (!context) {
+        return false;
+    }
+    auto bit = static_cast<uint32_t>(event);
+    Mutex::Lock lock(context->mutex);
+    if (!(context->events & bit)) {
+        return false;
+    }
+    Fire(context, event);
+    return true;
+}
+
+bool IOManager::CancelAll(int fd) {
+    auto context = FindContext(fd);
+    if (!context) {
+        return false;
+    }
+    Mutex::Lock lock(context->mutex);
+    auto events = context->events;
+    if (!events) {
+        return false;
+    }
+    if (events & static_cast<uint32_t>(Event::READ)) {
+        Fire(context, Event::READ);
+    }
+    if (events & static_cast<uint32_t>(Event::WRITE)) {
+        Fire(context, Event::WRITE);
+    }
+    return true;
+}
+
+IOManager* IOManager::GetThis() {
+    return dynamic_cast<IOManager*>(Scheduler::GetThis());
+}
+
+void IOManager::Idle(size_t index) {
+    int none = -1;
+    if (!poller_.compare_exchange_strong(none, static_cast<int>(index), std::memory_order_seq_cst)) {
+        Scheduler::Idle(index);
+        return;
+    }
+    // pairs with the fence in Tickle: a Tickle from before this worker took
+    // over epoll_wait only posted its semaphore
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (TryIdle(index)) {
+        poller_.store(-1, std::memory_order_seq_cst);
+        return;
+    }
+    epoll_event events[kMaxEvents];
+    int count;
+    while ((count = epoll_wait(epoll_fd_, events, kMaxEvents, -1)) < 0 && errno == EINTR) {
+    }
+    if (count < 0) {
+        LRERROR << GetName() << ": epoll_wait failed, errno " << errno;
+    }
+    size_t fired = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!events[i].data.ptr) {
+            uint64_t value;
+            while (read(event_fd_, &value, sizeof(value)) > 0) {
+            }
+            continue;
+        }
+        auto context = static_cast<FdContext*>(events[i].data.ptr);
+        auto ready = events[i].events;
+        if (ready & (EPOLLERR | EPOLLHUP)) {
+            ready |= EPOLLIN | EPOLLOUT;
+        }
+        Mutex::Lock lock(context->mutex);
+        ready &= context->events;
+        if (!ready) {
+            continue;
+        }
+        if (fired == 0) {
+            // no longer parked before anything is scheduled, or another worker
+            // could take all of them for parked, stop, and leave it unrun
+            Unpark(index);
+        }
+        if (ready & static_cast<uint32_t>(Event::READ)) {
+            Fire(context, Event::READ);
+            ++fired;
+        }
+        if (ready & static_cast<uint32_t>(Event::WRITE)) {
+            Fire(context, Event::WRITE);
+            ++fired;
+        }
+    }
+    poller_.store(-1, std::memory_order_seq_cst);
+    // the Tickle that wrote the eventfd posted the semaphore as well
+    TryIdle(index);
+    // tickled to run something: another idle worker takes over epoll_wait,
+    // scheduling what fired woke one already
+    if (fired == 0) {
+        WakeOne();
+    }
+}
+
+void IOManager::Tickle(size_t index) {
+    Scheduler::Tickle(index);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (poller_.load(std::memory_order_seq_cst) == static_cast<int>(index)) {
+        uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+            LRERROR << GetName() << ": eventfd write failed, errno " << errno;
+        }
+    }
+}
+
+bool IOManager::CanStop() {
+    return pending_events_.load(std::memory_order_seq_cst) == 0;
+}
+
+IOManager::FdContext* IOManager::GetContext(int fd) {
+    {
+        RWMutex::ReadLock lock(contexts_mutex_);
+        if (static_cast<size_t>(fd) < contexts_.size()) {
+            return contexts_[fd].get();
+        }
+    }
+    RWMutex::WriteLock lock(contexts_mutex_);
+    auto size = contexts_.size();
+    if (static_cast<size_t>(fd) >= size) {
+        auto grown = std::max(static_cast<size_t>(fd) + 1, size + size / 2);
+        contexts_.resize(grown);
+        for (auto i = size; i < grown; ++i) {
+            contexts_[i].reset(new FdContext());
+            contexts_[i]->fd = static_cast<int>(i);
+        }
+    }
+    return contexts_[fd].get();
+}
+
+IOManager::FdContext* IOManager::FindContext(int fd) {
+    RWMutex::ReadLock lock(contexts_mutex_);
+    return fd >= 0 && static_cast<size_t>(fd) < contexts_.size() ? contexts_[fd].get() : nullptr;
+}
+
+void IOManager::Fire(FdContext* context, Event event) {
+    context->events &= ~static_cast<uint32_t>(event);
+    auto& waiter = context->Get(event);
+    auto thread = waiter.thread;
+    if (waiter.fiber) {
+        Schedule(std::move(waiter.fiber), thread);
+    } else {
+        Schedule(std::move(waiter.callback), thread);
+    }
+    waiter = FdContext::Waiter();
+    // after Schedule, see Scheduler::Park
+    OnEventsDone(1);
+}
+
+void IOManager::OnEventsDone(size_t count) {
+    if (pending_events_.fetch_sub(count, std::memory_order_seq_cst) == count && IsStopping()) {
+        // the workers may stop now
+        WakeAll();
+    }
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mutex.hpp"
+#include "scheduler.hpp"
+
+namespace mysylar {
+
+/**
+ * @brief Scheduler that also waits for file descriptors. A fiber registers
+ * interest in an fd becoming readable or writable, yields HOLD and is
+ * scheduled again once epoll reports it (edge-triggered), so blocking-style
+ * code doesn't hold a worker. One idle worker at a time blocks in epoll_wait
+ * and is woken through an eventfd, the other idle workers park as in the
+ * Scheduler. Each wait fires once and has to be registered again for the next
+ * edge, the fd should be non-blocking and read or written until EAGAIN. An fd
+ * stays in the epoll set between waits, a wait costs one epoll_ctl, and may
+ * fire for an edge that came before it, readers retry on EAGAIN anyway.
+ * Stop waits for the registered events, cancel them first.
+ **/
+class IOManager : public Scheduler {
+public:
+    typedef std::shared_ptr<IOManager> SharedPtr;
+    enum class Event : uint32_t {
+        READ = 0x1, // EPOLLIN
+        WRITE = 0x4, // EPOLLOUT
+    };
+    // throws std::system_error when epoll or the eventfd can't be created
+    explicit IOManager(size_t threads = 0, const std::string& name = "iomanager", bool pin_threads = false);
+    ~IOManager();
+
+    /**
+     * @brief wait once for `fd` to be ready for `event`, errors and hangups count
+     * as ready. Without `callback` the running fiber waits and has to
+     * Fiber::YieldToHold right after; it is scheduled again on the worker its
+     * task is pinned to, if any. throws std::invalid_argument for a negative fd,
+     * std::logic_error when `fd` already waits for `event` or there is no
+     * callback outside of a fiber, std::system_error when epoll refuses the fd
+     **/
+    void AddEvent(int fd, Event event, std::function<void()> callback = nullptr);
+    // forget a wait without running its waiter, false when there was none
+    bool DelEvent(int fd, Event event);
+    // run the waiter of a wait now as if the fd was ready, false when there was none
+    bool CancelEvent(int fd, Event event);
+    // CancelEvent both events, before closing `fd`
+    bool CancelAll(int fd);
+    // waits registered and not fired, deleted or cancelled yet
+    size_t GetPendingEventCount() const { return pending_events_.load(std::memory_order_relaxed); }
+
+    // the IOManager of the calling worker, null outside of its workers
+    static IOManager* GetThis();
+protected:
+    void Idle(size_t index) override;
+    void Tickle(size_t index) override;
+    bool CanStop() override;
+private:
+    struct FdContext {
+        struct Waiter {
+            Fiber::SharedPtr fiber;
+            std::function<void()> callback;
+            int thread = -1;
+        };
+        Waiter& Get(Event event) { return event == Event::READ ? read : write; }
+
+        Mutex mutex;
+        int fd = -1;
+        bool registered = false; // in the epoll set, unless closed since
+        uint32_t events = 0; // waited for
+        Waiter read;
+        Waiter write;
+    };
+
+    // the context of `fd`, made on first use
+    FdContext* GetContext(int fd);
+    // the context of `fd`, null when it never waited
+    FdContext* FindContext(int fd);
+    // schedule the waiter of `event` and stop waiting for it, locked
+    void Fire(FdContext* context, Event event);
+    void OnEventsDone(size_t count);
+
+    int epoll_fd_ = -1;
+    int event_fd_ = -1; // wakes the worker in epoll_wait
+    std::atomic<int> poller_{-1}; // the worker in epoll_wait
+    RWMutex contexts_mutex_; // write locked to grow contexts_ only
+    std::vector<std::unique_ptr<FdContext> > contexts_; // indexed by fd
+    std::atomic<size_t> pending_events_{0};
+};
+
+}
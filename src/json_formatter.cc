@@ -0,0 +1,225 @@
+#include "json_formatter.hpp"
+#include <cmath>
+#include <ctime>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mysylar {
+
+namespace {
+const char kHexDigits[] = "0123456789abcdef";
+
+bool NeedsEscape(unsigned char ch) {
+    return ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+// offset of the first char that needs escaping, `size` if there is none
+size_t FindEscape(const char* data, size_t size) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= size; i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // a char is a control char if the unsigned max with 0x1f is 0x1f
+        auto special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        auto mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (NeedsEscape(data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+void AppendEscape(LogBuffer& buffer, unsigned char ch) {
+    switch (ch) {
+    case '"':
+        buffer.Append("\\\"");
+        break;
+    case '\\':
+        buffer.Append("\\\\");
+        break;
+    case '\n':
+        buffer.Append("\\n");
+        break;
+    case '\r':
+        buffer.Append("\\r");
+        break;
+    case '\t':
+        buffer.Append("\\t");
+        break;
+    case '\b':
+        buffer.Append("\\b");
+        break;
+    case '\f':
+        buffer.Append("\\f");
+        break;
+    default: {
+        char text[6] = { '\\', 'u', '0', '0', kHexDigits[ch >> 4], kHexDigits[ch & 0xf] };
+        buffer.Append(text, sizeof(text));
+        break;
+    }
+    }
+}
+
+void AppendJsonString(LogBuffer& buffer, std::string_view str) {
+    buffer.Append('"');
+    AppendJsonEscaped(buffer, str);
+    buffer.Append('"');
+}
+
+// "time":"2026-01-02T03:04:05.123456Z", the text of the second is cached
+void AppendTime(LogBuffer& buffer, uint64_t time_ns) {
+    static thread_local time_t t_second = -1;
+    static thread_local char t_text[32];
+    static thread_local size_t t_size = 0;
+    time_t second = time_ns / 1000000000;
+    if (second != t_second) {
+        struct tm tm_struct;
+        gmtime_r(&second, &tm_struct);
+        t_size = strftime(t_text, sizeof(t_text), "%Y-%m-%dT%H:%M:%S.", &tm_struct);
+        t_second = second;
+    }
+    buffer.Append("\"time\":\"");
+    buffer.Append(t_text, t_size);
+    auto micros = time_ns % 1000000000 / 1000;
+    auto begin = buffer.Reserve(6);
+    for (int i = 5; i >= 0; --i) {
+        begin[i] = '0' + micros % 10;
+        micros /= 10;
+    }
+    buffer.Commit(6);
+    buffer.Append("Z\"");
+}
+
+// the seconds of "2026-01-02T03:04:05", -1 if it doesn't read; the last text is kept
+time_t ParseTime(std::string_view text) {
+    static thread_local char t_text[20] = {0};
+    static thread_local time_t t_time = -1;
+    if (text.size() != sizeof(t_text) - 1) {
+        return -1;
+    }
+    if (memcmp(text.data(), t_text, text.size()) == 0) {
+        return t_time;
+    }
+    memcpy(t_text, text.data(), text.size());
+    struct tm tm_struct = {};
+    auto parsed_end = strptime(t_text, "%Y-%m-%dT%H:%M:%S", &tm_struct);
+    t_time = parsed_end && *parsed_end == '\0' ? timegm(&tm_struct) : -1;
+    return t_time;
+}
+}
+
+void AppendJsonEscaped(LogBuffer& buffer, std::string_view str) {
+    auto data = str.data();
+    auto size = str.size();
+    while (size > 0) {
+        auto clean = FindEscape(data, size);
+        buffer.Append(data, clean);
+        if (clean == size) {
+            break;
+        }
+        AppendEscape(buffer, data[clean]);
+        data += clean + 1;
+        size -= clean + 1;
+    }
+}
+
+void AppendJsonValue(LogBuffer& buffer, const LogField& field) {
+    switch (field.type) {
+    case LogField::Type::BOOL:
+        if (field.bool_value) {
+            buffer.Append("true");
+        } else {
+            buffer.Append("false");
+        }
+        break;
+    case LogField::Type::INT64:
+        buffer.AppendInteger(field.int_value);
+        break;
+    case LogField::Type::UINT64:
+        buffer.AppendInteger(field.uint_value);
+        break;
+    case LogField::Type::DOUBLE:
+        if (std::isfinite(field.double_value)) {
+            auto begin = buffer.Reserve(32);
+            buffer.Commit(std::to_chars(begin, begin + 32, field.double_value).ptr - begin);
+        } else {
+            buffer.Append("null");
+        }
+        break;
+    case LogField::Type::STRING:
+        AppendJsonString(buffer, field.string_value);
+        break;
+    }
+}
+
+void JsonFormatter::Format(
+    LogBuffer& buffer, const std::shared_ptr<Logger>& logger,
+    LogLevel::Level level, const LogEvent& event) const {
+    buffer.Append('{');
+    AppendTime(buffer, event.GetTimeNs());
+    buffer.Append(",\"level\":\"");
+    buffer.Append(LogLevel::ToString(level));
+    buffer.Append("\",\"logger\":");
+    AppendJsonString(buffer, logger->GetName());
+    buffer.Append(",\"thread_id\":");
+    buffer.AppendInteger(event.GetThreadId());
+    buffer.Append(",\"thread_name\":");
+    AppendJsonString(buffer, event.GetThreadName());
+    buffer.Append(",\"fiber_id\":");
+    buffer.AppendInteger(event.GetFiberId());
+    buffer.Append(",\"file\":");
+    AppendJsonString(buffer, event.GetFileName());
+    buffer.Append(",\"line\":");
+    buffer.AppendInteger(event.GetLine());
+    buffer.Append(",\"message\":");
+    AppendJsonString(buffer, event.GetContent());
+    event.ForEachField([&buffer](const LogField& field) {
+        buffer.Append(',');
+        AppendJsonString(buffer, field.key);
+        buffer.Append(':');
+        AppendJsonValue(buffer, field);
+    });
+    buffer.Append("}\n");
+}
+
+bool JsonFormatter::Parse(std::string_view line, LogRecordHeader& header) const {
+    static const std::string_view kTime("{\"time\":\"");
+    static const std::string_view kLevel(",\"level\":\"");
+    static const std::string_view kLogger("\",\"logger\":\"");
+    header = LogRecordHeader();
+    if (line.compare(0, kTime.size(), kTime) != 0) {
+        return false;
+    }
+    header.time = ParseTime(line.substr(kTime.size(), 19));
+    auto level_begin = line.find(kLevel, kTime.size());
+    if (header.time == -1 || level_begin == std::string_view::npos) {
+        return false;
+    }
+    level_begin += kLevel.size();
+    auto level_end = line.find('"', level_begin);
+    if (level_end == std::string_view::npos || line.compare(level_end, kLogger.size(), kLogger) != 0) {
+        return false;
+    }
+    header.level = LogLevel::ToLevel(std::string(line.substr(level_begin, level_end - level_begin)));
+    auto logger_begin = level_end + kLogger.size();
+    auto logger_end = line.find('"', logger_begin);
+    if (logger_end == std::string_view::npos) {
+        return false;
+    }
+    header.logger_name = line.substr(logger_begin, logger_end - logger_begin);
+    return true;
+}
+
+}
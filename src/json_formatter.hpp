@@ -0,0 +1,29 @@
+#pragma once
+#include <memory>
+#include <string_view>
+#include "logger.hpp"
+
+namespace mysylar {
+
+// append `str` with the characters JSON does not allow raw escaped, no quotes
+void AppendJsonEscaped(LogBuffer& buffer, std::string_view str);
+// append the value of a field as JSON, non-finite numbers become null
+void AppendJsonValue(LogBuffer& buffer, const LogField& field);
+
+/**
+ * @brief Formats an event as one JSON object per line: time (UTC, ISO 8601),
+ * level, logger, thread and fiber, source location, message, then the
+ * structured fields. Selected by the pattern "json".
+ **/
+class JsonFormatter : public Formatter {
+public:
+    typedef std::shared_ptr<JsonFormatter> SharedPtr;
+    JsonFormatter() : Formatter("json", NoPattern()) {}
+    using Formatter::Format;
+    void Format(
+        LogBuffer& buffer, const std::shared_ptr<Logger>& logger,
+        LogLevel::Level level, const LogEvent& event) const override;
+    bool Parse(std::string_view line, LogRecordHeader& header) const override;
+};
+
+}
@@ -0,0 +1,353 @@
+#include "log_config.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mysylar {
+
+namespace {
+
+const uint64_t kLogsCallbackId = 0x6c6f6773; // "logs"
+
+struct NamedValue {
+    const char* name;
+    int value;
+};
+
+const NamedValue kAppenderTypes[] = {
+    { "stdout", LogAppenderConfig::Type::STDOUT_APPENDER },
+    { "file", LogAppenderConfig::Type::FILE_APPENDER },
+    { "gzip", LogAppenderConfig::Type::GZIP_FILE_APPENDER },
+    { "StdoutLogAppender", LogAppenderConfig::Type::STDOUT_APPENDER },
+    { "FileLogAppender", LogAppenderConfig::Type::FILE_APPENDER },
+    { "GzipFileLogAppender", LogAppenderConfig::Type::GZIP_FILE_APPENDER },
+};
+
+const NamedValue kTargets[] = {
+    { "stdout", LogAppenderConfig::Target::STDOUT_TARGET },
+    { "stderr", LogAppenderConfig::Target::STDERR_TARGET },
+};
+
+const NamedValue kRotateIntervals[] = {
+    { "none", FileLogAppender::RotateInterval::NONE },
+    { "hourly", FileLogAppender::RotateInterval::HOURLY },
+    { "daily", FileLogAppender::RotateInterval::DAILY },
+};
+
+// a name of the table or a number, which the first name is written for
+template<size_t N>
+int ParseNamed(const YAML::Node& node, const NamedValue (&table)[N], const char* key) {
+    auto text = node.as<std::string>();
+    for (auto& i : table) {
+        if (text == i.name) {
+            return i.value;
+        }
+    }
+    int value;
+    try {
+        value = node.as<int>();
+    } catch (YAML::Exception&) {
+        throw std::invalid_argument(std::string("invalid ") + key + ": " + text);
+    }
+    for (auto& i : table) {
+        if (value == i.value) {
+            return value;
+        }
+    }
+    throw std::invalid_argument(std::string("invalid ") + key + ": " + text);
+}
+
+template<size_t N>
+const char* NameOf(int value, const NamedValue (&table)[N]) {
+    for (auto& i : table) {
+        if (value == i.value) {
+            return i.name;
+        }
+    }
+    return "unknown";
+}
+
+LogLevel::Level ParseLevel(const YAML::Node& node) {
+    auto text = node.as<std::string>();
+    auto level = LogLevel::ToLevel(std::string(text));
+    if (level == LogLevel::Level::UNKNOWN) {
+        throw std::invalid_argument("invalid level: " + text);
+    }
+    return level;
+}
+
+// whether both write the same output, only level and format may differ
+bool IsSameOutput(const LogAppenderConfig& a, const LogAppenderConfig& b) {
+    return a.type == b.type
+        && a.path == b.path
+        && a.target == b.target
+        && a.non_blocking == b.non_blocking
+        && a.buffer_size == b.buffer_size
+        && a.flush_interval_ms == b.flush_interval_ms
+        && a.rotate_size == b.rotate_size
+        && a.rotate_interval == b.rotate_interval
+        && a.max_files == b.max_files
+        && a.compress_level == b.compress_level
+        && a.index_interval == b.index_interval;
+}
+
+// changes the level, formatter and appenders of a live logger as one step: while `update` runs
+// only what both the old and the new level log gets through, like LogAppender::Reconfigure;
+// Logger::Log holds a read guard from the level check to the appending
+template<class Update>
+void Reconfigure(const Logger::SharedPtr& logger, LogLevel::Level level, Update update) {
+    logger->SetLevel(std::max(logger->GetEffectiveLevel(), level));
+    Rcu::Synchronize();
+    update();
+    Rcu::Synchronize();
+    logger->SetLevel(level);
+}
+
+// keeps the loggers in line with the variable from the start
+struct LogsVariableInit {
+    LogsVariableInit() {
+        auto logs = ConfigManager::GetInstance().Lookup("logs", "logger definitions",
+            std::vector<LoggerConfig>());
+        logs->AddOnChangeCallback(kLogsCallbackId,
+            [](const std::vector<LoggerConfig>& old_value, const std::vector<LoggerConfig>& new_value) {
+                LogConfigurator::GetInstance().Apply(new_value);
+            });
+    }
+};
+
+LogsVariableInit s_logs_variable_init;
+
+}
+
+LogAppenderConfig LogAppenderConfigFromYaml(const YAML::Node& node) {
+    if (!node.IsMap()) {
+        throw std::invalid_argument("an appender is not a map");
+    }
+    LogAppenderConfig config;
+    if (node["type"]) {
+        config.type = ParseNamed(node["type"], kAppenderTypes, "appender type");
+    }
+    if (node["path"]) {
+        config.path = node["path"].as<std::string>();
+    }
+    if (config.type != LogAppenderConfig::Type::STDOUT_APPENDER && config.path.empty()) {
+        throw std::invalid_argument("a file appender without path");
+    }
+    if (node["format"]) {
+        config.format_pattern = node["format"].as<std::string>();
+    }
+    if (node["level"]) {
+        config.level = ParseLevel(node["level"]);
+    }
+    if (node["target"]) {
+        config.target = ParseNamed(node["target"], kTargets, "target");
+    }
+    if (node["non_blocking"]) {
+        config.non_blocking = node["non_blocking"].as<bool>();
+    }
+    if (node["buffer_size"]) {
+        config.buffer_size = node["buffer_size"].as<size_t>();
+    }
+    if (node["flush_interval_ms"]) {
+        config.flush_interval_ms = node["flush_interval_ms"].as<uint32_t>();
+    }
+    if (node["rotate_size"]) {
+        config.rotate_size = node["rotate_size"].as<uint64_t>();
+    }
+    if (node["rotate_interval"]) {
+        config.rotate_interval = ParseNamed(node["rotate_interval"], kRotateIntervals, "rotate interval");
+    }
+    if (node["max_files"]) {
+        config.max_files = node["max_files"].as<uint32_t>();
+    }
+    if (node["compress_level"]) {
+        config.compress_level = node["compress_level"].as<int>();
+    }
+    if (node["index_interval"]) {
+        config.index_interval = node["index_interval"].as<uint32_t>();
+    }
+    return config;
+}
+
+YAML::Node LogAppenderConfigToYaml(const LogAppenderConfig& config) {
+    YAML::Node node;
+    node["type"] = NameOf(config.type, kAppenderTypes);
+    if (!config.path.empty()) {
+        node["path"] = config.path;
+    }
+    if (!config.format_pattern.empty()) {
+        node["format"] = config.format_pattern;
+    }
+    node["level"] = LogLevel::ToString(config.level);
+    if (config.type == LogAppenderConfig::Type::STDOUT_APPENDER) {
+        node["target"] = NameOf(config.target, kTargets);
+        node["non_blocking"] = config.non_blocking;
+    } else {
+        node["buffer_size"] = config.buffer_size;
+        node["flush_interval_ms"] = config.flush_interval_ms;
+        node["rotate_size"] = config.rotate_size;
+        node["rotate_interval"] = NameOf(config.rotate_interval, kRotateIntervals);
+        node["max_files"] = config.max_files;
+    }
+    if (config.type == LogAppenderConfig::Type::FILE_APPENDER) {
+        node["index_interval"] = config.index_interval;
+    }
+    if (config.type == LogAppenderConfig::Type::GZIP_FILE_APPENDER) {
+        node["compress_level"] = config.compress_level;
+    }
+    return node;
+}
+
+LoggerConfig LoggerConfigFromYaml(const YAML::Node& node) {
+    if (!node.IsMap() || !node["name"]) {
+        throw std::invalid_argument("a logger without name");
+    }
+    LoggerConfig config;
+    config.name = node["name"].as<std::string>();
+    if (node["level"]) {
+        config.level = ParseLevel(node["level"]);
+    }
+    if (node["format"]) {
+        config.format_pattern = node["format"].as<std::string>();
+    }
+    if (node["appenders"]) {
+        for (const auto& appender : node["appenders"]) {
+            config.appenders.push_back(LogAppenderConfigFromYaml(appender));
+        }
+    }
+    return config;
+}
+
+YAML::Node LoggerConfigToYaml(const LoggerConfig& config) {
+    YAML::Node node;
+    node["name"] = config.name;
+    if (config.level != LogLevel::Level::UNKNOWN) {
+        node["level"] = LogLevel::ToString(config.level);
+    }
+    if (!config.format_pattern.empty()) {
+        node["format"] = config.format_pattern;
+    }
+    for (auto& appender : config.appenders) {
+        node["appenders"].push_back(LogAppenderConfigToYaml(appender));
+    }
+    return node;
+}
+
+void LogConfigurator::Apply(const std::vector<LoggerConfig>& configs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // a later definition of a name wins
+    std::map<std::string, const LoggerConfig*> wanted;
+    for (auto& config : configs) {
+        wanted[config.name.empty() ? "root" : config.name] = &config;
+    }
+    for (auto it = loggers_.begin(); it != loggers_.end();) {
+        if (wanted.count(it->first)) {
+            ++it;
+            continue;
+        }
+        Restore(it->second);
+        it = loggers_.erase(it);
+    }
+    auto& manager = LoggerManager::GetInstance();
+    for (auto& [name, config] : wanted) {
+        auto it = loggers_.find(name);
+        if (it != loggers_.end() && it->second.config == *config) {
+            continue;
+        }
+        bool is_new = it == loggers_.end();
+        if (is_new) {
+            LoggerEntry entry;
+            entry.logger.reset(new Logger(name, config->level));
+            it = loggers_.emplace(name, std::move(entry)).first;
+        }
+        auto& entry = it->second;
+        bool registered = !is_new;
+        if (is_new) {
+            // built before anyone can log through it
+            entry.logger->SetFormatter(GetFormatter(config->format_pattern));
+            entry.logger->SetAppenders(UpdateAppenders(entry, *config));
+            entry.created = manager.AddLogger(entry.logger);
+            if (!entry.created) { // registered by the program, configure that one
+                entry.logger = manager.GetLogger(name);
+                entry.original_level = entry.logger->GetLevel();
+                entry.original_formatter = entry.logger->GetFormatter();
+                entry.original_appenders = entry.logger->GetAppenders();
+                registered = true;
+            }
+        }
+        if (registered) {
+            Reconfigure(entry.logger, config->level, [&]() {
+                auto appenders = UpdateAppenders(entry, *config);
+                entry.logger->SetFormatter(GetFormatter(config->format_pattern));
+                if (entry.logger->GetAppenders() != appenders) {
+                    entry.logger->SetAppenders(appenders);
+                }
+            });
+        }
+        entry.config = *config;
+    }
+    // patterns no appender uses any more
+    for (auto it = formatters_.begin(); it != formatters_.end();) {
+        it = it->second.use_count() == 1 ? formatters_.erase(it) : std::next(it);
+    }
+}
+
+std::vector<LogAppender::SharedPtr> LogConfigurator::UpdateAppenders(
+    LoggerEntry& entry, const LoggerConfig& config) {
+    std::vector<AppenderEntry> updated;
+    std::vector<LogAppender::SharedPtr> appenders;
+    for (auto& appender_config : config.appenders) {
+        auto pattern = appender_config.format_pattern.empty()
+            ? config.format_pattern : appender_config.format_pattern;
+        auto old = std::find_if(entry.appenders.begin(), entry.appenders.end(),
+            [&appender_config](const AppenderEntry& i) {
+                return i.appender && IsSameOutput(i.config, appender_config);
+            });
+        AppenderEntry appender_entry;
+        if (old != entry.appenders.end()) {
+            // keep the open file, the new level and formatter apply together from the next event
+            appender_entry = std::move(*old);
+            appender_entry.appender->Reconfigure(appender_config.level, appender_entry.pattern != pattern
+                ? GetFormatter(pattern) : appender_entry.appender->GetFormatter());
+        } else {
+            auto create_config = appender_config;
+            create_config.format_pattern.clear(); // parsed once by GetFormatter
+            appender_entry.appender = LogAppender::Create(create_config);
+            if (!appender_entry.appender) {
+                LRERROR << "unknown appender type " << appender_config.type << " of logger " << config.name;
+                continue;
+            }
+            appender_entry.appender->SetFormatter(GetFormatter(pattern));
+        }
+        appender_entry.config = appender_config;
+        appender_entry.pattern = pattern;
+        appenders.push_back(appender_entry.appender);
+        updated.push_back(std::move(appender_entry));
+    }
+    // the appenders left are closed once no thread logs through them
+    entry.appenders.swap(updated);
+    return appenders;
+}
+
+void LogConfigurator::Restore(LoggerEntry& entry) {
+    auto& manager = LoggerManager::GetInstance();
+    if (entry.created) {
+        if (manager.GetLogger(entry.logger->GetName()) == entry.logger) {
+            manager.DeleteLogger(entry.logger);
+        }
+        return;
+    }
+    Reconfigure(entry.logger, entry.original_level, [&entry]() {
+        entry.logger->SetFormatter(entry.original_formatter);
+        entry.logger->SetAppenders(entry.original_appenders);
+    });
+}
+
+Formatter::SharedPtr LogConfigurator::GetFormatter(const std::string& pattern) {
+    auto& formatter = formatters_[pattern];
+    if (!formatter) {
+        formatter = pattern.empty() ? std::make_shared<Formatter>() : Formatter::Create(pattern);
+    }
+    return formatter;
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "logger.hpp"
+#include "singleton.hpp"
+
+namespace mysylar {
+
+/**
+ * Loggers described in yaml, loaded into the "logs" config variable:
+ *
+ * logs:
+ *   - name: system.net
+ *     level: info                  # left out to inherit the parent level
+ *     format: "%d %p %m%n"         # for the appenders without a format
+ *     appenders:
+ *       - type: file               # stdout, file or gzip
+ *         path: ./net.log
+ *         level: warning
+ *         rotate_size: 104857600
+ *         rotate_interval: daily   # none, hourly or daily
+ *         max_files: 7
+ *         index_interval: 65536    # sidecar index for mysylar-logq, plain files only
+ *
+ * Invalid values throw, the variable keeps its value then.
+ **/
+LogAppenderConfig LogAppenderConfigFromYaml(const YAML::Node& node);
+YAML::Node LogAppenderConfigToYaml(const LogAppenderConfig& config);
+LoggerConfig LoggerConfigFromYaml(const YAML::Node& node);
+YAML::Node LoggerConfigToYaml(const LoggerConfig& config);
+
+template<>
+class StdYamlCast<std::string, LogAppenderConfig> {
+public:
+    LogAppenderConfig operator()(const std::string& from) {
+        return LogAppenderConfigFromYaml(YAML::Load(from));
+    }
+};
+
+template<>
+class StdYamlCast<LogAppenderConfig, std::string> {
+public:
+    std::string operator()(const LogAppenderConfig& from) {
+        std::stringstream to;
+        to << LogAppenderConfigToYaml(from);
+        return to.str();
+    }
+};
+
+template<>
+class StdYamlCast<std::string, LoggerConfig> {
+public:
+    LoggerConfig operator()(const std::string& from) {
+        return LoggerConfigFromYaml(YAML::Load(from));
+    }
+};
+
+template<>
+class StdYamlCast<LoggerConfig, std::string> {
+public:
+    std::string operator()(const LoggerConfig& from) {
+        std::stringstream to;
+        to << LoggerConfigToYaml(from);
+        return to.str();
+    }
+};
+
+// the loggers as a sequence of maps, not of strings like the generic vector cast
+template<>
+class StdYamlCast<std::vector<LoggerConfig>, std::string> {
+public:
+    std::string operator()(const std::vector<LoggerConfig>& from) {
+        YAML::Node node(YAML::NodeType::Sequence);
+        for (auto& config : from) {
+            node.push_back(LoggerConfigToYaml(config));
+        }
+        std::stringstream to;
+        to << node;
+        return to.str();
+    }
+};
+
+/**
+ * @brief Keeps the loggers in line with the "logs" config variable. A new
+ * value is compared with the previous one logger by logger, only loggers
+ * whose config changed are touched. An appender whose output is unchanged
+ * is kept with its open file and gets the new level or formatter in place,
+ * formatters are shared by pattern. A logger is fully built before it is
+ * registered and its appenders are replaced in one step, so logging threads
+ * see either the old or the new appenders. Loggers registered by the
+ * program get back their own level and appenders once the config drops them.
+ **/
+class LogConfigurator : public Singleton<LogConfigurator> {
+friend class Singleton<LogConfigurator>;
+public:
+    // bring the loggers in line with the configs, called when "logs" changes
+    void Apply(const std::vector<LoggerConfig>& configs);
+private:
+    struct AppenderEntry {
+        LogAppenderConfig config;
+        std::string pattern; // of the formatter in use, the appender or the logger format
+        LogAppender::SharedPtr appender;
+    };
+    struct LoggerEntry {
+        LoggerConfig config;
+        Logger::SharedPtr logger;
+        bool created = false; // registered here, deleted when the config goes
+        // what a logger registered by the program had before
+        LogLevel::Level original_level = LogLevel::Level::UNKNOWN;
+        Formatter::SharedPtr original_formatter;
+        std::vector<LogAppender::SharedPtr> original_appenders;
+        std::vector<AppenderEntry> appenders;
+    };
+    LogConfigurator() {}
+    // build or update the appenders of the entry to the config
+    std::vector<LogAppender::SharedPtr> UpdateAppenders(LoggerEntry& entry, const LoggerConfig& config);
+    // give a logger back the level and appenders it had before
+    void Restore(LoggerEntry& entry);
+    // the formatter of a pattern, parsed once while in use
+    Formatter::SharedPtr GetFormatter(const std::string& pattern);
+
+    std::mutex mutex_; // serializes Apply
+    std::map<std::string, LoggerEntry> loggers_; // by name
+    std::map<std::string, Formatter::SharedPtr> formatters_; // by pattern
+};
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace mysylar {
+
+/**
+ * @brief Argument of the type-safe format, the value with its kind. Every
+ * "{}" in the format takes the next argument, "{{" and "}}" are literal
+ * braces. Specs: "{:x}" and "{:X}" print integers and pointers in hex,
+ * "{:.N}" prints floating points with N digits after the point.
+ **/
+struct FormatArg {
+    enum Kind : uint8_t {
+        NONE = 0, // not formattable
+        BOOL,
+        CHAR,
+        INT64,
+        UINT64,
+        DOUBLE,
+        STRING,
+        POINTER,
+    };
+    template<class T>
+    static constexpr Kind KindOf() {
+        typedef std::decay_t<T> U;
+        if constexpr (std::is_same_v<U, bool>) {
+            return BOOL;
+        } else if constexpr (std::is_same_v<U, char>) {
+            return CHAR;
+        } else if constexpr ((std::is_integral_v<U> && std::is_signed_v<U>) || std::is_enum_v<U>) {
+            return INT64;
+        } else if constexpr (std::is_integral_v<U>) {
+            return UINT64;
+        } else if constexpr (std::is_floating_point_v<U>) {
+            return DOUBLE;
+        } else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>
+            || std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>) {
+            return STRING;
+        } else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>) {
+            return POINTER;
+        } else {
+            return NONE;
+        }
+    }
+
+    FormatArg() : kind(NONE), uint_value(0) {}
+    template<class T>
+    FormatArg(const T& value) : kind(KindOf<T>()) {
+        constexpr auto kind = KindOf<T>();
+        if constexpr (kind == BOOL) {
+            bool_value = value;
+        } else if constexpr (kind == CHAR) {
+            char_value = value;
+        } else if constexpr (kind == INT64) {
+            int_value = static_cast<int64_t>(value);
+        } else if constexpr (kind == UINT64) {
+            uint_value = value;
+        } else if constexpr (kind == DOUBLE) {
+            double_value = value;
+        } else if constexpr (kind == STRING && std::is_array_v<T>) {
+            uint_value = 0;
+            string_value = value;
+        } else if constexpr (kind == STRING && std::is_pointer_v<T>) {
+            uint_value = 0;
+            string_value = value ? std::string_view(value) : std::string_view("(null)");
+        } else if constexpr (kind == STRING) {
+            uint_value = 0;
+            string_value = value;
+        } else if constexpr (kind == POINTER) {
+            pointer_value = value;
+        }
+    }
+
+    Kind kind;
+    union {
+        bool bool_value;
+        char char_value;
+        int64_t int_value;
+        uint64_t uint_value;
+        double double_value;
+        const void* pointer_value;
+    };
+    std::string_view string_value;
+};
+
+/**
+ * @brief Kinds of the arguments of a call, checks the format at compile time
+ **/
+template<class... Args>
+struct FormatArgList {
+    static constexpr size_t kCount = sizeof...(Args);
+    static constexpr FormatArg::Kind kKinds[] = { FormatArg::KindOf<Args>()..., FormatArg::NONE };
+
+    // whether every placeholder matches an argument of a suitable kind and every argument is used
+    static constexpr bool Check(const char* format) {
+        size_t index = 0;
+        for (size_t i = 0; format[i] != '\0'; ++i) {
+            if (format[i] == '}') {
+                if (format[i + 1] != '}') {
+                    return false;
+                }
+                ++i;
+                continue;
+            }
+            if (format[i] != '{') {
+                continue;
+            }
+            if (format[i + 1] == '{') {
+                ++i;
+                continue;
+            }
+            if (index >= kCount || kKinds[index] == FormatArg::NONE) {
+                return false;
+            }
+            auto kind = kKinds[index++];
+            ++i;
+            if (format[i] == '}') {
+                continue;
+            }
+            if (format[i] != ':') {
+                return false;
+            }
+            ++i;
+            if (format[i] == 'x' || format[i] == 'X') {
+                if (kind != FormatArg::INT64 && kind != FormatArg::UINT64 && kind != FormatArg::POINTER) {
+                    return false;
+                }
+                ++i;
+            } else if (format[i] == '.') {
+                if (kind != FormatArg::DOUBLE || format[i + 1] < '0' || format[i + 1] > '9') {
+                    return false;
+                }
+                ++i;
+                while (format[i] >= '0' && format[i] <= '9') {
+                    ++i;
+                }
+            }
+            if (format[i] != '}') {
+                return false;
+            }
+        }
+        return index == kCount;
+    }
+};
+
+// the argument list type of a call, only used in decltype
+template<class... Args>
+FormatArgList<std::decay_t<Args>...> MakeFormatArgList(const Args&...);
+
+}
@@ -0,0 +1,199 @@
+#include "log_index.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace mysylar {
+
+namespace {
+
+const char kIndexMagic[8] = { 'M', 'Y', 'S', 'Y', 'L', 'I', 'D', 'X' };
+const uint32_t kIndexVersion = 1;
+const uint32_t kMaxPatternSize = 64 << 10;
+
+// followed by the pattern, then the blocks
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t interval;
+    uint32_t pattern_size;
+    uint32_t reserved;
+};
+
+// FNV-1a
+uint64_t HashName(std::string_view name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char ch : name) {
+        hash = (hash ^ ch) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// the two bits of a name in LogIndexBlock::loggers
+void LoggerBits(std::string_view name, size_t (&bits)[2]) {
+    auto hash = HashName(name);
+    bits[0] = hash % LogIndexBlock::kLoggerBits;
+    bits[1] = hash / LogIndexBlock::kLoggerBits % LogIndexBlock::kLoggerBits;
+}
+
+bool WriteAll(int fd, const void* data, size_t size) {
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        auto written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        size -= written;
+    }
+    return true;
+}
+
+}
+
+bool LogIndexBlock::MayHaveLogger(std::string_view name) const {
+    size_t bits[2];
+    LoggerBits(name, bits);
+    for (auto bit : bits) {
+        if (!(loggers[bit / 64] & (1ULL << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LogIndexBlock::AddLogger(std::string_view name) {
+    while (true) {
+        size_t bits[2];
+        LoggerBits(name, bits);
+        for (auto bit : bits) {
+            loggers[bit / 64] |= 1ULL << (bit % 64);
+        }
+        auto dot = name.rfind('.');
+        if (dot == std::string_view::npos) {
+            break;
+        }
+        name = name.substr(0, dot);
+    }
+}
+
+LogIndexWriter::LogIndexWriter(const std::string& path, uint32_t interval) :
+    path_(path),
+    interval_(std::max<uint32_t>(interval, 1024)) {
+
+}
+
+bool LogIndexWriter::Open(uint64_t file_size, const std::string& pattern) {
+    Close();
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ == -1) {
+        std::cerr << "open log index " << path_ << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    pattern_ = pattern;
+    // the blocks of the previous run still describe the file
+    LogIndexReader reader;
+    if (file_size > 0 && reader.Open(path_) && reader.GetPattern() == pattern
+        && (reader.GetBlocks().empty()
+            || reader.GetBlocks().back().offset + reader.GetBlocks().back().size <= file_size)) {
+        if (ftruncate(fd_, reader.GetValidSize()) == 0 && lseek(fd_, 0, SEEK_END) != -1) {
+            return true;
+        }
+    }
+    IndexHeader header = {};
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.interval = interval_;
+    header.pattern_size = pattern.size();
+    if (ftruncate(fd_, 0) != 0 || !WriteAll(fd_, &header, sizeof(header))
+        || !WriteAll(fd_, pattern.data(), pattern.size())) {
+        std::cerr << "write log index " << path_ << " failed: " << strerror(errno) << std::endl;
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void LogIndexWriter::Close() {
+    if (fd_ == -1) {
+        return;
+    }
+    FinishBlock();
+    Flush();
+    close(fd_);
+    fd_ = -1;
+}
+
+void LogIndexWriter::Add(uint64_t offset, uint64_t size, time_t time,
+    LogLevel::Level level, const std::string& logger_name) {
+    if (block_.records > 0 && offset - block_.offset >= interval_) {
+        FinishBlock();
+    }
+    if (block_.records == 0) {
+        block_.offset = offset;
+        block_.min_time = block_.max_time = time;
+    }
+    block_.size = offset + size - block_.offset;
+    block_.min_time = std::min<int64_t>(block_.min_time, time);
+    block_.max_time = std::max<int64_t>(block_.max_time, time);
+    ++block_.records;
+    block_.levels |= 1u << level;
+    // the name is hashed once per block while the same logger keeps writing; compared by
+    // content, a logger freed on reconfiguration may leave its address to another
+    if (last_logger_.empty() || logger_name != last_logger_) {
+        block_.AddLogger(logger_name);
+        last_logger_ = logger_name;
+    }
+}
+
+void LogIndexWriter::Flush() {
+    if (fd_ == -1 || finished_.empty()) {
+        return;
+    }
+    if (!WriteAll(fd_, finished_.data(), finished_.size() * sizeof(LogIndexBlock))) {
+        std::cerr << "write log index " << path_ << " failed: " << strerror(errno) << std::endl;
+    }
+    finished_.clear();
+}
+
+void LogIndexWriter::FinishBlock() {
+    if (block_.records == 0) {
+        return;
+    }
+    finished_.push_back(block_);
+    block_ = LogIndexBlock();
+    last_logger_.clear();
+}
+
+bool LogIndexReader::Open(const std::string& path) {
+    pattern_.clear();
+    blocks_.clear();
+    std::ifstream file(path, std::ios::binary);
+    IndexHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || header.version != kIndexVersion
+        || header.pattern_size > kMaxPatternSize) {
+        return false;
+    }
+    interval_ = header.interval;
+    pattern_.resize(header.pattern_size);
+    if (!file.read(&pattern_[0], pattern_.size())) {
+        return false;
+    }
+    LogIndexBlock block;
+    while (file.read(reinterpret_cast<char*>(&block), sizeof(block))) {
+        blocks_.push_back(block);
+    }
+    return true;
+}
+
+uint64_t LogIndexReader::GetValidSize() const {
+    return sizeof(IndexHeader) + pattern_.size() + blocks_.size() * sizeof(LogIndexBlock);
+}
+
+}
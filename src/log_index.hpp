@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "logger.hpp"
+
+namespace mysylar {
+
+/**
+ * @brief Summary of a run of records in a log file, about `interval` bytes.
+ * Blocks start at a record, so a reader can begin at any block and skip the
+ * blocks whose time range, levels or loggers can't match.
+ **/
+struct LogIndexBlock {
+    static const size_t kLoggerBits = 192;
+    uint64_t offset = 0; // of the first record in the log file
+    uint64_t size = 0; // bytes of the records
+    int64_t min_time = 0; // event seconds, records are not strictly in time order
+    int64_t max_time = 0;
+    uint32_t records = 0;
+    uint32_t levels = 0; // bit 1 << level of every level present
+    uint64_t loggers[kLoggerBits / 64] = {0}; // bloom filter of the logger names and their parents
+
+    // whether a record of `level` or above may be in the block
+    bool HasLevel(LogLevel::Level level) const { return (levels >> level) != 0; }
+    // whether a record of the logger or one of its children may be in the block
+    bool MayHaveLogger(std::string_view name) const;
+    // add the name with its parents, "a.b.c" also adds "a.b" and "a"
+    void AddLogger(std::string_view name);
+};
+
+/**
+ * @brief Writes the sparse index of a log file next to it, "<file>.idx": a
+ * header with the formatter pattern of the records, then one LogIndexBlock
+ * per block. Blocks are written once the records of the next block start,
+ * the tail of a live file is left to the reader to scan. An index of another
+ * pattern or of a file since truncated is started over.
+ **/
+class LogIndexWriter {
+public:
+    LogIndexWriter(const std::string& path, uint32_t interval);
+    ~LogIndexWriter() { Close(); }
+    // start indexing a log file of `file_size` bytes, keeping the blocks already there
+    bool Open(uint64_t file_size, const std::string& pattern);
+    // write out the index including the open block
+    void Close();
+    bool IsOpen() const { return fd_ != -1; }
+    const std::string& GetPath() const { return path_; }
+    const std::string& GetPattern() const { return pattern_; }
+    // the record of `size` bytes at `offset`, records come in file order
+    void Add(uint64_t offset, uint64_t size, time_t time, LogLevel::Level level, const std::string& logger_name);
+    // write the finished blocks, once their records are in the log file
+    void Flush();
+private:
+    void FinishBlock();
+
+    const std::string path_;
+    const uint32_t interval_;
+    int fd_ = -1;
+    std::string pattern_;
+    LogIndexBlock block_; // open block, empty while records is 0
+    std::string last_logger_; // already in block_
+    std::vector<LogIndexBlock> finished_;
+};
+
+/**
+ * @brief Reads an index written by LogIndexWriter
+ **/
+class LogIndexReader {
+public:
+    // false if the file is missing or not an index
+    bool Open(const std::string& path);
+    const std::string& GetPattern() const { return pattern_; }
+    uint32_t GetInterval() const { return interval_; }
+    // in file order, a torn last block is left out
+    const std::vector<LogIndexBlock>& GetBlocks() const { return blocks_; }
+    // bytes of the header and the whole blocks
+    uint64_t GetValidSize() const;
+private:
+    std::string pattern_;
+    uint32_t interval_ = 0;
+    std::vector<LogIndexBlock> blocks_;
+};
+
+}
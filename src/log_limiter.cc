@@ -0,0 +1,110 @@
+#include "log_limiter.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mysylar {
+
+/**
+ * @brief One thread logging the counts of the limiters whose window closed
+ * without a message let through. A limiter is handed over by the first call
+ * it suppresses in a window and kept from then on, limiters are statics.
+ **/
+class LogLimitReporter {
+public:
+    static void Add(LogLimiter* limiter, const LogLimiter::Site& site) {
+        if (s_gone.load(std::memory_order_acquire)) {
+            return; // exiting
+        }
+        GetInstance().Wake(limiter, site);
+    }
+    ~LogLimitReporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        s_gone.store(true, std::memory_order_release);
+    }
+private:
+    static LogLimitReporter& GetInstance() {
+        static LogLimitReporter s_instance;
+        return s_instance;
+    }
+    void Wake(LogLimiter* limiter, const LogLimiter::Site& site) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!limiter->registered_) {
+                limiter->handle_ = &site.handle;
+                limiter->level_ = site.level;
+                limiter->file_ = site.file;
+                limiter->line_ = site.line;
+                limiter->registered_ = true;
+                limiters_.push_back(limiter);
+            }
+            woken_ = true;
+            if (!thread_.joinable()) {
+                thread_ = std::thread([this]() { Run(); });
+            }
+        }
+        cond_.notify_one(); // its window may close before the current wait ends
+    }
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            woken_ = false;
+            auto limiters = limiters_;
+            lock.unlock();
+            auto now = GetCoarseMonotonicNs();
+            uint64_t next = UINT64_MAX;
+            for (auto limiter : limiters) {
+                if (limiter->suppressed_.load(std::memory_order_relaxed) == 0) {
+                    continue;
+                }
+                auto end = limiter->GetWindowEndNs();
+                if (now < end) {
+                    next = std::min(next, end);
+                } else if (auto suppressed = limiter->TakeSuppressed()) {
+                    limiter->Report(suppressed);
+                }
+            }
+            lock.lock();
+            if (next == UINT64_MAX) {
+                cond_.wait(lock, [this]() { return stop_ || woken_; });
+            } else {
+                // the coarse clock ticks every few ms, don't spin until it does
+                auto wait = std::max<uint64_t>(next - now, 1000000);
+                cond_.wait_for(lock, std::chrono::nanoseconds(wait), [this]() { return stop_ || woken_; });
+            }
+        }
+    }
+
+    static std::atomic<bool> s_gone;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<LogLimiter*> limiters_;
+    bool woken_ = false; // since the last round
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+std::atomic<bool> LogLimitReporter::s_gone{false};
+
+void LogLimiter::Pending(const Site& site) {
+    pending_since_ns_.store(GetCoarseMonotonicNs(), std::memory_order_relaxed);
+    LogLimitReporter::Add(this, site);
+}
+
+void LogLimiter::Report(uint64_t suppressed) {
+    if (handle_->IsCaptured(level_)) {
+        LogEventWrap(file_, line_, handle_->GetLogger(), level_).GetStringStream()
+            << "[suppressed " << suppressed << " messages]";
+    }
+}
+
+}
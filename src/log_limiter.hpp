@@ -0,0 +1,238 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "logger.hpp"
+
+/**
+ * Rate limited variants of LLOG/FLLOG. Each call site keeps its own state in
+ * a static, checked after the level and before any event is built, so a
+ * suppressed call costs an atomic operation or two. Events the flight
+ * recorder keeps are limited the same way. The number of messages suppressed
+ * is reported at the start of the next message that gets through, or by a
+ * shared background thread as a "[suppressed N messages]" event of the call
+ * site once the window closes without one: at the end of the period, when the
+ * bucket has a token again, and LogLimiter::kQuietNs after the first call
+ * suppressed for the count-based limiters.
+ **/
+// the limiter of the call site, used inside MYSYLAR_*LOG_LIMITED only
+#define MYSYLAR_LOG_LIMITER(type, ...) \
+    []() -> type& { \
+        static type mysylar_limiter; \
+        return mysylar_limiter; \
+    }().Allow(mysylar_site, __VA_ARGS__)
+
+#define MYSYLAR_LLOG_LIMITED(logger_name, event_level, limiter) \
+    if ((event_level) < MYSYLAR_MIN_LOG_LEVEL) {} \
+    else if (mysylar::LogLimiter::Site mysylar_site{MYSYLAR_LOGGER_HANDLE(logger_name), event_level, \
+        __FILE__, __LINE__}; !mysylar_site.handle.IsCaptured(event_level)) {} \
+    else if (uint64_t mysylar_suppressed = limiter; mysylar_suppressed == mysylar::LogLimiter::kDeny) {} \
+    else mysylar::LogLimiter::Prefix(mysylar::LogEventWrap(__FILE__, __LINE__, \
+        mysylar_site.handle.GetLogger(), event_level).GetStringStream(), mysylar_suppressed)
+
+#define MYSYLAR_FLLOG_LIMITED(logger_name, event_level, limiter, format, ...) \
+    if ((event_level) < MYSYLAR_MIN_LOG_LEVEL) {} \
+    else if (mysylar::LogLimiter::Site mysylar_site{MYSYLAR_LOGGER_HANDLE(logger_name), event_level, \
+        __FILE__, __LINE__}; !mysylar_site.handle.IsCaptured(event_level)) {} \
+    else if (uint64_t mysylar_suppressed = limiter; mysylar_suppressed == mysylar::LogLimiter::kDeny) {} \
+    else mysylar::LogLimiter::Prefix(mysylar::LogEventWrap(__FILE__, __LINE__, \
+        mysylar_site.handle.GetLogger(), event_level).GetEvent(), mysylar_suppressed).Format(format, __VA_ARGS__)
+
+// log the 1st, (n+1)th, (2n+1)th... call
+#define LLOG_EVERY_N(logger_name, event_level, n) MYSYLAR_LLOG_LIMITED(logger_name, event_level, \
+    MYSYLAR_LOG_LIMITER(mysylar::LogEveryN, n))
+// log the first n calls only
+#define LLOG_FIRST_N(logger_name, event_level, n) MYSYLAR_LLOG_LIMITED(logger_name, event_level, \
+    MYSYLAR_LOG_LIMITER(mysylar::LogFirstN, n))
+// log at most once per `ms` milliseconds
+#define LLOG_EVERY_MS(logger_name, event_level, ms) MYSYLAR_LLOG_LIMITED(logger_name, event_level, \
+    MYSYLAR_LOG_LIMITER(mysylar::LogEveryMs, ms))
+// log at most `per_second` calls a second on average, in bursts of up to `burst`
+#define LLOG_RATE_LIMITED(logger_name, event_level, per_second, burst) MYSYLAR_LLOG_LIMITED( \
+    logger_name, event_level, MYSYLAR_LOG_LIMITER(mysylar::LogTokenBucket, per_second, burst))
+
+#define FLLOG_EVERY_N(logger_name, event_level, n, format, ...) MYSYLAR_FLLOG_LIMITED(logger_name, \
+    event_level, MYSYLAR_LOG_LIMITER(mysylar::LogEveryN, n), format, __VA_ARGS__)
+#define FLLOG_FIRST_N(logger_name, event_level, n, format, ...) MYSYLAR_FLLOG_LIMITED(logger_name, \
+    event_level, MYSYLAR_LOG_LIMITER(mysylar::LogFirstN, n), format, __VA_ARGS__)
+#define FLLOG_EVERY_MS(logger_name, event_level, ms, format, ...) MYSYLAR_FLLOG_LIMITED(logger_name, \
+    event_level, MYSYLAR_LOG_LIMITER(mysylar::LogEveryMs, ms), format, __VA_ARGS__)
+#define FLLOG_RATE_LIMITED(logger_name, event_level, per_second, burst, format, ...) MYSYLAR_FLLOG_LIMITED( \
+    logger_name, event_level, MYSYLAR_LOG_LIMITER(mysylar::LogTokenBucket, per_second, burst), \
+    format, __VA_ARGS__)
+
+namespace mysylar {
+
+class LogLimitReporter;
+
+/**
+ * @brief State shared by the limiters: the calls suppressed and not reported
+ * yet, and the call site the background reporter logs them at
+ **/
+class LogLimiter {
+friend class LogLimitReporter;
+public:
+    // the call site of a limiter
+    struct Site {
+        const LoggerHandle& handle;
+        LogLevel::Level level;
+        const char* file;
+        uint32_t line;
+    };
+    // returned by Allow when the call is suppressed
+    static constexpr uint64_t kDeny = UINT64_MAX;
+    // how long the count-based limiters wait for a message to take their count
+    static constexpr uint64_t kQuietNs = 1000000000;
+    // write the suppressed count ahead of the message
+    static std::ostream& Prefix(std::ostream& os, uint64_t suppressed) {
+        if (suppressed > 0) {
+            os << "[suppressed " << suppressed << " messages] ";
+        }
+        return os;
+    }
+    static LogEvent& Prefix(LogEvent& event, uint64_t suppressed) {
+        Prefix(event.GetStringStream(), suppressed);
+        return event;
+    }
+    virtual ~LogLimiter() {}
+protected:
+    // count a suppressed call, the first of a window is handed to the reporter
+    void Suppress(const Site& site) {
+        if (suppressed_.fetch_add(1, std::memory_order_relaxed) == 0) {
+            Pending(site);
+        }
+    }
+    // the calls suppressed since the last report
+    uint64_t TakeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+    // when the first call of the pending ones was suppressed, GetCoarseMonotonicNs time
+    uint64_t GetPendingSinceNs() const { return pending_since_ns_.load(std::memory_order_relaxed); }
+    // when the window of the pending calls closes, GetCoarseMonotonicNs time
+    virtual uint64_t GetWindowEndNs() const = 0;
+private:
+    void Pending(const Site& site);
+    // log the summary at the call site, reporter thread only
+    void Report(uint64_t suppressed);
+
+    std::atomic<uint64_t> suppressed_{0};
+    std::atomic<uint64_t> pending_since_ns_{0};
+    // the call site, set once under the reporter's lock
+    const LoggerHandle* handle_ = nullptr;
+    LogLevel::Level level_ = LogLevel::Level::UNKNOWN;
+    const char* file_ = nullptr;
+    uint32_t line_ = 0;
+    bool registered_ = false;
+};
+
+/**
+ * @brief Lets through one call in n
+ **/
+class LogEveryN : public LogLimiter {
+public:
+    // the number of calls suppressed since the last report, or LogLimiter::kDeny
+    uint64_t Allow(const Site& site, uint64_t n) {
+        auto count = count_.fetch_add(1, std::memory_order_relaxed);
+        if (n <= 1 || count % n == 0) {
+            return TakeSuppressed();
+        }
+        Suppress(site);
+        return kDeny;
+    }
+protected:
+    uint64_t GetWindowEndNs() const override { return GetPendingSinceNs() + kQuietNs; }
+private:
+    std::atomic<uint64_t> count_{0};
+};
+
+/**
+ * @brief Lets through the first n calls, what it drops is reported by the
+ * background reporter only
+ **/
+class LogFirstN : public LogLimiter {
+public:
+    uint64_t Allow(const Site& site, uint64_t n) {
+        // stop counting once closed, the counter is only read from then on
+        if (count_.load(std::memory_order_relaxed) >= n || count_.fetch_add(1, std::memory_order_relaxed) >= n) {
+            Suppress(site);
+            return kDeny;
+        }
+        return 0;
+    }
+protected:
+    uint64_t GetWindowEndNs() const override { return GetPendingSinceNs() + kQuietNs; }
+private:
+    std::atomic<uint64_t> count_{0};
+};
+
+/**
+ * @brief Lets through one call per period
+ **/
+class LogEveryMs : public LogLimiter {
+public:
+    uint64_t Allow(const Site& site, uint64_t ms) {
+        auto now = GetCoarseMonotonicNs();
+        auto next = next_ns_.load(std::memory_order_relaxed);
+        if (now < next || !next_ns_.compare_exchange_strong(next, now + ms * 1000000, std::memory_order_relaxed)) {
+            Suppress(site);
+            return kDeny;
+        }
+        return TakeSuppressed();
+    }
+protected:
+    uint64_t GetWindowEndNs() const override { return next_ns_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> next_ns_{0};
+};
+
+/**
+ * @brief Token bucket of `burst` tokens refilled at `per_second`, kept as
+ * the time the bucket would be full again (GCRA) so a call is a single CAS.
+ * A rate that is not positive lets nothing through.
+ **/
+class LogTokenBucket : public LogLimiter {
+public:
+    uint64_t Allow(const Site& site, double per_second, uint64_t burst) {
+        if (!(per_second > 0) || burst == 0) {
+            Deny(site, kNoToken);
+            return kDeny;
+        }
+        // 1ns to ~30 years a token, the window of the whole bucket stays below 2^63
+        auto interval = static_cast<uint64_t>(std::clamp(1e9 / per_second, 1.0, 1e18));
+        burst = std::min<uint64_t>(burst, static_cast<uint64_t>(1e18) / interval + 1);
+        auto now = GetCoarseMonotonicNs();
+        auto full_at = full_at_ns_.load(std::memory_order_relaxed);
+        while (true) {
+            auto next = (full_at > now ? full_at : now) + interval;
+            if (next - now > burst * interval) {
+                Deny(site, (burst - 1) * interval);
+                return kDeny;
+            }
+            if (full_at_ns_.compare_exchange_weak(full_at, next, std::memory_order_relaxed)) {
+                return TakeSuppressed();
+            }
+        }
+    }
+protected:
+    uint64_t GetWindowEndNs() const override {
+        auto token_wait = token_wait_ns_.load(std::memory_order_relaxed);
+        if (token_wait == kNoToken) {
+            return GetPendingSinceNs() + kQuietNs;
+        }
+        auto full_at = full_at_ns_.load(std::memory_order_relaxed);
+        return full_at > token_wait ? full_at - token_wait : 0;
+    }
+private:
+    static constexpr uint64_t kNoToken = UINT64_MAX;
+    // `token_wait`: how long before the bucket is full a token is there again
+    void Deny(const Site& site, uint64_t token_wait) {
+        if (token_wait_ns_.load(std::memory_order_relaxed) != token_wait) {
+            token_wait_ns_.store(token_wait, std::memory_order_relaxed);
+        }
+        Suppress(site);
+    }
+
+    std::atomic<uint64_t> full_at_ns_{0};
+    std::atomic<uint64_t> token_wait_ns_{kNoToken};
+};
+
+}
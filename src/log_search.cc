@@ -0,0 +1,241 @@
+#include "log_search.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace mysylar {
+
+namespace {
+
+size_t FindTextTail(const char* data, size_t size, size_t from, std::string_view needle) {
+    auto found = memmem(data + from, size - from, needle.data(), needle.size());
+    return found ? static_cast<const char*>(found) - data : std::string_view::npos;
+}
+
+#if defined(__x86_64__)
+// Positions whose first and last bytes match the needle are found a vector at
+// a time, only those are compared in full. Needles of 2 bytes and more.
+size_t FindTextSse2(const char* data, size_t size, std::string_view needle) {
+    auto last_offset = needle.size() - 1;
+    auto first = _mm_set1_epi8(needle.front());
+    auto last = _mm_set1_epi8(needle.back());
+    size_t i = 0;
+    for (; i + last_offset + 16 <= size; i += 16) {
+        auto block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last_offset));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        for (; mask != 0; mask &= mask - 1) {
+            auto pos = i + __builtin_ctz(mask);
+            if (memcmp(data + pos + 1, needle.data() + 1, last_offset - 1) == 0) {
+                return pos;
+            }
+        }
+    }
+    return FindTextTail(data, size, i, needle);
+}
+
+__attribute__((target("avx2")))
+size_t FindTextAvx2(const char* data, size_t size, std::string_view needle) {
+    auto last_offset = needle.size() - 1;
+    auto first = _mm256_set1_epi8(needle.front());
+    auto last = _mm256_set1_epi8(needle.back());
+    size_t i = 0;
+    for (; i + last_offset + 32 <= size; i += 32) {
+        auto block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + last_offset));
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        for (; mask != 0; mask &= mask - 1) {
+            auto pos = i + __builtin_ctz(mask);
+            if (memcmp(data + pos + 1, needle.data() + 1, last_offset - 1) == 0) {
+                return pos;
+            }
+        }
+    }
+    return FindTextTail(data, size, i, needle);
+}
+#endif
+
+const char* LineEnd(const char* p, const char* end) {
+    auto newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+bool HasRecordFilter(const LogQuery& query) {
+    return query.level > LogLevel::Level::DEBUG || !query.logger.empty()
+        || query.from != LLONG_MIN || query.to != LLONG_MAX;
+}
+
+// fields the pattern doesn't have pass, they were checked on the block
+bool IsMatch(const LogQuery& query, const LogRecordHeader& header, bool parsed) {
+    if (!parsed) {
+        return !HasRecordFilter(query);
+    }
+    if (header.level != LogLevel::Level::UNKNOWN && header.level < query.level) {
+        return false;
+    }
+    if (header.time != -1 && (header.time < query.from || header.time > query.to)) {
+        return false;
+    }
+    if (!query.logger.empty() && !header.logger_name.empty()) {
+        auto& name = header.logger_name;
+        return name.size() >= query.logger.size()
+            && name.compare(0, query.logger.size(), query.logger) == 0
+            && (name.size() == query.logger.size() || name[query.logger.size()] == '.');
+    }
+    return true;
+}
+
+}
+
+size_t FindText(const char* data, size_t size, std::string_view needle) {
+    if (needle.empty()) {
+        return 0;
+    }
+    if (size < needle.size()) {
+        return std::string_view::npos;
+    }
+    if (needle.size() == 1) {
+        auto found = memchr(data, needle.front(), size);
+        return found ? static_cast<const char*>(found) - data : std::string_view::npos;
+    }
+#if defined(__x86_64__)
+    static const bool s_avx2 = __builtin_cpu_supports("avx2");
+    return s_avx2 ? FindTextAvx2(data, size, needle) : FindTextSse2(data, size, needle);
+#else
+    return FindTextTail(data, size, 0, needle);
+#endif
+}
+
+bool LogSearcher::Open(const std::string& path, const std::string& pattern) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        data_ = static_cast<const char*>(data);
+        size_ = st.st_size;
+    }
+    close(fd);
+    has_index_ = index_.Open(path + ".idx");
+    auto& use_pattern = !pattern.empty() || !has_index_ ? pattern : index_.GetPattern();
+    formatter_ = use_pattern.empty() ? std::make_shared<Formatter>() : Formatter::Create(use_pattern);
+    return true;
+}
+
+void LogSearcher::Close() {
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    has_index_ = false;
+}
+
+void LogSearcher::Search(const LogQuery& query, const Callback& callback, LogSearchStats* stats) const {
+    LogSearchStats local_stats;
+    auto& counts = stats ? *stats : local_stats;
+    uint64_t pos = 0;
+    if (has_index_) {
+        for (auto& block : index_.GetBlocks()) {
+            ++counts.blocks;
+            // blocks past the end describe a file since truncated
+            if (block.offset < pos || block.offset + block.size > size_) {
+                continue;
+            }
+            // records the index doesn't cover are read in full
+            SearchRange(query, data_ + pos, data_ + block.offset, callback, counts);
+            if (!block.HasLevel(query.level) || block.max_time < query.from || block.min_time > query.to
+                || (!query.logger.empty() && !block.MayHaveLogger(query.logger))) {
+                ++counts.skipped_blocks;
+                counts.skipped_bytes += block.size;
+            } else {
+                SearchRange(query, data_ + block.offset, data_ + block.offset + block.size, callback, counts);
+            }
+            pos = block.offset + block.size;
+        }
+    }
+    SearchRange(query, data_ + pos, data_ + size_, callback, counts);
+}
+
+void LogSearcher::SearchRange(const LogQuery& query, const char* begin, const char* end,
+    const Callback& callback, LogSearchStats& stats) const {
+    if (begin >= end) {
+        return;
+    }
+    stats.scanned_bytes += end - begin;
+    LogRecordHeader header;
+    LogRecordHeader next;
+    if (!query.text.empty()) {
+        // from match to match, the records in between are never parsed
+        for (auto p = begin; p < end;) {
+            auto found = FindText(p, end - p, query.text);
+            if (found == std::string_view::npos) {
+                break;
+            }
+            // back to the first line of the record holding the match
+            auto hit = p + found;
+            auto newline = static_cast<const char*>(memrchr(p, '\n', hit - p));
+            auto record = newline ? newline + 1 : p;
+            bool record_parsed;
+            while (!(record_parsed = ParseLine(record, end, header)) && record > p) {
+                newline = static_cast<const char*>(memrchr(p, '\n', record - 1 - p));
+                record = newline ? newline + 1 : p;
+            }
+            bool next_parsed;
+            p = RecordEnd(record, end, next, next_parsed);
+            if (IsMatch(query, header, record_parsed)) {
+                callback(record, p - record);
+                ++stats.records;
+            }
+        }
+        return;
+    }
+    bool parsed = ParseLine(begin, end, header);
+    for (auto p = begin; p < end;) {
+        bool next_parsed;
+        auto record_end = RecordEnd(p, end, next, next_parsed);
+        if (IsMatch(query, header, parsed)) {
+            callback(p, record_end - p);
+            ++stats.records;
+        }
+        p = record_end;
+        header = next;
+        parsed = next_parsed;
+    }
+}
+
+bool LogSearcher::ParseLine(const char* p, const char* end, LogRecordHeader& header) const {
+    auto line_end = LineEnd(p, end);
+    if (line_end > p && line_end[-1] == '\n') {
+        --line_end;
+    }
+    return formatter_->Parse(std::string_view(p, line_end - p), header);
+}
+
+const char* LogSearcher::RecordEnd(const char* p, const char* end, LogRecordHeader& next, bool& next_parsed) const {
+    next_parsed = false;
+    auto line = LineEnd(p, end);
+    while (line < end && !(next_parsed = ParseLine(line, end, next))) {
+        line = LineEnd(line, end);
+    }
+    return line;
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "log_index.hpp"
+
+namespace mysylar {
+
+// position of the first `needle` in the text, npos if there is none; compares
+// the first and last bytes of the needle 16 or 32 positions at a time
+size_t FindText(const char* data, size_t size, std::string_view needle);
+
+// records wanted from a log file
+struct LogQuery {
+    int64_t from = LLONG_MIN; // event seconds, both inclusive
+    int64_t to = LLONG_MAX;
+    LogLevel::Level level = LogLevel::Level::DEBUG; // and above
+    std::string logger; // the logger and its children, empty for all
+    std::string text; // in the record, empty for all
+};
+
+struct LogSearchStats {
+    uint64_t blocks = 0; // in the index
+    uint64_t skipped_blocks = 0; // ruled out by their summary
+    uint64_t scanned_bytes = 0;
+    uint64_t skipped_bytes = 0;
+    uint64_t records = 0; // matched
+};
+
+/**
+ * @brief Searches a log file written by FileLogAppender. The file is mapped,
+ * the blocks of its index that can't match are skipped, the rest is read
+ * record by record. Records are told apart by reading their first line back
+ * with the formatter, lines that don't parse continue the record before.
+ * Without an index, or past its last block, the file is scanned in full.
+ **/
+class LogSearcher {
+public:
+    typedef std::function<void(const char* data, size_t size)> Callback;
+    LogSearcher() {}
+    ~LogSearcher() { Close(); }
+    LogSearcher(const LogSearcher&) = delete;
+    LogSearcher& operator=(const LogSearcher&) = delete;
+    // map the file and read "<path>.idx"; the pattern of the index is used if
+    // `pattern` is empty, the default pattern without index
+    bool Open(const std::string& path, const std::string& pattern = "");
+    void Close();
+    bool HasIndex() const { return has_index_; }
+    const Formatter& GetFormatter() const { return *formatter_; }
+    // call `callback` with every matching record in file order
+    void Search(const LogQuery& query, const Callback& callback, LogSearchStats* stats = nullptr) const;
+private:
+    // records of [begin, end), which starts at a record
+    void SearchRange(const LogQuery& query, const char* begin, const char* end,
+        const Callback& callback, LogSearchStats& stats) const;
+    // read back the line at `p`, false if it continues a record
+    bool ParseLine(const char* p, const char* end, LogRecordHeader& header) const;
+    // end of the record at `p` past its continuation lines, `next` and
+    // `next_parsed` tell about the record following
+    const char* RecordEnd(const char* p, const char* end, LogRecordHeader& next, bool& next_parsed) const;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool has_index_ = false;
+    LogIndexReader index_;
+    Formatter::SharedPtr formatter_;
+};
+
+}
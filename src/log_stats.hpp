@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mysylar {
+
+// shard of the calling thread, threads are spread round robin on first use
+inline size_t CurrentStatsShard() {
+    static std::atomic<size_t> s_next_shard{0};
+    static thread_local const size_t t_shard = s_next_shard.fetch_add(1, std::memory_order_relaxed);
+    return t_shard;
+}
+
+/**
+ * @brief N counters split into shards on cache lines of their own. A thread
+ * always counts into the same shard, so threads logging at the same time
+ * don't bounce lines between cores. Reads add the shards up and may miss
+ * the counts made meanwhile.
+ **/
+template<size_t N>
+class ShardedCounters {
+public:
+    static const size_t kShardCount = 16;
+    void Add(size_t index, uint64_t value = 1) {
+        shards_[CurrentStatsShard() % kShardCount].values[index].fetch_add(value, std::memory_order_relaxed);
+    }
+    // raise the counter to value if it is lower, read it back with Max
+    void UpdateMax(size_t index, uint64_t value) {
+        auto& counter = shards_[CurrentStatsShard() % kShardCount].values[index];
+        auto current = counter.load(std::memory_order_relaxed);
+        while (value > current && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+    uint64_t Sum(size_t index) const {
+        uint64_t sum = 0;
+        for (auto& shard : shards_) {
+            sum += shard.values[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+    uint64_t Max(size_t index) const {
+        uint64_t max = 0;
+        for (auto& shard : shards_) {
+            max = std::max(max, shard.values[index].load(std::memory_order_relaxed));
+        }
+        return max;
+    }
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> values[N] {};
+    };
+    Shard shards_[kShardCount];
+};
+
+// snapshots of the counters, see Logger::GetStats and LoggerManager::GetStats
+struct AppenderStats {
+    std::string name;
+    uint64_t events = 0; // records given to the appender
+    uint64_t filtered = 0; // records below the appender level
+    uint64_t bytes = 0; // written to the output
+    uint64_t flushes = 0; // writes to the output
+    uint64_t drops = 0; // records lost
+    uint64_t queue_high_water = 0; // most records or buffers waiting to be written at once
+    uint64_t time_ns = 0; // spent logging, estimated from one call in LogAppender::kTimeSampleRate
+};
+
+struct LoggerStats {
+    std::string name;
+    uint64_t events[5] = {0}; // logged, by level from DEBUG to FATAL
+    uint64_t filtered = 0; // events that reached the logger below its level
+    std::vector<AppenderStats> appenders; // of the logger itself, not the inherited ones
+};
+
+}
@@ -1,9 +1,22 @@
 #include "logger.hpp"
+#include "async_logger.hpp"
+#include "flight_recorder.hpp"
+#include "gzip_file_appender.hpp"
+#include "json_formatter.hpp"
+#include "log_index.hpp"
 #include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#include <poll.h>
+#include <chrono>
 
 namespace mysylar {
 LogLevel::Level LogLevel::ToLevel(const std::string& level_str) {
-    auto level_str_upper = const_cast<std::string&>(level_str);
+    auto level_str_upper = level_str;
     std::transform(level_str_upper.begin(), level_str_upper.end(), level_str_upper.begin(), ::toupper); 
 #define XX(L) \
     if (#L == level_str_upper) return LogLevel::Level::L;
@@ -16,17 +29,17 @@ LogLevel::Level LogLevel::ToLevel(const std::string& level_str) {
     return LogLevel::Level::UNKNOWN;
 }
 
-const std::string LogLevel::ToString(LogLevel::Level level) {
+const std::string& LogLevel::ToString(LogLevel::Level level) {
     switch (level) {
 #define XX(L) \
-        case LogLevel::Level::L: return std::string(#L);
+        case LogLevel::Level::L: { static const std::string s_name(#L); return s_name; }
         XX(DEBUG)
         XX(INFO)
         XX(WARNING)
         XX(ERROR)
         XX(FATAL)
 #undef XX
-        default: return std::string("UNKNOWN");
+        default: { static const std::string s_unknown("UNKNOWN"); return s_unknown; }
     }
 }
 
@@ -35,38 +48,252 @@ Logger::Logger(const std::string& logger_name, LogLevel::Level level) : logger_n
 }
 
 void Logger::AddAppender(LogAppender::SharedPtr appender) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
     if (!appender->GetFormatter()) {
         appender->SetFormatter(formatter_);
     }
-    log_appenders_.push_back(appender);
+    auto appenders = new AppenderList(*log_appenders_.Read());
+    appenders->push_back(appender);
+    log_appenders_.Update(appenders);
 } 
 
+void Logger::SetAppenders(const std::vector<LogAppender::SharedPtr>& appenders) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    for (auto& appender : appenders) {
+        if (!appender->GetFormatter()) {
+            appender->SetFormatter(formatter_);
+        }
+    }
+    log_appenders_.Update(new AppenderList(appenders));
+}
+
+std::vector<LogAppender::SharedPtr> Logger::GetAppenders() const {
+    Rcu::ReadGuard guard;
+    return *log_appenders_.Read();
+}
+
+void Logger::SetFormatter(Formatter::SharedPtr formatter) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    formatter_ = std::move(formatter);
+}
+
+Formatter::SharedPtr Logger::GetFormatter() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return formatter_;
+}
+
 void Logger::DeleteAppender(LogAppender::SharedPtr appender) {
-    for (auto i = log_appenders_.begin(); i != log_appenders_.end(); ++i) {
-        if (*i == appender) {
-            log_appenders_.erase(i);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto appenders = new AppenderList(*log_appenders_.Read());
+    appenders->erase(std::remove(appenders->begin(), appenders->end(), appender), appenders->end());
+    log_appenders_.Update(appenders);
+}
+
+void Logger::ClearAppenders() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    log_appenders_.Update(new AppenderList());
+}
+
+void Logger::SetLevel(LogLevel::Level level) {
+    level_.store(level, std::memory_order_relaxed);
+    if (auto handle = handle_.load(std::memory_order_acquire)) {
+        LoggerManager::GetInstance().UpdateLevel(handle);
+    }
+}
+
+const Logger::AppenderList* Logger::GetEffectiveAppenders() const {
+    auto appenders = log_appenders_.Read();
+    auto handle = handle_.load(std::memory_order_acquire);
+    for (auto node = handle ? handle->parent_ : nullptr; appenders->empty() && node; node = node->parent_) {
+        appenders = node->binding_.Read()->logger->log_appenders_.Read();
+    }
+    return appenders;
+}
+
+void Logger::Log(LogEvent& event) {
+    auto event_level = event.GetLevel();
+    // a reconfiguration waits for the guard to raise the level before changing the appenders
+    Rcu::ReadGuard guard;
+    if (!IsEnabled(event_level)) {
+        CountFiltered();
+        return;
+    }
+    counters_.Add(event_level - LogLevel::Level::DEBUG);
+    auto self = shared_from_this();
+    for (auto& i : *GetEffectiveAppenders()) {
+        i->Append(self, event_level, event);
+    }
+}
+
+LoggerStats Logger::GetStats() const {
+    LoggerStats stats;
+    stats.name = logger_name_;
+    for (size_t i = 0; i < kFilteredCounter; ++i) {
+        stats.events[i] = counters_.Sum(i);
+    }
+    stats.filtered = counters_.Sum(kFilteredCounter);
+    Rcu::ReadGuard guard;
+    for (auto& i : *log_appenders_.Read()) {
+        stats.appenders.push_back(i->GetStats());
+    }
+    return stats;
+}
+
+void Logger::Flush() {
+    Rcu::ReadGuard guard;
+    for (auto& i : *GetEffectiveAppenders()) {
+        i->Flush();
+    }
+}
+
+void LogStreamBuf::Reset() {
+    if (heap_capacity_ > kMaxKeptHeapSize) {
+        heap_buffer_.reset();
+        heap_capacity_ = 0;
+    }
+    setp(inline_buffer_, inline_buffer_ + kInlineSize);
+}
+
+void LogStreamBuf::Reserve(size_t n) {
+    if (static_cast<size_t>(epptr() - pptr()) >= n) {
+        return;
+    }
+    size_t size = pptr() - pbase();
+    if (pbase() == inline_buffer_ && heap_capacity_ >= size + n) { // reuse the kept heap buffer
+        memcpy(heap_buffer_.get(), inline_buffer_, size);
+    } else {
+        size_t capacity = std::max(size + n, static_cast<size_t>(epptr() - pbase()) * 2);
+        std::unique_ptr<char[]> buffer(new char[capacity]);
+        memcpy(buffer.get(), pbase(), size);
+        heap_buffer_ = std::move(buffer);
+        heap_capacity_ = capacity;
+    }
+    setp(heap_buffer_.get(), heap_buffer_.get() + heap_capacity_);
+    pbump(static_cast<int>(size));
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type ch) {
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return traits_type::not_eof(ch);
+    }
+    Reserve(1);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n) {
+    Reserve(n);
+    memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+}
+
+void LogStreamBuf::VPrintf(const char* format, va_list args) {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    size_t available = epptr() - pptr();
+    int len = vsnprintf(pptr(), available, format, args_copy);
+    va_end(args_copy);
+    if (len < 0) {
+        return;
+    }
+    if (static_cast<size_t>(len) >= available) { // +1 for the terminator vsnprintf writes
+        Reserve(len + 1);
+        vsnprintf(pptr(), epptr() - pptr(), format, args);
+    }
+    pbump(len);
+}
+
+void LogStreamBuf::AppendFormat(const char* format, const FormatArg* args) {
+    auto text = format;
+    auto p = format;
+    for (; *p != '\0'; ++p) {
+        if (*p != '{' && *p != '}') {
+            continue;
+        }
+        Append(text, p - text);
+        if (p[1] == *p) { // "{{" or "}}"
+            Append(p, 1);
+            text = ++p + 1;
+            continue;
+        }
+        // a placeholder, checked at compile time: "{}", "{:x}", "{:X}" or "{:.N}"
+        char spec = 0;
+        int precision = -1;
+        if (*++p == ':') {
+            ++p;
+            if (*p == 'x' || *p == 'X') {
+                spec = *p++;
+            } else if (*p == '.') {
+                for (precision = 0; *++p >= '0' && *p <= '9'; ) {
+                    precision = precision * 10 + (*p - '0');
+                }
+            }
         }
+        AppendArg(*args++, spec, precision);
+        text = p + 1;
     }
+    Append(text, p - text);
 }
 
-void Logger::Log(LogEvent::SharedPtr event) {
-    auto event_level = event->GetLevel();
-    if (event_level >= level_) {
-        for (auto i : log_appenders_) {
-            i->Log(shared_from_this(), event_level, event);
+void LogStreamBuf::AppendArg(const FormatArg& arg, char spec, int precision) {
+    switch (arg.kind) {
+    case FormatArg::BOOL:
+        if (arg.bool_value) {
+            Append("true", 4);
+        } else {
+            Append("false", 5);
         }
+        break;
+    case FormatArg::CHAR:
+        Append(&arg.char_value, 1);
+        break;
+    case FormatArg::INT64:
+    case FormatArg::UINT64:
+    case FormatArg::POINTER: {
+        if (arg.kind == FormatArg::POINTER) {
+            Append("0x", 2);
+            spec = spec ? spec : 'x';
+        }
+        Reserve(24);
+        auto begin = pptr();
+        auto end = arg.kind == FormatArg::INT64
+            ? std::to_chars(begin, begin + 24, arg.int_value, spec ? 16 : 10).ptr
+            : std::to_chars(begin, begin + 24, arg.uint_value, spec ? 16 : 10).ptr;
+        if (spec == 'X') {
+            std::transform(begin, end, begin, ::toupper);
+        }
+        pbump(static_cast<int>(end - begin));
+        break;
+    }
+    case FormatArg::DOUBLE: {
+        // fixed notation of large values is long, retry with the room for any double
+        size_t digits = precision < 0 ? 0 : precision;
+        for (size_t room : { digits + 32, digits + 320 }) {
+            Reserve(room);
+            auto result = precision < 0
+                ? std::to_chars(pptr(), pptr() + room, arg.double_value)
+                : std::to_chars(pptr(), pptr() + room, arg.double_value, std::chars_format::fixed, precision);
+            if (result.ec == std::errc()) {
+                pbump(static_cast<int>(result.ptr - pptr()));
+                break;
+            }
+        }
+        break;
+    }
+    case FormatArg::STRING:
+        Append(arg.string_value.data(), arg.string_value.size());
+        break;
+    case FormatArg::NONE:
+        break;
     }
 }
 
 void LogEvent::Format(const char* format, ...) {
     va_list valist;
     va_start(valist, format);
-    char* buf = nullptr;
-    int len = vasprintf(&buf, format, valist);
-    if(len != -1) {
-        content_ss_ << std::string(buf, len);
-        free(buf);
-    }
+    content_buf_.VPrintf(format, valist);
     va_end(valist);
 }
 
@@ -80,202 +307,1050 @@ LogEvent::LogEvent(
     const uint32_t& fiber_id,
     std::shared_ptr<Logger> logger,
     LogLevel::Level level) :
-    file_name_(file_name), time_(time), elapse_(elapse), 
+    file_name_(file_name), time_ns_(time * 1000000000), elapse_(elapse), 
     line_(line), thread_id_(thread_id),
     thread_name_(thread_name), fiber_id_(fiber_id),
-    logger_(logger), level_(level) {
+    content_os_(*this, &content_buf_), fields_(0), logger_(logger), level_(level) {
+
+}
+
+LogEvent::LogEvent() :
+    file_name_(nullptr), time_ns_(0), elapse_(0), line_(0), thread_id_(0),
+    fiber_id_(0), content_os_(*this, &content_buf_), fields_(0), level_(LogLevel::Level::UNKNOWN) {
+
+}
+
+void LogEvent::Init(
+    const char* file_name, uint64_t time_ns, uint32_t elapse, uint32_t line,
+    uint32_t thread_id, const std::string& thread_name, uint32_t fiber_id,
+    std::shared_ptr<Logger>&& logger, LogLevel::Level level) {
+    file_name_ = file_name;
+    time_ns_ = time_ns;
+    elapse_ = elapse;
+    line_ = line;
+    thread_id_ = thread_id;
+    thread_name_ = thread_name; // reuses the capacity of the previous name
+    fiber_id_ = fiber_id;
+    logger_ = std::move(logger);
+    level_ = level;
+}
+
+void LogEvent::AddField(std::string_view key, LogField::Type type, const void* value, size_t size) {
+    FieldHeader header;
+    header.type = type;
+    header.reserved = 0;
+    header.key_size = std::min<size_t>(key.size(), UINT16_MAX);
+    header.value_size = std::min<size_t>(size, UINT32_MAX);
+    auto data = fields_.Reserve(sizeof(header) + header.key_size + header.value_size);
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), key.data(), header.key_size);
+    memcpy(data + sizeof(header) + header.key_size, value, header.value_size);
+    fields_.Commit(sizeof(header) + header.key_size + header.value_size);
+}
+
+void LogEvent::Reset() {
+    logger_.reset();
+    content_buf_.Reset();
+    fields_.Clear();
+    // undo manipulators like std::hex the last user left behind
+    content_os_.clear();
+    content_os_.flags(std::ios_base::skipws | std::ios_base::dec);
+    content_os_.precision(6);
+    content_os_.width(0);
+    content_os_.fill(' ');
+}
+
+namespace {
+// the pool owned by current thread, abandoned when the thread exits
+struct ThreadEventPool {
+    LogEventPool* pool = nullptr;
+    ~ThreadEventPool() {
+        if (pool) {
+            pool->Abandon();
+            pool = nullptr;
+        }
+    }
+};
+thread_local ThreadEventPool t_event_pool;
+}
+
+LogEvent* LogEventPool::Acquire(
+    const char* file_name, uint64_t time_ns, uint32_t elapse, uint32_t line,
+    uint32_t thread_id, const std::string& thread_name, uint32_t fiber_id,
+    std::shared_ptr<Logger>&& logger, LogLevel::Level level) {
+    if (!t_event_pool.pool) {
+        t_event_pool.pool = new LogEventPool();
+    }
+    auto pool = t_event_pool.pool;
+    auto event = pool->Pop();
+    if (!event) {
+        event = new LogEvent();
+        event->pool_ = pool;
+    }
+    pool->refs_.fetch_add(1, std::memory_order_relaxed);
+    event->Init(file_name, time_ns, elapse, line, thread_id, thread_name, fiber_id, std::move(logger), level);
+    return event;
+}
+
+void LogEventPool::Release(LogEvent* event) {
+    auto pool = event->pool_;
+    if (!pool) {
+        delete event;
+        return;
+    }
+    event->Reset();
+    if (pool == t_event_pool.pool) {
+        pool->PushLocal(event);
+    } else {
+        pool->PushRemote(event);
+    }
+    pool->Unref();
+}
+
+void LogEventPool::Abandon() {
+    while (local_free_) {
+        auto event = local_free_;
+        local_free_ = event->next_free_;
+        delete event;
+    }
+    local_count_ = 0;
+    auto event = remote_free_.exchange(nullptr, std::memory_order_acquire);
+    while (event) {
+        auto next = event->next_free_;
+        delete event;
+        event = next;
+    }
+    Unref();
+}
 
+LogEventPool::~LogEventPool() {
+    // events given back after the owner thread exited
+    auto event = remote_free_.load(std::memory_order_acquire);
+    while (event) {
+        auto next = event->next_free_;
+        delete event;
+        event = next;
+    }
+}
+
+LogEvent* LogEventPool::Pop() {
+    if (!local_free_) { // take everything other threads gave back
+        local_free_ = remote_free_.exchange(nullptr, std::memory_order_acquire);
+        local_count_ = 0;
+        for (auto i = local_free_; i; i = i->next_free_) {
+            ++local_count_;
+        }
+    }
+    if (!local_free_) {
+        return nullptr;
+    }
+    auto event = local_free_;
+    local_free_ = event->next_free_;
+    --local_count_;
+    return event;
+}
+
+void LogEventPool::PushLocal(LogEvent* event) {
+    if (local_count_ >= kMaxCachedEvents) {
+        delete event;
+        return;
+    }
+    event->next_free_ = local_free_;
+    local_free_ = event;
+    ++local_count_;
+}
+
+void LogEventPool::PushRemote(LogEvent* event) {
+    auto head = remote_free_.load(std::memory_order_relaxed);
+    do {
+        event->next_free_ = head;
+    } while (!remote_free_.compare_exchange_weak(head, event,
+        std::memory_order_release, std::memory_order_relaxed));
+}
+
+void LogEventPool::Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+LogEventWrap::LogEventWrap(const char* file_name, uint32_t line,
+    std::shared_ptr<Logger>&& logger, LogLevel::Level level) :
+    event_(nullptr) {
+    auto now = GetCurrentNs();
+    event_ = LogEventPool::Acquire(file_name, now, GetElapsedMs(now), line, GetThreadId(),
+        GetThreadName(), GetFiberId(), std::move(logger), level);
 }
 
 LogEventWrap::~LogEventWrap() {
-    event_->GetLogger()->Log(event_); 
+    auto level = event_->GetLevel();
+    bool fatal = level == LogLevel::Level::FATAL;
+    if (level >= LoggerHandle::GetRecordLevel()) {
+        auto& recorder = FlightRecorder::GetInstance();
+        recorder.Record(*event_);
+        if (fatal) {
+            recorder.Flush();
+        }
+    }
+    // captured for the flight recorder only
+    if (!event_->GetLogger()->IsEnabled(level)) {
+        event_->GetLogger()->CountFiltered();
+        LogEventPool::Release(event_);
+        return;
+    }
+    auto& dispatcher = AsyncLogDispatcher::GetInstance();
+    if (dispatcher.IsRunning()) {
+        dispatcher.Submit(event_); // the dispatcher releases the event
+        if (fatal) {
+            dispatcher.Flush();
+        }
+    } else {
+        auto logger = event_->GetLogger();
+        logger->Log(*event_);
+        if (fatal) {
+            logger->Flush();
+        }
+        LogEventPool::Release(event_);
+    }
 }
 
 Formatter::Formatter(const std::string& pattern) : pattern_(pattern) {
     PatternParse();
 }
 
-void Formatter::Format(
-    std::ostream& os, Logger::SharedPtr logger, 
-    LogLevel::Level level, LogEvent::SharedPtr event) {
-    for (auto& i : format_items_) {
-        i->Format(os, logger, level, event);
+Formatter::SharedPtr Formatter::Create(const std::string& pattern) {
+    if (pattern == "json") {
+        return std::make_shared<JsonFormatter>();
     }
+    return std::make_shared<Formatter>(pattern);
+}
 
+void LogBuffer::Grow(size_t min_capacity) {
+    auto capacity = std::max(min_capacity, capacity_ * 2);
+    std::unique_ptr<char[]> data(new char[capacity]);
+    memcpy(data.get(), data_.get(), size_);
+    data_ = std::move(data);
+    capacity_ = capacity;
 }
 
-FileLogAppender::FileLogAppender(const std::string file_name) : file_name_(file_name) {
-    if (file_stream_.is_open()) {
-        file_stream_.close();
+namespace {
+// formatted time text of the current second
+struct TimeCache {
+    uint64_t formatter_id = 0;
+    uint32_t offset = 0;
+    time_t second = -1;
+    size_t size = 0;
+    char text[64];
+};
+const size_t kTimeCacheSize = 4;
+thread_local TimeCache t_time_caches[kTimeCacheSize];
+
+// append `value` zero padded to `width` digits
+void AppendPadded(LogBuffer& buffer, uint64_t value, int width) {
+    auto begin = buffer.Reserve(width);
+    for (int i = width - 1; i >= 0; --i) {
+        begin[i] = '0' + value % 10;
+        value /= 10;
     }
-    file_stream_.open(file_name_);
+    buffer.Commit(width);
 }
 
-bool FileLogAppender::ReopenFile() {
-    if (file_stream_.is_open()) {
-        file_stream_.close();
+// logfmt leaves a string unquoted unless that would make it ambiguous
+bool NeedsQuotes(std::string_view str) {
+    if (str.empty()) {
+        return true;
+    }
+    for (unsigned char ch : str) {
+        if (ch <= ' ' || ch == '"' || ch == '=' || ch == '\\') {
+            return true;
+        }
     }
-    file_stream_.open(file_name_, std::ios_base::app);
-    return file_stream_.is_open();
+    return false;
 }
 
-void FileLogAppender::Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) {
-    ReopenFile();
-    if (level >= level_) {
-        formatter_->Format(file_stream_, logger, level, event);
+// the seconds of a local time written with `format`, -1 if it doesn't read; the last text is kept
+time_t ParseLocalTime(std::string_view text, const char* format) {
+    static thread_local const char* t_format = nullptr;
+    static thread_local std::string t_text;
+    static thread_local time_t t_time = -1;
+    if (format == t_format && text == t_text) {
+        return t_time;
+    }
+    char buffer[64];
+    if (text.size() >= sizeof(buffer)) {
+        return -1;
+    }
+    memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+    struct tm tm_struct = {};
+    auto parsed_end = strptime(buffer, format, &tm_struct);
+    time_t time = -1;
+    if (parsed_end && *parsed_end == '\0') {
+        tm_struct.tm_isdst = -1;
+        time = mktime(&tm_struct);
+    }
+    t_format = format;
+    t_text.assign(text.data(), text.size());
+    t_time = time;
+    return time;
+}
+
+bool IsDigits(std::string_view text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char ch) { return ch >= '0' && ch <= '9'; });
+}
+}
+
+uint64_t Formatter::NewId() {
+    static std::atomic<uint64_t> s_id{0};
+    return ++s_id;
+}
+
+void Formatter::Format(
+    LogBuffer& buffer, const Logger::SharedPtr& logger,
+    LogLevel::Level level, const LogEvent& event) const {
+    for (auto& i : program_) {
+        switch (i.op) {
+        case Op::STRING:
+            buffer.Append(strings_.data() + i.offset, i.size);
+            break;
+        case Op::CONTENT:
+            buffer.Append(event.GetContent());
+            break;
+        case Op::LEVEL:
+            buffer.Append(LogLevel::ToString(level));
+            break;
+        case Op::ELAPSE:
+            buffer.AppendInteger(event.GetElapse());
+            break;
+        case Op::LOGGER_NAME:
+            buffer.Append(logger->GetName());
+            break;
+        case Op::THREAD_ID:
+            buffer.AppendInteger(event.GetThreadId());
+            break;
+        case Op::TIME: {
+            // the text only changes once a second, keep the last one of each formatter
+            time_t second = event.GetTime();
+            auto& cache = t_time_caches[(id_ * 31 + i.offset) % kTimeCacheSize];
+            if (cache.formatter_id != id_ || cache.offset != i.offset || cache.second != second) {
+                struct tm tm_struct;
+                localtime_r(&second, &tm_struct);
+                cache.size = strftime(cache.text, sizeof(cache.text), strings_.data() + i.offset, &tm_struct);
+                cache.formatter_id = id_;
+                cache.offset = i.offset;
+                cache.second = second;
+            }
+            buffer.Append(cache.text, cache.size);
+            break;
+        }
+        case Op::MILLISECOND:
+            AppendPadded(buffer, event.GetTimeNs() % 1000000000 / 1000000, 3);
+            break;
+        case Op::MICROSECOND:
+            AppendPadded(buffer, event.GetTimeNs() % 1000000000 / 1000, 6);
+            break;
+        case Op::FILE_NAME:
+            buffer.Append(event.GetFileName(), strlen(event.GetFileName()));
+            break;
+        case Op::LINE:
+            buffer.AppendInteger(event.GetLine());
+            break;
+        case Op::FIBER_ID:
+            buffer.AppendInteger(event.GetFiberId());
+            break;
+        case Op::THREAD_NAME:
+            buffer.Append(event.GetThreadName());
+            break;
+        case Op::FIELDS:
+            event.ForEachField([&buffer](const LogField& field) {
+                buffer.Append(' ');
+                buffer.Append(field.key);
+                buffer.Append('=');
+                if (field.type == LogField::Type::STRING && !NeedsQuotes(field.string_value)) {
+                    buffer.Append(field.string_value);
+                } else {
+                    AppendJsonValue(buffer, field);
+                }
+            });
+            break;
+        }
     }
 }
 
+void Formatter::Format(
+    std::ostream& os, const Logger::SharedPtr& logger,
+    LogLevel::Level level, const LogEvent& event) const {
+    static thread_local LogBuffer t_buffer;
+    t_buffer.Clear();
+    Format(t_buffer, logger, level, event);
+    os.write(t_buffer.Data(), t_buffer.Size());
+}
 
-void StdoutLogAppender::Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) {
-    if (level >= level_) {
-        switch (level) {
-        case LogLevel::Level::DEBUG:
-            std::cout << "\033[1;32m"; break;
-        case LogLevel::Level::INFO:
-            std::cout << "\033[1;36m"; break;
-        case LogLevel::Level::WARNING:
-            std::cout << "\033[1;33m"; break;
-        case LogLevel::Level::ERROR:
-            std::cout << "\033[1;31m"; break;
-        case LogLevel::Level::FATAL:
-            std::cout << "\033[1;41m"; break;
+bool Formatter::Parse(std::string_view line, LogRecordHeader& header) const {
+    header = LogRecordHeader();
+    size_t pos = 0;
+    for (size_t n = 0; n < program_.size(); ++n) {
+        auto& i = program_[n];
+        if (i.op == Op::CONTENT) {
+            return true;
+        }
+        if (i.op == Op::STRING) {
+            std::string_view text(strings_.data() + i.offset, i.size);
+            auto newline = text.find('\n');
+            if (line.compare(pos, text.substr(0, newline).size(), text.substr(0, newline)) != 0) {
+                return false;
+            }
+            if (newline != std::string_view::npos) {
+                return true;
+            }
+            pos += text.size();
+            continue;
+        }
+        if (i.op == Op::LEVEL) {
+            auto level = LogLevel::Level::DEBUG;
+            for (; level <= LogLevel::Level::FATAL; level = static_cast<LogLevel::Level>(level + 1)) {
+                auto& name = LogLevel::ToString(level);
+                if (line.compare(pos, name.size(), name) == 0) {
+                    break;
+                }
+            }
+            if (level > LogLevel::Level::FATAL) {
+                return false;
+            }
+            header.level = level;
+            pos += LogLevel::ToString(level).size();
+            continue;
+        }
+        // any other field runs up to the text after it, or to the end
+        size_t end = line.size();
+        if (n + 1 < program_.size() && program_[n + 1].op == Op::STRING) {
+            std::string_view text(strings_.data() + program_[n + 1].offset, program_[n + 1].size);
+            text = text.substr(0, text.find('\n'));
+            end = text.empty() ? line.size() : line.find(text, pos);
+        } else if (n + 1 < program_.size() && program_[n + 1].op != Op::CONTENT) {
+            return false; // two fields in a row can't be told apart
+        }
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        auto field = line.substr(pos, end - pos);
+        switch (i.op) {
+        case Op::LOGGER_NAME:
+            header.logger_name = field;
+            break;
+        case Op::TIME:
+            header.time = ParseLocalTime(field, strings_.data() + i.offset);
+            if (header.time == -1) {
+                return false;
+            }
+            break;
+        case Op::ELAPSE:
+        case Op::THREAD_ID:
+        case Op::MILLISECOND:
+        case Op::MICROSECOND:
+        case Op::LINE:
+        case Op::FIBER_ID:
+            if (!IsDigits(field)) {
+                return false;
+            }
+            break;
         default:
             break;
         }
-        formatter_->Format(std::cout, logger, level, event);
-        std::cout << "\033[0m";
+        pos = end;
     }
+    return true;
 }
 
+LogAppender::SharedPtr LogAppender::Create(const LogAppenderConfig& config) {
+    switch (config.type) {
+    case LogAppenderConfig::Type::STDOUT_APPENDER: {
+        auto appender = std::make_shared<StdoutLogAppender>(
+            config.target == LogAppenderConfig::Target::STDERR_TARGET ? STDERR_FILENO : STDOUT_FILENO,
+            config.non_blocking);
+        appender->SetLevel(config.level);
+        if (!config.format_pattern.empty()) {
+            appender->SetFormatter(Formatter::Create(config.format_pattern));
+        }
+        return appender;
+    }
+    case LogAppenderConfig::Type::FILE_APPENDER:
+        return std::make_shared<FileLogAppender>(config);
+    case LogAppenderConfig::Type::GZIP_FILE_APPENDER:
+        return std::make_shared<GzipFileLogAppender>(config);
+    default:
+        return nullptr;
+    }
+}
 
-class ContentFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    ContentFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetContent();
+void LogAppender::Reconfigure(LogLevel::Level level, Formatter::SharedPtr formatter) {
+    auto old_level = GetLevel();
+    if (level == old_level || formatter == GetFormatter()) {
+        // one store is seen at once
+        SetFormatter(std::move(formatter));
+        SetLevel(level);
+        return;
     }
-};
+    // only what both settings log gets through while the formatter changes;
+    // Logger::Log holds a read guard from the level check to the formatting
+    SetLevel(std::max(level, old_level));
+    Rcu::Synchronize();
+    SetFormatter(std::move(formatter));
+    Rcu::Synchronize();
+    SetLevel(level);
+}
 
-class FileNameFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    FileNameFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetFileName();
+void LogAppender::Append(const Logger::SharedPtr& logger, LogLevel::Level level, LogEvent& event) {
+    if (level < GetLevel()) {
+        counters_.Add(FILTERED);
+        return;
     }
-};
+    counters_.Add(EVENTS);
+    static thread_local uint32_t t_calls = 0;
+    if (++t_calls % kTimeSampleRate != 0) {
+        Log(logger, level, event);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    Log(logger, level, event);
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    counters_.Add(TIME_NS, elapsed.count() * kTimeSampleRate);
+}
 
-class TimeFormatItem : public Formatter::FormatItem {
-public:
-    TimeFormatItem(const std::string& time_format) : time_format_(time_format) {
-        if (time_format.empty()) {
-            time_format_ = "%Y-%m-%d %H:%M:%S";
+AppenderStats LogAppender::GetStats() const {
+    AppenderStats stats;
+    stats.name = GetName();
+    stats.events = counters_.Sum(EVENTS);
+    stats.filtered = counters_.Sum(FILTERED);
+    stats.bytes = counters_.Sum(BYTES);
+    stats.flushes = counters_.Sum(FLUSHES);
+    stats.drops = counters_.Sum(DROPS);
+    stats.queue_high_water = counters_.Max(QUEUE_HIGH_WATER);
+    stats.time_ns = counters_.Sum(TIME_NS);
+    return stats;
+}
+
+static LogAppenderConfig FileAppenderConfig(const std::string& file_name) {
+    LogAppenderConfig config;
+    config.path = file_name;
+    return config;
+}
+
+FileLogAppender::FileLogAppender(const std::string file_name) :
+    FileLogAppender(FileAppenderConfig(file_name)) {
+
+}
+
+FileLogAppender::FileLogAppender(const LogAppenderConfig& config) :
+    file_name_(config.path),
+    buffer_size_(std::max<size_t>(config.buffer_size, 1024)),
+    buffer_(buffer_size_ + 1024),
+    flush_interval_ms_(config.flush_interval_ms),
+    rotate_size_(config.rotate_size),
+    rotate_interval_(config.rotate_interval),
+    max_files_(config.max_files) {
+    level_ = config.level;
+    if (!config.format_pattern.empty()) {
+        formatter_ = Formatter::Create(config.format_pattern);
+    }
+    // offsets of gzip records are not known until compressed
+    if (config.index_interval && config.type != LogAppenderConfig::Type::GZIP_FILE_APPENDER) {
+        index_.reset(new LogIndexWriter(file_name_ + ".idx", config.index_interval));
+    }
+    OpenFile();
+    auto now = time(NULL);
+    next_rotate_time_ = NextRotateTime(now, rotate_interval_);
+    last_flush_ = last_inode_check_ = std::chrono::steady_clock::now();
+}
+
+FileLogAppender::~FileLogAppender() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    WriteOut();
+    CloseFile();
+}
+
+bool FileLogAppender::OpenFile() {
+    fd_ = open(file_name_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ == -1) {
+        std::cerr << "open log file " << file_name_ << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) == 0) {
+        dev_ = st.st_dev;
+        ino_ = st.st_ino;
+        file_size_ = st.st_size;
+    }
+    return true;
+}
+
+void FileLogAppender::CloseFile() {
+    // opened again with the next record
+    if (index_) {
+        index_->Close();
+    }
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+size_t FileLogAppender::WriteFile(const char* data, size_t size) {
+    size_t total = 0;
+    while (fd_ != -1 && size > 0) {
+        auto written = write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // the records are lost, don't block logging on a broken file
         }
+        data += written;
+        size -= written;
+        total += written;
     }
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        struct tm tm_struct;
-        time_t time = event->GetTime();
-        localtime_r(&time, &tm_struct);
-        char buf[64];
-        strftime(buf, sizeof(buf), time_format_.c_str(), &tm_struct);
-        os << buf;
+    if (total > 0) {
+        CountWrite(total);
     }
-private:
-    std::string time_format_;
-};
+    return total;
+}
 
-class ElapseFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    ElapseFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetFileName();
+void FileLogAppender::WriteOut() {
+    file_size_ += WriteFile(buffer_.Data(), buffer_.Size());
+    buffer_.Clear();
+    if (index_) {
+        index_->Flush();
     }
-};
+}
 
-class LineFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    LineFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetLine();
+void FileLogAppender::Rotate(time_t now) {
+    WriteOut();
+    CloseFile();
+    struct tm tm_struct;
+    localtime_r(&now, &tm_struct);
+    char suffix[32];
+    strftime(suffix, sizeof(suffix), ".%Y%m%d%H%M%S", &tm_struct);
+    auto rotated_name = file_name_ + suffix;
+    struct stat st;
+    for (int i = 1; stat(rotated_name.c_str(), &st) == 0; ++i) {
+        rotated_name = file_name_ + suffix + "-" + std::to_string(i);
     }
-};
+    rename(file_name_.c_str(), rotated_name.c_str());
+    if (index_) {
+        rename(index_->GetPath().c_str(), (rotated_name + ".idx").c_str());
+    }
+    OpenFile();
+    RemoveOldFiles();
+    next_rotate_time_ = NextRotateTime(now, rotate_interval_);
+}
 
-class ThreadIdFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    ThreadIdFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetThreadId();
+// whether `suffix` is one Rotate gives: .%Y%m%d%H%M%S, then -N when that was taken
+static bool IsRotatedSuffix(const std::string& suffix) {
+    const size_t stamp = 15;
+    if (suffix.size() < stamp || suffix[0] != '.'
+        || !std::all_of(suffix.begin() + 1, suffix.begin() + stamp, ::isdigit)) {
+        return false;
     }
-};
+    if (suffix.size() == stamp) {
+        return true;
+    }
+    return suffix.size() > stamp + 1 && suffix[stamp] == '-'
+        && std::all_of(suffix.begin() + stamp + 1, suffix.end(), ::isdigit);
+}
 
-class ThreadNameFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    ThreadNameFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetThreadName();
+void FileLogAppender::RemoveOldFiles() {
+    if (max_files_ == 0) {
+        return;
     }
-};
+    namespace fs = std::filesystem;
+    fs::path path(file_name_);
+    auto dir = path.has_parent_path() ? path.parent_path() : fs::path(".");
+    auto prefix = path.filename().string();
+    std::vector<std::pair<fs::file_time_type, fs::path> > rotated_files;
+    std::error_code ec;
+    for (auto& entry : fs::directory_iterator(dir, ec)) {
+        // other files next to it, app.log.err or app.log.bak, aren't ours to delete
+        auto name = entry.path().filename().string();
+        if (entry.is_regular_file(ec) && name.compare(0, prefix.size(), prefix) == 0
+            && IsRotatedSuffix(name.substr(prefix.size()))) {
+            rotated_files.emplace_back(entry.last_write_time(ec), entry.path());
+        }
+    }
+    if (rotated_files.size() <= max_files_) {
+        return;
+    }
+    std::sort(rotated_files.begin(), rotated_files.end());
+    for (size_t i = 0; i < rotated_files.size() - max_files_; ++i) {
+        fs::remove(rotated_files[i].second, ec);
+        fs::remove(rotated_files[i].second.string() + ".idx", ec);
+    }
+}
 
-class FiberIdFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    FiberIdFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << event->GetFiberId();
+bool FileLogAppender::IsFileReplaced() {
+    struct stat st;
+    if (stat(file_name_.c_str(), &st) != 0) {
+        return true;
     }
-};
+    return st.st_ino != ino_ || st.st_dev != dev_;
+}
+
+void FileLogAppender::IndexRecord(uint64_t offset, const Logger& logger,
+    LogLevel::Level level, const LogEvent& event) {
+    // the reader parses records with the pattern of the index, a new one starts it over
+    auto& pattern = formatter_->GetPattern();
+    if ((!index_->IsOpen() || index_->GetPattern() != pattern) && !index_->Open(offset, pattern)) {
+        index_.reset(); // logged by the writer, the file goes on without index
+        return;
+    }
+    index_->Add(offset, file_size_ + buffer_.Size() - offset, event.GetTime(), level, logger.GetName());
+}
+
+time_t FileLogAppender::NextRotateTime(time_t now, int interval) {
+    if (interval == RotateInterval::NONE) {
+        return 0;
+    }
+    struct tm tm_struct;
+    localtime_r(&now, &tm_struct);
+    tm_struct.tm_sec = 0;
+    tm_struct.tm_min = 0;
+    if (interval == RotateInterval::DAILY) {
+        tm_struct.tm_hour = 0;
+        tm_struct.tm_mday += 1;
+    } else {
+        tm_struct.tm_hour += 1;
+    }
+    tm_struct.tm_isdst = -1;
+    return mktime(&tm_struct);
+}
+
+namespace {
 
-class StringFormatItem : public Formatter::FormatItem {
+/**
+ * @brief One thread writing out file appenders that hold records past their
+ * flush interval, Log only flushes when the next record comes. Appenders are
+ * held weakly and flushed without the registry locked, Log registers under
+ * the appender's lock.
+ **/
+class IdleFileFlusher {
 public:
-    StringFormatItem(const std::string& string_content = "") : string_content_(string_content) {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << string_content_;
+    static void Register(std::weak_ptr<LogAppender> appender) {
+        if (s_gone.load(std::memory_order_acquire)) {
+            return; // exiting, the appenders flush when destroyed
+        }
+        GetInstance().Add(std::move(appender));
+    }
+    ~IdleFileFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        s_gone.store(true, std::memory_order_release);
     }
 private:
-    std::string string_content_;
+    static IdleFileFlusher& GetInstance() {
+        static IdleFileFlusher s_instance;
+        return s_instance;
+    }
+    void Add(std::weak_ptr<LogAppender> appender) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            appenders_.push_back(std::move(appender));
+            added_ = true;
+            if (!thread_.joinable()) {
+                thread_ = std::thread([this]() { Run(); });
+            }
+        }
+        cond_.notify_one(); // its interval may end before the current wait
+    }
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            added_ = false;
+            auto appenders = appenders_;
+            lock.unlock();
+            auto now = std::chrono::steady_clock::now();
+            auto next = now + std::chrono::seconds(1);
+            bool expired = false;
+            for (auto& weak : appenders) {
+                if (auto appender = weak.lock()) {
+                    auto due = static_cast<FileLogAppender*>(appender.get())->FlushIfDue(now);
+                    next = std::min(next, std::max(due, now + std::chrono::milliseconds(1)));
+                } else {
+                    expired = true;
+                }
+            }
+            lock.lock();
+            if (expired) {
+                appenders_.erase(std::remove_if(appenders_.begin(), appenders_.end(),
+                    [](const std::weak_ptr<LogAppender>& weak) { return weak.expired(); }), appenders_.end());
+            }
+            cond_.wait_until(lock, next, [this]() { return stop_ || added_; });
+        }
+    }
+
+    static std::atomic<bool> s_gone;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<std::weak_ptr<LogAppender> > appenders_;
+    bool added_ = false; // since the last round
+    bool stop_ = false;
+    std::thread thread_;
 };
 
-class LevelFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    LevelFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << LogLevel::ToString(level);
+std::atomic<bool> IdleFileFlusher::s_gone{false};
+
+}
+
+void FileLogAppender::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    WriteOut();
+    last_flush_ = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point FileLogAppender::FlushIfDue(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto interval = std::chrono::milliseconds(flush_interval_ms_);
+    if (buffer_.Size() == 0) {
+        return now + interval;
     }
-};
+    if (now - last_flush_ < interval) {
+        return last_flush_ + interval;
+    }
+    WriteOut();
+    last_flush_ = now;
+    return now + interval;
+}
 
-class LoggerFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    LoggerFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << logger->GetName();
+void FileLogAppender::Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    // someone moved the file away, e.g. logrotate
+    if (now - last_inode_check_ >= std::chrono::seconds(1)) {
+        last_inode_check_ = now;
+        if (IsFileReplaced()) {
+            WriteOut();
+            CloseFile();
+            OpenFile();
+        }
     }
-};
+    if (rotate_interval_ != RotateInterval::NONE && static_cast<time_t>(event.GetTime()) >= next_rotate_time_) {
+        Rotate(event.GetTime());
+    }
+    auto offset = file_size_ + buffer_.Size();
+    formatter_->Format(buffer_, logger, level, event);
+    if (index_) {
+        IndexRecord(offset, *logger, level, event);
+    }
+    if (rotate_size_ && GetPendingFileSize() >= rotate_size_) {
+        Rotate(event.GetTime());
+        last_flush_ = now;
+    } else if (buffer_.Size() >= buffer_size_
+        || now - last_flush_ >= std::chrono::milliseconds(flush_interval_ms_)) {
+        WriteOut();
+        last_flush_ = now;
+    }
+    // the rest of the buffer is written out by the idle flusher if no record follows;
+    // appenders not owned by a shared_ptr have no weak one and flush with records only
+    if (!flush_registered_) {
+        flush_registered_ = true;
+        auto self = weak_from_this();
+        if (!self.expired()) {
+            IdleFileFlusher::Register(std::move(self));
+        }
+    }
+}
 
-class NewLineFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    NewLineFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << std::endl; 
+
+static const char* LevelColor(LogLevel::Level level) {
+    switch (level) {
+    case LogLevel::Level::DEBUG:
+        return "\033[1;32m";
+    case LogLevel::Level::INFO:
+        return "\033[1;36m";
+    case LogLevel::Level::WARNING:
+        return "\033[1;33m";
+    case LogLevel::Level::ERROR:
+        return "\033[1;31m";
+    case LogLevel::Level::FATAL:
+        return "\033[1;41m";
+    default:
+        return "";
     }
-};
+}
 
-class TabFormatItem : public Formatter::FormatItem {
-public:
-    // In order to use map, `str` never used
-    TabFormatItem(const std::string& str = "") {}
-    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent::SharedPtr event) override {
-        os << "  "; 
+// an fd of our own with O_NONBLOCK, so the flag does not leak to other writers of the stream
+static int OpenNonBlocking(int fd, bool& own_fd) {
+    own_fd = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) { // a reopened file would lose its offset
+        return fd;
     }
-};
+    auto path = "/proc/self/fd/" + std::to_string(fd);
+    int new_fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (new_fd >= 0) {
+        own_fd = true;
+        return new_fd;
+    }
+    // sockets can not be reopened, the flag goes on the shared description
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+StdoutLogAppender::StdoutLogAppender(int fd, bool non_blocking)
+    : fd_(fd), name_(fd == STDERR_FILENO ? "stderr" : "stdout"), colored_(isatty(fd)), non_blocking_(non_blocking) {
+    if (non_blocking_) {
+        fd_ = OpenNonBlocking(fd, own_fd_);
+    }
+}
+
+StdoutLogAppender::~StdoutLogAppender() {
+    Flush();
+    if (own_fd_) {
+        close(fd_);
+    }
+}
+
+void StdoutLogAppender::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cond_.wait(lock, [this] { return !writing_; });
+    if (!pending_records_.empty()) {
+        WriteBatches(lock);
+    }
+}
+
+void StdoutLogAppender::Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) {
+    static thread_local LogBuffer t_buffer;
+    t_buffer.Clear();
+    formatter_->Format(t_buffer, logger, level, event);
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_records_.push_back(Record{static_cast<uint32_t>(pending_.Size()),
+        static_cast<uint32_t>(t_buffer.Size()), level});
+    pending_.Append(t_buffer.Data(), t_buffer.Size());
+    CountQueued(pending_records_.size());
+    // the thread already writing takes this record with its next batch
+    if (!writing_) {
+        WriteBatches(lock);
+    }
+}
+
+void StdoutLogAppender::WriteBatches(std::unique_lock<std::mutex>& lock) {
+    writing_ = true;
+    while (!pending_records_.empty()) {
+        batch_.Swap(pending_);
+        batch_records_.swap(pending_records_);
+        lock.unlock();
+        WriteBatch();
+        batch_.Clear();
+        batch_records_.clear();
+        lock.lock();
+    }
+    writing_ = false;
+    idle_cond_.notify_all();
+}
+
+void StdoutLogAppender::WriteBatch() {
+    static const char kReset[] = "\033[0m";
+    static const char kResetNewLine[] = "\033[0m\n";
+    bool colored = colored_.load(std::memory_order_relaxed);
+    auto dropped = dropped_.load(std::memory_order_relaxed);
+    std::string dropped_notice;
+    if (dropped != reported_dropped_) {
+        dropped_notice = (cut_line_ ? "\n[" : "[") + std::to_string(dropped - reported_dropped_)
+            + " log records dropped, the output was not ready]\n";
+    }
+    // iovecs of a record: color, body without the final newline, reset and newline
+    const size_t per_record = colored ? 3 : 1;
+    // non-blocking mode waits this long in all for a started line to be taken
+    std::chrono::steady_clock::time_point line_deadline;
+    const size_t max_records = IOV_MAX / 3;
+    for (size_t first = 0; first < batch_records_.size(); first += max_records) {
+        auto last = std::min(first + max_records, batch_records_.size());
+        iovecs_.clear();
+        if (!dropped_notice.empty()) {
+            iovecs_.push_back({const_cast<char*>(dropped_notice.data()), dropped_notice.size()});
+        }
+        for (auto i = first; i < last; ++i) {
+            auto& record = batch_records_[i];
+            auto body = const_cast<char*>(batch_.Data()) + record.offset;
+            if (!colored) {
+                iovecs_.push_back({body, record.size});
+                continue;
+            }
+            bool newline = record.size > 0 && body[record.size - 1] == '\n';
+            auto color = LevelColor(record.level);
+            iovecs_.push_back({const_cast<char*>(color), strlen(color)});
+            iovecs_.push_back({body, record.size - newline});
+            iovecs_.push_back(newline ? iovec{const_cast<char*>(kResetNewLine), sizeof(kResetNewLine) - 1}
+                : iovec{const_cast<char*>(kReset), sizeof(kReset) - 1});
+        }
+        size_t skip = dropped_notice.empty() ? 0 : 1; // iovecs before the first record
+        size_t index = 0;
+        bool partial = false; // iovecs_[index] is partly written
+        while (index < iovecs_.size()) {
+            auto count = std::min<size_t>(iovecs_.size() - index, IOV_MAX);
+            auto written = writev(fd_, iovecs_.data() + index, count);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            // half a line is finished unless the reader is stuck for good
+            bool in_line = partial || (index >= skip && (index - skip) % per_record != 0);
+            if (written < 0 && errno == EAGAIN) {
+                struct pollfd pfd = {fd_, POLLOUT, 0};
+                if (!non_blocking_) {
+                    poll(&pfd, 1, 100);
+                    continue;
+                }
+                if (in_line) {
+                    auto now = std::chrono::steady_clock::now();
+                    if (line_deadline == std::chrono::steady_clock::time_point()) {
+                        line_deadline = now + std::chrono::milliseconds(kLineWaitMs);
+                    }
+                    if (now < line_deadline) {
+                        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(line_deadline - now);
+                        poll(&pfd, 1, static_cast<int>(left.count()) + 1);
+                        continue;
+                    }
+                }
+            }
+            if (written < 0) { // drop what is left of the batch
+                size_t done = index > skip ? (index - skip) / per_record : 0;
+                dropped_.fetch_add(batch_records_.size() - first - done, std::memory_order_relaxed);
+                CountDrops(batch_records_.size() - first - done);
+                if (in_line) { // the cut line is ended ahead of the next output
+                    cut_line_ = true;
+                }
+                break;
+            }
+            CountWrite(written);
+            // move past what was written
+            while (written > 0 && index < iovecs_.size()) {
+                auto& iov = iovecs_[index];
+                if (static_cast<size_t>(written) >= iov.iov_len) {
+                    written -= iov.iov_len;
+                    ++index;
+                    partial = false;
+                } else {
+                    iov.iov_base = static_cast<char*>(iov.iov_base) + written;
+                    iov.iov_len -= written;
+                    written = 0;
+                    partial = true;
+                }
+            }
+        }
+        if (!dropped_notice.empty() && index >= skip) {
+            reported_dropped_ = dropped;
+            cut_line_ = false;
+            dropped_notice.clear();
+        }
+        if (index < iovecs_.size()) {
+            return;
+        }
+    }
+}
 
 void Formatter::PatternParse() {
 
@@ -343,38 +1418,44 @@ void Formatter::PatternParse() {
     if (!content_str.empty()) {
         pattern_parsed.push_back(std::make_tuple(content_str, "", 0));
     }
-    // static map from char to item constructor
-    static std::map<std::string,   
-        std::function<FormatItem::SharedPtr(const std::string&)> > char_to_item_map = {
-#define XX(STR, CLASS) \
-    { #STR, [](const std::string& str){ return FormatItem::SharedPtr(new CLASS(str)); } }
-
-    XX(m, ContentFormatItem),
-    XX(p, LevelFormatItem),
-    XX(r, ElapseFormatItem),
-    XX(c, LoggerFormatItem), // logger name
-    XX(t, ThreadIdFormatItem),
-    XX(n, NewLineFormatItem),
-    XX(d, TimeFormatItem),
-    XX(f, FileNameFormatItem),
-    XX(l, LineFormatItem),
-    XX(T, TabFormatItem),
-    XX(F, FiberIdFormatItem),
-    XX(N, ThreadNameFormatItem),
+    // static map from char to instruction
+    static const std::map<std::string, Op> char_to_op_map = {
+#define XX(STR, OP) { #STR, Op::OP }
+    XX(m, CONTENT),
+    XX(p, LEVEL),
+    XX(r, ELAPSE),
+    XX(c, LOGGER_NAME),
+    XX(t, THREAD_ID),
+    XX(d, TIME),
+    XX(i, MILLISECOND),
+    XX(u, MICROSECOND),
+    XX(f, FILE_NAME),
+    XX(l, LINE),
+    XX(F, FIBER_ID),
+    XX(N, THREAD_NAME),
+    XX(K, FIELDS),
 #undef XX
     };
-    // add to format_items
+    // items that are fixed text, compiled into literals
+    static const std::map<std::string, std::string> char_to_text_map = {
+        { "n", "\n" },
+        { "T", "  " },
+    };
+    // add to program
     for (auto& i : pattern_parsed) {
         if (std::get<2>(i) == 0) {
-            format_items_.push_back(FormatItem::SharedPtr(new StringFormatItem(std::get<0>(i))));
+            AddInstruction(Op::STRING, std::get<0>(i));
         } else {
-            auto it = char_to_item_map.find(std::get<0>(i));
-            if (it == char_to_item_map.end()) {
-                format_items_.push_back(
-                    FormatItem::SharedPtr(new StringFormatItem(
-                    "<<error_format %" + std::get<0>(i) + ">>")));
+            auto it = char_to_op_map.find(std::get<0>(i));
+            auto text_it = char_to_text_map.find(std::get<0>(i));
+            if (text_it != char_to_text_map.end()) {
+                AddInstruction(Op::STRING, text_it->second);
+            } else if (it == char_to_op_map.end()) {
+                AddInstruction(Op::STRING, "<<error_format %" + std::get<0>(i) + ">>");
+            } else if (it->second == Op::TIME) {
+                AddInstruction(Op::TIME, std::get<1>(i).empty() ? "%Y-%m-%d %H:%M:%S" : std::get<1>(i));
             } else {
-                format_items_.push_back(it->second(std::get<1>(i)));
+                AddInstruction(it->second);
             }
         }
         //std::cout << "(" << std::get<0>(i) << ") - (" << std::get<1>(i) << ") - (" << std::get<2>(i) << ")" << std::endl;
@@ -382,39 +1463,195 @@ void Formatter::PatternParse() {
     //std::cout << "-----------end parse-----------" << std::endl;
 }
 
+void Formatter::AddInstruction(Op op, const std::string& argument) {
+    // merge adjacent literal text into one copy
+    if (op == Op::STRING && !program_.empty() && program_.back().op == Op::STRING) {
+        strings_.pop_back();
+        strings_ += argument;
+        strings_.push_back('\0');
+        program_.back().size += argument.size();
+        return;
+    }
+    program_.push_back(Instruction{op, static_cast<uint32_t>(strings_.size()),
+        static_cast<uint32_t>(argument.size())});
+    strings_ += argument;
+    strings_.push_back('\0');
+}
+
+
+std::atomic<int> LoggerHandle::s_record_level_{INT_MAX};
+
+std::shared_ptr<Logger> LoggerHandle::GetLogger() const {
+    Rcu::ReadGuard guard;
+    return binding_.Read()->logger;
+}
+
+// "" is another name of root
+static const std::string& NormalizeLoggerName(const std::string& logger_name) {
+    static const std::string s_root("root");
+    return logger_name.empty() ? s_root : logger_name;
+}
+
+LoggerHandle* LoggerManager::GetHandleLocked(const std::string& logger_name) {
+    auto& name = NormalizeLoggerName(logger_name);
+    auto current = handles_.Read();
+    auto it = current->find(name);
+    if (it != current->end()) {
+        return it->second;
+    }
+    auto dot = name.rfind('.');
+    auto parent = dot == std::string::npos ? root_handle_ : GetHandleLocked(name.substr(0, dot));
+    Logger::SharedPtr logger(new Logger(name, LogLevel::Level::UNKNOWN));
+    auto handle = new LoggerHandle(name, parent, new LoggerHandle::Binding{logger, false});
+    handle_storage_.emplace_back(handle);
+    logger->handle_.store(handle, std::memory_order_release);
+    handle->effective_level_.store(parent->GetEffectiveLevel(), std::memory_order_relaxed);
+    parent->children_.push_back(handle);
+    // the parent may have published a new map
+    auto handles = new HandleMap(*handles_.Read());
+    handles->insert(std::pair(name, handle));
+    handles_.Update(handles);
+    return handle;
+}
+
+void LoggerManager::UnbindLocked(LoggerHandle* handle) {
+    auto logger = handle == root_handle_ ? root_logger_
+        : Logger::SharedPtr(new Logger(handle->name_, LogLevel::Level::UNKNOWN));
+    logger->handle_.store(handle, std::memory_order_release);
+    handle->binding_.Update(new LoggerHandle::Binding{logger, false});
+    UpdateLevelLocked(handle);
+}
+
+void LoggerManager::UpdateLevelLocked(LoggerHandle* handle) {
+    auto level = handle->binding_.Read()->logger->GetLevel();
+    if (level == LogLevel::Level::UNKNOWN) {
+        level = handle->parent_ ? handle->parent_->GetEffectiveLevel() : LogLevel::Level::DEBUG;
+    }
+    if (level == handle->GetEffectiveLevel()) { // nothing changes below either
+        return;
+    }
+    handle->effective_level_.store(level, std::memory_order_relaxed);
+    for (auto child : handle->children_) {
+        if (child->binding_.Read()->logger->GetLevel() == LogLevel::Level::UNKNOWN) {
+            UpdateLevelLocked(child);
+        }
+    }
+}
+
+void LoggerManager::UpdateLevel(LoggerHandle* handle) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    UpdateLevelLocked(handle);
+}
 
 bool LoggerManager::AddLogger(std::shared_ptr<Logger> logger) {
-    auto logger_name = logger->GetName();
-    if (loggers_.find(logger_name) == loggers_.end()) {
-        loggers_.insert(std::pair(logger_name, logger));
-        return true;
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto handle = GetHandleLocked(logger->GetName());
+    if (handle->binding_.Read()->registered) {
+        return false;
     }
-    return false;
+    logger->handle_.store(handle, std::memory_order_release);
+    handle->binding_.Update(new LoggerHandle::Binding{logger, true});
+    UpdateLevelLocked(handle);
+    return true;
 }
 bool LoggerManager::DeleteLogger(std::shared_ptr<Logger> logger) {
-    auto logger_name = logger->GetName();
-    if (loggers_.find(logger_name) != loggers_.end()) {
-        loggers_.erase(logger_name);
-        return true;
-    }
-    return false;
+    return DeleteLogger(logger->GetName());
 }
 bool LoggerManager::DeleteLogger(const std::string& logger_name) {
-    if (loggers_.find(logger_name) != loggers_.end()) {
-        loggers_.erase(logger_name);
-        return true;
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto handles = handles_.Read();
+    auto it = handles->find(NormalizeLoggerName(logger_name));
+    if (it == handles->end() || !it->second->binding_.Read()->registered) {
+        return false;
     }
-    return false;
+    UnbindLocked(it->second);
+    return true;
 }
 void LoggerManager::ClearLoggers() {
-    loggers_.clear();
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    for (auto& i : *handles_.Read()) {
+        if (i.second->binding_.Read()->registered) {
+            UnbindLocked(i.second);
+        }
+    }
 }
 std::shared_ptr<Logger> LoggerManager::GetLogger(const std::string& logger_name) {
-    auto it = loggers_.find(logger_name);
-    if (it != loggers_.end()) {
-        return it->second; 
-    } else {
-        return root_logger_;
+    return GetHandle(logger_name).GetLogger();
+}
+const LoggerHandle& LoggerManager::GetHandle(const std::string& logger_name) {
+    {
+        Rcu::ReadGuard guard;
+        auto handles = handles_.Read();
+        auto it = handles->find(NormalizeLoggerName(logger_name));
+        if (it != handles->end()) {
+            return *it->second;
+        }
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return *GetHandleLocked(logger_name);
+}
+
+std::vector<LoggerStats> LoggerManager::GetStats() {
+    std::vector<LoggerStats> result;
+    Rcu::ReadGuard guard;
+    for (auto& i : *handles_.Read()) {
+        auto binding = i.second->binding_.Read();
+        auto stats = binding->logger->GetStats();
+        auto counted = stats.filtered;
+        for (auto events : stats.events) {
+            counted += events;
+        }
+        if (binding->registered || counted != 0) {
+            result.push_back(std::move(stats));
+        }
+    }
+    return result;
+}
+
+void LoggerManager::DumpStats(const std::string& logger_name) {
+    for (auto& stats : GetStats()) {
+        LINFO(logger_name).With("logger", stats.name)
+            .With("debug", stats.events[0]).With("info", stats.events[1])
+            .With("warning", stats.events[2]).With("error", stats.events[3])
+            .With("fatal", stats.events[4]).With("filtered", stats.filtered) << "logger stats";
+        for (auto& appender : stats.appenders) {
+            LINFO(logger_name).With("logger", stats.name).With("appender", appender.name)
+                .With("events", appender.events).With("filtered", appender.filtered)
+                .With("bytes", appender.bytes).With("flushes", appender.flushes)
+                .With("drops", appender.drops).With("queue_high_water", appender.queue_high_water)
+                .With("time_us", appender.time_ns / 1000) << "appender stats";
+        }
+    }
+}
+
+bool LoggerManager::StartStatsDump(const std::string& logger_name, uint32_t interval_ms) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (stats_thread_.joinable()) {
+        return false;
+    }
+    stats_stopping_ = false;
+    stats_thread_ = std::thread([this, logger_name, interval_ms]() {
+        std::unique_lock<std::mutex> lock(stats_mutex_);
+        while (!stats_cond_.wait_for(lock, std::chrono::milliseconds(interval_ms),
+            [this]() { return stats_stopping_; })) {
+            lock.unlock();
+            DumpStats(logger_name);
+            lock.lock();
+        }
+    });
+    return true;
+}
+
+void LoggerManager::StopStatsDump() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_stopping_ = true;
+        thread.swap(stats_thread_);
+    }
+    stats_cond_.notify_all();
+    if (thread.joinable()) {
+        thread.join();
     }
 }
 
@@ -422,7 +1659,13 @@ LoggerManager::LoggerManager() {
     root_logger_ = std::make_shared<Logger>("root", LogLevel::Level::DEBUG);
     StdoutLogAppender::SharedPtr stdout_log_appender(new StdoutLogAppender());
     root_logger_->AddAppender(stdout_log_appender);
-    AddLogger(root_logger_);
+    root_handle_ = new LoggerHandle("root", nullptr, new LoggerHandle::Binding{root_logger_, true});
+    handle_storage_.emplace_back(root_handle_);
+    root_logger_->handle_.store(root_handle_, std::memory_order_release);
+    root_handle_->effective_level_.store(root_logger_->GetLevel(), std::memory_order_relaxed);
+    auto handles = new HandleMap();
+    handles->insert(std::pair(root_handle_->name_, root_handle_));
+    handles_.Update(handles);
 }
 
 };
\ No newline at end of file
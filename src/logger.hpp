@@ -11,20 +11,48 @@
 #include <fstream>
 #include <vector>
 #include <list>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string_view>
+#include <type_traits>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <ctime>
 #include <cstring>
 #include <cstdarg>
+#include "log_format.hpp"
+#include "log_stats.hpp"
+#include "rcu.hpp"
 #include "utils.hpp"
 #include "singleton.hpp"
 
 
 
-#define LLOG(logger_name, event_level) mysylar::LogEventWrap::SharedPtr( \
-    new mysylar::LogEventWrap(mysylar::LogEvent::SharedPtr( \
-    new mysylar::LogEvent(__FILE__, time(NULL), 0, __LINE__, \
-    mysylar::GetThreadId(), mysylar::GetThreadName(), mysylar::GetFiberId(), \
-    mysylar::LoggerManager::GetInstance().GetLogger(logger_name), \
-    event_level))))->GetStringStream() 
+// Events below this level are compiled out, e.g. -DMYSYLAR_MIN_LOG_LEVEL=2 drops DEBUG
+#ifndef MYSYLAR_MIN_LOG_LEVEL
+#define MYSYLAR_MIN_LOG_LEVEL 0
+#endif
+
+// The handle of the logger, cached per call site when the name is a string
+// literal. Any other name, a char buffer filled at run time included, is looked
+// up on every call.
+#define MYSYLAR_LOGGER_HANDLE(logger_name) \
+    []() -> mysylar::LoggerHandleCache& { \
+        static mysylar::LoggerHandleCache mysylar_handle_cache; \
+        return mysylar_handle_cache; \
+    }().Get(logger_name, __builtin_constant_p(logger_name))
+
+// The streamed arguments are not evaluated unless the logger accepts the level
+#define LLOG(logger_name, event_level) \
+    if ((event_level) < MYSYLAR_MIN_LOG_LEVEL) {} \
+    else if (auto mysylar_logger = MYSYLAR_LOGGER_HANDLE(logger_name).Acquire(event_level); \
+        !mysylar_logger) {} \
+    else mysylar::LogEventWrap(__FILE__, __LINE__, \
+    std::move(mysylar_logger), event_level).GetStringStream()
 #define LDEBUG(logger_name) LLOG(logger_name, mysylar::LogLevel::Level::DEBUG)
 #define LINFO(logger_name) LLOG(logger_name, mysylar::LogLevel::Level::INFO)
 #define LWARNING(logger_name) LLOG(logger_name, mysylar::LogLevel::Level::WARNING)
@@ -38,12 +66,12 @@
 #define LRFATAL LFATAL("root")
 
 
-#define FLLOG(logger_name, event_level, format, ...) mysylar::LogEventWrap::SharedPtr( \
-    new mysylar::LogEventWrap(mysylar::LogEvent::SharedPtr( \
-    new mysylar::LogEvent(__FILE__, time(NULL), 0, __LINE__, \
-    mysylar::GetThreadId(), mysylar::GetThreadName(), mysylar::GetFiberId(), \
-    mysylar::LoggerManager::GetInstance().GetLogger(logger_name), \
-    event_level))))->GetEvent()->Format(format, __VA_ARGS__) 
+#define FLLOG(logger_name, event_level, format, ...) \
+    if ((event_level) < MYSYLAR_MIN_LOG_LEVEL) {} \
+    else if (auto mysylar_logger = MYSYLAR_LOGGER_HANDLE(logger_name).Acquire(event_level); \
+        !mysylar_logger) {} \
+    else mysylar::LogEventWrap(__FILE__, __LINE__, \
+    std::move(mysylar_logger), event_level).GetEvent().Format(format, __VA_ARGS__)
 #define FLDEBUG(logger_name, format, ...) FLLOG(logger_name, \
     mysylar::LogLevel::Level::DEBUG, format, __VA_ARGS__)
 #define FLINFO(logger_name, format, ...) FLLOG(logger_name, \
@@ -57,9 +85,35 @@
 
 #define FLRDEBUG(format, ...) FLDEBUG("root", format, __VA_ARGS__)
 #define FLRINFO(format, ...) FLINFO("root", format, __VA_ARGS__)
-#define FLRWARNING(format, ...) FLWARNING("root", fromat, __VA_ARGS__)
-#define FLRERROR(format, ...) FLERROR("root", format, _VA__ARGS__)
-#define FLRFATAL(format, ...) FLFATAL("root", format, _VA_ARGS__)
+#define FLRWARNING(format, ...) FLWARNING("root", format, __VA_ARGS__)
+#define FLRERROR(format, ...) FLERROR("root", format, __VA_ARGS__)
+#define FLRFATAL(format, ...) FLFATAL("root", format, __VA_ARGS__)
+
+// Type-safe format, e.g. TLINFO("x", "user {} took {:.3} ms", id, ms). The format
+// must be a string literal and is checked against the arguments at compile time.
+#define TLLOG(logger_name, event_level, format, ...) \
+    if ((event_level) < MYSYLAR_MIN_LOG_LEVEL) {} \
+    else if (auto mysylar_logger = MYSYLAR_LOGGER_HANDLE(logger_name).Acquire(event_level); \
+        !mysylar_logger) {} \
+    else mysylar::LogEventWrap(__FILE__, __LINE__, \
+    std::move(mysylar_logger), event_level).GetEvent().FormatChecked< \
+        decltype(mysylar::MakeFormatArgList(__VA_ARGS__))::Check(format)>(format, ##__VA_ARGS__)
+#define TLDEBUG(logger_name, format, ...) TLLOG(logger_name, \
+    mysylar::LogLevel::Level::DEBUG, format, ##__VA_ARGS__)
+#define TLINFO(logger_name, format, ...) TLLOG(logger_name, \
+    mysylar::LogLevel::Level::INFO, format, ##__VA_ARGS__)
+#define TLWARNING(logger_name, format, ...) TLLOG(logger_name, \
+    mysylar::LogLevel::Level::WARNING, format, ##__VA_ARGS__)
+#define TLERROR(logger_name, format, ...) TLLOG(logger_name, \
+    mysylar::LogLevel::Level::ERROR, format, ##__VA_ARGS__)
+#define TLFATAL(logger_name, format, ...) TLLOG(logger_name, \
+    mysylar::LogLevel::Level::FATAL, format, ##__VA_ARGS__)
+
+#define TLRDEBUG(format, ...) TLDEBUG("root", format, ##__VA_ARGS__)
+#define TLRINFO(format, ...) TLINFO("root", format, ##__VA_ARGS__)
+#define TLRWARNING(format, ...) TLWARNING("root", format, ##__VA_ARGS__)
+#define TLRERROR(format, ...) TLERROR("root", format, ##__VA_ARGS__)
+#define TLRFATAL(format, ...) TLFATAL("root", format, ##__VA_ARGS__)
 
 
 namespace mysylar {
@@ -78,10 +132,126 @@ public:
         FATAL = 5,
   };
   static Level ToLevel(const std::string& level_str); 
-  static const std::string ToString(Level level); 
+  static const std::string& ToString(Level level); 
 };
 
+/**
+ * @brief Contiguous output buffer, grows when a record does not fit
+ **/
+class LogBuffer {
+public:
+    explicit LogBuffer(size_t capacity = 1024) : data_(new char[capacity]), capacity_(capacity) {}
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+    const char* Data() const { return data_.get(); }
+    size_t Size() const { return size_; }
+    void Clear() { size_ = 0; }
+    // get room for `n` chars after the content, follow with Commit
+    char* Reserve(size_t n) {
+        if (size_ + n > capacity_) {
+            Grow(size_ + n);
+        }
+        return data_.get() + size_;
+    }
+    void Commit(size_t n) { size_ += n; }
+    void Swap(LogBuffer& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+    void Append(const char* str, size_t n) { memcpy(Reserve(n), str, n); size_ += n; }
+    void Append(std::string_view str) { Append(str.data(), str.size()); }
+    void Append(char ch) { *Reserve(1) = ch; ++size_; }
+    template<class T>
+    void AppendInteger(T value) {
+        auto begin = Reserve(24);
+        size_ += std::to_chars(begin, begin + 24, value).ptr - begin;
+    }
+private:
+    void Grow(size_t min_capacity);
+    std::unique_ptr<char[]> data_;
+    size_t size_ = 0;
+    size_t capacity_;
+};
+
+/**
+ * @brief Stream buffer that writes into an inline array and only moves to
+ * the heap when the message outgrows it
+ **/
+class LogStreamBuf : public std::streambuf {
+public:
+    LogStreamBuf() { Reset(); }
+    LogStreamBuf(const LogStreamBuf&) = delete;
+    LogStreamBuf& operator=(const LogStreamBuf&) = delete;
+    std::string_view View() const { return std::string_view(pbase(), pptr() - pbase()); }
+    // forget the content, keep a moderately sized heap buffer for the next spill
+    void Reset();
+    // append printf-style formatted text
+    void VPrintf(const char* format, va_list args);
+    // append text of the type-safe format, `args` has an entry per placeholder
+    void AppendFormat(const char* format, const FormatArg* args);
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+private:
+    // make room for at least `n` more chars
+    void Reserve(size_t n);
+    void Append(const char* data, size_t size) {
+        Reserve(size);
+        memcpy(pptr(), data, size);
+        pbump(static_cast<int>(size));
+    }
+    // spec is 0, 'x' or 'X', precision -1 for the shortest form
+    void AppendArg(const FormatArg& arg, char spec, int precision);
+    static const size_t kInlineSize = 256;
+    static const size_t kMaxKeptHeapSize = 16 << 10;
+    char inline_buffer_[kInlineSize];
+    std::unique_ptr<char[]> heap_buffer_;
+    size_t heap_capacity_ = 0;
+};
+
+/**
+ * @brief Typed key-value field of a structured event
+ **/
+struct LogField {
+    enum Type : uint8_t {
+        BOOL = 0,
+        INT64 = 1,
+        UINT64 = 2,
+        DOUBLE = 3,
+        STRING = 4,
+    };
+    Type type;
+    std::string_view key;
+    union {
+        bool bool_value;
+        int64_t int_value;
+        uint64_t uint_value;
+        double double_value;
+    };
+    std::string_view string_value;
+};
+
+class LogEvent;
+
+/**
+ * @brief Content stream of an event, also takes the structured fields,
+ * e.g. LINFO("x").With("user", id).With("latency_us", t) << "done"
+ **/
+class LogStream : public std::ostream {
+public:
+    LogStream(LogEvent& event, std::streambuf* buf) : std::ostream(buf), event_(event) {}
+    // attach a field, the value may be a bool, number or string
+    template<class T>
+    LogStream& With(std::string_view key, const T& value);
+private:
+    LogEvent& event_;
+};
+
+class LogEventPool;
+
 class LogEvent {
+friend class LogEventPool;
 public:
     typedef std::shared_ptr<LogEvent> SharedPtr;
     LogEvent(const char* file_name, const uint64_t& time, 
@@ -89,170 +259,676 @@ public:
              const uint32_t& thread_id, const std::string& thread_name,
              const uint32_t& fiber_id, std::shared_ptr<Logger> logger,
              LogLevel::Level level);
+    LogEvent(const LogEvent&) = delete;
+    LogEvent& operator=(const LogEvent&) = delete;
     const char* GetFileName() const { return file_name_; }
-    const uint64_t& GetTime() const { return time_; }
+    // wall clock time in seconds
+    uint64_t GetTime() const { return time_ns_ / 1000000000; }
+    // wall clock time in nanoseconds
+    uint64_t GetTimeNs() const { return time_ns_; }
     const uint32_t& GetElapse() const { return elapse_; }
     const uint32_t& GetLine() const { return line_; }
     const uint32_t& GetThreadId() const { return thread_id_; }
     const std::string& GetThreadName() const { return thread_name_; }
     const uint32_t& GetFiberId() const { return fiber_id_; }
-    const std::string GetContent() const { return content_ss_.str(); }
+    std::string_view GetContent() const { return content_buf_.View(); }
     const LogLevel::Level GetLevel() const { return level_; }
     std::shared_ptr<Logger> GetLogger() { return logger_; }
-    std::stringstream& GetStringStream() { return content_ss_; }
-    void Format(const char* format, ...);
+    LogStream& GetStringStream() { return content_os_; }
+    void Format(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    // append the type-safe format, kValid is the compile time check of TLLOG
+    template<bool kValid, class... Args>
+    void FormatChecked(const char* format, const Args&... args) {
+        static_assert(kValid, "the format does not match the arguments");
+        const FormatArg arg_list[] = { FormatArg(args)..., FormatArg() };
+        content_buf_.AppendFormat(format, arg_list);
+    }
+    // attach a field, the key and string values are copied
+    void AddField(std::string_view key, bool value) { AddField(key, LogField::Type::BOOL, &value, sizeof(value)); }
+    void AddField(std::string_view key, int64_t value) { AddField(key, LogField::Type::INT64, &value, sizeof(value)); }
+    void AddField(std::string_view key, uint64_t value) { AddField(key, LogField::Type::UINT64, &value, sizeof(value)); }
+    void AddField(std::string_view key, double value) { AddField(key, LogField::Type::DOUBLE, &value, sizeof(value)); }
+    void AddField(std::string_view key, std::string_view value) {
+        AddField(key, LogField::Type::STRING, value.data(), value.size());
+    }
+    bool HasFields() const { return fields_.Size() != 0; }
+    // call `f(const LogField&)` for every field in the order they were added
+    template<class F>
+    void ForEachField(F&& f) const;
 private:
+    // header of a field in fields_, followed by the key and the value bytes
+    struct FieldHeader {
+        LogField::Type type;
+        uint8_t reserved;
+        uint16_t key_size;
+        uint32_t value_size;
+    };
+    void AddField(std::string_view key, LogField::Type type, const void* value, size_t size);
+    LogEvent();
+    // fill the fields of a pooled event
+    void Init(const char* file_name, uint64_t time_ns, uint32_t elapse, uint32_t line,
+              uint32_t thread_id, const std::string& thread_name, uint32_t fiber_id,
+              std::shared_ptr<Logger>&& logger, LogLevel::Level level);
+    // drop the content and the logger reference before going back to the pool
+    void Reset();
     const char* file_name_; // file name
-    uint64_t time_; // timestamp
-    uint32_t elapse_; // elapsed time from program run
+    uint64_t time_ns_; // timestamp in nanoseconds
+    uint32_t elapse_; // milliseconds elapsed from program run
     uint32_t line_; // line number
     uint32_t thread_id_; // thread id
     std::string thread_name_; // thread name
     uint32_t fiber_id_; // fiber id
-    std::stringstream content_ss_; // content
+    LogStreamBuf content_buf_; // content
+    LogStream content_os_; // stream writing into content_buf_
+    LogBuffer fields_; // encoded fields, reused with the pooled event
     std::shared_ptr<Logger> logger_;
     LogLevel::Level level_;
+    LogEventPool* pool_ = nullptr; // the pool the event belongs to, null if allocated by user
+    LogEvent* next_free_ = nullptr; // link in the free lists of the pool
+};
+
+template<class F>
+void LogEvent::ForEachField(F&& f) const {
+    auto data = fields_.Data();
+    auto end = data + fields_.Size();
+    while (data < end) {
+        FieldHeader header;
+        memcpy(&header, data, sizeof(header));
+        data += sizeof(header);
+        LogField field;
+        field.type = header.type;
+        field.key = std::string_view(data, header.key_size);
+        data += header.key_size;
+        if (field.type == LogField::Type::STRING) {
+            field.string_value = std::string_view(data, header.value_size);
+        } else {
+            memcpy(&field.uint_value, data, header.value_size);
+        }
+        data += header.value_size;
+        f(static_cast<const LogField&>(field));
+    }
+}
 
+template<class T>
+LogStream& LogStream::With(std::string_view key, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        event_.AddField(key, value);
+    } else if constexpr (std::is_same_v<T, char>) {
+        event_.AddField(key, std::string_view(&value, 1));
+    } else if constexpr ((std::is_integral_v<T> && std::is_signed_v<T>) || std::is_enum_v<T>) {
+        event_.AddField(key, static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        event_.AddField(key, static_cast<uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        event_.AddField(key, static_cast<double>(value));
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        event_.AddField(key, std::string_view(value));
+    } else {
+        static_assert(std::is_same_v<T, bool>, "a field value must be a bool, number or string");
+    }
+    return *this;
+}
+
+/**
+ * @brief Per-thread cache of reusable events. Events are taken by the owner
+ * thread and may be given back from any thread, e.g. the async flusher.
+ **/
+class LogEventPool {
+public:
+    // take an event from the pool of current thread
+    static LogEvent* Acquire(const char* file_name, uint64_t time_ns, uint32_t elapse, uint32_t line,
+                             uint32_t thread_id, const std::string& thread_name, uint32_t fiber_id,
+                             std::shared_ptr<Logger>&& logger, LogLevel::Level level);
+    // give an event back to the pool it came from
+    static void Release(LogEvent* event);
+    // called when the owner thread exits
+    void Abandon();
+private:
+    ~LogEventPool();
+    LogEvent* Pop();
+    void PushLocal(LogEvent* event);
+    void PushRemote(LogEvent* event);
+    void Unref();
+    static const size_t kMaxCachedEvents = 1024;
+    LogEvent* local_free_ = nullptr; // only touched by the owner thread
+    size_t local_count_ = 0;
+    std::atomic<LogEvent*> remote_free_{nullptr}; // events given back by other threads
+    std::atomic<size_t> refs_{1}; // the owner thread plus every event out of the pool
 };
 
+/**
+ * @brief Stack object built by the log macros, the event is logged when the
+ * statement ends
+ **/
 class LogEventWrap {
 public:
-    typedef std::shared_ptr<LogEventWrap> SharedPtr;
-    LogEventWrap(LogEvent::SharedPtr event) : event_(event) {}
+    LogEventWrap(const char* file_name, uint32_t line,
+                 std::shared_ptr<Logger>&& logger, LogLevel::Level level);
+    LogEventWrap(const LogEventWrap&) = delete;
+    LogEventWrap& operator=(const LogEventWrap&) = delete;
     ~LogEventWrap(); 
-    LogEvent::SharedPtr GetEvent() { return event_; }
-    std::stringstream& GetStringStream() { return event_->GetStringStream(); }
+    LogEvent& GetEvent() { return *event_; }
+    LogStream& GetStringStream() { return event_->GetStringStream(); }
 private:
-    LogEvent::SharedPtr event_;
+    LogEvent* event_;
 };
 
 
 
+
+/**
+ * @brief Formats events by a pattern. The pattern is compiled to a flat list
+ * of instructions run by a single switch, rendering into a LogBuffer.
+ **/
+// what Formatter::Parse reads back from the first line of a formatted record
+struct LogRecordHeader {
+    LogLevel::Level level = LogLevel::Level::UNKNOWN;
+    std::string_view logger_name;
+    time_t time = -1; // seconds, -1 if the pattern has no time
+};
+
 class Formatter {
 public:
     typedef std::shared_ptr<Formatter> SharedPtr;
     Formatter() { PatternParse(); }
     Formatter(const std::string& pattern);
+    virtual ~Formatter() {}
+    // the formatter of a pattern, "json" selects the JsonFormatter
+    static SharedPtr Create(const std::string& pattern);
+    // append the formatted event to the buffer
+    virtual void Format(
+        LogBuffer& buffer, const std::shared_ptr<Logger>& logger,
+        LogLevel::Level level, const LogEvent& event) const;
     // output the event as formatted
     void Format(
-        std::ostream& os, std::shared_ptr<Logger> logger, 
-        LogLevel::Level level, LogEvent::SharedPtr event);
-    class FormatItem { // every format item has `Format` method to output their content
-    public:
-        typedef std::shared_ptr<FormatItem> SharedPtr;
-        //FormatItem(const std::string& str = "") {}
-        virtual ~FormatItem() {}
-        virtual void Format(
-            std::ostream& os, std::shared_ptr<Logger> logger, 
-            LogLevel::Level level, LogEvent::SharedPtr event) = 0;
-    };
+        std::ostream& os, const std::shared_ptr<Logger>& logger,
+        LogLevel::Level level, const LogEvent& event) const;
+    const std::string& GetPattern() const { return pattern_; }
+    // read back a line written by the formatter up to the content, without the
+    // newline; false if the line doesn't start a record, e.g. a continuation line
+    virtual bool Parse(std::string_view line, LogRecordHeader& header) const;
+protected:
+    struct NoPattern {};
+    // for subclasses formatting without a compiled pattern
+    Formatter(const std::string& name, NoPattern) : pattern_(name) {}
 private:
-    std::string pattern_ = std::string("[%p]%d{%Y-%m-%d %H:%M:%S}%T(tid)%t%T(tname)%N%T(fid)%F%T[%c]%T%f:%l%T%m%n"); // the pattern of formatter
-    std::vector<FormatItem::SharedPtr> format_items_; // formatted items
-    void PatternParse(); // parse the pattern to format items
+    enum class Op : uint8_t {
+        STRING, // literal text
+        CONTENT, // %m
+        LEVEL, // %p
+        ELAPSE, // %r
+        LOGGER_NAME, // %c
+        THREAD_ID, // %t
+        TIME, // %d{strftime format}
+        MILLISECOND, // %i, milliseconds of the second
+        MICROSECOND, // %u, microseconds of the second
+        FILE_NAME, // %f
+        LINE, // %l
+        FIBER_ID, // %F
+        THREAD_NAME, // %N
+        FIELDS, // %K, the structured fields as " key=value"
+    };
+    struct Instruction {
+        Op op;
+        uint32_t offset; // argument of STRING and TIME in strings_
+        uint32_t size;
+    };
+    std::string pattern_ = std::string("[%p]%d{%Y-%m-%d %H:%M:%S}.%u%T(tid)%t%T(tname)%N%T(fid)%F%T[%c]%T%f:%l%T%m%K%n"); // the pattern of formatter
+    std::vector<Instruction> program_; // compiled pattern, %n and %T become literal text
+    std::string strings_; // literal text and time formats, each followed by '\0'
+    void PatternParse(); // compile the pattern to instructions
+    void AddInstruction(Op op, const std::string& argument = "");
+    static uint64_t NewId();
+    const uint64_t id_ = NewId(); // distinguishes formatters in the per-thread time cache
 
 };
 
 
 
-class LogAppender {
+struct LogAppenderConfig;
+class LogIndexWriter;
+
+/**
+ * @brief Formatter pointer replaced while other threads format through it.
+ * Readers need a Rcu::ReadGuard, Logger::Log holds one around the appenders.
+ **/
+class AtomicFormatter {
+public:
+    AtomicFormatter& operator=(Formatter::SharedPtr formatter) {
+        ptr_.Update(formatter ? new Formatter::SharedPtr(std::move(formatter)) : nullptr);
+        return *this;
+    }
+    // the formatter in use, valid until the read guard is released
+    const Formatter* Get() const { return ptr_.Read()->get(); }
+    const Formatter* operator->() const { return Get(); }
+    Formatter::SharedPtr Load() const {
+        Rcu::ReadGuard guard;
+        auto formatter = ptr_.Read();
+        return formatter ? *formatter : nullptr;
+    }
+private:
+    RcuPtr<Formatter::SharedPtr> ptr_;
+};
+
+class LogAppender : public std::enable_shared_from_this<LogAppender> {
 friend class Logger;
 public:
     typedef std::shared_ptr<LogAppender> SharedPtr;
     virtual ~LogAppender() {}
-    // set the formatter of the appender
-    void SetFormatter(Formatter::SharedPtr formatter) { formatter_ = formatter; }
+    // create the appender of config.type, null for an unknown type
+    static SharedPtr Create(const LogAppenderConfig& config);
+    // set the formatter of the appender, takes effect while other threads log
+    void SetFormatter(Formatter::SharedPtr formatter) { formatter_ = std::move(formatter); }
     // get the formatter of the appender
-    Formatter::SharedPtr GetFormatter() { return formatter_; }
+    Formatter::SharedPtr GetFormatter() const { return formatter_.Load(); }
     // set the level of the appender
-    void SetLevel(LogLevel::Level level) { level_ = level; }
+    void SetLevel(LogLevel::Level level) { level_.store(level, std::memory_order_relaxed); }
     // get the level of the appender
-    LogLevel::Level GetLevel() { return level_; }
+    LogLevel::Level GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    /**
+     * @brief set the level and the formatter while other threads log, no event
+     * gets the level of one setting and the formatter of the other. Waits for
+     * the events being logged when both change, not to be called while logging
+     **/
+    void Reconfigure(LogLevel::Level level, Formatter::SharedPtr formatter);
+    // write out anything the appender has buffered
+    virtual void Flush() {}
+    // shown in the stats, e.g. "file:/var/log/app.log"
+    virtual std::string GetName() const { return "appender"; }
+    // read the counters of the appender
+    AppenderStats GetStats() const;
+    // the time spent logging is measured on one call in kTimeSampleRate per thread
+    static const uint32_t kTimeSampleRate = 16;
 protected:
+    enum Counter {
+        EVENTS = 0,
+        FILTERED,
+        BYTES,
+        FLUSHES,
+        DROPS,
+        QUEUE_HIGH_WATER,
+        TIME_NS,
+        COUNTER_COUNT,
+    };
+    // count the event and log it, called by Logger
+    void Append(const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event);
     // set the event level and log it 
-    virtual void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::SharedPtr evnet) = 0;
-    LogLevel::Level level_ = LogLevel::Level::DEBUG;
-    Formatter::SharedPtr formatter_;
+    virtual void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event) = 0;
+    // called by the subclasses once output is written, records are dropped or queued
+    void CountWrite(size_t bytes) {
+        counters_.Add(BYTES, bytes);
+        counters_.Add(FLUSHES);
+    }
+    void CountDrops(uint64_t records) { counters_.Add(DROPS, records); }
+    void CountQueued(uint64_t queued) { counters_.UpdateMax(QUEUE_HIGH_WATER, queued); }
+    std::atomic<LogLevel::Level> level_{LogLevel::Level::DEBUG};
+    AtomicFormatter formatter_;
+    ShardedCounters<COUNTER_COUNT> counters_;
 };
 
 
 
+class LoggerHandle;
+
+/**
+ * @brief Named logger. Logging only reads an immutable snapshot of the
+ * appenders, reconfiguration publishes a new one, so both can run at once.
+ * A removed appender may still get the events in flight before it is freed.
+ * Once registered, a logger without a level takes the one of its closest
+ * ancestor, and one without appenders writes to its closest ancestor's.
+ **/
 class Logger : public std::enable_shared_from_this<Logger> {
 friend class LogEventWrap;
+friend class LoggerManager;
 public:
     typedef std::shared_ptr<Logger> SharedPtr;
+    // LogLevel::Level::UNKNOWN inherits the level of the parent logger
     Logger(const std::string& logger_name, LogLevel::Level level);
     Logger(const Logger& logger);
     // log the event
-    void Log(LogEvent::SharedPtr event);
+    void Log(LogEvent& event);
+    void Log(LogEvent::SharedPtr event) { Log(*event); }
     void AddAppender(LogAppender::SharedPtr appender);
+    // replace the appenders at once, a logging thread sees either the old or the new ones
+    void SetAppenders(const std::vector<LogAppender::SharedPtr>& appenders);
+    // the own appenders, not the inherited ones
+    std::vector<LogAppender::SharedPtr> GetAppenders() const;
+    // the formatter given to the appenders added without one
+    void SetFormatter(Formatter::SharedPtr formatter);
+    Formatter::SharedPtr GetFormatter();
     // delete a log appender to the logger
     void DeleteAppender(LogAppender::SharedPtr appender);
     // clear all log appenders
-    void ClearAppenders() { log_appenders_.clear(); }
+    void ClearAppenders();
+    // flush all log appenders
+    void Flush();
 //TODO: get log appender by name
     // get the logger name
-    const std::string& GetName() { return logger_name_; }
-    void SetLevel(LogLevel::Level level) { level_ = level; }
+    const std::string& GetName() const { return logger_name_; }
+    // set the level, descendants inheriting it follow
+    void SetLevel(LogLevel::Level level);
+    // the level set on this logger, UNKNOWN if inherited
+    LogLevel::Level GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    // the level in effect, set or inherited
+    LogLevel::Level GetEffectiveLevel() const;
+    // whether an event of `level` would be logged
+    bool IsEnabled(LogLevel::Level level) const { return level >= GetEffectiveLevel(); }
+    // read the counters of the logger and of its own appenders
+    LoggerStats GetStats() const;
 private:
+    typedef std::vector<LogAppender::SharedPtr> AppenderList;
+    // counters_ holds the logged events by level from DEBUG, then the filtered ones
+    static const size_t kFilteredCounter = 5;
+    // an event below the level was built anyway, e.g. for the flight recorder
+    void CountFiltered() { counters_.Add(kFilteredCounter); }
+    // the appenders used for logging, own or inherited, needs a Rcu::ReadGuard
+    const AppenderList* GetEffectiveAppenders() const;
     // default name
     const std::string logger_name_; 
     // default formatter
     Formatter::SharedPtr formatter_ = std::make_shared<Formatter>(); 
     // default level
-    LogLevel::Level level_ = LogLevel::Level::DEBUG;
-    // the list of logappenders
-    std::list<LogAppender::SharedPtr> log_appenders_;
+    std::atomic<LogLevel::Level> level_{LogLevel::Level::DEBUG};
+    // snapshot of the log appenders
+    RcuPtr<AppenderList> log_appenders_{new AppenderList()};
+    // serializes the updates of log_appenders_
+    std::mutex write_mutex_;
+    // the place of the name in the hierarchy, set once registered
+    std::atomic<LoggerHandle*> handle_{nullptr};
+    ShardedCounters<kFilteredCounter + 1> counters_;
 
 };
 
+/**
+ * @brief Appender writing to stdout or stderr. Records arriving while a
+ * thread is writing are batched and written by that thread with one writev,
+ * so lines of different threads never mix. Colors are only used on a
+ * terminal. In non-blocking mode records are dropped and counted instead of
+ * waiting for a slow reader, the count is reported in the output later. A
+ * line already started gets kLineWaitMs to be taken in all, then its tail
+ * is dropped too and the report starts on a new line.
+ **/
 class StdoutLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<StdoutLogAppender> SharedPtr;
+    // fd is STDOUT_FILENO or STDERR_FILENO
+    StdoutLogAppender(int fd = STDOUT_FILENO, bool non_blocking = false);
+    ~StdoutLogAppender();
+    // wait until every record logged so far is written or dropped
+    void Flush() override;
+    void SetColored(bool colored) { colored_.store(colored, std::memory_order_relaxed); }
+    bool IsColored() const { return colored_.load(std::memory_order_relaxed); }
+    // records dropped in non-blocking mode
+    uint64_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+    std::string GetName() const override { return name_; }
+    // non-blocking mode: the longest a batch waits for a stuck reader to take the rest of a line
+    static constexpr int kLineWaitMs = 10;
 private:
-    void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::SharedPtr event) override;
+    struct Record {
+        uint32_t offset; // in the buffer of the batch
+        uint32_t size;
+        LogLevel::Level level;
+    };
+    void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event) override;
+    // write batches until nothing is pending, mutex_ is held and no one else writes
+    void WriteBatches(std::unique_lock<std::mutex>& lock);
+    void WriteBatch();
+    int fd_;
+    const char* name_; // "stdout" or "stderr"
+    bool own_fd_ = false; // fd_ was opened here
+    std::atomic<bool> colored_;
+    bool non_blocking_;
+    std::mutex mutex_;
+    std::condition_variable idle_cond_;
+    bool writing_ = false; // a thread is writing batches
+    LogBuffer pending_; // records waiting for the next batch
+    std::vector<Record> pending_records_;
+    LogBuffer batch_; // the batch being written, owned by the writing thread
+    std::vector<Record> batch_records_;
+    std::vector<struct iovec> iovecs_;
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_dropped_ = 0;
+    bool cut_line_ = false; // the last record written was cut short
 };
 
+/**
+ * @brief Appender keeping the file open and writing through a user-space
+ * buffer. The file is rotated by size or time, and reopened when it has been
+ * renamed or deleted by someone else.
+ **/
 class FileLogAppender : public LogAppender {
 public:
+    enum RotateInterval {
+        NONE = 0,
+        HOURLY = 1,
+        DAILY = 2,
+    };
     FileLogAppender(const std::string file_name);
-private:
-    bool ReopenFile();
+    FileLogAppender(const LogAppenderConfig& config);
+    ~FileLogAppender();
+    void Flush() override;
+    std::string GetName() const override { return "file:" + file_name_; }
+    /**
+     * @brief write the buffered records out if they are older than the flush
+     * interval, for appenders that stopped receiving records
+     * @return when to look again
+     **/
+    std::chrono::steady_clock::time_point FlushIfDue(std::chrono::steady_clock::time_point now);
+protected:
+    bool OpenFile();
+    virtual void CloseFile();
+    // write the buffered records to the file
+    virtual void WriteOut();
+    // size the file will have once the buffered records are written
+    virtual uint64_t GetPendingFileSize() const { return file_size_ + buffer_.Size(); }
+    // write all of `data` to the open file, returns the bytes written
+    size_t WriteFile(const char* data, size_t size);
+    // move the current file aside and start a new one
+    void Rotate(time_t now);
+    // delete the oldest rotated files beyond max_files_
+    void RemoveOldFiles();
+    // whether the path no longer refers to the open file
+    bool IsFileReplaced();
+    // note the record just formatted at `offset` in the index
+    void IndexRecord(uint64_t offset, const Logger& logger, LogLevel::Level level, const LogEvent& event);
+    static time_t NextRotateTime(time_t now, int interval);
+    void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event) override;
+
     const std::string file_name_;
-    std::ofstream file_stream_;
-    void Log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::SharedPtr evnet) override;
+    int fd_ = -1;
+    dev_t dev_ = 0; // device and inode of the open file
+    ino_t ino_ = 0;
+    uint64_t file_size_ = 0; // bytes already in the file
+    size_t buffer_size_; // records are written out once buffer_ holds this much
+    LogBuffer buffer_;
+    uint32_t flush_interval_ms_;
+    uint64_t rotate_size_;
+    int rotate_interval_;
+    uint32_t max_files_;
+    time_t next_rotate_time_ = 0;
+    std::chrono::steady_clock::time_point last_flush_;
+    std::chrono::steady_clock::time_point last_inode_check_;
+    bool flush_registered_ = false; // with the thread flushing idle appenders
+    std::unique_ptr<LogIndexWriter> index_; // "<file>.idx", null without index_interval
+    std::mutex mutex_;
 };
 
+/**
+ * @brief Node of the logger hierarchy, one per dotted name, e.g.
+ * "system.net.http" under "system.net" under "system" under root. It lives
+ * as long as the manager and always points to the logger of the name, a
+ * registered one or an empty one created by the manager. Call sites keep it
+ * instead of looking the name up, and follow later reconfiguration.
+ **/
+class LoggerHandle {
+friend class Logger;
+friend class LoggerManager;
+public:
+    const std::string& GetName() const { return name_; }
+    // the parent node, null for root
+    const LoggerHandle* GetParent() const { return parent_; }
+    // the level in effect for the name, kept up to date by the manager
+    LogLevel::Level GetEffectiveLevel() const { return effective_level_.load(std::memory_order_relaxed); }
+    // whether the name logs `level`
+    bool IsEnabled(LogLevel::Level level) const { return level >= GetEffectiveLevel(); }
+    // the logger of the name
+    std::shared_ptr<Logger> GetLogger() const;
+    // whether the name logs `level` or the flight recorder keeps it
+    bool IsCaptured(LogLevel::Level level) const { return IsEnabled(level) || level >= GetRecordLevel(); }
+    // the logger of the name if `level` is captured, null otherwise
+    std::shared_ptr<Logger> Acquire(LogLevel::Level level) const {
+        return IsCaptured(level) ? GetLogger() : nullptr;
+    }
+    // events of this level and above go to the flight recorder whatever the logger level
+    static int GetRecordLevel() { return s_record_level_.load(std::memory_order_relaxed); }
+    // set by the flight recorder, INT_MAX when it is stopped
+    static void SetRecordLevel(int level) { s_record_level_.store(level, std::memory_order_relaxed); }
+private:
+    static std::atomic<int> s_record_level_;
+    struct Binding {
+        std::shared_ptr<Logger> logger;
+        bool registered; // false for the loggers created by the manager
+    };
+    LoggerHandle(const std::string& name, LoggerHandle* parent, Binding* binding)
+        : name_(name), parent_(parent), binding_(binding) {}
+    const std::string name_;
+    LoggerHandle* const parent_;
+    std::vector<LoggerHandle*> children_; // guarded by the manager write mutex
+    RcuPtr<Binding> binding_;
+    std::atomic<LogLevel::Level> effective_level_{LogLevel::Level::DEBUG};
+};
+
+inline LogLevel::Level Logger::GetEffectiveLevel() const {
+    auto level = level_.load(std::memory_order_relaxed);
+    if (level != LogLevel::Level::UNKNOWN) {
+        return level;
+    }
+    auto handle = handle_.load(std::memory_order_acquire);
+    return handle && handle->parent_ ? handle->parent_->GetEffectiveLevel() : LogLevel::Level::DEBUG;
+}
+
+/**
+ * @brief Registry of the named loggers. Every name ever used gets a handle
+ * in the hierarchy. Lookups read an immutable snapshot of the handles
+ * without locking, changes copy it and publish the copy. A name that was
+ * never registered inherits level and appenders from its ancestors.
+ **/
 class LoggerManager : public Singleton<LoggerManager> {
 friend class Singleton<LoggerManager>;
+friend class Logger;
 public:
     bool AddLogger(std::shared_ptr<Logger> logger);
     bool DeleteLogger(std::shared_ptr<Logger> logger);
     bool DeleteLogger(const std::string& logger_name);
     void ClearLoggers();
+    // the logger of the name, an empty one inheriting from its ancestors if not registered
     std::shared_ptr<Logger> GetLogger(const std::string& logger_name);
+    // the handle of a name, created on first use
+    const LoggerHandle& GetHandle(const std::string& logger_name);
+    // counters of the registered loggers and of the others that counted anything, by name
+    std::vector<LoggerStats> GetStats();
+    // log the counters of every logger and appender to a logger, as INFO events with fields
+    void DumpStats(const std::string& logger_name);
+    // dump the counters every interval_ms from a background thread, false if already dumping
+    bool StartStatsDump(const std::string& logger_name, uint32_t interval_ms);
+    void StopStatsDump();
 private:
+    typedef std::map<std::string, LoggerHandle*> HandleMap;
+    // find or create the handle of a name and its ancestors, write_mutex_ must be held
+    LoggerHandle* GetHandleLocked(const std::string& logger_name);
+    // bind the handle to the logger the name falls back to when none is registered
+    void UnbindLocked(LoggerHandle* handle);
+    // recompute the effective level of a handle and of the descendants inheriting it
+    void UpdateLevelLocked(LoggerHandle* handle);
+    // called by Logger::SetLevel
+    void UpdateLevel(LoggerHandle* handle);
     std::shared_ptr<Logger> root_logger_;
-    std::map<std::string, std::shared_ptr<Logger> > loggers_;
+    LoggerHandle* root_handle_;
+    RcuPtr<HandleMap> handles_{new HandleMap()};
+    std::vector<std::unique_ptr<LoggerHandle> > handle_storage_;
+    // serializes the updates of handles_, of the handle bindings and levels
+    std::mutex write_mutex_;
+    std::mutex stats_mutex_; // guards the dump thread and stats_stopping_
+    std::condition_variable stats_cond_;
+    bool stats_stopping_ = false;
+    std::thread stats_thread_;
     LoggerManager();
+    ~LoggerManager() { StopStatsDump(); }
 
 };
 
+/**
+ * @brief Handle cache of one call site. A string literal name is resolved on
+ * first use only, other names are looked up on every call.
+ **/
+class LoggerHandleCache {
+public:
+    // `constant`: the name is a constant expression, the same on every call
+    template<size_t N>
+    const LoggerHandle& Get(const char (&logger_name)[N], bool constant) {
+        if (!constant) {
+            return Get(std::string_view(logger_name), false);
+        }
+        auto handle = handle_.load(std::memory_order_acquire);
+        if (!handle) {
+            handle = &LoggerManager::GetInstance().GetHandle(logger_name);
+            handle_.store(handle, std::memory_order_release);
+        }
+        return *handle;
+    }
+    const LoggerHandle& Get(std::string_view logger_name, bool) {
+        return LoggerManager::GetInstance().GetHandle(std::string(logger_name));
+    }
+private:
+    std::atomic<const LoggerHandle*> handle_{nullptr};
+};
+
 struct LogAppenderConfig {
-    int type = 0;
+    enum Type {
+        STDOUT_APPENDER = 0,
+        FILE_APPENDER = 1,
+        GZIP_FILE_APPENDER = 2,
+    };
+    enum Target {
+        STDOUT_TARGET = 0,
+        STDERR_TARGET = 1,
+    };
+    int type = Type::STDOUT_APPENDER;
     std::string path;
     std::string format_pattern;
-    LogLevel::Level level;
+    LogLevel::Level level = LogLevel::Level::DEBUG;
+    // stdout appender only
+    int target = Target::STDOUT_TARGET;
+    bool non_blocking = false; // drop and count records instead of waiting for a slow reader
+    // file appender only
+    size_t buffer_size = 64 << 10; // user-space write buffer, one gzip member per buffer
+    uint32_t flush_interval_ms = 1000; // buffered records are written at least this often, by a shared thread once the appender goes quiet
+    uint64_t rotate_size = 0; // rotate once the file reaches this size, 0 disables
+    int rotate_interval = FileLogAppender::RotateInterval::NONE;
+    uint32_t max_files = 0; // rotated files to keep, 0 keeps all
+    int compress_level = 6; // gzip file appender only, 1 fastest to 9 smallest
+    uint32_t index_interval = 0; // plain file appender only, bytes per block of the sidecar index, 0 writes none
 
     bool operator==(const LogAppenderConfig& log_appender_config) const {
         return type == log_appender_config.type
             && path == log_appender_config.path
             && format_pattern == log_appender_config.format_pattern
-            && level == log_appender_config.level;
+            && level == log_appender_config.level
+            && target == log_appender_config.target
+            && non_blocking == log_appender_config.non_blocking
+            && buffer_size == log_appender_config.buffer_size
+            && flush_interval_ms == log_appender_config.flush_interval_ms
+            && rotate_size == log_appender_config.rotate_size
+            && rotate_interval == log_appender_config.rotate_interval
+            && max_files == log_appender_config.max_files
+            && compress_level == log_appender_config.compress_level
+            && index_interval == log_appender_config.index_interval;
     }
 };
 
 struct LoggerConfig {
     std::string name;
-    LogLevel::Level level;
+    LogLevel::Level level = LogLevel::Level::UNKNOWN; // UNKNOWN inherits the parent level
     std::string format_pattern;
     std::vector<LogAppenderConfig> appenders;
 
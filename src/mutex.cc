@@ -0,0 +1,33 @@
+#include "mutex.hpp"
+#include <cerrno>
+#include <system_error>
+
+namespace mysylar {
+
+Semaphore::Semaphore(uint32_t count) {
+    if (sem_init(&semaphore_, 0, count) != 0) {
+        throw std::system_error(errno, std::generic_category(), "sem_init");
+    }
+}
+
+Semaphore::~Semaphore() {
+    sem_destroy(&semaphore_);
+}
+
+void Semaphore::Wait() {
+    while (sem_wait(&semaphore_) != 0 && errno == EINTR) {
+    }
+}
+
+bool Semaphore::TryWait() {
+    int ret;
+    while ((ret = sem_trywait(&semaphore_)) != 0 && errno == EINTR) {
+    }
+    return ret == 0;
+}
+
+void Semaphore::Notify() {
+    sem_post(&semaphore_);
+}
+
+}
@@ -0,0 +1,288 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace mysylar {
+
+// size of a cache line, locks on their own line don't share it with the data around them
+constexpr size_t kCacheLineSize = 64;
+
+// tell the CPU we are spinning, lets the sibling hyperthread run and saves power
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * @brief Exponential backoff for spin loops: 1, 2, 4... up to 64 pauses, then
+ * the CPU is yielded so a preempted owner gets to run again
+ **/
+class Backoff {
+public:
+    void Pause() {
+        if (pauses_ <= kMaxPauses) {
+            for (uint32_t i = 0; i < pauses_; ++i) {
+                CpuRelax();
+            }
+            pauses_ <<= 1;
+        } else {
+            sched_yield();
+        }
+    }
+private:
+    static constexpr uint32_t kMaxPauses = 64;
+    uint32_t pauses_ = 1;
+};
+
+/**
+ * @brief Counting semaphore
+ **/
+class Semaphore {
+public:
+    // throws std::system_error when the semaphore can't be created
+    explicit Semaphore(uint32_t count = 0);
+    ~Semaphore();
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+    // take one, waits while the count is 0
+    void Wait();
+    // take one if the count isn't 0, without waiting
+    bool TryWait();
+    // give one back, wakes a waiter
+    void Notify();
+private:
+    sem_t semaphore_;
+};
+
+/**
+ * @brief Holds a lock for its scope. The locks below name their methods after
+ * the standard ones (lock, unlock, lock_shared...) so std::unique_lock,
+ * std::shared_lock and std::condition_variable_any take them as well.
+ * @tparam T a mutex with lock() and unlock()
+ **/
+template<class T>
+class ScopedLockImpl {
+public:
+    explicit ScopedLockImpl(T& mutex) : mutex_(mutex) {
+        mutex_.lock();
+        locked_ = true;
+    }
+    ~ScopedLockImpl() { Unlock(); }
+    ScopedLockImpl(const ScopedLockImpl&) = delete;
+    ScopedLockImpl& operator=(const ScopedLockImpl&) = delete;
+    void Lock() {
+        if (!locked_) {
+            mutex_.lock();
+            locked_ = true;
+        }
+    }
+    void Unlock() {
+        if (locked_) {
+            mutex_.unlock();
+            locked_ = false;
+        }
+    }
+private:
+    T& mutex_;
+    bool locked_ = false;
+};
+
+/**
+ * @brief Holds the shared side of a lock for its scope
+ * @tparam T a mutex with lock_shared() and unlock_shared()
+ **/
+template<class T>
+class ReadScopedLockImpl {
+public:
+    explicit ReadScopedLockImpl(T& mutex) : mutex_(mutex) {
+        mutex_.lock_shared();
+        locked_ = true;
+    }
+    ~ReadScopedLockImpl() { Unlock(); }
+    ReadScopedLockImpl(const ReadScopedLockImpl&) = delete;
+    ReadScopedLockImpl& operator=(const ReadScopedLockImpl&) = delete;
+    void Lock() {
+        if (!locked_) {
+            mutex_.lock_shared();
+            locked_ = true;
+        }
+    }
+    void Unlock() {
+        if (locked_) {
+            mutex_.unlock_shared();
+            locked_ = false;
+        }
+    }
+private:
+    T& mutex_;
+    bool locked_ = false;
+};
+
+// the exclusive side of a read-write lock, the same as a plain scoped lock
+template<class T>
+using WriteScopedLockImpl = ScopedLockImpl<T>;
+
+/**
+ * @brief pthread mutex, waiters sleep in the kernel. The default choice.
+ **/
+class Mutex {
+public:
+    typedef ScopedLockImpl<Mutex> Lock;
+    Mutex() { pthread_mutex_init(&mutex_, nullptr); }
+    ~Mutex() { pthread_mutex_destroy(&mutex_); }
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+    void lock() { pthread_mutex_lock(&mutex_); }
+    bool try_lock() { return pthread_mutex_trylock(&mutex_) == 0; }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+private:
+    pthread_mutex_t mutex_;
+};
+
+/**
+ * @brief pthread read-write lock, readers share it. Pays off when reads
+ * outnumber writes and hold the lock for more than a few loads, otherwise the
+ * shared counter costs as much as a Mutex.
+ **/
+class RWMutex {
+public:
+    typedef ReadScopedLockImpl<RWMutex> ReadLock;
+    typedef WriteScopedLockImpl<RWMutex> WriteLock;
+    RWMutex() { pthread_rwlock_init(&lock_, nullptr); }
+    ~RWMutex() { pthread_rwlock_destroy(&lock_); }
+    RWMutex(const RWMutex&) = delete;
+    RWMutex& operator=(const RWMutex&) = delete;
+    void lock_shared() { pthread_rwlock_rdlock(&lock_); }
+    bool try_lock_shared() { return pthread_rwlock_tryrdlock(&lock_) == 0; }
+    void unlock_shared() { pthread_rwlock_unlock(&lock_); }
+    void lock() { pthread_rwlock_wrlock(&lock_); }
+    bool try_lock() { return pthread_rwlock_trywrlock(&lock_) == 0; }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+private:
+    pthread_rwlock_t lock_;
+};
+
+/**
+ * @brief Test-and-test-and-set spin lock on its own cache line, for critical
+ * sections of a few instructions. Waiters spin on a plain load with Backoff
+ * instead of hammering the line with exchanges.
+ **/
+class alignas(kCacheLineSize) SpinLock {
+public:
+    typedef ScopedLockImpl<SpinLock> Lock;
+    SpinLock() = default;
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+    void lock() {
+        Backoff backoff;
+        while (locked_.exchange(true, std::memory_order_acquire)) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                backoff.Pause();
+            }
+        }
+    }
+    bool try_lock() {
+        return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+    }
+    void unlock() { locked_.store(false, std::memory_order_release); }
+private:
+    std::atomic<bool> locked_{false};
+};
+
+/**
+ * @brief Sequence lock for a small trivially copyable value read far more
+ * often than written. Readers don't write anything shared, they copy the
+ * value and retry if a writer got in between. Writers exclude each other.
+ * The value is kept in atomic words, so a torn copy is never used and is not
+ * a data race either.
+ **/
+template<class T>
+class SeqLock {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+    explicit SeqLock(const T& value = T()) { Copy(value); }
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    T Load() const {
+        T value;
+        Backoff backoff;
+        while (true) {
+            auto seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1) { // a writer is in
+                backoff.Pause();
+                continue;
+            }
+            uint64_t words[kWords];
+            for (size_t i = 0; i < kWords; ++i) {
+                words[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                memcpy(&value, words, sizeof(T));
+                return value;
+            }
+        }
+    }
+    void Store(const T& value) {
+        Backoff backoff;
+        auto seq = seq_.load(std::memory_order_relaxed);
+        while ((seq & 1) || !seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_relaxed)) {
+            backoff.Pause();
+            seq = seq_.load(std::memory_order_relaxed);
+        }
+        // the odd sequence is visible before any word changes
+        std::atomic_thread_fence(std::memory_order_release);
+        Copy(value);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    void Copy(const T& value) {
+        uint64_t words[kWords] = {};
+        memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < kWords; ++i) {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+    std::atomic<uint32_t> seq_{0}; // odd while a writer is in
+    std::atomic<uint64_t> words_[kWords];
+};
+
+/**
+ * @brief Locks that do nothing, for code built single threaded or owned by
+ * one thread, e.g. `template<class MutexType = Mutex>` instantiated with
+ * NullMutex.
+ **/
+class NullMutex {
+public:
+    typedef ScopedLockImpl<NullMutex> Lock;
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+class NullRWMutex {
+public:
+    typedef ReadScopedLockImpl<NullRWMutex> ReadLock;
+    typedef WriteScopedLockImpl<NullRWMutex> WriteLock;
+    void lock_shared() {}
+    bool try_lock_shared() { return true; }
+    void unlock_shared() {}
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+}
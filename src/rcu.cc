@@ -0,0 +1,142 @@
+#include "rcu.hpp"
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mysylar {
+
+namespace {
+// per-thread slot, the epoch is 0 while the thread is not reading
+struct Reader {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{true};
+    Reader* next = nullptr;
+};
+
+struct Retired {
+    uint64_t epoch; // deletable once every active reader entered after it
+    void* ptr;
+    void (*deleter)(void*);
+};
+
+struct Domain {
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<Reader*> readers{nullptr}; // push only, slots are reused
+    std::mutex mutex;
+    std::vector<Retired> retired;
+};
+
+// never destroyed, readers may still show up while statics are torn down
+Domain& GetDomain() {
+    static Domain* domain = new Domain();
+    return *domain;
+}
+
+Reader* AcquireReader() {
+    auto& domain = GetDomain();
+    for (auto reader = domain.readers.load(std::memory_order_acquire); reader; reader = reader->next) {
+        bool in_use = false;
+        if (!reader->in_use.load(std::memory_order_relaxed)
+            && reader->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+            return reader;
+        }
+    }
+    auto reader = new Reader();
+    reader->next = domain.readers.load(std::memory_order_relaxed);
+    while (!domain.readers.compare_exchange_weak(reader->next, reader, std::memory_order_release)) {
+    }
+    return reader;
+}
+
+struct ThreadReader {
+    Reader* reader = nullptr;
+    uint32_t depth = 0;
+    ~ThreadReader() {
+        if (reader) {
+            reader->epoch.store(0, std::memory_order_release);
+            reader->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+thread_local ThreadReader t_reader;
+
+// smallest epoch of the readers inside a critical section, UINT64_MAX if none
+uint64_t MinActiveEpoch() {
+    uint64_t min = UINT64_MAX;
+    for (auto reader = GetDomain().readers.load(std::memory_order_acquire); reader; reader = reader->next) {
+        auto epoch = reader->epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0 && epoch < min) {
+            min = epoch;
+        }
+    }
+    return min;
+}
+
+// delete what no reader can see any more
+void Reclaim() {
+    auto& domain = GetDomain();
+    std::vector<Retired> done;
+    {
+        std::lock_guard<std::mutex> lock(domain.mutex);
+        auto min = MinActiveEpoch();
+        size_t kept = 0;
+        for (auto& i : domain.retired) {
+            if (i.epoch < min) {
+                done.push_back(i);
+            } else {
+                domain.retired[kept++] = i;
+            }
+        }
+        domain.retired.resize(kept);
+    }
+    // deleters may retire again, so they run unlocked
+    for (auto& i : done) {
+        i.deleter(i.ptr);
+    }
+}
+}
+
+void Rcu::ReadLock() {
+    if (t_reader.depth++ != 0) {
+        return;
+    }
+    if (!t_reader.reader) {
+        t_reader.reader = AcquireReader();
+    }
+    // the epoch must be visible to writers before any protected pointer is loaded
+    t_reader.reader->epoch.store(GetDomain().epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Rcu::ReadUnlock() {
+    if (--t_reader.depth == 0) {
+        t_reader.reader->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void Rcu::Retire(void* ptr, void (*deleter)(void*)) {
+    auto& domain = GetDomain();
+    // readers that entered before the increment may hold ptr, later ones can not
+    auto epoch = domain.epoch.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> lock(domain.mutex);
+        domain.retired.push_back(Retired{epoch, ptr, deleter});
+    }
+    Reclaim();
+}
+
+void Rcu::Synchronize() {
+    auto epoch = GetDomain().epoch.fetch_add(1, std::memory_order_seq_cst);
+    while (MinActiveEpoch() <= epoch) {
+        std::this_thread::yield();
+    }
+    Reclaim();
+}
+
+size_t Rcu::GetPendingCount() {
+    auto& domain = GetDomain();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    return domain.retired.size();
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mysylar {
+
+/**
+ * @brief Epoch based read-copy-update for read-mostly data. Readers publish
+ * the epoch they entered in a per-thread slot and never block or write shared
+ * state. Writers copy the data, publish the new version with RcuPtr::Update
+ * and retire the old one, which is deleted once no reader can still see it.
+ **/
+class Rcu {
+public:
+    /**
+     * @brief Read-side critical section, may be nested. Pointers loaded by
+     * RcuPtr::Read stay valid until the outermost guard is destroyed.
+     **/
+    class ReadGuard {
+    public:
+        ReadGuard() { ReadLock(); }
+        ~ReadGuard() { ReadUnlock(); }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+    static void ReadLock();
+    static void ReadUnlock();
+    /**
+     * @brief delete `ptr` with `deleter` once every reader inside a critical
+     * section at the time of the call has left it
+     **/
+    static void Retire(void* ptr, void (*deleter)(void*));
+    /**
+     * @brief wait for the readers of the current epoch to leave and delete
+     * everything retired so far, must not be called inside a read guard
+     **/
+    static void Synchronize();
+    // number of retired objects not deleted yet
+    static size_t GetPendingCount();
+};
+
+/**
+ * @brief Pointer to an immutable snapshot, replaced as a whole by writers.
+ * Writers have to be serialized by the owner, readers need a Rcu::ReadGuard.
+ **/
+template<class T>
+class RcuPtr {
+public:
+    explicit RcuPtr(T* value = nullptr) : ptr_(value) {}
+    ~RcuPtr() { delete ptr_.load(std::memory_order_relaxed); }
+    RcuPtr(const RcuPtr&) = delete;
+    RcuPtr& operator=(const RcuPtr&) = delete;
+    // the current snapshot, valid until the read guard is released
+    const T* Read() const { return ptr_.load(std::memory_order_acquire); }
+    // publish a new snapshot, the old one is reclaimed once no reader can see it
+    void Update(T* value) {
+        auto old = ptr_.exchange(value, std::memory_order_seq_cst);
+        if (old) {
+            Rcu::Retire(old, [](void* p) { delete static_cast<T*>(p); });
+        }
+    }
+private:
+    std::atomic<T*> ptr_;
+};
+
+}
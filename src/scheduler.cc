@@ -0,0 +1,431 @@
+#include "scheduler.hpp"
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "config.hpp"
+
+namespace mysylar {
+
+namespace {
+
+const uint64_t kInjectedEvery = 61; // ticks between looks at the injection queue ahead of local work
+const size_t kInjectedBatch = 32; // most tasks a worker moves from the injection queue at once
+
+thread_local Scheduler* t_scheduler = nullptr;
+thread_local int t_worker_index = -1;
+thread_local int t_task_thread = -1;
+
+size_t GetDefaultThreadCount() {
+    auto threads = ConfigManager::GetInstance().Lookup("scheduler.threads",
+        "worker threads of a scheduler made without a count, 0 for one per CPU", static_cast<uint32_t>(0));
+    size_t count = threads->GetValue();
+    return count ? count : std::max(1u, std::thread::hardware_concurrency());
+}
+
+uint32_t NextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+}
+
+Scheduler::Scheduler(size_t threads, const std::string& name, bool pin_threads) :
+    name_(name),
+    pin_threads_(pin_threads) {
+    if (threads == 0) {
+        threads = GetDefaultThreadCount();
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->index = i;
+        worker->random = static_cast<uint32_t>(i) * 2654435761u + 1;
+        workers_.push_back(std::move(worker));
+    }
+}
+
+Scheduler::~Scheduler() {
+    StopForDestructor();
+    std::vector<Task*> tasks(injected_.begin(), injected_.end());
+    for (auto& worker : workers_) {
+        tasks.insert(tasks.end(), worker->local.begin(), worker->local.end());
+        tasks.insert(tasks.end(), worker->inbox.begin(), worker->inbox.end());
+        while (auto task = worker->deque.Pop()) {
+            tasks.push_back(task);
+        }
+    }
+    for (auto task : tasks) {
+        delete task;
+    }
+}
+
+void Scheduler::Start() {
+    if (started_.exchange(true)) {
+        return;
+    }
+    auto cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (auto& worker : workers_) {
+        auto index = worker->index;
+        auto self = worker.get();
+        worker->thread = std::make_shared<Thread>([this, self]() { Run(*self); },
+            name_ + "_" + std::to_string(index), pin_threads_ ? static_cast<int>(index % cpus) : -1);
+    }
+}
+
+void Scheduler::Stop() {
+    if (GetThis() == this) {
+        throw std::logic_error("stop " + name_ + " from its own worker");
+    }
+    stopping_.store(true, std::memory_order_seq_cst);
+    if (!started_) {
+        return;
+    }
+    WakeAll();
+    for (auto& worker : workers_) {
+        worker->thread->Join();
+    }
+}
+
+void Scheduler::StopForDestructor() {
+    if (GetThis() == this) {
+        // the worker can't wait for itself, and would go on in freed memory
+        LRFATAL << name_ << " destroyed from its own worker";
+        std::abort();
+    }
+    try {
+        Stop();
+    } catch (std::exception& e) {
+        LRERROR << name_ << ": " << e.what();
+    }
+}
+
+void Scheduler::Schedule(Fiber::SharedPtr fiber, int thread) {
+    if (!fiber) {
+        throw std::invalid_argument("schedule no fiber on " + name_);
+    }
+    auto task = new Task();
+    task->fiber = std::move(fiber);
+    task->thread = thread;
+    Submit(task);
+}
+
+void Scheduler::Schedule(std::function<void()> callback, int thread) {
+    if (!callback) {
+        throw std::invalid_argument("schedule no callback on " + name_);
+    }
+    auto task = new Task();
+    task->callback = std::move(callback);
+    task->thread = thread;
+    Submit(task);
+}
+
+Scheduler* Scheduler::GetThis() {
+    return t_scheduler;
+}
+
+int Scheduler::GetWorkerIndex() {
+    return t_worker_index;
+}
+
+int Scheduler::GetTaskThread() {
+    return t_task_thread;
+}
+
+void Scheduler::Idle(size_t index) {
+    workers_[index]->semaphore.Wait();
+}
+
+void Scheduler::Tickle(size_t index) {
+    workers_[index]->semaphore.Notify();
+}
+
+bool Scheduler::TryIdle(size_t index) {
+    return workers_[index]->semaphore.TryWait();
+}
+
+void Scheduler::WakeAll() {
+    for (auto& worker : workers_) {
+        Wake(*worker);
+    }
+}
+
+void Scheduler::Submit(Task* task) {
+    if (task->thread >= static_cast<int>(workers_.size()) || task->thread < -1) {
+        auto thread = task->thread;
+        delete task;
+        throw std::invalid_argument(name_ + " has no worker " + std::to_string(thread));
+    }
+    auto index = t_scheduler == this ? t_worker_index : -1;
+    // from other threads under injected_mutex_, Park decides to exit under it too
+    std::unique_lock<Mutex> lock(injected_mutex_, std::defer_lock);
+    if (index < 0) {
+        lock.lock();
+    }
+    if (exiting_.load(std::memory_order_acquire)) {
+        if (lock) {
+            lock.unlock();
+        }
+        delete task;
+        throw std::logic_error(name_ + " is stopped");
+    }
+    if (task->thread >= 0) {
+        if (task->thread == index) {
+            workers_[index]->local.push_back(task);
+            return;
+        }
+        auto& worker = *workers_[task->thread];
+        {
+            SpinLock::Lock inbox_lock(worker.inbox_lock);
+            worker.inbox.push_back(task);
+            worker.has_inbox.store(true, std::memory_order_relaxed);
+        }
+        if (lock) {
+            lock.unlock();
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (worker.parked.load(std::memory_order_relaxed)) {
+            Wake(worker);
+        }
+        return;
+    }
+    if (index >= 0) {
+        workers_[index]->deque.Push(task);
+    } else {
+        injected_.push_back(task);
+        injected_size_.fetch_add(1, std::memory_order_relaxed);
+        lock.unlock();
+    }
+    // pairs with the fence in Park: either the parked worker sees the task or we see it parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked_count_.load(std::memory_order_relaxed) > 0) {
+        WakeOne();
+    }
+}
+
+void Scheduler::Run(Worker& self) {
+    t_scheduler = this;
+    t_worker_index = static_cast<int>(self.index);
+    uint64_t tick = 0;
+    while (!exiting_.load(std::memory_order_acquire)) {
+        auto task = NextTask(self, ++tick);
+        if (task) {
+            RunTask(self, task);
+        } else if (Park(self)) {
+            break;
+        }
+    }
+    self.fiber.reset();
+    t_scheduler = nullptr;
+    t_worker_index = -1;
+}
+
+Scheduler::Task* Scheduler::NextTask(Worker& self, uint64_t tick) {
+    if (self.has_inbox.load(std::memory_order_acquire)) {
+        std::vector<Task*> inbox;
+        {
+            SpinLock::Lock lock(self.inbox_lock);
+            inbox.swap(self.inbox);
+            self.has_inbox.store(false, std::memory_order_relaxed);
+        }
+        self.local.insert(self.local.end(), inbox.begin(), inbox.end());
+    }
+    Task* task = nullptr;
+    // the injection queue and the local one aren't starved by a busy deque
+    if (tick % kInjectedEvery == 0 && (task = TakeInjected())) {
+        return task;
+    }
+    if ((tick & 1) && !self.local.empty()) {
+        task = self.local.front();
+        self.local.pop_front();
+        return task;
+    }
+    if ((task = self.deque.Pop())) {
+        return task;
+    }
+    if (!self.local.empty()) {
+        task = self.local.front();
+        self.local.pop_front();
+        return task;
+    }
+    if ((task = TakeInjected())) {
+        return task;
+    }
+    return StealTask(self);
+}
+
+Scheduler::Task* Scheduler::TakeInjected() {
+    if (injected_size_.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+    Task* batch[kInjectedBatch];
+    size_t count = 0;
+    {
+        Mutex::Lock lock(injected_mutex_);
+        // a fair share, the rest is left to the other workers
+        auto share = std::min(kInjectedBatch, injected_.size() / workers_.size() + 1);
+        while (count < share && !injected_.empty()) {
+            batch[count++] = injected_.front();
+            injected_.pop_front();
+        }
+        injected_size_.fetch_sub(count, std::memory_order_relaxed);
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+    auto& self = *workers_[t_worker_index];
+    for (size_t i = 1; i < count; ++i) {
+        self.deque.Push(batch[i]);
+    }
+    // the rest is up for stealing
+    if (count > 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_count_.load(std::memory_order_relaxed) > 0) {
+            WakeOne();
+        }
+    }
+    return batch[0];
+}
+
+Scheduler::Task* Scheduler::StealTask(Worker& self) {
+    auto count = workers_.size();
+    if (count < 2) {
+        return nullptr;
+    }
+    auto start = NextRandom(self.random);
+    for (size_t i = 0; i < count; ++i) {
+        auto& victim = *workers_[(start + i) % count];
+        if (&victim == &self) {
+            continue;
+        }
+        // a steal loses against a concurrent one now and then, try a second time
+        for (int attempt = 0; attempt < 2 && !victim.deque.IsEmpty(); ++attempt) {
+            if (auto task = victim.deque.Steal()) {
+                return task;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::RunTask(Worker& self, Task* task) {
+    Fiber::SharedPtr fiber;
+    if (task->fiber) {
+        fiber = std::move(task->fiber);
+    } else {
+        if (self.fiber) {
+            self.fiber->Reset(std::move(task->callback));
+        } else {
+            self.fiber = std::make_shared<Fiber>(std::move(task->callback));
+        }
+        fiber = self.fiber;
+    }
+    Fiber::State state;
+    t_task_thread = task->thread;
+    try {
+        state = fiber->Resume();
+    } catch (std::logic_error& e) {
+        t_task_thread = -1;
+        LRERROR << name_ << ": " << e.what();
+        delete task;
+        return;
+    }
+    t_task_thread = -1;
+    if (state == Fiber::State::READY || state == Fiber::State::HOLD) {
+        // held by whoever schedules it again, not reused for callbacks
+        if (fiber == self.fiber) {
+            self.fiber.reset();
+        }
+        if (state == Fiber::State::READY) {
+            task->fiber = std::move(fiber);
+            self.local.push_back(task);
+            return;
+        }
+    }
+    delete task;
+}
+
+bool Scheduler::HasWork(Worker& self) {
+    if (self.has_inbox.load(std::memory_order_relaxed) || !self.local.empty()
+        || injected_size_.load(std::memory_order_relaxed) > 0) {
+        return true;
+    }
+    for (auto& worker : workers_) {
+        if (!worker->deque.IsEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::Park(Worker& self) {
+    parked_count_.fetch_add(1, std::memory_order_seq_cst);
+    self.parked.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (HasWork(self)) {
+        if (!self.parked.exchange(false)) {
+            Idle(self.index); // woken meanwhile, takes the wakeup
+        } else {
+            parked_count_.fetch_sub(1);
+        }
+        return exiting_.load(std::memory_order_acquire);
+    }
+    // nobody runs anything, nothing can be scheduled from a worker any more; CanStop
+    // goes first, whatever made it true scheduled its work and woke a worker before
+    if (stopping_.load(std::memory_order_acquire) && CanStop() && parked_count_.load() == workers_.size()
+        && TryExit()) {
+        WakeAll();
+        return true;
+    }
+    // a submission TryExit saw wakes a worker once it is done
+    Idle(self.index);
+    // back by itself rather than woken by Wake
+    if (self.parked.exchange(false)) {
+        parked_count_.fetch_sub(1);
+    }
+    return exiting_.load(std::memory_order_acquire);
+}
+
+bool Scheduler::TryExit() {
+    // other threads may have submitted since HasWork, they do so under the lock
+    Mutex::Lock lock(injected_mutex_);
+    if (!injected_.empty()) {
+        return false;
+    }
+    for (auto& worker : workers_) {
+        if (worker->has_inbox.load(std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    exiting_.store(true, std::memory_order_release);
+    return true;
+}
+
+bool Scheduler::Wake(Worker& worker) {
+    if (!worker.parked.exchange(false)) {
+        return false;
+    }
+    parked_count_.fetch_sub(1);
+    Tickle(worker.index);
+    return true;
+}
+
+void Scheduler::Unpark(size_t index) {
+    if (workers_[index]->parked.exchange(false)) {
+        parked_count_.fetch_sub(1);
+    }
+}
+
+void Scheduler::WakeOne() {
+    auto count = workers_.size();
+    auto start = next_wake_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+        auto& worker = *workers_[(start + i) % count];
+        if (worker.parked.load(std::memory_order_relaxed) && Wake(worker)) {
+            return;
+        }
+    }
+}
+
+}
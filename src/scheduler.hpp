@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "fiber.hpp"
+#include "mutex.hpp"
+#include "singleton.hpp"
+#include "thread.hpp"
+#include "work_stealing_deque.hpp"
+
+namespace mysylar {
+
+/**
+ * @brief N:M scheduler running fibers and callbacks on a pool of worker
+ * threads. Work scheduled from a worker goes to that worker's work-stealing
+ * deque, from other threads to a shared injection queue; idle workers take
+ * from the injection queue and steal from the others' deques, and park on a
+ * semaphore when there is nothing left. Work pinned to a worker runs only on
+ * that worker. Callbacks run in fibers, a fiber yielding READY is run again
+ * later on the same worker, one yielding HOLD waits to be scheduled again.
+ **/
+class Scheduler {
+public:
+    typedef std::shared_ptr<Scheduler> SharedPtr;
+    /**
+     * @param threads workers, 0 takes `scheduler.threads` and then one per CPU
+     * @param name workers are named name_0, name_1...
+     * @param pin_threads run worker i on CPU i modulo the CPU count
+     **/
+    explicit Scheduler(size_t threads = 0, const std::string& name = "scheduler", bool pin_threads = false);
+    virtual ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    const std::string& GetName() const { return name_; }
+    size_t GetThreadCount() const { return workers_.size(); }
+    // start the workers, work scheduled before waits until then
+    void Start();
+    // run what is scheduled and stop the workers once nothing is left, not from a worker
+    void Stop();
+    /**
+     * @brief run `fiber` (or `callback` in a fiber) on a worker
+     * @param thread the worker it has to run on, -1 for any
+     * throws std::invalid_argument for a worker that doesn't exist, std::logic_error
+     * once the workers exit; work scheduled while Stop runs is run first
+     **/
+    void Schedule(Fiber::SharedPtr fiber, int thread = -1);
+    void Schedule(std::function<void()> callback, int thread = -1);
+
+    // the scheduler of the calling worker, null outside of workers
+    static Scheduler* GetThis();
+    // index of the calling worker, -1 outside of workers
+    static int GetWorkerIndex();
+    // the worker the running task is pinned to, -1 when it isn't or outside of workers
+    static int GetTaskThread();
+protected:
+    // wait on worker `index` until Tickle(index) or something else wakes it up
+    virtual void Idle(size_t index);
+    // wake worker `index` out of Idle, or make its next Idle return right away
+    virtual void Tickle(size_t index);
+    // take a Tickle(index) Idle hasn't returned for yet, without waiting
+    bool TryIdle(size_t index);
+    // whether the workers may exit once stopping with nothing to run
+    virtual bool CanStop() { return true; }
+    // parked workers check for work again, e.g. when CanStop changes
+    void WakeAll();
+    // wake a parked worker, if any
+    void WakeOne();
+    // worker `index`, in Idle and about to schedule work itself, counts as running again
+    void Unpark(size_t index);
+    bool IsStopping() const { return stopping_.load(std::memory_order_acquire); }
+    // Stop without throwing, for destructors; aborts on one of the workers
+    void StopForDestructor();
+private:
+    struct Task {
+        Fiber::SharedPtr fiber;
+        std::function<void()> callback;
+        int thread = -1;
+    };
+    struct Worker {
+        size_t index = 0;
+        Thread::SharedPtr thread;
+        WorkStealingDeque<Task*> deque; // from this worker, others steal
+        std::deque<Task*> local; // pinned here or yielded READY, owner only
+        Fiber::SharedPtr fiber; // runs callbacks, reused once they end
+        uint32_t random = 0; // picks victims to steal from
+        alignas(kCacheLineSize) SpinLock inbox_lock;
+        std::vector<Task*> inbox; // pinned here by other threads
+        std::atomic<bool> has_inbox{false};
+        alignas(kCacheLineSize) std::atomic<bool> parked{false};
+        Semaphore semaphore;
+    };
+
+    void Submit(Task* task);
+    void Run(Worker& self);
+    Task* NextTask(Worker& self, uint64_t tick);
+    Task* TakeInjected();
+    Task* StealTask(Worker& self);
+    void RunTask(Worker& self, Task* task);
+    bool HasWork(Worker& self);
+    // park the worker, true when the scheduler stops
+    bool Park(Worker& self);
+    // set exiting_ unless other threads submitted meanwhile, true when set
+    bool TryExit();
+    // wake `worker` if it is parked
+    bool Wake(Worker& worker);
+
+    std::string name_;
+    bool pin_threads_;
+    std::vector<std::unique_ptr<Worker> > workers_;
+    Mutex injected_mutex_;
+    std::deque<Task*> injected_; // from threads that aren't workers
+    std::atomic<size_t> injected_size_{0};
+    alignas(kCacheLineSize) std::atomic<size_t> parked_count_{0};
+    std::atomic<size_t> next_wake_{0};
+    std::atomic<bool> started_{false};
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> exiting_{false};
+};
+
+// the process wide scheduler, `scheduler.threads` workers, call Start before use
+typedef Singleton<Scheduler> DefaultScheduler;
+
+}
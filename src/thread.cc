@@ -0,0 +1,138 @@
+#include "thread.hpp"
+#include <sched.h>
+#include <system_error>
+
+namespace mysylar {
+
+__thread pid_t t_thread_id = 0;
+__thread const std::string* t_thread_name = nullptr;
+
+namespace {
+
+thread_local Thread* t_thread = nullptr;
+
+// owns the name t_thread_name points to, logging from later thread exit handlers reads a placeholder
+struct ThreadNameStorage {
+    std::string name;
+    ~ThreadNameStorage() {
+        static const std::string* s_exited = new std::string("exited");
+        t_thread_name = s_exited;
+    }
+};
+
+thread_local ThreadNameStorage t_name_storage;
+
+// the child of fork runs on a new thread id, the name carries over
+struct AtForkInit {
+    AtForkInit() {
+        pthread_atfork(nullptr, nullptr, []() { t_thread_id = 0; });
+    }
+};
+
+AtForkInit s_at_fork_init;
+
+void SetThreadName(const std::string& name) {
+    t_name_storage.name = name;
+    t_thread_name = &t_name_storage.name;
+}
+
+// the kernel keeps 15 bytes of a name
+void SetKernelName(const std::string& name) {
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+}
+
+bool SetThreadAffinity(pthread_t thread, int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0;
+}
+
+}
+
+pid_t CacheThreadId() {
+    t_thread_id = syscall(SYS_gettid);
+    return t_thread_id;
+}
+
+const std::string& CacheThreadName() {
+    // a thread not started by Thread goes by its kernel name, e.g. the program name for main
+    char name[16] = {0};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    SetThreadName(name[0] ? name : "unknown");
+    return *t_thread_name;
+}
+
+Thread::Thread(std::function<void()> callback, const std::string& name, int cpu) :
+    name_(name.empty() ? "unknown" : name),
+    cpu_(cpu),
+    callback_(std::move(callback)) {
+    int ret = pthread_create(&thread_, nullptr, &Thread::Run, this);
+    if (ret != 0) {
+        thread_ = 0;
+        throw std::system_error(ret, std::generic_category(), "pthread_create " + name_);
+    }
+    started_.Wait();
+}
+
+Thread::~Thread() {
+    if (thread_) {
+        pthread_detach(thread_);
+    }
+}
+
+void Thread::Join() {
+    if (!thread_) {
+        return;
+    }
+    int ret = pthread_join(thread_, nullptr);
+    if (ret != 0) {
+        throw std::system_error(ret, std::generic_category(), "pthread_join " + name_);
+    }
+    thread_ = 0;
+}
+
+bool Thread::SetAffinity(int cpu) {
+    return thread_ && SetThreadAffinity(thread_, cpu);
+}
+
+Thread* Thread::GetThis() {
+    return t_thread;
+}
+
+void Thread::SetCurrentName(const std::string& name) {
+    if (name.empty()) {
+        return;
+    }
+    SetThreadName(name);
+    SetKernelName(name);
+}
+
+bool Thread::SetCurrentAffinity(int cpu) {
+    return SetThreadAffinity(pthread_self(), cpu);
+}
+
+void* Thread::Run(void* arg) {
+    auto thread = static_cast<Thread*>(arg);
+    t_thread = thread;
+    SetThreadName(thread->name_);
+    thread->id_ = GetThreadId();
+    SetKernelName(thread->name_);
+    if (thread->cpu_ >= 0) {
+        SetThreadAffinity(pthread_self(), thread->cpu_);
+    }
+    // for fatal signal handlers, e.g. the flight recorder's, to run after a stack overflow
+    InstallSignalStack();
+    std::function<void()> callback;
+    callback.swap(thread->callback_);
+    // the Thread may be gone once the constructor returns, only thread locals from here on
+    thread->started_.Notify();
+    callback();
+    t_thread = nullptr;
+    return nullptr;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include "mutex.hpp"
+#include "utils.hpp"
+
+namespace mysylar {
+
+/**
+ * @brief pthread with a name and an optional CPU. The constructor returns
+ * once the thread runs with its id, name and affinity set, so GetId is valid
+ * right away. The name is given to the kernel (cut to 15 bytes) and kept
+ * with the id in thread locals, where GetThreadId and GetThreadName read it.
+ * A thread not joined is detached by the destructor.
+ **/
+class Thread {
+public:
+    typedef std::shared_ptr<Thread> SharedPtr;
+    // throws std::system_error when the thread can't be created
+    Thread(std::function<void()> callback, const std::string& name, int cpu = -1);
+    ~Thread();
+    Thread(const Thread&) = delete;
+    Thread& operator=(const Thread&) = delete;
+    pid_t GetId() const { return id_; }
+    // the name the thread started with
+    const std::string& GetName() const { return name_; }
+    // wait for the thread to finish, throws std::system_error on failure
+    void Join();
+    // run the thread only on `cpu`, false if it can't
+    bool SetAffinity(int cpu);
+
+    // the Thread running the caller, null for threads started otherwise; valid
+    // as long as its owner keeps it
+    static Thread* GetThis();
+    // rename the calling thread for GetThreadName and the kernel
+    static void SetCurrentName(const std::string& name);
+    // run the calling thread only on `cpu`, false if it can't
+    static bool SetCurrentAffinity(int cpu);
+private:
+    static void* Run(void* arg);
+
+    pthread_t thread_ = 0;
+    pid_t id_ = -1;
+    std::string name_;
+    int cpu_;
+    std::function<void()> callback_;
+    Semaphore started_; // the constructor waits for Run to set the thread up
+};
+
+}
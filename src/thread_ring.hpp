@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mysylar {
+
+/**
+ * @brief The per-thread rings drained by one background thread. A producer
+ * thread registers its own ring on first use, the ring is closed when the
+ * thread exits and forgotten once drained. Reset makes every thread register
+ * a new ring, e.g. when the background thread is started again. Rings are
+ * kept per Ring type, one set of each type is in use at a time.
+ * @tparam Ring has Close(), IsClosed() and Empty()
+ **/
+template<class Ring>
+class ThreadRings {
+public:
+    typedef std::shared_ptr<Ring> RingPtr;
+    /**
+     * @brief the ring of the calling thread
+     * @param make makes the ring when the thread has none since the last Reset
+     **/
+    template<class Make>
+    Ring* Get(Make make);
+    // threads register new rings from now on
+    void Reset() { generation_.fetch_add(1, std::memory_order_release); }
+    // the registered rings, copied again only once they changed; consumer only
+    const std::vector<RingPtr>& Snapshot();
+    // forget the drained rings of exited threads; consumer only
+    void Purge();
+    // forget every ring
+    void Clear();
+private:
+    // the ring owned by current thread, closed when the thread exits
+    struct Owned {
+        RingPtr ring;
+        uint64_t generation = 0;
+        ~Owned() {
+            if (ring) {
+                ring->Close();
+            }
+        }
+    };
+    static thread_local Owned t_owned;
+
+    std::atomic<uint64_t> generation_{0}; // bumped by Reset, invalidates the thread rings
+    std::mutex mutex_;
+    std::vector<RingPtr> rings_; // registered rings, guarded by mutex_
+    std::atomic<uint64_t> version_{0}; // bumped whenever rings_ changes
+    // consumer-side state
+    std::vector<RingPtr> snapshot_; // copy of rings_
+    uint64_t snapshot_version_ = 0;
+};
+
+template<class Ring>
+thread_local typename ThreadRings<Ring>::Owned ThreadRings<Ring>::t_owned;
+
+template<class Ring>
+template<class Make>
+Ring* ThreadRings<Ring>::Get(Make make) {
+    auto generation = generation_.load(std::memory_order_acquire);
+    if (!t_owned.ring || t_owned.generation != generation) {
+        if (t_owned.ring) {
+            t_owned.ring->Close();
+        }
+        RingPtr ring = make();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings_.push_back(ring);
+            version_.fetch_add(1, std::memory_order_release);
+        }
+        t_owned.ring = std::move(ring);
+        t_owned.generation = generation;
+    }
+    return t_owned.ring.get();
+}
+
+template<class Ring>
+const std::vector<typename ThreadRings<Ring>::RingPtr>& ThreadRings<Ring>::Snapshot() {
+    if (version_.load(std::memory_order_acquire) != snapshot_version_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot_ = rings_;
+        snapshot_version_ = version_.load(std::memory_order_relaxed);
+    }
+    return snapshot_;
+}
+
+template<class Ring>
+void ThreadRings<Ring>::Purge() {
+    auto is_dead = [](const RingPtr& ring) {
+        return ring->IsClosed() && ring->Empty();
+    };
+    if (std::any_of(snapshot_.begin(), snapshot_.end(), is_dead)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.erase(std::remove_if(rings_.begin(), rings_.end(), is_dead), rings_.end());
+        snapshot_ = rings_;
+        snapshot_version_ = version_.fetch_add(1, std::memory_order_release) + 1;
+    }
+}
+
+template<class Ring>
+void ThreadRings<Ring>::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rings_.clear();
+    snapshot_.clear();
+    snapshot_version_ = version_.fetch_add(1, std::memory_order_release) + 1;
+}
+
+}
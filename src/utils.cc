@@ -0,0 +1,106 @@
+#include "utils.hpp"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <thread>
+#include <time.h>
+#if defined(MYSYLAR_TSC_CLOCK) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace mysylar {
+
+static const size_t kSignalStackSize = 64 << 10;
+
+// the alternate signal stack of a thread, disabled before it is unmapped
+struct SignalStack {
+    bool installed = false;
+    void* memory = nullptr;
+    ~SignalStack() {
+        if (!memory) {
+            return;
+        }
+        stack_t stack;
+        memset(&stack, 0, sizeof(stack));
+        stack.ss_flags = SS_DISABLE;
+        sigaltstack(&stack, nullptr);
+        munmap(memory, kSignalStackSize);
+    }
+};
+
+static thread_local SignalStack t_signal_stack;
+
+void InstallSignalStack() {
+    if (t_signal_stack.installed) {
+        return;
+    }
+    t_signal_stack.installed = true;
+    stack_t stack;
+    if (sigaltstack(nullptr, &stack) == 0 && !(stack.ss_flags & SS_DISABLE)) {
+        return; // the thread has its own
+    }
+    auto memory = mmap(nullptr, kSignalStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+    memset(&stack, 0, sizeof(stack));
+    stack.ss_sp = memory;
+    stack.ss_size = kSignalStackSize;
+    if (sigaltstack(&stack, nullptr) != 0) {
+        munmap(memory, kSignalStackSize);
+        return;
+    }
+    t_signal_stack.memory = memory;
+}
+
+static uint64_t RealtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#if defined(MYSYLAR_TSC_CLOCK) && defined(__x86_64__)
+/**
+ * @brief Converts TSC ticks to wall time. Calibrated against CLOCK_REALTIME
+ * once, relies on an invariant TSC
+ **/
+class TscClock {
+public:
+    TscClock() {
+        auto start_tsc = __rdtsc();
+        auto start_ns = RealtimeNs();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        base_tsc_ = __rdtsc();
+        base_ns_ = RealtimeNs();
+        ns_per_tick_ = static_cast<double>(base_ns_ - start_ns) / (base_tsc_ - start_tsc);
+    }
+    uint64_t Now() const {
+        return base_ns_ + static_cast<uint64_t>((__rdtsc() - base_tsc_) * ns_per_tick_);
+    }
+private:
+    uint64_t base_tsc_;
+    uint64_t base_ns_;
+    double ns_per_tick_;
+};
+
+static const TscClock s_tsc_clock;
+
+uint64_t GetCurrentNs() { return s_tsc_clock.Now(); }
+#else
+uint64_t GetCurrentNs() { return RealtimeNs(); }
+#endif
+
+static const uint64_t s_start_ns = GetCurrentNs();
+
+uint32_t GetElapsedMs(uint64_t now_ns) {
+    return now_ns > s_start_ns ? (now_ns - s_start_ns) / 1000000 : 0;
+}
+
+uint64_t GetCoarseMonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}
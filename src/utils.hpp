@@ -7,12 +7,44 @@
 #include <sys/types.h>
 #include <cxxabi.h>
 #include <unistd.h>
+#include <cstdint>
 
 namespace mysylar {
 
-inline static pid_t GetThreadId() { return syscall(SYS_gettid); }
-inline static uint32_t GetFiberId() { return 0; }
-inline static std::string GetThreadName() { return "name"; }
+// identity of the calling thread, filled in on first use and by Thread; plain
+// __thread with initial-exec so reading them is one load, no call
+extern __thread pid_t t_thread_id __attribute__((tls_model("initial-exec")));
+extern __thread const std::string* t_thread_name __attribute__((tls_model("initial-exec")));
+// id of the running fiber, 0 outside of fibers, kept by Fiber in fiber.hpp
+extern __thread uint32_t t_fiber_id __attribute__((tls_model("initial-exec")));
+pid_t CacheThreadId();
+const std::string& CacheThreadName();
+
+// id of the calling thread, the kernel is asked once per thread
+inline pid_t GetThreadId() { return t_thread_id ? t_thread_id : CacheThreadId(); }
+inline uint32_t GetFiberId() { return t_fiber_id; }
+// name of the calling thread, see Thread in thread.hpp
+inline const std::string& GetThreadName() { return t_thread_name ? *t_thread_name : CacheThreadName(); }
+/**
+ * @brief wall clock time in nanoseconds. clock_gettime is served by the vDSO,
+ * with MYSYLAR_TSC_CLOCK defined the TSC is read instead on x86-64
+ **/
+uint64_t GetCurrentNs();
+/**
+ * @brief milliseconds elapsed since the program started
+ * @param now_ns current time from GetCurrentNs
+ **/
+uint32_t GetElapsedMs(uint64_t now_ns);
+/**
+ * @brief monotonic time in nanoseconds at tick resolution (a few ms), cheaper
+ * than GetCurrentNs, for intervals that do not need precision
+ **/
+uint64_t GetCoarseMonotonicNs();
+/**
+ * @brief give the calling thread an alternate signal stack, once, so handlers
+ * installed with SA_ONSTACK run even on an overflowed stack; freed at thread exit
+ **/
+void InstallSignalStack();
 
 template<class T>
 const char* TypeToName() {
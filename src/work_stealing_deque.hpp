@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "mutex.hpp"
+
+namespace mysylar {
+
+/**
+ * @brief Chase-Lev work-stealing deque of pointers. The owning thread pushes
+ * and pops at the bottom without atomic read-modify-writes except on the last
+ * element, other threads steal from the top with one compare-and-swap. The
+ * array grows when full; old arrays are kept until the deque is destroyed,
+ * a thief may still read them, and they add up to less than the last one.
+ * @tparam T pointer type, nullptr means empty
+ **/
+template<class T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        array_.store(new Array(size), std::memory_order_relaxed);
+    }
+    ~WorkStealingDeque() {
+        delete array_.load(std::memory_order_relaxed);
+        for (auto array : garbage_) {
+            delete array;
+        }
+    }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void Push(T value) {
+        auto bottom = bottom_.load(std::memory_order_relaxed);
+        auto top = top_.load(std::memory_order_acquire);
+        auto array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->mask)) {
+            auto bigger = array->Grow(top, bottom);
+            garbage_.push_back(array);
+            array = bigger;
+            array_.store(array, std::memory_order_release);
+        }
+        array->Put(bottom, value);
+        bottom_.store(bottom + 1, std::memory_order_release);
+    }
+    // owner only, the last pushed, nullptr when empty
+    T Pop() {
+        auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        auto array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) { // empty
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T value = array->Get(bottom);
+        if (top == bottom) { // the last one, thieves may want it too
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                    std::memory_order_relaxed)) {
+                value = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+    // any thread, the oldest, nullptr when empty or another thread took it first
+    T Steal() {
+        auto top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        auto array = array_.load(std::memory_order_acquire);
+        T value = array->Get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return value;
+    }
+    // any thread, a snapshot
+    bool IsEmpty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+    size_t Size() const {
+        auto size = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+        return size > 0 ? size : 0;
+    }
+private:
+    struct Array {
+        explicit Array(size_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {}
+        ~Array() { delete[] slots; }
+        T Get(int64_t index) const { return slots[index & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t index, T value) { slots[index & mask].store(value, std::memory_order_relaxed); }
+        Array* Grow(int64_t top, int64_t bottom) const {
+            auto array = new Array((mask + 1) * 2);
+            for (auto i = top; i < bottom; ++i) {
+                array->Put(i, Get(i));
+            }
+            return array;
+        }
+        size_t mask;
+        std::atomic<T>* slots;
+    };
+
+    // thieves write top, the owner bottom, each on its own line
+    alignas(kCacheLineSize) std::atomic<int64_t> top_{0};
+    alignas(kCacheLineSize) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array*> array_{nullptr};
+    std::vector<Array*> garbage_; // owner only
+};
+
+}
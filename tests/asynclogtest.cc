@@ -0,0 +1,81 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/async_logger.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+void LogFromThreads(const std::string& logger_name, int thread_count, int event_count) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([=]() {
+            for (int j = 0; j < event_count; ++j) {
+                LINFO(logger_name) << "thread " << i << " event " << j;
+            }
+        });
+    }
+    for (auto& i : threads) {
+        i.join();
+    }
+}
+
+int main() {
+    Logger::SharedPtr file_logger(new Logger("async_logger", LogLevel::Level::DEBUG));
+    file_logger->AddAppender(FileLogAppender::SharedPtr(new FileLogAppender("./asynclog.txt")));
+    LoggerManager::GetInstance().AddLogger(file_logger);
+
+    // 1. block when full, nothing is lost
+    AsyncLogConfig config;
+    config.ring_capacity = 64;
+    AsyncLogDispatcher::GetInstance().Start(config);
+    LogFromThreads("async_logger", 4, 10000);
+    AsyncLogDispatcher::GetInstance().Flush();
+    LRINFO << "block policy dropped " << AsyncLogDispatcher::GetInstance().GetDroppedCount();
+    AsyncLogDispatcher::GetInstance().Stop();
+
+    // 2. drop the newest events once the budget is used up
+    config.overflow_policy = AsyncLogConfig::OverflowPolicy::DROP_NEWEST;
+    config.memory_budget = 64 << 10;
+    AsyncLogDispatcher::GetInstance().Start(config);
+    LogFromThreads("async_logger", 4, 10000);
+    AsyncLogDispatcher::GetInstance().Flush();
+    LRINFO << "drop newest policy dropped " << AsyncLogDispatcher::GetInstance().GetDroppedCount();
+    AsyncLogDispatcher::GetInstance().Stop();
+
+    // 3. drop the oldest events of the ring
+    config.overflow_policy = AsyncLogConfig::OverflowPolicy::DROP_OLDEST;
+    AsyncLogDispatcher::GetInstance().Start(config);
+    LogFromThreads("async_logger", 4, 10000);
+    LRINFO << "drop oldest policy dropped " << AsyncLogDispatcher::GetInstance().GetDroppedCount();
+
+    // 4. fatal events are written before the call returns
+    LFATAL("async_logger") << "fatal event is flushed";
+    AsyncLogDispatcher::GetInstance().Stop();
+
+    // 5. events submitted while the dispatcher stops are written, not left in a retired ring
+    Logger::SharedPtr counting_logger(new Logger("counting_logger", LogLevel::Level::DEBUG));
+    std::shared_ptr<CountingLogAppender> counting_appender(new CountingLogAppender());
+    counting_logger->AddAppender(counting_appender);
+    LoggerManager::GetInstance().AddLogger(counting_logger);
+    config.overflow_policy = AsyncLogConfig::OverflowPolicy::BLOCK;
+    config.memory_budget = 64 << 20;
+    std::atomic<bool> logging{true};
+    std::thread restarter([&]() {
+        while (logging) {
+            AsyncLogDispatcher::GetInstance().Start(config);
+            std::this_thread::yield();
+            AsyncLogDispatcher::GetInstance().Stop();
+        }
+    });
+    LogFromThreads("counting_logger", 4, 20000);
+    logging = false;
+    restarter.join();
+    AsyncLogDispatcher::GetInstance().Stop();
+    if (counting_appender->count != 4 * 20000) {
+        LRERROR << "wrote " << counting_appender->count << " of " << 4 * 20000 << " events across restarts";
+        return 1;
+    }
+    return 0;
+}
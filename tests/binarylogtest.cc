@@ -0,0 +1,159 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/binary_logger.hpp"
+#include "../src/fiber.hpp"
+#include "../src/thread.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+void LogFromThreads(int thread_count, int event_count) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([=]() {
+            for (int j = 0; j < event_count; ++j) {
+                BLINFO("binary_logger", "thread %d event %d value %.3f name %s", i, j, j * 0.5, "binary");
+            }
+        });
+    }
+    for (auto& i : threads) {
+        i.join();
+    }
+}
+
+off_t FileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+int main() {
+    const int thread_count = 4;
+    const int event_count = 10000;
+    remove("./binarylog.txt");
+    remove("./binarylog.bin");
+    Logger::SharedPtr text_logger(new Logger("binary_logger", LogLevel::Level::DEBUG));
+    text_logger->AddAppender(FileLogAppender::SharedPtr(new FileLogAppender("./binarylog.txt")));
+    LoggerManager::GetInstance().AddLogger(text_logger);
+
+    // 1. formatted on the spot before the background thread starts
+    BLINFO("root", "not started, %s %d %u %lld %x %c %5.1f%% %p", "formatted now", -1, 2u, 3ll, 255, 'c', 99.5,
+        static_cast<void*>(text_logger.get()));
+    BLINFO("root", "no arguments");
+
+    // 2. formatted by the background thread into the loggers
+    BinaryLogger::GetInstance().Start();
+    LogFromThreads(thread_count, event_count);
+    // deferred records keep the thread name and the fiber id
+    Logger::SharedPtr fields_logger(new Logger("binary_fields", LogLevel::Level::DEBUG));
+    auto capture = std::make_shared<CapturingLogAppender>();
+    capture->SetFormatter(std::make_shared<Formatter>("%N %F %m%n"));
+    fields_logger->AddAppender(capture);
+    LoggerManager::GetInstance().AddLogger(fields_logger);
+    uint32_t fiber_id = 0;
+    Thread named([&fiber_id]() {
+        Fiber::SharedPtr fiber(new Fiber([]() { BLINFO("binary_fields", "in a fiber"); }));
+        fiber_id = fiber->GetId();
+        fiber->Resume();
+        BLINFO("binary_fields", "outside");
+    }, "binary_named");
+    named.Join();
+    BLFATAL("root", "fatal record is flushed, %s", std::string("std::string argument"));
+    BinaryLogger::GetInstance().Stop();
+    if (capture->lines.size() != 2 || capture->lines[0] != "binary_named " + std::to_string(fiber_id) + " in a fiber\n"
+        || capture->lines[1] != "binary_named 0 outside\n") {
+        LRERROR << "deferred records: " << (capture->lines.empty() ? "none" : capture->lines[0]);
+        return 1;
+    }
+
+    // 3. written as binary records and read back
+    BinaryLogConfig config;
+    config.path = "./binarylog.bin";
+    BinaryLogger::GetInstance().Start(config);
+    auto start = std::chrono::steady_clock::now();
+    LogFromThreads(thread_count, event_count);
+    auto end = std::chrono::steady_clock::now();
+    BinaryLogger::GetInstance().Stop();
+
+    BinaryLogReader reader;
+    if (!reader.Open(config.path)) {
+        LRERROR << "can not read " << config.path;
+        return 1;
+    }
+    BinaryLogReader::Record record;
+    LogBuffer text;
+    int count = 0;
+    while (reader.Next(record)) {
+        if (count == 0) {
+            record.site->Decode(record.payload, record.payload_size, text);
+        }
+        ++count;
+    }
+    if (count != thread_count * event_count) {
+        LRERROR << "read " << count << " records, expected " << thread_count * event_count;
+        return 1;
+    }
+    LRINFO << "first record: " << std::string_view(text.Data(), text.Size());
+    LRINFO << "record cost " << std::chrono::duration<double, std::nano>(end - start).count()
+        / event_count << " ns per thread call, binary file " << FileSize("./binarylog.bin")
+        << " bytes, text file " << FileSize("./binarylog.txt") << " bytes";
+
+    // 4. records made while the background thread stops are written, not left in a retired ring
+    Logger::SharedPtr counting_logger(new Logger("binary_counting", LogLevel::Level::DEBUG));
+    auto counting_appender = std::make_shared<CountingLogAppender>();
+    counting_logger->AddAppender(counting_appender);
+    LoggerManager::GetInstance().AddLogger(counting_logger);
+    std::atomic<bool> logging{true};
+    std::thread restarter([&logging]() {
+        while (logging) {
+            BinaryLogger::GetInstance().Start();
+            std::this_thread::yield();
+            BinaryLogger::GetInstance().Stop();
+        }
+    });
+    // a long argument keeps the producers between reserving and committing most of the time
+    const std::string padding(16 << 10, 'p');
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([=, &padding]() {
+            for (int j = 0; j < event_count; ++j) {
+                BLINFO("binary_counting", "thread %d event %d %s", i, j, padding);
+            }
+        });
+    }
+    for (auto& i : threads) {
+        i.join();
+    }
+    logging = false;
+    restarter.join();
+    BinaryLogger::GetInstance().Stop();
+    if (counting_appender->count != thread_count * event_count) {
+        LRERROR << "wrote " << counting_appender->count << " of " << thread_count * event_count
+            << " records across restarts";
+        return 1;
+    }
+
+    // 5. a name built at run time reaches the logger it names on every call
+    std::shared_ptr<CountingLogAppender> buffer_appenders[2];
+    for (int i = 0; i < 2; ++i) {
+        Logger::SharedPtr logger(new Logger("binary_buffer." + std::to_string(i), LogLevel::Level::DEBUG));
+        buffer_appenders[i] = std::make_shared<CountingLogAppender>();
+        logger->AddAppender(buffer_appenders[i]);
+        LoggerManager::GetInstance().AddLogger(logger);
+    }
+    char buffer_name[32];
+    for (int i = 0; i < 2; ++i) {
+        snprintf(buffer_name, sizeof(buffer_name), "binary_buffer.%d", i);
+        BLINFO(buffer_name, "to %s", buffer_name);
+    }
+    if (buffer_appenders[0]->count != 1 || buffer_appenders[1]->count != 1) {
+        LRERROR << "buffer names: " << buffer_appenders[0]->count << " and " << buffer_appenders[1]->count
+            << " records";
+        return 1;
+    }
+    return 0;
+}
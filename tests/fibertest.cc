@@ -0,0 +1,206 @@
+#include <csignal>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+#include "../src/config.hpp"
+#include "../src/fiber.hpp"
+#include "../src/logger.hpp"
+#include "../src/thread.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+struct Counted {
+    static int s_alive;
+    int value = 0;
+    Counted() { ++s_alive; }
+    ~Counted() { --s_alive; }
+};
+
+int Counted::s_alive = 0;
+
+FiberLocal<Counted> g_local;
+
+// deep enough to run through any stack
+int Recurse(int depth) {
+    volatile char frame[1024];
+    frame[0] = static_cast<char>(depth);
+    return depth > 0 ? Recurse(depth - 1) + frame[0] : frame[0];
+}
+
+int main() {
+    // 1. resume and yield take turns, the fiber id follows the running fiber
+    std::vector<int> steps;
+    uint32_t inner_id = 0;
+    Fiber::SharedPtr fiber(new Fiber([&steps, &inner_id]() {
+        inner_id = GetFiberId();
+        steps.push_back(1);
+        Fiber::YieldToReady();
+        steps.push_back(3);
+        Fiber::YieldToHold();
+        steps.push_back(5);
+    }));
+    if (fiber->GetState() != Fiber::State::INIT || GetFiberId() != 0 || Fiber::GetThis()->GetId() != 0) {
+        LRERROR << "new fiber";
+        return 1;
+    }
+    fiber->Resume();
+    steps.push_back(2);
+    auto after_first = fiber->GetState();
+    fiber->Resume();
+    steps.push_back(4);
+    auto after_second = fiber->GetState();
+    fiber->Resume();
+    if (steps != std::vector<int>{1, 2, 3, 4, 5} || after_first != Fiber::State::READY
+        || after_second != Fiber::State::HOLD || fiber->GetState() != Fiber::State::TERM
+        || inner_id != fiber->GetId() || GetFiberId() != 0) {
+        LRERROR << "steps " << steps.size() << " fiber id " << inner_id;
+        return 1;
+    }
+    bool thrown = false;
+    try {
+        fiber->Resume();
+    } catch (std::logic_error&) {
+        thrown = true;
+    }
+    if (!thrown) {
+        LRERROR << "resumed a finished fiber";
+        return 1;
+    }
+
+    // 2. log events carry the fiber id
+    Logger::SharedPtr logger(new Logger("fiber_logger", LogLevel::Level::DEBUG));
+    auto capture = std::make_shared<CapturingLogAppender>();
+    capture->SetFormatter(std::make_shared<Formatter>("%F %m%n"));
+    logger->AddAppender(capture);
+    LoggerManager::GetInstance().AddLogger(logger);
+    fiber->Reset([]() { LINFO("fiber_logger") << "inside"; });
+    fiber->Resume();
+    LINFO("fiber_logger") << "outside";
+    if (capture->lines.size() != 2 || capture->lines[0] != std::to_string(fiber->GetId()) + " inside\n"
+        || capture->lines[1] != "0 outside\n") {
+        LRERROR << "log lines " << capture->lines.size();
+        return 1;
+    }
+
+    // 3. nested fibers return to the one that resumed them, exceptions end a fiber
+    std::string order;
+    Fiber::SharedPtr inner(new Fiber([&order]() {
+        order += "b";
+        Fiber::YieldToHold();
+        order += "d";
+        throw std::runtime_error("expected");
+    }));
+    Fiber::SharedPtr outer(new Fiber([&order, inner]() {
+        order += "a";
+        inner->Resume();
+        order += "c";
+        inner->Resume();
+        order += "e";
+    }));
+    outer->Resume();
+    if (order != "abcde" || outer->GetState() != Fiber::State::TERM || inner->GetState() != Fiber::State::EXCEPT) {
+        LRERROR << "nested order " << order;
+        return 1;
+    }
+
+    // 4. fiber locals are per fiber and die with it
+    g_local->value = -1;
+    {
+        std::vector<Fiber::SharedPtr> fibers;
+        for (int i = 0; i < 3; ++i) {
+            fibers.emplace_back(new Fiber([i]() {
+                g_local->value = i;
+                Fiber::YieldToHold();
+                if (g_local->value != i) {
+                    throw std::runtime_error("local changed");
+                }
+            }));
+            fibers.back()->Resume();
+        }
+        if (Counted::s_alive != 4) {
+            LRERROR << Counted::s_alive << " locals";
+            return 1;
+        }
+        for (auto& each : fibers) {
+            each->Resume();
+            if (each->GetState() != Fiber::State::TERM) {
+                LRERROR << "fiber local of " << each->GetId();
+                return 1;
+            }
+        }
+    }
+    if (Counted::s_alive != 1 || g_local->value != -1) {
+        LRERROR << Counted::s_alive << " locals after the fibers";
+        return 1;
+    }
+
+    // 5. many suspended fibers at once, their stacks come back to the pool
+    const int count = 10000;
+    {
+        std::vector<Fiber::SharedPtr> fibers;
+        auto before = Fiber::GetCount();
+        uint64_t sum = 0;
+        for (int i = 0; i < count; ++i) {
+            fibers.emplace_back(new Fiber([&sum, i]() {
+                Fiber::YieldToHold();
+                sum += i;
+            }, 32 << 10));
+            fibers.back()->Resume();
+        }
+        if (Fiber::GetCount() != before + count) {
+            LRERROR << Fiber::GetCount() << " fibers";
+            return 1;
+        }
+        for (auto& each : fibers) {
+            each->Resume();
+        }
+        if (sum != static_cast<uint64_t>(count) * (count - 1) / 2) {
+            LRERROR << "sum " << sum;
+            return 1;
+        }
+    }
+    if (FiberStackPool::GetCachedCount() == 0) {
+        LRERROR << "no stack cached";
+        return 1;
+    }
+
+    // 6. a fiber resumed by another thread carries on there
+    pid_t first_tid = 0;
+    pid_t second_tid = 0;
+    Fiber::SharedPtr migrating(new Fiber([&first_tid, &second_tid]() {
+        first_tid = GetThreadId();
+        Fiber::YieldToHold();
+        second_tid = GetThreadId();
+    }));
+    Thread first([migrating]() { migrating->Resume(); }, "fiber_first");
+    first.Join();
+    Thread second([migrating]() { migrating->Resume(); }, "fiber_second");
+    second.Join();
+    if (first_tid != first.GetId() || second_tid != second.GetId() || !migrating->IsDone()) {
+        LRERROR << "migrated from " << first_tid << " to " << second_tid;
+        return 1;
+    }
+
+    // 7. the stack size follows fiber.stack_size, an overflow hits the guard page
+    ConfigManager::GetInstance().SetConfig("fiber.stack_size", "", static_cast<uint32_t>(64 << 10));
+    Fiber sized([]() {});
+    if (sized.GetStackSize() != (64 << 10)) {
+        LRERROR << "stack of " << sized.GetStackSize();
+        return 1;
+    }
+    auto child = fork();
+    if (child == 0) {
+        Fiber overflowing([]() { Recurse(1000); });
+        overflowing.Resume();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+        LRERROR << "overflow status " << status;
+        return 1;
+    }
+    LRINFO << "fibers done";
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/logger.hpp"
+#include "../src/flight_recorder.hpp"
+#include "../src/log_limiter.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+std::string ReadText(const std::string& path) {
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+int CountLines(const std::string& text) {
+    return std::count(text.begin(), text.end(), '\n');
+}
+
+__attribute__((noinline)) void CrashHere(volatile int* p) {
+    *p = 1;
+}
+
+__attribute__((noinline)) int Overflow(int depth) {
+    volatile char frame[4096];
+    frame[0] = depth;
+    return depth < 0 ? 0 : Overflow(depth + 1) + frame[0];
+}
+
+void ExitOnSignal(int sig, siginfo_t* info, void* context) {
+    _exit(42);
+}
+
+int main() {
+    const std::string path = "./flight_recorder.ring";
+    Logger::SharedPtr logger(new Logger("recorded_logger", LogLevel::Level::ERROR));
+    auto appender = std::make_shared<CountingLogAppender>();
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance().AddLogger(logger);
+
+    // 1. events below the logger level are recorded but not logged, rate limited ones too
+    FlightRecorderConfig config;
+    config.path = path;
+    config.capacity = 64 << 10;
+    auto& recorder = FlightRecorder::GetInstance();
+    if (!recorder.Start(config)) {
+        LRERROR << "start failed";
+        return 1;
+    }
+    LINFO("recorded_logger") << "info event " << 1;
+    TLWARNING("recorded_logger", "warning event {}", 2);
+    LERROR("recorded_logger") << "error event " << 3;
+    for (int i = 0; i < 3; ++i) {
+        LLOG_FIRST_N("recorded_logger", LogLevel::Level::INFO, 1) << "limited event " << 4;
+    }
+    std::string records;
+    if (!FlightRecorder::ReadFile(path, records) || CountLines(records) != 4 || appender->count != 1
+        || records.find(" INFO ") == std::string::npos || records.find("info event 1\n") == std::string::npos) {
+        LRERROR << "records: " << records << " logged: " << appender->count;
+        return 1;
+    }
+
+    // 2. the ring keeps the latest records, starting at a whole line
+    for (int i = 0; i < 10000; ++i) {
+        LINFO("recorded_logger") << "wrapping event " << i;
+    }
+    FlightRecorder::ReadFile(path, records);
+    auto tail = "wrapping event 9999\n";
+    if (records.size() > config.capacity || records.size() < config.capacity / 2
+        || records.compare(records.size() - strlen(tail), strlen(tail), tail) != 0
+        || records.compare(0, 2, "20") != 0) {
+        LRERROR << "wrapped ring of " << records.size() << " bytes: " << records.substr(0, 100);
+        return 1;
+    }
+
+    // 3. recording cost of an event the logger drops
+    const int count = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        LINFO("recorded_logger") << "request " << i << " done";
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    recorder.Stop();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        LINFO("recorded_logger") << "request " << i << " done";
+    }
+    std::chrono::duration<double, std::nano> disabled = std::chrono::steady_clock::now() - start;
+    LRINFO << "recorded info event: " << elapsed.count() / count << " ns, not recorded: "
+        << disabled.count() / count << " ns";
+
+    // 4. a crash leaves the ring and a report with the backtrace and the last records
+    auto pid = fork();
+    if (pid == 0) {
+        recorder.Start(config);
+        for (int i = 0; i < 100; ++i) {
+            LINFO("recorded_logger") << "before crash " << i;
+        }
+        CrashHere(nullptr);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    auto report = ReadText(path + ".crash");
+    FlightRecorder::ReadFile(path, records);
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV
+        || report.find("*** fatal SIGSEGV (11)") != 0
+        || report.find("CrashHere") == std::string::npos
+        || report.find("before crash 99\n") == std::string::npos
+        || records.find("before crash 99\n*** fatal SIGSEGV") == std::string::npos) {
+        LRERROR << "status " << status << ", report:\n" << report;
+        return 1;
+    }
+    LRINFO << "crash report: " << CountLines(report) << " lines";
+
+    // 5. a stack overflow in another thread is reported too
+    remove((path + ".crash").c_str());
+    pid = fork();
+    if (pid == 0) {
+        recorder.Start(config);
+        std::thread overflowing([]() {
+            LINFO("recorded_logger") << "before overflow";
+            Overflow(0);
+        });
+        overflowing.join();
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    report = ReadText(path + ".crash");
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV
+        || report.find("*** fatal SIGSEGV (11)") != 0
+        || report.find("before overflow\n") == std::string::npos) {
+        LRERROR << "overflow status " << status << ", report:\n" << report;
+        return 1;
+    }
+
+    // 6. the handler installed before the recorder runs after the report
+    remove((path + ".crash").c_str());
+    pid = fork();
+    if (pid == 0) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &ExitOnSignal;
+        action.sa_flags = SA_SIGINFO;
+        sigaction(SIGABRT, &action, nullptr);
+        recorder.Start(config);
+        raise(SIGABRT);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    report = ReadText(path + ".crash");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 42
+        || report.find("*** fatal SIGABRT (6)") != 0) {
+        LRERROR << "chained status " << status << ", report:\n" << report;
+        return 1;
+    }
+    remove(path.c_str());
+    remove((path + ".1").c_str());
+    remove((path + ".crash").c_str());
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <sstream>
+#include "../src/logger.hpp"
+
+using namespace mysylar;
+
+// The formatter as it was before patterns were compiled: one virtual call
+// per item, written through std::ostream, std::endl at the end of line.
+namespace legacy {
+class FormatItem {
+public:
+    typedef std::shared_ptr<FormatItem> SharedPtr;
+    virtual ~FormatItem() {}
+    virtual void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) = 0;
+};
+
+#define XX(NAME, EXPR) \
+class NAME : public FormatItem { \
+public: \
+    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override { \
+        EXPR; \
+    } \
+};
+XX(LevelItem, os << LogLevel::ToString(level))
+XX(ThreadIdItem, os << event.GetThreadId())
+XX(ThreadNameItem, os << event.GetThreadName())
+XX(FiberIdItem, os << event.GetFiberId())
+XX(LoggerItem, os << logger->GetName())
+XX(FileNameItem, os << event.GetFileName())
+XX(LineItem, os << event.GetLine())
+XX(ContentItem, os << std::string(event.GetContent()))
+XX(TabItem, os << "  ")
+XX(NewLineItem, os << std::endl)
+#undef XX
+
+class StringItem : public FormatItem {
+public:
+    StringItem(const std::string& str) : str_(str) {}
+    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        os << str_;
+    }
+private:
+    std::string str_;
+};
+
+class TimeItem : public FormatItem {
+public:
+    void Format(std::ostream& os, Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        struct tm tm_struct;
+        time_t time = event.GetTime();
+        localtime_r(&time, &tm_struct);
+        char buf[64];
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_struct);
+        os << buf;
+    }
+};
+
+// items of the default pattern
+std::vector<FormatItem::SharedPtr> DefaultItems() {
+    return {
+        std::make_shared<StringItem>("["), std::make_shared<LevelItem>(), std::make_shared<StringItem>("]"),
+        std::make_shared<TimeItem>(), std::make_shared<TabItem>(),
+        std::make_shared<StringItem>("(tid)"), std::make_shared<ThreadIdItem>(), std::make_shared<TabItem>(),
+        std::make_shared<StringItem>("(tname)"), std::make_shared<ThreadNameItem>(), std::make_shared<TabItem>(),
+        std::make_shared<StringItem>("(fid)"), std::make_shared<FiberIdItem>(), std::make_shared<TabItem>(),
+        std::make_shared<StringItem>("["), std::make_shared<LoggerItem>(), std::make_shared<StringItem>("]"),
+        std::make_shared<TabItem>(), std::make_shared<FileNameItem>(), std::make_shared<StringItem>(":"),
+        std::make_shared<LineItem>(), std::make_shared<TabItem>(), std::make_shared<ContentItem>(),
+        std::make_shared<NewLineItem>(),
+    };
+}
+}
+
+template<class F>
+double NanosecondsPerCall(int count, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main() {
+    const int count = 1000000;
+    Logger::SharedPtr logger(new Logger("bench_logger", LogLevel::Level::DEBUG));
+    LogEvent event(__FILE__, time(NULL), 0, __LINE__, 1234, "bench thread", 0, logger, LogLevel::Level::INFO);
+    event.GetStringStream() << "formatter benchmark event with a typical message length " << 42;
+
+    // 1. virtual items writing to an ostream
+    auto items = legacy::DefaultItems();
+    std::stringstream ss;
+    auto legacy_ns = NanosecondsPerCall(count, [&]() {
+        ss.str("");
+        for (auto& i : items) {
+            i->Format(ss, logger, LogLevel::Level::INFO, event);
+        }
+    });
+
+    // 2. compiled pattern rendering into a flat buffer
+    Formatter formatter("[%p]%d{%Y-%m-%d %H:%M:%S}%T(tid)%t%T(tname)%N%T(fid)%F%T[%c]%T%f:%l%T%m%n");
+    LogBuffer buffer;
+    auto compiled_ns = NanosecondsPerCall(count, [&]() {
+        buffer.Clear();
+        formatter.Format(buffer, logger, LogLevel::Level::INFO, event);
+    });
+
+    if (ss.str() != std::string(buffer.Data(), buffer.Size())) {
+        LRERROR << "outputs differ:\n" << ss.str() << std::string(buffer.Data(), buffer.Size());
+        return 1;
+    }
+    LRINFO << "legacy formatter: " << legacy_ns << " ns/event, compiled formatter: "
+        << compiled_ns << " ns/event";
+    return 0;
+}
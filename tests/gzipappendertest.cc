@@ -0,0 +1,142 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <zlib.h>
+#include "../src/logger.hpp"
+#include "../src/gzip_file_appender.hpp"
+
+using namespace mysylar;
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+// inflate the gzip members one by one into text, a cut last member is left out
+bool ReadMembers(const std::string& data, std::string& text, int& members) {
+    members = 0;
+    size_t offset = 0;
+    char out[65536];
+    while (offset < data.size()) {
+        z_stream stream = {};
+        inflateInit2(&stream, 15 + 16);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + offset));
+        stream.avail_in = data.size() - offset;
+        std::string member;
+        int ret;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(out);
+            stream.avail_out = sizeof(out);
+            ret = inflate(&stream, Z_NO_FLUSH);
+            member.append(out, sizeof(out) - stream.avail_out);
+        } while (ret == Z_OK);
+        offset = data.size() - stream.avail_in;
+        inflateEnd(&stream);
+        if (ret != Z_STREAM_END) {
+            return false;
+        }
+        text += member;
+        ++members;
+    }
+    return true;
+}
+
+int CountLines(const std::string& text) {
+    return std::count(text.begin(), text.end(), '\n');
+}
+
+void RemoveLogs(const std::string& prefix) {
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(".", ec)) {
+        if (entry.path().filename().string().compare(0, prefix.size(), prefix) == 0) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+int main() {
+    RemoveLogs("gzip_log");
+
+    // 1. a gzip appender comes from the config type, the file is readable by zcat
+    LogAppenderConfig config;
+    config.type = LogAppenderConfig::Type::GZIP_FILE_APPENDER;
+    config.path = "./gzip_log.txt.gz";
+    config.format_pattern = "%d [%p] %c %f:%l %m%n";
+    config.buffer_size = 16 << 10;
+    auto appender = LogAppender::Create(config);
+    auto gzip_appender = std::dynamic_pointer_cast<GzipFileLogAppender>(appender);
+    if (!gzip_appender) {
+        LRERROR << "type " << config.type << " did not create a gzip appender";
+        return 1;
+    }
+    Logger::SharedPtr logger(new Logger("gzip_logger", LogLevel::Level::DEBUG));
+    logger->AddAppender(appender);
+    for (int i = 0; i < 20000; ++i) {
+        LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+            .GetStringStream() << "request " << i << " served in " << i % 97 << " ms";
+    }
+    logger->Flush();
+    std::string text;
+    int members;
+    auto data = ReadFile(config.path);
+    if (!ReadMembers(data, text, members) || CountLines(text) != 20000 || members < 2) {
+        LRERROR << "read back " << CountLines(text) << " lines in " << members << " members";
+        return 1;
+    }
+    LRINFO << "20000 records: " << gzip_appender->GetRawBytes() << " bytes compressed to "
+        << gzip_appender->GetCompressedBytes() << " in " << members << " members";
+
+    // 2. members are independent, a cut last member leaves the others readable
+    std::ofstream(config.path, std::ios::binary | std::ios::trunc).write(data.data(), data.size() - 10);
+    text.clear();
+    int intact_members;
+    if (ReadMembers(ReadFile(config.path), text, intact_members) || intact_members != members - 1
+        || CountLines(text) == 0 || CountLines(text) >= 20000) {
+        LRERROR << "truncated file: " << intact_members << " intact members, " << CountLines(text) << " lines";
+        return 1;
+    }
+    logger->DeleteAppender(appender);
+    appender.reset();
+    gzip_appender.reset();
+
+    // 3. rotation by compressed size, every file holds whole members
+    LogAppenderConfig rotate_config = config;
+    rotate_config.path = "./gzip_log_rotate.gz";
+    rotate_config.buffer_size = 4 << 10;
+    rotate_config.rotate_size = 16 << 10;
+    Logger::SharedPtr rotate_logger(new Logger("gzip_rotate_logger", LogLevel::Level::DEBUG));
+    rotate_logger->AddAppender(LogAppender::Create(rotate_config));
+    for (int i = 0; i < 50000; ++i) {
+        LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(rotate_logger), LogLevel::Level::INFO)
+            .GetStringStream() << "rotating event " << i << " of session " << i * 7919 % 10007;
+    }
+    rotate_logger->ClearAppenders();
+    Rcu::Synchronize(); // the last appender writes out its buffer when it is freed
+    int files = 0;
+    int lines = 0;
+    for (auto& entry : std::filesystem::directory_iterator(".")) {
+        if (entry.path().filename().string().compare(0, 14, "gzip_log_rotat") != 0) {
+            continue;
+        }
+        text.clear();
+        if (!ReadMembers(ReadFile(entry.path().string()), text, members)) {
+            LRERROR << entry.path() << " is not a complete gzip file";
+            return 1;
+        }
+        ++files;
+        lines += CountLines(text);
+        if (entry.file_size() > rotate_config.rotate_size * 3 / 2) {
+            LRERROR << entry.path() << " has " << entry.file_size() << " bytes";
+            return 1;
+        }
+    }
+    if (files < 2 || lines != 50000) {
+        LRERROR << "rotation: " << files << " files, " << lines << " lines";
+        return 1;
+    }
+    LRINFO << "rotation: 50000 records in " << files << " files";
+    RemoveLogs("gzip_log");
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "../src/iomanager.hpp"
+#include "../src/logger.hpp"
+
+using namespace mysylar;
+
+// CPU time of the process in microseconds
+int64_t GetCpuUs() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void SetNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// blocking-style read of one byte from a non-blocking fd
+bool ReadByte(IOManager& iom, int fd, char& byte) {
+    while (true) {
+        auto ret = read(fd, &byte, 1);
+        if (ret == 1) {
+            return true;
+        }
+        if (ret == 0 || errno != EAGAIN) {
+            return false;
+        }
+        iom.AddEvent(fd, IOManager::Event::READ);
+        Fiber::YieldToHold();
+    }
+}
+
+int main() {
+    // 1. fibers block on sockets without holding workers, each echoes what it reads
+    {
+        const int count = 500;
+        IOManager iom(4, "echo");
+        iom.Start();
+        std::vector<int> outside(count);
+        std::atomic<int> echoed{0};
+        for (int i = 0; i < count; ++i) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                LRERROR << "socketpair failed, errno " << errno;
+                return 1;
+            }
+            SetNonBlocking(fds[1]);
+            outside[i] = fds[0];
+            int fd = fds[1];
+            iom.Schedule([&iom, &echoed, fd]() {
+                char byte;
+                while (ReadByte(iom, fd, byte)) {
+                    byte += 1;
+                    if (write(fd, &byte, 1) == 1) {
+                        ++echoed;
+                    }
+                }
+                close(fd);
+            });
+        }
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < count; ++i) {
+                char byte = static_cast<char>(round);
+                if (write(outside[i], &byte, 1) != 1) {
+                    LRERROR << "write failed, errno " << errno;
+                    return 1;
+                }
+            }
+            for (int i = 0; i < count; ++i) {
+                char byte = 0;
+                if (read(outside[i], &byte, 1) != 1 || byte != round + 1) {
+                    LRERROR << "socket " << i << " echoed " << static_cast<int>(byte) << " in round " << round;
+                    return 1;
+                }
+            }
+        }
+        for (auto fd : outside) {
+            close(fd); // the fibers read 0 and end
+        }
+        iom.Stop();
+        if (echoed != 3 * count || iom.GetPendingEventCount() != 0) {
+            LRERROR << "echoed " << echoed << ", " << iom.GetPendingEventCount() << " pending";
+            return 1;
+        }
+    }
+
+    // 2. callbacks, pinned fibers, fds past the initial contexts, cancel and delete
+    {
+        IOManager iom(3, "events");
+        iom.Start();
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return 1;
+        }
+        // a pipe is writable right away
+        std::atomic<int> writable{0};
+        iom.AddEvent(fds[1], IOManager::Event::WRITE, [&writable]() { ++writable; });
+
+        int high = dup2(fds[0], 700);
+        SetNonBlocking(high);
+        std::atomic<int> wrong_thread{0};
+        std::atomic<bool> read_done{false};
+        iom.Schedule([&]() {
+            char byte;
+            if (ReadByte(iom, high, byte) && Scheduler::GetWorkerIndex() == 1) {
+                read_done = true;
+            } else {
+                ++wrong_thread;
+            }
+        }, 1);
+
+        std::atomic<int> deleted{0};
+        int other[2];
+        if (pipe(other) != 0) {
+            return 1;
+        }
+        iom.AddEvent(other[0], IOManager::Event::READ, [&deleted]() { ++deleted; });
+        bool thrown = false;
+        try {
+            iom.AddEvent(other[0], IOManager::Event::READ, []() {});
+        } catch (std::logic_error&) {
+            thrown = true;
+        }
+        if (!thrown || !iom.DelEvent(other[0], IOManager::Event::READ)
+            || iom.DelEvent(other[0], IOManager::Event::READ)) {
+            LRERROR << "waited twice on an fd or deleted a wait twice";
+            return 1;
+        }
+
+        std::atomic<int> cancelled{0};
+        iom.Schedule([&]() {
+            iom.AddEvent(other[0], IOManager::Event::READ);
+            Fiber::YieldToHold();
+            ++cancelled;
+        });
+        while (iom.GetPendingEventCount() != 2 || writable != 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // the reader and the cancelled one wait, the write callback ran
+        if (!iom.CancelAll(other[0]) || iom.CancelEvent(other[0], IOManager::Event::READ)) {
+            LRERROR << "cancelling the wait on fd " << other[0];
+            return 1;
+        }
+        if (write(fds[1], "x", 1) != 1) {
+            return 1;
+        }
+        thrown = false;
+        try {
+            iom.AddEvent(other[0], IOManager::Event::READ);
+        } catch (std::logic_error&) {
+            thrown = true;
+        }
+        iom.Stop();
+        if (!thrown || !read_done || wrong_thread != 0 || cancelled != 1 || deleted != 0) {
+            LRERROR << "read " << read_done << " off worker 1 " << wrong_thread << " cancelled " << cancelled
+                << " deleted " << deleted << " thrown " << thrown;
+            return 1;
+        }
+        close(high);
+        for (auto fd : {fds[0], fds[1], other[0], other[1]}) {
+            close(fd);
+        }
+    }
+
+    // 3. a closed fd's number is waited on again, Stop waits for pending events,
+    // idle workers use no CPU meanwhile
+    {
+        IOManager iom(4, "stop");
+        iom.Start();
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return 1;
+        }
+        SetNonBlocking(fds[0]);
+        std::atomic<bool> first{false};
+        iom.Schedule([&]() {
+            char byte;
+            first = ReadByte(iom, fds[0], byte);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (write(fds[1], "x", 1) != 1) {
+            return 1;
+        }
+        while (!first) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        int reused = fds[0];
+        close(fds[0]);
+        close(fds[1]);
+        if (pipe(fds) != 0 || fds[0] != reused) {
+            LRERROR << "fd " << reused << " not reused";
+            return 1;
+        }
+        SetNonBlocking(fds[0]);
+        std::atomic<bool> done{false};
+        iom.Schedule([&]() {
+            char byte;
+            done = ReadByte(iom, fds[0], byte);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto cpu = GetCpuUs();
+        Thread writer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (write(fds[1], "x", 1) != 1) {
+                LRERROR << "write failed";
+            }
+        }, "writer");
+        iom.Stop();
+        cpu = GetCpuUs() - cpu;
+        writer.Join();
+        if (!done || cpu > 20000) {
+            LRERROR << "stopped before the read: " << !done << ", idle workers used " << cpu << " us of CPU";
+            return 1;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    LRINFO << "iomanager done";
+    return 0;
+}
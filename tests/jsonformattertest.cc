@@ -0,0 +1,136 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include "../src/logger.hpp"
+#include "../src/json_formatter.hpp"
+
+static std::atomic<size_t> s_allocations{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+using namespace mysylar;
+
+// keeps the last formatted record
+class CaptureLogAppender : public LogAppender {
+public:
+    std::string_view Last() const { return std::string_view(buffer_.Data(), buffer_.Size()); }
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        buffer_.Clear();
+        formatter_->Format(buffer_, logger, level, event);
+    }
+    LogBuffer buffer_;
+};
+
+// one char at a time, what the vectorized scan has to match
+std::string ReferenceEscape(std::string_view str) {
+    std::string escaped;
+    for (unsigned char ch : str) {
+        switch (ch) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        case '\b': escaped += "\\b"; break;
+        case '\f': escaped += "\\f"; break;
+        default:
+            if (ch < 0x20) {
+                char text[8];
+                snprintf(text, sizeof(text), "\\u%04x", ch);
+                escaped += text;
+            } else {
+                escaped += ch;
+            }
+        }
+    }
+    return escaped;
+}
+
+int main() {
+    // 1. escaping matches the reference for every length and position
+    std::mt19937 rng(42);
+    LogBuffer buffer;
+    for (int i = 0; i < 20000; ++i) {
+        std::string str(rng() % 100, 'a');
+        for (auto& ch : str) {
+            auto r = rng() % 16;
+            ch = r == 0 ? static_cast<char>(rng() % 0x20) : r == 1 ? '"' : r == 2 ? '\\'
+                : r == 3 ? static_cast<char>(0x80 + rng() % 0x80) : static_cast<char>(' ' + rng() % 95);
+        }
+        buffer.Clear();
+        AppendJsonEscaped(buffer, str);
+        if (std::string_view(buffer.Data(), buffer.Size()) != ReferenceEscape(str)) {
+            LRERROR << "escaping differs for a string of " << str.size() << " chars";
+            return 1;
+        }
+    }
+
+    // 2. fields of the JSON formatter and of the pattern item %K
+    Logger::SharedPtr logger(new Logger("json_logger", LogLevel::Level::DEBUG));
+    auto json_appender = std::make_shared<CaptureLogAppender>();
+    json_appender->SetFormatter(Formatter::Create("json"));
+    auto text_appender = std::make_shared<CaptureLogAppender>();
+    text_appender->SetFormatter(Formatter::Create("%m%K"));
+    logger->AddAppender(json_appender);
+    logger->AddAppender(text_appender);
+    LoggerManager::GetInstance().AddLogger(logger);
+    LINFO("json_logger").With("user", 42).With("latency_us", 1.5).With("ok", true)
+        .With("name", std::string("bob \"b\"")).With("path", "/tmp") << "hello\tworld";
+    auto json = json_appender->Last();
+    if (json.find("\"level\":\"INFO\",\"logger\":\"json_logger\"") == std::string_view::npos
+        || json.find(",\"message\":\"hello\\tworld\",\"user\":42,\"latency_us\":1.5,\"ok\":true,"
+            "\"name\":\"bob \\\"b\\\"\",\"path\":\"/tmp\"}\n") == std::string_view::npos) {
+        LRERROR << "json: " << json;
+        return 1;
+    }
+    if (text_appender->Last() != "hello\tworld user=42 latency_us=1.5 ok=true name=\"bob \\\"b\\\"\" path=/tmp") {
+        LRERROR << "logfmt: " << text_appender->Last();
+        return 1;
+    }
+    LRINFO << json.substr(0, json.size() - 1);
+
+    // 3. once the pooled event and the buffers have grown, logging fields allocates nothing
+    logger->DeleteAppender(text_appender);
+    Rcu::Synchronize();
+    for (int i = 0; i < 100; ++i) {
+        LINFO("json_logger").With("user", i).With("latency_us", i * 0.5).With("name", "bob") << "request " << i;
+    }
+    auto allocations = s_allocations.load();
+    for (int i = 0; i < 10000; ++i) {
+        LINFO("json_logger").With("user", i).With("latency_us", i * 0.5).With("name", "bob") << "request " << i;
+    }
+    if (s_allocations.load() != allocations) {
+        LRERROR << "structured logging allocated " << s_allocations.load() - allocations << " times";
+        return 1;
+    }
+
+    // 4. escaping speed of a long message without and with chars to escape
+    std::string clean(4096, 'x');
+    std::string dirty = clean;
+    for (size_t i = 0; i < dirty.size(); i += 64) {
+        dirty[i] = '"';
+    }
+    for (auto str : { &clean, &dirty }) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10000; ++i) {
+            buffer.Clear();
+            AppendJsonEscaped(buffer, *str);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        LRINFO << "escape " << (str == &clean ? "clean" : "dirty") << ": "
+            << elapsed.count() / 10000 / str->size() << " ns/byte";
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "../src/logger.hpp"
+#include "../src/log_config.hpp"
+
+using namespace mysylar;
+
+std::string ReadText(const std::string& path) {
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+void Load(const std::string& yaml) {
+    ConfigManager::ConfigFromYaml(YAML::Load(yaml));
+}
+
+const char kBase[] = R"(
+logs:
+  - name: cfg.app
+    level: info
+    format: "%p %m%n"
+    appenders:
+      - type: file
+        path: ./cfg_app.log
+      - type: stdout
+        level: fatal
+  - name: cfg.other
+    level: warning
+    appenders:
+      - type: file
+        path: ./cfg_other.log
+        format: "%m%n"
+      - type: file
+        path: ./cfg_other2.log
+        format: "%m%n"
+)";
+
+// levels and formats change, the outputs stay
+const char kRetuned[] = R"(
+logs:
+  - name: cfg.app
+    level: debug
+    format: "%p %m%n"
+    appenders:
+      - type: file
+        path: ./cfg_app.log
+        level: warning
+      - type: stdout
+        level: fatal
+        format: "%d %m%n"
+  - name: cfg.other
+    level: warning
+    appenders:
+      - type: file
+        path: ./cfg_other.log
+        format: "%m%n"
+      - type: file
+        path: ./cfg_other2.log
+        format: "%m%n"
+)";
+
+// cfg.other moves to a new file, cfg.app is unchanged
+const char kMoved[] = R"(
+logs:
+  - name: cfg.app
+    level: debug
+    format: "%p %m%n"
+    appenders:
+      - type: file
+        path: ./cfg_app.log
+        level: warning
+      - type: stdout
+        level: fatal
+        format: "%d %m%n"
+  - name: cfg.other
+    level: warning
+    appenders:
+      - type: gzip
+        path: ./cfg_other.log.gz
+)";
+
+// logs through every change until destroyed
+class BackgroundProducer {
+public:
+    BackgroundProducer() : thread_([this]() {
+        while (!stop_.load(std::memory_order_relaxed)) {
+            LINFO("cfg.app") << "background";
+            LWARNING("cfg.other") << "background";
+        }
+    }) {}
+    ~BackgroundProducer() {
+        stop_.store(true);
+        thread_.join();
+    }
+private:
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+int main() {
+    auto& manager = LoggerManager::GetInstance();
+    auto root_appenders = manager.GetLogger("root")->GetAppenders();
+    auto logs = ConfigManager::GetInstance().Lookup("logs", "", std::vector<LoggerConfig>());
+    if (!logs) {
+        LRERROR << "no logs variable";
+        return 1;
+    }
+    // 1. loggers are built from yaml
+    Load(kBase);
+    auto app = manager.GetLogger("cfg.app");
+    auto app_appenders = app->GetAppenders();
+    auto other_appenders = manager.GetLogger("cfg.other")->GetAppenders();
+    if (app->GetLevel() != LogLevel::Level::INFO || app_appenders.size() != 2 || other_appenders.size() != 2
+        || app_appenders[0]->GetName() != "file:./cfg_app.log" || app_appenders[1]->GetLevel() != LogLevel::Level::FATAL
+        || app_appenders[0]->GetFormatter()->GetPattern() != "%p %m%n"
+        || other_appenders[0]->GetFormatter() != other_appenders[1]->GetFormatter()) {
+        LRERROR << "loaded " << app->GetLevel() << " " << app_appenders.size() << " " << other_appenders.size();
+        return 1;
+    }
+    LINFO("cfg.app") << "first";
+    app->Flush();
+    if (ReadText("./cfg_app.log").find("INFO first\n") == std::string::npos) {
+        LRERROR << "cfg_app.log: " << ReadText("./cfg_app.log");
+        return 1;
+    }
+
+    // 2. the open appenders get the new level and formatter in place
+    BackgroundProducer producer;
+    Load(kRetuned);
+    auto retuned = app->GetAppenders();
+    if (manager.GetLogger("cfg.app") != app || app->GetLevel() != LogLevel::Level::DEBUG
+        || retuned != app_appenders || retuned[0]->GetLevel() != LogLevel::Level::WARNING
+        || retuned[1]->GetFormatter()->GetPattern() != "%d %m%n"
+        || manager.GetLogger("cfg.other")->GetAppenders() != other_appenders) {
+        LRERROR << "retuned";
+        return 1;
+    }
+
+    // 3. only the changed logger gets new appenders
+    Load(kMoved);
+    auto moved = manager.GetLogger("cfg.other")->GetAppenders();
+    if (app->GetAppenders() != app_appenders || moved.size() != 1 || moved[0]->GetName() != "gzip:./cfg_other.log.gz") {
+        LRERROR << "moved";
+        return 1;
+    }
+
+    // 4. an invalid value is refused as a whole
+    Load("logs:\n  - name: cfg.app\n    appenders:\n      - type: socket\n");
+    Load("logs:\n  - name: cfg.app\n    level: loud\n");
+    if (app->GetAppenders() != app_appenders || logs->GetValue().size() != 2) {
+        LRERROR << "invalid config applied";
+        return 1;
+    }
+
+    // 5. the value written back reads the same
+    auto text = logs->GetValueAsString();
+    if (StdYamlCast<std::string, std::vector<LoggerConfig> >()(text) != logs->GetValue()) {
+        LRERROR << "round trip: " << text;
+        return 1;
+    }
+
+    // 6. root is taken over, then gets back what it had when the config drops it
+    Load(std::string(kMoved) + "  - name: root\n    level: error\n    appenders:\n"
+        "      - type: file\n        path: ./cfg_root.log\n");
+    auto root = manager.GetLogger("root");
+    bool taken_over = root->GetLevel() == LogLevel::Level::ERROR && root->GetAppenders().size() == 1
+        && root->GetAppenders()[0]->GetName() == "file:./cfg_root.log";
+    Load("logs: []\n");
+    if (!taken_over || root->GetAppenders() != root_appenders || root->GetLevel() != LogLevel::Level::DEBUG) {
+        LRERROR << "root taken over: " << taken_over;
+        return 1;
+    }
+
+    // 7. dropped loggers go away
+    if (manager.GetLogger("cfg.app") == app || !manager.GetLogger("cfg.app")->GetAppenders().empty()) {
+        LRERROR << "not deleted";
+        return 1;
+    }
+    // 8. a retuned appender never formats an event of one setting with the pattern of the other
+    const std::string flip = "logs:\n  - name: cfg.flip\n    level: debug\n    appenders:\n"
+        "      - type: file\n        path: ./cfg_flip.log\n";
+    remove("./cfg_flip.log");
+    Load(flip + "        level: info\n        format: \"A %p %m%n\"\n");
+    {
+        std::atomic<bool> stop{false};
+        std::thread info_producer([&stop]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                LINFO("cfg.flip") << "x";
+            }
+        });
+        for (int i = 0; i < 100; ++i) {
+            Load(flip + "        level: warning\n        format: \"B %p %m%n\"\n");
+            Load(flip + "        level: info\n        format: \"A %p %m%n\"\n");
+        }
+        stop.store(true);
+        info_producer.join();
+    }
+    manager.GetLogger("cfg.flip")->Flush();
+    auto flipped = ReadText("./cfg_flip.log");
+    if (flipped.find("A INFO x\n") == std::string::npos || flipped.find("B INFO") != std::string::npos) {
+        LRERROR << "half configured appender wrote " << flipped.size() << " bytes";
+        return 1;
+    }
+
+    // 9. a console appender can go to stderr and drop instead of blocking
+    const std::string console = "logs:\n  - name: cfg.console\n    appenders:\n"
+        "      - type: stdout\n        level: fatal\n        target: stderr\n";
+    // SetValue registers the variable again, look it up after every load
+    auto current_logs = []() {
+        return ConfigManager::GetInstance().Lookup("logs", "", std::vector<LoggerConfig>());
+    };
+    Load(console + "        non_blocking: true\n");
+    auto console_appenders = manager.GetLogger("cfg.console")->GetAppenders();
+    auto console_text = current_logs()->GetValueAsString();
+    Load(console + "        non_blocking: false\n");
+    auto blocking_appenders = manager.GetLogger("cfg.console")->GetAppenders();
+    Load(console + "        target: printer\n");
+    if (console_appenders.size() != 1 || console_appenders[0]->GetName() != "stderr"
+        || current_logs()->GetValue().size() != 1 || current_logs()->GetValue()[0].appenders[0].non_blocking
+        || StdYamlCast<std::string, std::vector<LoggerConfig> >()(console_text)[0].appenders[0].target
+            != LogAppenderConfig::Target::STDERR_TARGET
+        || console_text.find("non_blocking: true") == std::string::npos
+        || blocking_appenders.size() != 1 || blocking_appenders == console_appenders
+        || manager.GetLogger("cfg.console")->GetAppenders() != blocking_appenders) {
+        LRERROR << "console appender: " << console_text;
+        return 1;
+    }
+    // 10. the level and format of a logger change together
+    const std::string whole = "logs:\n  - name: cfg.whole\n    appenders:\n"
+        "      - type: file\n        path: ./cfg_whole.log\n";
+    remove("./cfg_whole.log");
+    Load(whole + "    level: info\n    format: \"A %p %m%n\"\n");
+    {
+        std::atomic<bool> stop{false};
+        std::thread info_producer([&stop]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                LINFO("cfg.whole") << "x";
+            }
+        });
+        for (int i = 0; i < 100; ++i) {
+            Load(whole + "    level: warning\n    format: \"B %p %m%n\"\n");
+            Load(whole + "    level: info\n    format: \"A %p %m%n\"\n");
+        }
+        stop.store(true);
+        info_producer.join();
+    }
+    manager.GetLogger("cfg.whole")->Flush();
+    auto whole_text = ReadText("./cfg_whole.log");
+    if (whole_text.find("A INFO x\n") == std::string::npos || whole_text.find("B INFO") != std::string::npos) {
+        LRERROR << "half configured logger wrote " << whole_text.size() << " bytes";
+        return 1;
+    }
+    LRINFO << "reloads done, cfg_app.log has " << ReadText("./cfg_app.log").size() << " bytes";
+    for (auto path : { "./cfg_app.log", "./cfg_other.log", "./cfg_other2.log", "./cfg_other.log.gz", "./cfg_root.log",
+        "./cfg_flip.log", "./cfg_whole.log" }) {
+        remove(path);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+const LoggerStats* FindStats(const std::vector<LoggerStats>& all, const std::string& name) {
+    for (auto& stats : all) {
+        if (stats.name == name) {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+int main() {
+    const std::string path = "./stats_log.txt";
+    remove(path.c_str());
+    Logger::SharedPtr logger(new Logger("stats_logger", LogLevel::Level::INFO));
+    LogAppenderConfig config;
+    config.type = LogAppenderConfig::Type::FILE_APPENDER;
+    config.path = path;
+    config.buffer_size = 4096;
+    config.level = LogLevel::Level::WARNING;
+    logger->AddAppender(LogAppender::Create(config));
+    LoggerManager::GetInstance().AddLogger(logger);
+
+    // 1. events by level, counted from several threads
+    const int threads = 4;
+    const int count = 10000;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([count]() {
+            for (int i = 0; i < count; ++i) {
+                LINFO("stats_logger") << "info " << i;
+                LWARNING("stats_logger") << "warning " << i;
+            }
+            LERROR("stats_logger") << "error";
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    // events below the logger level that reach it anyway
+    logger->Log(*LogEventPool::Acquire(__FILE__, GetCurrentNs(), 0, __LINE__, 0, "", 0,
+        Logger::SharedPtr(logger), LogLevel::Level::DEBUG));
+    logger->Flush();
+    auto stats = logger->GetStats();
+    if (stats.events[0] != 0 || stats.events[1] != threads * count || stats.events[2] != threads * count
+        || stats.events[3] != threads || stats.filtered != 1 || stats.appenders.size() != 1) {
+        LRERROR << "logger stats: " << stats.events[1] << " " << stats.events[2] << " "
+            << stats.events[3] << " " << stats.filtered;
+        return 1;
+    }
+
+    // 2. the appender counts what passed its level and what it wrote
+    auto& appender = stats.appenders[0];
+    struct stat st;
+    stat(path.c_str(), &st);
+    if (appender.name != "file:" + path || appender.events != threads * count + threads
+        || appender.filtered != threads * count || appender.bytes != static_cast<uint64_t>(st.st_size)
+        || appender.flushes == 0 || appender.drops != 0 || appender.time_ns == 0) {
+        LRERROR << "appender " << appender.name << ": events " << appender.events << " filtered "
+            << appender.filtered << " bytes " << appender.bytes << " of " << st.st_size
+            << " flushes " << appender.flushes << " time " << appender.time_ns;
+        return 1;
+    }
+    LRINFO << "file appender: " << appender.bytes / appender.flushes << " bytes per write, "
+        << appender.time_ns / appender.events << " ns per event";
+
+    // 3. the manager reports the registered loggers and the dump writes them out
+    auto all = LoggerManager::GetInstance().GetStats();
+    if (!FindStats(all, "stats_logger") || !FindStats(all, "root")) {
+        LRERROR << "missing loggers in " << all.size() << " stats";
+        return 1;
+    }
+    Logger::SharedPtr dump_logger(new Logger("stats_dump", LogLevel::Level::INFO));
+    auto capture = std::make_shared<CapturingLogAppender>();
+    capture->SetFormatter(std::make_shared<Formatter>("%m%K"));
+    dump_logger->AddAppender(capture);
+    LoggerManager::GetInstance().AddLogger(dump_logger);
+    LoggerManager::GetInstance().DumpStats("stats_dump");
+    auto expected = "logger stats logger=stats_logger debug=0 info=40000 warning=40000 error=4 fatal=0 filtered=1";
+    if (std::find(capture->lines.begin(), capture->lines.end(), expected) == capture->lines.end()) {
+        LRERROR << "no line '" << expected << "' among " << capture->lines.size();
+        return 1;
+    }
+
+    // 4. the periodic dump
+    capture->lines.clear();
+    if (!LoggerManager::GetInstance().StartStatsDump("stats_dump", 20)
+        || LoggerManager::GetInstance().StartStatsDump("stats_dump", 20)) {
+        LRERROR << "start stats dump";
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    LoggerManager::GetInstance().StopStatsDump();
+    size_t dumps;
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        dumps = std::count_if(capture->lines.begin(), capture->lines.end(),
+            [](const std::string& line) { return line.find("logger=stats_logger debug") != std::string::npos; });
+    }
+    if (dumps < 2) {
+        LRERROR << "periodic dumps: " << dumps;
+        return 1;
+    }
+    LRINFO << "periodic dumps: " << dumps;
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/rcu.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+int main() {
+    const int thread_count = 4;
+    const int logger_count = 8;
+    const auto duration = std::chrono::milliseconds(500);
+    std::atomic<bool> stop{false};
+    auto logger_name = [](int i) { return "stress_" + std::to_string(i); };
+    // names missing at the moment fall back to root, keep it quiet meanwhile
+    auto root = LoggerManager::GetInstance().GetLogger("root");
+    root->SetLevel(LogLevel::Level::ERROR);
+
+    // 1. log from many threads to loggers being replaced
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> calls{0};
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i]() {
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto name = logger_name((i + n) % logger_count);
+                LINFO(name) << "thread " << i << " event " << n;
+                LoggerManager::GetInstance().GetLogger(name)->Flush();
+                ++n;
+            }
+            calls.fetch_add(n);
+        });
+    }
+
+    // 2. reconfigure concurrently: replace loggers, change appenders and levels
+    auto end = std::chrono::steady_clock::now() + duration;
+    uint64_t changes = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        auto name = logger_name(changes % logger_count);
+        auto& manager = LoggerManager::GetInstance();
+        switch (changes % 4) {
+        case 0: {
+            Logger::SharedPtr logger(new Logger(name, LogLevel::Level::DEBUG));
+            logger->AddAppender(LogAppender::SharedPtr(new CountingLogAppender()));
+            manager.DeleteLogger(name);
+            manager.AddLogger(logger);
+            break;
+        }
+        case 1: {
+            auto logger = manager.GetLogger(name);
+            if (logger->GetName() == name) {
+                LogAppender::SharedPtr appender(new CountingLogAppender());
+                logger->AddAppender(appender);
+                logger->DeleteAppender(appender);
+            }
+            break;
+        }
+        case 2: {
+            auto logger = manager.GetLogger(name);
+            if (logger->GetName() == name) {
+                logger->SetLevel(logger->GetLevel() == LogLevel::Level::DEBUG
+                    ? LogLevel::Level::ERROR : LogLevel::Level::DEBUG);
+            }
+            break;
+        }
+        default:
+            manager.DeleteLogger(name);
+            break;
+        }
+        ++changes;
+    }
+    stop.store(true);
+    for (auto& i : threads) {
+        i.join();
+    }
+
+    // 3. every retired snapshot and appender is reclaimed
+    for (int i = 0; i < logger_count; ++i) {
+        LoggerManager::GetInstance().DeleteLogger(logger_name(i));
+    }
+    root->SetLevel(LogLevel::Level::DEBUG);
+    Rcu::Synchronize();
+    if (CountingLogAppender::live.load() != 0 || Rcu::GetPendingCount() != 0) {
+        LRERROR << CountingLogAppender::live.load() << " appenders alive, "
+            << Rcu::GetPendingCount() << " snapshots pending";
+        return 1;
+    }
+    LRINFO << calls.load() << " log calls, " << CountingLogAppender::total.load() << " reached an appender, "
+        << changes << " reconfigurations";
+    return 0;
+}
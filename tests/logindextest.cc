@@ -0,0 +1,262 @@
+#include <filesystem>
+#include <random>
+#include <sys/stat.h>
+#include "../src/logger.hpp"
+#include "../src/log_search.hpp"
+
+using namespace mysylar;
+
+const char kPath[] = "./index_log.txt";
+const char kRotatePath[] = "./index_rotate.txt";
+
+struct Expected {
+    int64_t base = 0; // seconds of the first record
+    uint64_t total = 0;
+    uint64_t errors = 0;
+    uint64_t db = 0; // records of idx.db
+    uint64_t idx = 0; // of idx.app and idx.db
+    uint64_t second_hour = 0; // between base + 3600 and base + 7199
+    uint64_t traces = 0; // multi-line records
+};
+
+void LogAt(Logger::SharedPtr logger, uint64_t time_ns, LogLevel::Level level, const std::string& content) {
+    auto event = LogEventPool::Acquire(__FILE__, time_ns, 0, __LINE__, 0, "", 0, Logger::SharedPtr(logger), level);
+    event->GetStringStream() << content;
+    logger->Log(*event);
+    LogEventPool::Release(event);
+}
+
+// a day of records from three loggers, some spanning several lines
+Expected WriteDay(const std::string& path, const std::string& pattern, int count) {
+    Expected expected;
+    expected.base = time(NULL) / 86400 * 86400 - 86400;
+    LogAppenderConfig config;
+    config.type = LogAppenderConfig::Type::FILE_APPENDER;
+    config.path = path;
+    config.format_pattern = pattern;
+    config.index_interval = 4096;
+    auto appender = LogAppender::Create(config);
+    Logger::SharedPtr loggers[] = {
+        Logger::SharedPtr(new Logger("idx.app", LogLevel::Level::DEBUG)),
+        Logger::SharedPtr(new Logger("idx.db", LogLevel::Level::DEBUG)),
+        Logger::SharedPtr(new Logger("other", LogLevel::Level::DEBUG)),
+    };
+    for (auto& logger : loggers) {
+        logger->AddAppender(appender);
+    }
+    for (int i = 0; i < count; ++i) {
+        auto second = expected.base + static_cast<int64_t>(i) * 86400 / count;
+        auto& logger = loggers[i % 3];
+        auto level = i % 1000 == 7 ? LogLevel::Level::ERROR : LogLevel::Level::INFO;
+        std::string content = "request " + std::to_string(i) + " done";
+        if (i % 500 == 3) {
+            level = LogLevel::Level::WARNING;
+            content = "trace " + std::to_string(i) + "\n  frame#" + std::to_string(i) + ";\n  frame#end";
+            ++expected.traces;
+        }
+        LogAt(logger, second * 1000000000ULL + 1234, level, content);
+        ++expected.total;
+        expected.errors += level == LogLevel::Level::ERROR;
+        expected.db += i % 3 == 1;
+        expected.idx += i % 3 != 2;
+        expected.second_hour += second >= expected.base + 3600 && second < expected.base + 7200;
+    }
+    return expected;
+}
+
+uint64_t Count(const LogSearcher& searcher, const LogQuery& query, LogSearchStats* stats = nullptr) {
+    uint64_t count = 0;
+    searcher.Search(query, [&count](const char*, size_t) { ++count; }, stats);
+    return count;
+}
+
+bool CheckQueries(const std::string& path, const Expected& expected) {
+    LogSearcher searcher;
+    if (!searcher.Open(path) || !searcher.HasIndex()) {
+        LRERROR << path << ": no index";
+        return false;
+    }
+    LogQuery all;
+    LogQuery errors;
+    errors.level = LogLevel::Level::ERROR;
+    LogQuery db;
+    db.logger = "idx.db";
+    LogQuery idx;
+    idx.logger = "idx";
+    LogQuery partial;
+    partial.logger = "idx.d";
+    LogQuery hour;
+    hour.from = expected.base + 3600;
+    hour.to = expected.base + 7199;
+    LogQuery traces;
+    traces.level = LogLevel::Level::WARNING;
+    traces.text = "frame#end";
+    LogSearchStats error_stats;
+    LogSearchStats hour_stats;
+    auto counts = {
+        Count(searcher, all), Count(searcher, errors, &error_stats), Count(searcher, db), Count(searcher, idx),
+        Count(searcher, partial), Count(searcher, hour, &hour_stats), Count(searcher, traces) };
+    auto wanted = {
+        expected.total, expected.errors, expected.db, expected.idx, uint64_t(0), expected.second_hour,
+        expected.traces };
+    if (!std::equal(counts.begin(), counts.end(), wanted.begin())) {
+        std::stringstream ss;
+        for (auto count : counts) {
+            ss << " " << count;
+        }
+        LRERROR << path << ": counts" << ss.str();
+        return false;
+    }
+    // ERROR is in few blocks, the hour in a 24th of them
+    if (error_stats.skipped_blocks < error_stats.blocks / 2 || hour_stats.skipped_blocks < hour_stats.blocks * 9 / 10) {
+        LRERROR << path << ": skipped " << error_stats.skipped_blocks << " and " << hour_stats.skipped_blocks
+            << " of " << hour_stats.blocks;
+        return false;
+    }
+    // a match on a continuation line gives the whole record
+    LogQuery trace;
+    trace.text = "frame#1503;";
+    std::string record;
+    searcher.Search(trace, [&record](const char* data, size_t size) { record.assign(data, size); });
+    if (record.empty() || (record[0] != '[' && record[0] != '{') || record.find("trace 1503") == std::string::npos
+        || record.find("frame#end") == std::string::npos || record.back() != '\n') {
+        LRERROR << path << ": trace record '" << record << "'";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    // 1. the vector search finds what std::string finds, up to the last byte
+    std::mt19937 rng(42);
+    std::string text(1000, 'a');
+    for (auto& ch : text) {
+        ch = "abc\n"[rng() % 4];
+    }
+    for (int i = 0; i < 2000; ++i) {
+        auto begin = rng() % text.size();
+        auto needle = text.substr(begin, 1 + rng() % 40);
+        auto size = begin + needle.size() + rng() % 3;
+        size = std::min(size, text.size());
+        auto found = FindText(text.data(), size, needle);
+        if (found != std::string_view(text.data(), size).find(needle)) {
+            LRERROR << "FindText " << needle.size() << " bytes in " << size << ": " << found;
+            return 1;
+        }
+    }
+
+    // 2. blocks cover the file record by record
+    remove(kPath);
+    remove((std::string(kPath) + ".idx").c_str());
+    auto expected = WriteDay(kPath, "", 30000);
+    struct stat st;
+    stat(kPath, &st);
+    LogIndexReader index;
+    if (!index.Open(std::string(kPath) + ".idx") || index.GetBlocks().size() < 100) {
+        LRERROR << "index of " << index.GetBlocks().size() << " blocks";
+        return 1;
+    }
+    uint64_t offset = 0;
+    uint64_t records = 0;
+    for (auto& block : index.GetBlocks()) {
+        if (block.offset != offset || block.records == 0) {
+            LRERROR << "block at " << block.offset << " after " << offset;
+            return 1;
+        }
+        offset += block.size;
+        records += block.records;
+    }
+    if (offset != static_cast<uint64_t>(st.st_size) || records != expected.total) {
+        LRERROR << "blocks end at " << offset << " of " << st.st_size << " with " << records << " records";
+        return 1;
+    }
+
+    // 3. queries by level, logger, time and text, with the default pattern and as json
+    if (!CheckQueries(kPath, expected)) {
+        return 1;
+    }
+    // the next run appends to the file and to its index
+    auto more = WriteDay(kPath, "", 3000);
+    LogSearcher searcher;
+    LogIndexReader appended;
+    if (!appended.Open(std::string(kPath) + ".idx") || appended.GetBlocks().size() <= index.GetBlocks().size()
+        || !searcher.Open(kPath) || Count(searcher, LogQuery()) != expected.total + more.total) {
+        LRERROR << "appended " << appended.GetBlocks().size() << " blocks";
+        return 1;
+    }
+    remove(kPath);
+    remove((std::string(kPath) + ".idx").c_str());
+    expected = WriteDay(kPath, "json", 30000);
+    if (!CheckQueries(kPath, expected)) {
+        return 1;
+    }
+    remove(kPath);
+    remove((std::string(kPath) + ".idx").c_str());
+
+    // 4. rotated files keep their index, the old ones go together
+    LogAppenderConfig config;
+    config.type = LogAppenderConfig::Type::FILE_APPENDER;
+    config.path = kRotatePath;
+    config.rotate_size = 64 << 10;
+    config.max_files = 3;
+    config.index_interval = 4096;
+    {
+        Logger::SharedPtr logger(new Logger("idx.rotate", LogLevel::Level::DEBUG));
+        logger->AddAppender(LogAppender::Create(config));
+        for (int i = 0; i < 5000; ++i) {
+            LogAt(logger, GetCurrentNs(), LogLevel::Level::INFO, "rotating " + std::to_string(i));
+        }
+    }
+    int logs = 0;
+    int indexes = 0;
+    uint64_t rotated_records = 0;
+    std::vector<std::filesystem::path> rotated_paths;
+    for (auto& entry : std::filesystem::directory_iterator(".")) {
+        auto name = entry.path().filename().string();
+        if (name.compare(0, strlen(kRotatePath) - 2, kRotatePath + 2) != 0) {
+            continue;
+        }
+        if (entry.path().extension() == ".idx") {
+            ++indexes;
+        } else {
+            ++logs;
+            LogSearcher rotated;
+            if (!rotated.Open(entry.path().string()) || !rotated.HasIndex()) {
+                LRERROR << name << " has no index";
+                return 1;
+            }
+            rotated_records += Count(rotated, LogQuery());
+        }
+        rotated_paths.push_back(entry.path());
+    }
+    for (auto& path : rotated_paths) {
+        std::filesystem::remove(path);
+    }
+    if (logs != 4 || indexes != 4 || rotated_records == 0) {
+        LRERROR << logs << " rotated logs, " << indexes << " indexes, " << rotated_records << " records";
+        return 1;
+    }
+    // 5. a logger name at the address of a freed one is still indexed
+    {
+        const std::string reuse_path = "./index_reuse.txt.idx";
+        std::filesystem::remove(reuse_path);
+        {
+            LogIndexWriter writer(reuse_path, 1 << 20);
+            writer.Open(0, "%m%n");
+            std::string name = "idx.first";
+            writer.Add(0, 10, 0, LogLevel::Level::INFO, name);
+            name = "idx.second";
+            writer.Add(10, 10, 0, LogLevel::Level::INFO, name);
+        }
+        LogIndexReader reused;
+        bool found = reused.Open(reuse_path) && reused.GetBlocks().size() == 1
+            && reused.GetBlocks()[0].MayHaveLogger("idx.first") && reused.GetBlocks()[0].MayHaveLogger("idx.second");
+        std::filesystem::remove(reuse_path);
+        if (!found) {
+            LRERROR << "the second logger at the same address is not in the index";
+            return 1;
+        }
+    }
+    LRINFO << "index queries done, " << index.GetBlocks().size() << " blocks a day";
+    return 0;
+}
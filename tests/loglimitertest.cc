@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/log_limiter.hpp"
+
+using namespace mysylar;
+
+// keeps the count and the last message, the reporter's summaries apart
+class RecordingLogAppender : public LogAppender {
+public:
+    std::mutex mutex;
+    int count = 0;
+    std::string last;
+    std::vector<std::string> summaries;
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        std::string content(event.GetContent());
+        std::lock_guard<std::mutex> lock(mutex);
+        if (content.compare(0, 11, "[suppressed") == 0 && content.back() == ']') {
+            summaries.push_back(content);
+            return;
+        }
+        ++count;
+        last = content;
+    }
+};
+
+int main() {
+    Logger::SharedPtr logger(new Logger("limited", LogLevel::Level::DEBUG));
+    std::shared_ptr<RecordingLogAppender> appender(new RecordingLogAppender());
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance().AddLogger(logger);
+    bool ok = true;
+    auto check = [&](const char* what, int expected_min, int expected_max) {
+        std::lock_guard<std::mutex> lock(appender->mutex);
+        LRINFO << what << ": " << appender->count << " logged, last \"" << appender->last << "\"";
+        if (appender->count < expected_min || appender->count > expected_max) {
+            LRERROR << what << ": expected " << expected_min << " to " << expected_max;
+            ok = false;
+        }
+        appender->count = 0;
+    };
+
+    // 1. one in n
+    for (int i = 0; i < 1000; ++i) {
+        LLOG_EVERY_N("limited", LogLevel::Level::ERROR, 100) << "every 100, call " << i;
+    }
+    check("every n", 10, 10);
+    for (int i = 0; i < 1000; ++i) {
+        FLLOG_EVERY_N("limited", LogLevel::Level::ERROR, 250, "every 250, call %d", i);
+    }
+    check("formatted every n", 4, 4);
+
+    // 2. the first n only
+    for (int i = 0; i < 1000; ++i) {
+        LLOG_FIRST_N("limited", LogLevel::Level::ERROR, 5) << "first 5, call " << i;
+    }
+    check("first n", 5, 5);
+
+    // 3. once per period
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(220);
+    while (std::chrono::steady_clock::now() < end) {
+        LLOG_EVERY_MS("limited", LogLevel::Level::ERROR, 50) << "every 50ms";
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    check("every ms", 4, 6);
+
+    // 4. token bucket, a burst then the refill rate
+    end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < end) {
+        LLOG_RATE_LIMITED("limited", LogLevel::Level::ERROR, 20, 5) << "20 per second, bursts of 5";
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    check("token bucket", 9, 13);
+
+    // 5. a disabled level is not counted, a suppressed call builds no event
+    logger->SetLevel(LogLevel::Level::ERROR);
+    for (int i = 0; i < 1000; ++i) {
+        LLOG_EVERY_N("limited", LogLevel::Level::INFO, 1) << "disabled";
+    }
+    check("disabled level", 0, 0);
+    const int count = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        LLOG_FIRST_N("limited", LogLevel::Level::ERROR, 1) << "suppressed call " << i;
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    check("suppressed calls", 1, 1);
+    LRINFO << "suppressed call cost " << ns << " ns";
+
+    // 6. what no later message reports is logged once the window closes, a rate of 0 lets nothing through
+    for (int i = 0; i < 10; ++i) {
+        LLOG_EVERY_MS("limited", LogLevel::Level::ERROR, 1000) << "tail of a burst";
+    }
+    for (int i = 0; i < 3; ++i) {
+        LLOG_FIRST_N("limited", LogLevel::Level::ERROR, 1) << "first 1 of 3";
+    }
+    for (int i = 0; i < 5; ++i) {
+        LLOG_RATE_LIMITED("limited", LogLevel::Level::ERROR, 0, 5) << "never";
+    }
+    check("tails", 2, 2);
+    auto has_summary = [&](const std::string& summary) {
+        std::lock_guard<std::mutex> lock(appender->mutex);
+        return std::find(appender->summaries.begin(), appender->summaries.end(), summary)
+            != appender->summaries.end();
+    };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!(has_summary("[suppressed 9 messages]") && has_summary("[suppressed 2 messages]")
+        && has_summary("[suppressed 5 messages]")) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        std::lock_guard<std::mutex> lock(appender->mutex);
+        LRINFO << "summaries: " << appender->summaries.size();
+    }
+    if (!has_summary("[suppressed 9 messages]") || !has_summary("[suppressed 2 messages]")
+        || !has_summary("[suppressed 5 messages]")) {
+        LRERROR << "the suppressed tails were not reported";
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,7 +1,31 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <unistd.h>
 #include "../src/logger.hpp"
 #include "../src/singleton.hpp"
+#include "test_appenders.hpp"
+
+// per thread, the background flush thread allocates whenever it runs
+static thread_local size_t t_allocations = 0;
+
+// kept out of line, gcc flags the inlined malloc and free as mismatched new/delete
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++t_allocations;
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
 
 using namespace mysylar;
+
 int main() {
     // 1. log directly
     LDEBUG("root") << "log directly using root logger";
@@ -29,6 +53,139 @@ int main() {
     FLERROR("root", "it's %d", (int)10);
     FLFATAL("root", "%s %d", "it's", (int)10);
 
+    //4. events come from a thread-local pool, no allocation once warmed up
+    Logger::SharedPtr null_logger(new Logger("null_logger", LogLevel::Level::DEBUG));
+    null_logger->AddAppender(LogAppender::SharedPtr(new NullLogAppender()));
+    LoggerManager::GetInstance().AddLogger(null_logger);
+    LINFO("null_logger") << "warm up";
+    auto allocations = t_allocations;
+    for (int i = 0; i < 1000; ++i) {
+        LINFO("null_logger") << "steady state event " << i;
+        FLINFO("null_logger", "steady state event %d", i);
+    }
+    allocations = t_allocations - allocations;
+    if (allocations != 0) {
+        LRERROR << allocations << " allocations in 2000 warmed-up events";
+        return 1;
+    }
+
+    //5. rotate the log file by size, keep the newest 2 rotated files and leave other files alone
+    unlink("./rotate_log.txt");
+    const char* siblings[] = {"./rotate_log.txt.err", "./rotate_log.txt.bak", "./rotate_log.txt.20260101000000.gz"};
+    for (auto sibling : siblings) {
+        std::ofstream(sibling) << "not a rotated file\n";
+    }
+    LogAppenderConfig rotate_config;
+    rotate_config.path = "./rotate_log.txt";
+    rotate_config.rotate_size = 4 << 10;
+    rotate_config.max_files = 2;
+    Logger::SharedPtr rotate_logger(new Logger("rotate_logger", LogLevel::Level::DEBUG));
+    rotate_logger->AddAppender(LogAppender::SharedPtr(new FileLogAppender(rotate_config)));
+    LoggerManager::GetInstance().AddLogger(rotate_logger);
+    for (int i = 0; i < 200; ++i) {
+        LINFO("rotate_logger") << "rotating event " << i;
+    }
+    rotate_logger->Flush();
+    for (auto sibling : siblings) {
+        if (access(sibling, F_OK) != 0) {
+            LRERROR << "rotation deleted " << sibling;
+            return 1;
+        }
+        unlink(sibling);
+    }
+    // the kept files hold the newest events without a gap
+    std::vector<std::string> rotate_files;
+    for (auto& entry : std::filesystem::directory_iterator(".")) {
+        auto name = entry.path().filename().string();
+        if (name.compare(0, 15, "rotate_log.txt.") == 0) {
+            rotate_files.push_back(name);
+        }
+    }
+    rotate_files.push_back("rotate_log.txt");
+    std::vector<int> rotated_events;
+    for (auto& name : rotate_files) {
+        std::ifstream file(name);
+        std::string line;
+        while (std::getline(file, line)) {
+            auto pos = line.find("rotating event ");
+            if (pos != std::string::npos) {
+                rotated_events.push_back(std::stoi(line.substr(pos + 15)));
+            }
+        }
+    }
+    std::sort(rotated_events.begin(), rotated_events.end());
+    bool contiguous = !rotated_events.empty() && rotated_events.back() == 199;
+    for (size_t i = 1; contiguous && i < rotated_events.size(); ++i) {
+        contiguous = rotated_events[i] == rotated_events[i - 1] + 1;
+    }
+    if (rotate_files.size() != 3 || !contiguous) {
+        LRERROR << "rotation kept " << rotate_files.size() - 1 << " rotated files and "
+            << rotated_events.size() << " events, " << (contiguous ? "" : "not ") << "up to the last in order";
+        return 1;
+    }
+
+    //6. dotted names inherit level and appenders from their ancestors
+    Logger::SharedPtr system_logger(new Logger("system", LogLevel::Level::ERROR));
+    std::shared_ptr<CountingLogAppender> system_appender(new CountingLogAppender());
+    system_logger->AddAppender(system_appender);
+    LoggerManager::GetInstance().AddLogger(system_logger);
+    auto& http_handle = LoggerManager::GetInstance().GetHandle("system.net.http");
+    LINFO("system.net.http") << "not logged, system is at ERROR";
+    LERROR("system.net.http") << "logged by the appenders of system";
+    // INFO rather than DEBUG, Release builds compile DEBUG statements out
+    system_logger->SetLevel(LogLevel::Level::INFO); // propagates to the descendants
+    LINFO("system.net.http") << "logged once system is at INFO";
+    Logger::SharedPtr net_logger(new Logger("system.net", LogLevel::Level::WARNING));
+    LoggerManager::GetInstance().AddLogger(net_logger);
+    LINFO("system.net.http") << "not logged, system.net is at WARNING";
+    if (system_appender->count != 2 || http_handle.GetEffectiveLevel() != LogLevel::Level::WARNING
+        || LoggerManager::GetInstance().GetLogger("system")->GetEffectiveLevel() != LogLevel::Level::INFO) {
+        LRERROR << "hierarchy: " << system_appender->count << " events, system.net.http at "
+            << LogLevel::ToString(http_handle.GetEffectiveLevel());
+        return 1;
+    }
+    LoggerManager::GetInstance().DeleteLogger("system.net");
+    if (http_handle.GetEffectiveLevel() != LogLevel::Level::INFO) {
+        LRERROR << "hierarchy: system.net.http still at " << LogLevel::ToString(http_handle.GetEffectiveLevel());
+        return 1;
+    }
+
+    //7. records left in the buffer of a quiet file appender are written after the flush interval
+    LogAppenderConfig quiet_config;
+    quiet_config.path = "./flush_log.txt";
+    quiet_config.flush_interval_ms = 50;
+    unlink(quiet_config.path.c_str());
+    Logger::SharedPtr quiet_logger(new Logger("quiet_logger", LogLevel::Level::DEBUG));
+    quiet_logger->AddAppender(LogAppender::SharedPtr(new FileLogAppender(quiet_config)));
+    LoggerManager::GetInstance().AddLogger(quiet_logger);
+    LINFO("quiet_logger") << "written without a flush";
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::ifstream quiet_file(quiet_config.path);
+    std::string quiet_line;
+    std::getline(quiet_file, quiet_line);
+    if (quiet_line.find("written without a flush") == std::string::npos) {
+        LRERROR << "the quiet appender kept its record, the file has \"" << quiet_line << "\"";
+        return 1;
+    }
+    unlink(quiet_config.path.c_str());
+
+    //8. a name built at run time in a char buffer isn't cached by the call site
+    std::shared_ptr<CountingLogAppender> buffer_appenders[2];
+    for (int i = 0; i < 2; ++i) {
+        buffer_appenders[i].reset(new CountingLogAppender());
+        Logger::SharedPtr buffer_logger(new Logger(i == 0 ? "buffer_a" : "buffer_b", LogLevel::Level::DEBUG));
+        buffer_logger->AddAppender(buffer_appenders[i]);
+        LoggerManager::GetInstance().AddLogger(buffer_logger);
+    }
+    for (int i = 0; i < 2; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "buffer_%c", 'a' + i);
+        LINFO(name) << "to the logger named in the buffer";
+    }
+    if (buffer_appenders[0]->count != 1 || buffer_appenders[1]->count != 1) {
+        LRERROR << "buffer names: " << buffer_appenders[0]->count << " and " << buffer_appenders[1]->count << " events";
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,183 @@
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include "../src/config.hpp"
+#include "../src/mutex.hpp"
+#include "../src/thread.hpp"
+
+using namespace mysylar;
+
+const int kThreads = 4;
+const int kIterations = 200000;
+
+// every thread increments a plain counter under the lock
+template<class M>
+bool CheckExclusive(const char* name) {
+    M mutex;
+    uint64_t counter = 0;
+    std::vector<Thread::SharedPtr> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back(new Thread([&mutex, &counter]() {
+            for (int j = 0; j < kIterations; ++j) {
+                std::lock_guard<M> lock(mutex);
+                ++counter;
+            }
+        }, name));
+    }
+    for (auto& thread : threads) {
+        thread->Join();
+    }
+    if (counter != static_cast<uint64_t>(kThreads) * kIterations) {
+        LRERROR << name << " counted " << counter;
+        return false;
+    }
+    return true;
+}
+
+struct Pair {
+    uint64_t a = 0;
+    uint64_t b = ~0ULL; // always ~a
+    uint32_t c = 0; // odd size, the last word is partly used
+};
+
+int main() {
+    // 1. scoped locks, also through the standard wrappers
+    Mutex mutex;
+    {
+        Mutex::Lock lock(mutex);
+        if (mutex.try_lock()) {
+            LRERROR << "Mutex taken twice";
+            return 1;
+        }
+        lock.Unlock();
+        if (!mutex.try_lock()) {
+            LRERROR << "Mutex not released";
+            return 1;
+        }
+        mutex.unlock();
+        lock.Lock();
+    }
+    {
+        std::lock_guard<Mutex> lock(mutex);
+    }
+    RWMutex rw_mutex;
+    {
+        RWMutex::ReadLock first(rw_mutex);
+        std::shared_lock<RWMutex> second(rw_mutex);
+        if (rw_mutex.try_lock()) {
+            LRERROR << "RWMutex written while read";
+            return 1;
+        }
+    }
+    {
+        RWMutex::WriteLock lock(rw_mutex);
+        if (rw_mutex.try_lock_shared()) {
+            LRERROR << "RWMutex read while written";
+            return 1;
+        }
+    }
+    SpinLock spin_lock;
+    if (alignof(SpinLock) != kCacheLineSize || sizeof(SpinLock) != kCacheLineSize
+        || !spin_lock.try_lock() || spin_lock.try_lock()) {
+        LRERROR << "SpinLock of " << sizeof(SpinLock) << " bytes";
+        return 1;
+    }
+    spin_lock.unlock();
+    NullMutex null_mutex;
+    {
+        NullMutex::Lock first(null_mutex);
+        NullMutex::Lock second(null_mutex);
+    }
+
+    // 2. mutual exclusion under contention
+    if (!CheckExclusive<Mutex>("mutex") || !CheckExclusive<SpinLock>("spin_lock")
+        || !CheckExclusive<RWMutex>("rw_mutex")) {
+        return 1;
+    }
+
+    // 3. SeqLock readers never see a value half written
+    SeqLock<Pair> seq_lock;
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> torn{0};
+    std::atomic<uint64_t> reads{0};
+    std::vector<Thread::SharedPtr> threads;
+    for (int i = 0; i < kThreads - 1; ++i) {
+        threads.emplace_back(new Thread([&]() {
+            uint64_t last = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto pair = seq_lock.Load();
+                // values only grow
+                torn += pair.b != ~pair.a || pair.c != static_cast<uint32_t>(pair.a) || pair.a < last;
+                last = pair.a;
+                ++reads;
+            }
+        }, "seq_reader"));
+    }
+    threads.emplace_back(new Thread([&]() {
+        for (uint64_t i = 1; i <= kIterations; ++i) {
+            Pair pair;
+            pair.a = i;
+            pair.b = ~i;
+            pair.c = static_cast<uint32_t>(i);
+            seq_lock.Store(pair);
+        }
+        done = true;
+    }, "seq_writer"));
+    for (auto& thread : threads) {
+        thread->Join();
+    }
+    if (torn != 0 || seq_lock.Load().a != static_cast<uint64_t>(kIterations)) {
+        LRERROR << torn << " torn reads of " << reads << ", last " << seq_lock.Load().a;
+        return 1;
+    }
+
+    // 4. Semaphore hands over one at a time
+    Semaphore ping;
+    Semaphore pong;
+    int turns = 0;
+    Thread ponger([&]() {
+        for (int i = 0; i < 1000; ++i) {
+            ping.Wait();
+            ++turns;
+            pong.Notify();
+        }
+    }, "ponger");
+    for (int i = 0; i < 1000; ++i) {
+        ping.Notify();
+        pong.Wait();
+    }
+    ponger.Join();
+    if (turns != 1000) {
+        LRERROR << "semaphore turns " << turns;
+        return 1;
+    }
+
+    // 5. config variables read while they are set
+    auto port = ConfigManager::GetInstance().Lookup<int>("mutex.port", "port", 0);
+    threads.clear();
+    std::atomic<uint64_t> bad{0};
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back(new Thread([&bad, i]() {
+            for (int j = 0; j < 50; ++j) {
+                auto config = ConfigManager::GetInstance().Lookup<int>("mutex.port", "port", 0);
+                if (!config) {
+                    ++bad;
+                    continue;
+                }
+                if (i == 0) {
+                    config->SetValue(j);
+                }
+                bad += config->GetValue() < 0;
+            }
+        }, "config"));
+    }
+    for (auto& thread : threads) {
+        thread->Join();
+    }
+    if (bad != 0 || !port) {
+        LRERROR << "config lookups failed " << bad;
+        return 1;
+    }
+    LRINFO << "locks done, " << reads << " seq lock reads";
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <atomic>
+#include <chrono>
+#include <sys/resource.h>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/scheduler.hpp"
+
+using namespace mysylar;
+
+// CPU time of the process in microseconds
+int64_t GetCpuUs() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// counts the nodes of a binary tree of tasks, each spawning its children
+void Spawn(Scheduler& scheduler, int depth, std::atomic<int>& count) {
+    ++count;
+    if (depth > 0) {
+        scheduler.Schedule([&scheduler, depth, &count]() { Spawn(scheduler, depth - 1, count); });
+        scheduler.Schedule([&scheduler, depth, &count]() { Spawn(scheduler, depth - 1, count); });
+    }
+}
+
+int main() {
+    // 1. the deque hands every element out once, to the owner or to a thief
+    {
+        const int count = 200000;
+        WorkStealingDeque<int*> deque(4);
+        std::vector<int> values(count);
+        std::vector<std::atomic<int> > taken(count);
+        std::atomic<bool> done{false};
+        std::vector<Thread::SharedPtr> thieves;
+        for (int i = 0; i < 3; ++i) {
+            thieves.emplace_back(new Thread([&]() {
+                while (!done.load() || !deque.IsEmpty()) {
+                    if (auto value = deque.Steal()) {
+                        ++taken[value - values.data()];
+                    }
+                }
+            }, "thief"));
+        }
+        for (int i = 0; i < count; ++i) {
+            deque.Push(&values[i]);
+            if (i % 3 == 0) {
+                if (auto value = deque.Pop()) {
+                    ++taken[value - values.data()];
+                }
+            }
+        }
+        while (auto value = deque.Pop()) {
+            ++taken[value - values.data()];
+        }
+        done = true;
+        for (auto& thief : thieves) {
+            thief->Join();
+        }
+        for (int i = 0; i < count; ++i) {
+            if (taken[i] != 1) {
+                LRERROR << "element " << i << " taken " << taken[i] << " times";
+                return 1;
+            }
+        }
+    }
+
+    // 2. callbacks from outside and tasks spawning tasks all run before Stop returns
+    {
+        Scheduler scheduler(4, "sched");
+        scheduler.Start();
+        std::atomic<int> outside{0};
+        for (int i = 0; i < 100000; ++i) {
+            scheduler.Schedule([&outside]() { ++outside; });
+        }
+        std::atomic<int> nodes{0};
+        scheduler.Schedule([&scheduler, &nodes]() { Spawn(scheduler, 14, nodes); });
+        scheduler.Stop();
+        if (outside != 100000 || nodes != (1 << 15) - 1) {
+            LRERROR << "ran " << outside << " callbacks and " << nodes << " nodes";
+            return 1;
+        }
+    }
+
+    // 3. pinned work stays on its worker across yields, held fibers wait to be scheduled
+    {
+        Scheduler scheduler(3, "pinned");
+        scheduler.Start();
+        std::atomic<int> wrong_thread{0};
+        std::atomic<int> pinned_done{0};
+        std::atomic<pid_t> worker_tid{0};
+        scheduler.Schedule([&worker_tid]() { worker_tid = GetThreadId(); }, 2);
+        for (int i = 0; i < 100; ++i) {
+            scheduler.Schedule([&]() {
+                for (int j = 0; j < 10; ++j) {
+                    if (Scheduler::GetWorkerIndex() != 2) {
+                        ++wrong_thread;
+                    }
+                    Fiber::YieldToReady();
+                }
+                ++pinned_done;
+            }, 2);
+        }
+        std::atomic<int> stage{0};
+        Fiber::SharedPtr held(new Fiber([&stage]() {
+            stage = 1;
+            Fiber::YieldToHold();
+            stage = 2;
+        }));
+        scheduler.Schedule(held);
+        while (stage != 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (stage != 1) {
+            LRERROR << "held fiber ran on";
+            return 1;
+        }
+        scheduler.Schedule(held);
+        scheduler.Stop();
+        if (wrong_thread != 0 || pinned_done != 100 || stage != 2 || !held->IsDone()) {
+            LRERROR << wrong_thread << " runs off worker 2, " << pinned_done << " pinned done, stage " << stage;
+            return 1;
+        }
+        bool thrown = false;
+        try {
+            scheduler.Schedule([]() {}, 3);
+        } catch (std::invalid_argument&) {
+            thrown = true;
+        }
+        if (!thrown) {
+            LRERROR << "scheduled on a missing worker";
+            return 1;
+        }
+    }
+
+    // 4. idle workers park instead of spinning
+    {
+        Scheduler scheduler(4, "idle");
+        scheduler.Start();
+        std::atomic<int> ran{0};
+        scheduler.Schedule([&ran]() { ++ran; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto cpu = GetCpuUs();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        cpu = GetCpuUs() - cpu;
+        scheduler.Schedule([&ran]() { ++ran; });
+        scheduler.Stop();
+        if (cpu > 20000 || ran != 2) {
+            LRERROR << "idle workers used " << cpu << " us of CPU, ran " << ran;
+            return 1;
+        }
+    }
+
+    // 5. work scheduled from another thread while Stop runs is run, or refused once stopped
+    for (int round = 0; round < 200; ++round) {
+        Scheduler scheduler(2, "race");
+        scheduler.Start();
+        std::atomic<int> ran{0};
+        int scheduled = 0;
+        Thread submitter([&]() {
+            try {
+                while (true) {
+                    scheduler.Schedule([&ran]() { ++ran; }, scheduled % 3 - 1);
+                    // or Stop waits for a queue that never empties
+                    if (++scheduled - ran > 1000) {
+                        std::this_thread::yield();
+                    }
+                }
+            } catch (std::logic_error&) {
+            }
+        }, "submitter");
+        std::this_thread::sleep_for(std::chrono::microseconds(round * 10));
+        scheduler.Stop();
+        submitter.Join();
+        if (ran != scheduled) {
+            LRERROR << "round " << round << " ran " << ran << " of " << scheduled << " scheduled";
+            return 1;
+        }
+    }
+
+    // 6. the default scheduler
+    auto& scheduler = DefaultScheduler::GetInstance();
+    scheduler.Start();
+    std::atomic<int> ran{0};
+    scheduler.Schedule([&ran]() { ++ran; });
+    scheduler.Stop();
+    if (ran != 1 || scheduler.GetThreadCount() == 0) {
+        LRERROR << "default scheduler of " << scheduler.GetThreadCount() << " workers";
+        return 1;
+    }
+    LRINFO << "scheduler done";
+    return 0;
+}
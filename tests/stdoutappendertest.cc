@@ -0,0 +1,135 @@
+#include <chrono>
+#include <fcntl.h>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "../src/logger.hpp"
+
+using namespace mysylar;
+
+// read everything in the pipe without blocking
+std::string DrainPipe(int fd) {
+    std::string data;
+    char buf[65536];
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    return data;
+}
+
+// every line is a record written in one piece
+bool LinesAreWhole(const std::string& data, int& lines) {
+    std::stringstream ss(data);
+    std::string line;
+    lines = 0;
+    while (std::getline(ss, line)) {
+        ++lines;
+        if (line.compare(0, 6, "[INFO]") != 0 && line.compare(0, 1, "[") != 0) {
+            return false;
+        }
+        if (line.find("end-of-record") == std::string::npos && line.find("dropped") == std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    Formatter::SharedPtr formatter(new Formatter("[%p]%T%m end-of-record%n"));
+    Logger::SharedPtr logger(new Logger("pipe_logger", LogLevel::Level::DEBUG));
+
+    // 1. records of concurrent threads stay whole, a reader keeps the pipe flowing
+    StdoutLogAppender::SharedPtr appender(new StdoutLogAppender(fds[1]));
+    appender->SetFormatter(formatter);
+    logger->AddAppender(appender);
+    std::string output;
+    std::thread reader([&]() {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+            output.append(buf, n);
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&, i]() {
+            for (int j = 0; j < 2000; ++j) {
+                LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+                    .GetStringStream() << "thread " << i << " event " << j << std::string(j % 100, 'x');
+            }
+        });
+    }
+    for (auto& i : threads) {
+        i.join();
+    }
+    appender->Flush();
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    int lines;
+    if (!LinesAreWhole(output, lines) || lines != 8000) {
+        LRERROR << "blocking mode: " << lines << " lines, whole: " << LinesAreWhole(output, lines);
+        return 1;
+    }
+
+    // 2. nobody reads: non-blocking mode drops and counts instead of stalling
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    logger->ClearAppenders();
+    StdoutLogAppender::SharedPtr non_blocking(new StdoutLogAppender(fds[1], true));
+    non_blocking->SetFormatter(formatter);
+    logger->AddAppender(non_blocking);
+    for (int j = 0; j < 10000; ++j) {
+        LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+            .GetStringStream() << "event " << j;
+    }
+    auto dropped = non_blocking->GetDroppedCount();
+    output = DrainPipe(fds[0]);
+    LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+        .GetStringStream() << "after the reader caught up";
+    non_blocking->Flush();
+    output += DrainPipe(fds[0]);
+    if (dropped == 0 || !LinesAreWhole(output, lines) || lines + dropped != 10002
+        || output.find("log records dropped") == std::string::npos) {
+        LRERROR << "non-blocking mode: " << lines << " lines, " << dropped << " dropped";
+        return 1;
+    }
+    LRINFO << "non-blocking mode wrote " << lines - 2 << " records and dropped " << dropped;
+    close(fds[0]);
+    close(fds[1]);
+
+    // 3. a line larger than the pipe: its tail is dropped after a short wait
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    logger->ClearAppenders();
+    StdoutLogAppender::SharedPtr cut(new StdoutLogAppender(fds[1], true));
+    cut->SetFormatter(formatter);
+    logger->AddAppender(cut);
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < 3; ++j) {
+        LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+            .GetStringStream() << std::string(256 << 10, 'y');
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    output = DrainPipe(fds[0]);
+    LogEventWrap(__FILE__, __LINE__, Logger::SharedPtr(logger), LogLevel::Level::INFO)
+        .GetStringStream() << "after the cut";
+    cut->Flush();
+    output += DrainPipe(fds[0]);
+    if (elapsed > 200 || cut->GetDroppedCount() != 3
+        || output.find("yy\n[3 log records dropped") == std::string::npos
+        || output.find("not ready]\n[INFO]  after the cut end-of-record\n") == std::string::npos) {
+        LRERROR << "cut line: " << elapsed << " ms, " << cut->GetDroppedCount() << " dropped";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../src/logger.hpp"
+
+namespace mysylar {
+
+// keeps the formatted lines
+class CapturingLogAppender : public LogAppender {
+public:
+    std::mutex mutex;
+    std::vector<std::string> lines;
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        LogBuffer buffer;
+        formatter_->Format(buffer, logger, level, event);
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.emplace_back(buffer.Data(), buffer.Size());
+    }
+};
+
+// counts the events it gets, and how many of its kind are alive
+class CountingLogAppender : public LogAppender {
+public:
+    CountingLogAppender() { live.fetch_add(1); }
+    ~CountingLogAppender() { live.fetch_sub(1); }
+    std::atomic<int> count{0};
+    static inline std::atomic<int> live{0};
+    static inline std::atomic<uint64_t> total{0}; // events of every instance
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// formats every event like a real appender and drops the text
+class NullLogAppender : public LogAppender {
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        static thread_local LogBuffer t_buffer;
+        t_buffer.Clear();
+        formatter_->Format(t_buffer, logger, level, event);
+    }
+};
+
+}
@@ -0,0 +1,101 @@
+#include <atomic>
+#include <chrono>
+#include <sched.h>
+#include <vector>
+#include "../src/logger.hpp"
+#include "../src/thread.hpp"
+#include "test_appenders.hpp"
+
+using namespace mysylar;
+
+int main() {
+    // 1. the main thread goes by its kernel name
+    char kernel_name[16] = {0};
+    pthread_getname_np(pthread_self(), kernel_name, sizeof(kernel_name));
+    if (GetThreadName() != kernel_name || GetThreadId() != syscall(SYS_gettid) || Thread::GetThis()) {
+        LRERROR << "main thread " << GetThreadName() << " " << GetThreadId();
+        return 1;
+    }
+
+    // 2. id and name are set before the constructor returns, and seen by the thread itself
+    Logger::SharedPtr logger(new Logger("thread_logger", LogLevel::Level::DEBUG));
+    auto capture = std::make_shared<CapturingLogAppender>();
+    capture->SetFormatter(std::make_shared<Formatter>("%N %t %m%n"));
+    logger->AddAppender(capture);
+    LoggerManager::GetInstance().AddLogger(logger);
+    const int count = 4;
+    std::atomic<int> finished{0};
+    std::atomic<int> mismatches{0};
+    std::vector<Thread::SharedPtr> threads;
+    for (int i = 0; i < count; ++i) {
+        auto name = "worker_with_a_long_name_" + std::to_string(i);
+        threads.emplace_back(new Thread([&finished, &mismatches, name]() {
+            char kernel_name[16] = {0};
+            pthread_getname_np(pthread_self(), kernel_name, sizeof(kernel_name));
+            auto self = Thread::GetThis();
+            if (!self || self->GetName() != name || self->GetId() != GetThreadId()
+                || GetThreadId() != syscall(SYS_gettid) || GetThreadName() != name
+                || name.compare(0, 15, kernel_name) != 0) {
+                ++mismatches;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            LINFO("thread_logger") << "hello";
+            ++finished;
+        }, name));
+        if (threads.back()->GetId() <= 0 || threads.back()->GetName() != name) {
+            LRERROR << "thread " << i << " not started";
+            return 1;
+        }
+    }
+    for (auto& thread : threads) {
+        thread->Join();
+    }
+    if (finished != count || mismatches != 0 || capture->lines.size() != count) {
+        LRERROR << "finished " << finished << " mismatches " << mismatches << " lines " << capture->lines.size();
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        auto expected = "worker_with_a_long_name_" + std::to_string(i) + " " + std::to_string(threads[i]->GetId());
+        bool found = false;
+        for (auto& line : capture->lines) {
+            found |= line.compare(0, expected.size(), expected) == 0;
+        }
+        if (!found) {
+            LRERROR << "no line of " << expected;
+            return 1;
+        }
+    }
+
+    // 3. pinned to a CPU, renamed while running
+    std::atomic<int> cpu{-1};
+    Thread pinned([&cpu]() {
+        cpu = sched_getcpu();
+        Thread::SetCurrentName("renamed");
+        if (GetThreadName() != "renamed") {
+            cpu = -2;
+        }
+    }, "pinned", 0);
+    pinned.Join();
+    if (cpu != 0) {
+        LRERROR << "pinned thread ran on " << cpu;
+        return 1;
+    }
+
+    // 4. the identity is read without a syscall
+    const int calls = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (int i = 0; i < calls; ++i) {
+        sum += GetThreadId() + GetThreadName().size();
+    }
+    auto cached = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) {
+        sum += syscall(SYS_gettid);
+    }
+    auto syscalls = std::chrono::steady_clock::now() - start;
+    LRINFO << "thread id and name " << std::chrono::duration_cast<std::chrono::nanoseconds>(cached).count() / calls
+        << " ns, gettid " << std::chrono::duration_cast<std::chrono::nanoseconds>(syscalls).count() / calls
+        << " ns (" << sum % 10 << ")";
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <chrono>
+#include "../src/logger.hpp"
+
+using namespace mysylar;
+
+// keeps the content of the last event
+class ContentLogAppender : public LogAppender {
+public:
+    std::string content;
+private:
+    void Log(Logger::SharedPtr logger, LogLevel::Level level, LogEvent& event) override {
+        content.assign(event.GetContent());
+    }
+};
+
+// formats are checked against the argument types at compile time
+static_assert(decltype(MakeFormatArgList(1, "a"))::Check("{} {}"));
+static_assert(decltype(MakeFormatArgList(1.5))::Check("{:.3} {{literal}}"));
+static_assert(decltype(MakeFormatArgList(255u, (void*)nullptr))::Check("{:x} {:X}"));
+static_assert(!decltype(MakeFormatArgList(1))::Check("{} {}"));
+static_assert(!decltype(MakeFormatArgList(1, 2))::Check("{}"));
+static_assert(!decltype(MakeFormatArgList("a"))::Check("{:x}"));
+static_assert(!decltype(MakeFormatArgList(1))::Check("{:.2}"));
+static_assert(!decltype(MakeFormatArgList(std::chrono::seconds(1)))::Check("{}"));
+static_assert(!decltype(MakeFormatArgList(1))::Check("{} }"));
+
+template<class F>
+double NanosecondsPerCall(int count, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        f(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main() {
+    Logger::SharedPtr logger(new Logger("typed_logger", LogLevel::Level::DEBUG));
+    auto appender = std::make_shared<ContentLogAppender>();
+    logger->AddAppender(appender);
+    LoggerManager::GetInstance().AddLogger(logger);
+
+    // 1. every kind of argument and spec
+    std::string name("bob");
+    TLINFO("typed_logger", "{} {} {} {} {} {} {:.2} {} {{{}}} {:x} {:X} {}", true, 'c', -42, 42u,
+        int64_t(-9000000000), 0.1, 3.14159, name, std::string_view("sv"), 255, 48879, "end");
+    auto expected = "true c -42 42 -9000000000 0.1 3.14 bob {sv} ff BEEF end";
+    if (appender->content != expected) {
+        LRERROR << "got: " << appender->content << " expected: " << expected;
+        return 1;
+    }
+    TLINFO("typed_logger", "{:.1} {}", 1e300, static_cast<const char*>(nullptr));
+    auto& content = appender->content;
+    if (content.size() != 310 || content.compare(0, 2, "10") != 0 || content.substr(301) != ".0 (null)") {
+        LRERROR << "large double: " << appender->content;
+        return 1;
+    }
+    TLINFO("typed_logger", "no arguments }}");
+    if (appender->content != "no arguments }") {
+        LRERROR << "got: " << appender->content;
+        return 1;
+    }
+
+    // 2. the same message through the printf path and the typed path
+    const int count = 1000000;
+    FLINFO("typed_logger", "request %d from %s took %.3f ms, %lu bytes", 1, name.c_str(), 0.25, 1024UL);
+    auto printf_content = appender->content;
+    TLINFO("typed_logger", "request {} from {} took {:.3} ms, {} bytes", 1, name, 0.25, 1024UL);
+    if (printf_content != appender->content) {
+        LRERROR << "outputs differ: " << printf_content << " / " << appender->content;
+        return 1;
+    }
+    auto printf_ns = NanosecondsPerCall(count, [&](int i) {
+        FLINFO("typed_logger", "request %d from %s took %.3f ms, %lu bytes", i, name.c_str(), i * 0.001, 1024UL);
+    });
+    auto typed_ns = NanosecondsPerCall(count, [&](int i) {
+        TLINFO("typed_logger", "request {} from {} took {:.3} ms, {} bytes", i, name, i * 0.001, 1024UL);
+    });
+    LRINFO << "FLLOG: " << printf_ns << " ns/event, TLLOG: " << typed_ns << " ns/event";
+    return 0;
+}
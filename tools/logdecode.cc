@@ -0,0 +1,78 @@
+// Prints the files written by BinaryLogger as text.
+// usage: mysylar-logdecode [-p pattern] file...
+#include <map>
+#include <unistd.h>
+#include "../src/binary_logger.hpp"
+
+using namespace mysylar;
+
+static void Usage(const char* name) {
+    std::cerr << "usage: " << name << " [-p pattern] file..." << std::endl;
+}
+
+static void WriteOut(const LogBuffer& buffer) {
+    auto data = buffer.Data();
+    size_t left = buffer.Size();
+    while (left > 0) {
+        auto n = write(STDOUT_FILENO, data, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        left -= n;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string pattern;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:h")) != -1) {
+        if (opt == 'p') {
+            pattern = optarg;
+        } else {
+            Usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+    Formatter formatter = pattern.empty() ? Formatter() : Formatter(pattern);
+    std::map<std::string, Logger::SharedPtr> loggers;
+    LogBuffer text;
+    LogBuffer out;
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+        BinaryLogReader reader;
+        if (!reader.Open(argv[i])) {
+            std::cerr << argv[i] << ": not a binary log file" << std::endl;
+            ret = 1;
+            continue;
+        }
+        BinaryLogReader::Record record;
+        while (reader.Next(record)) {
+            auto& site = *record.site;
+            auto& logger = loggers[site.logger_name];
+            if (!logger) {
+                logger.reset(new Logger(site.logger_name, LogLevel::Level::DEBUG));
+            }
+            text.Clear();
+            site.Decode(record.payload, record.payload_size, text);
+            auto event = LogEventPool::Acquire(site.file_name.c_str(), record.time_ns, 0, site.line,
+                record.thread_id, "", 0, Logger::SharedPtr(logger), site.level);
+            event->GetStringStream().write(text.Data(), text.Size());
+            formatter.Format(out, logger, site.level, *event);
+            LogEventPool::Release(event);
+            if (out.Size() >= (64 << 10)) {
+                WriteOut(out);
+                out.Clear();
+            }
+        }
+    }
+    WriteOut(out);
+    return ret;
+}
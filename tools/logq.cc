@@ -0,0 +1,131 @@
+// Prints the records of log files written by FileLogAppender that match a
+// query, skipping what the sidecar index rules out.
+// usage: mysylar-logq [-f from] [-t to] [-l level] [-c logger] [-m text] [-p pattern] [-n] [-s] file...
+//   from, to: "2026-01-02 03:04:05", "2026-01-02" or seconds since the epoch, both inclusive
+//   -n prints the number of matching records, -s how much the index saved
+#include <chrono>
+#include <unistd.h>
+#include "../src/log_search.hpp"
+
+using namespace mysylar;
+
+static void Usage(const char* name) {
+    std::cerr << "usage: " << name << " [-f from] [-t to] [-l level] [-c logger] [-m text] [-p pattern]"
+        " [-n] [-s] file..." << std::endl;
+}
+
+static void WriteOut(const LogBuffer& buffer) {
+    auto data = buffer.Data();
+    size_t left = buffer.Size();
+    while (left > 0) {
+        auto n = write(STDOUT_FILENO, data, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        left -= n;
+    }
+}
+
+// local time or seconds since the epoch, -1 if it doesn't read
+static int64_t ParseTimeArg(const char* text) {
+    for (auto format : { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d" }) {
+        struct tm tm_struct = {};
+        auto end = strptime(text, format, &tm_struct);
+        if (end && *end == '\0') {
+            tm_struct.tm_isdst = -1;
+            return mktime(&tm_struct);
+        }
+    }
+    char* end;
+    auto seconds = strtoll(text, &end, 10);
+    return *text != '\0' && *end == '\0' ? seconds : -1;
+}
+
+int main(int argc, char** argv) {
+    LogQuery query;
+    std::string pattern;
+    bool count_only = false;
+    bool show_stats = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:l:c:m:p:nsh")) != -1) {
+        switch (opt) {
+        case 'f':
+        case 't': {
+            auto time = ParseTimeArg(optarg);
+            if (time == -1) {
+                std::cerr << "invalid time: " << optarg << std::endl;
+                return 1;
+            }
+            (opt == 'f' ? query.from : query.to) = time;
+            break;
+        }
+        case 'l':
+            query.level = LogLevel::ToLevel(optarg);
+            if (query.level == LogLevel::Level::UNKNOWN) {
+                std::cerr << "invalid level: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+        case 'c':
+            query.logger = optarg;
+            break;
+        case 'm':
+            query.text = optarg;
+            break;
+        case 'p':
+            pattern = optarg;
+            break;
+        case 'n':
+            count_only = true;
+            break;
+        case 's':
+            show_stats = true;
+            break;
+        default:
+            Usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    LogSearchStats stats;
+    LogBuffer out;
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+        LogSearcher searcher;
+        if (!searcher.Open(argv[i], pattern)) {
+            std::cerr << argv[i] << ": " << strerror(errno) << std::endl;
+            ret = 1;
+            continue;
+        }
+        searcher.Search(query, [&out, count_only](const char* data, size_t size) {
+            if (count_only) {
+                return;
+            }
+            out.Append(data, size);
+            if (out.Size() >= (64 << 10)) {
+                WriteOut(out);
+                out.Clear();
+            }
+        }, &stats);
+    }
+    WriteOut(out);
+    if (count_only) {
+        std::cout << stats.records << std::endl;
+    }
+    if (show_stats) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        std::cerr << stats.records << " records, " << stats.skipped_blocks << " of " << stats.blocks
+            << " blocks skipped, " << stats.scanned_bytes << " bytes scanned, " << stats.skipped_bytes
+            << " skipped, " << elapsed.count() / 1000.0 << " ms" << std::endl;
+    }
+    return ret;
+}